@@ -0,0 +1,141 @@
+/**
+ * @file bench_channel.cpp
+ * @brief 通道的乒乓延迟与多生产者汇聚吞吐
+ * @details
+ * 乒乓：两个协程通过两个容量为 1 的通道来回传递一个整数，每一轮都要挂起和唤醒对方，衡量一次往返的耗时。
+ * 汇聚：若干生产者协程向同一个有界通道发送，一个消费者协程接收，衡量每秒传递的元素数。
+ * 作为对照，汇聚场景也用 std::list + gudov::Mutex 加 usleep 轮询实现一遍
+ *
+ * 用法: bench_channel [线程数] [往返次数] [生产者数] [每个生产者发送的元素数] [通道容量]
+ */
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <list>
+
+#include "gudov/channel.h"
+#include "gudov/iomanager.h"
+#include "gudov/log.h"
+#include "gudov/util.h"
+
+static int      s_threads   = 4;
+static uint64_t s_rounds    = 100000;
+static int      s_producers = 8;
+static uint64_t s_items     = 100000;
+static size_t   s_capacity  = 1024;
+
+static void PingPong() {
+  gudov::Channel<uint64_t> ping(1);
+  gudov::Channel<uint64_t> pong(1);
+  uint64_t                 start = gudov::GetMonotonicUS();
+  {
+    gudov::IOManager iom(s_threads, false, "bench");
+    iom.Schedule([&]() {
+      uint64_t value = 0;
+      for (uint64_t i = 0; i < s_rounds; ++i) {
+        ping.Send(value);
+        pong.Recv(value);
+      }
+      ping.Close();
+    });
+    iom.Schedule([&]() {
+      uint64_t value;
+      while (ping.Recv(value)) {
+        pong.Send(value + 1);
+      }
+    });
+  }
+  uint64_t us = gudov::GetMonotonicUS() - start;
+  std::cout << "ping-pong: " << us * 1000.0 / s_rounds << " ns/round trip" << std::endl;
+}
+
+static void FanIn() {
+  gudov::Channel<uint64_t> channel(s_capacity);
+  std::atomic<int>         running{s_producers};
+  uint64_t                 sum   = 0;
+  uint64_t                 start = gudov::GetMonotonicUS();
+  {
+    gudov::IOManager iom(s_threads, false, "bench");
+    for (int p = 0; p < s_producers; ++p) {
+      iom.Schedule([&]() {
+        for (uint64_t i = 0; i < s_items; ++i) {
+          channel.Send(i);
+        }
+        if (--running == 0) {
+          channel.Close();
+        }
+      });
+    }
+    iom.Schedule([&]() {
+      uint64_t value;
+      while (channel.Recv(value)) {
+        sum += value;
+      }
+    });
+  }
+  uint64_t us = gudov::GetMonotonicUS() - start;
+  std::cout << "fan-in channel: " << s_producers * s_items * 1.0 / us << " M items/s, sum " << sum << std::endl;
+}
+
+static void FanInPolling() {
+  gudov::Mutex        mutex;
+  std::list<uint64_t> queue;
+  std::atomic<int>    running{s_producers};
+  uint64_t            sum   = 0;
+  uint64_t            start = gudov::GetMonotonicUS();
+  {
+    gudov::IOManager iom(s_threads, false, "bench");
+    for (int p = 0; p < s_producers; ++p) {
+      iom.Schedule([&]() {
+        for (uint64_t i = 0; i < s_items; ++i) {
+          gudov::Mutex::Locker lock(mutex);
+          queue.push_back(i);
+        }
+        --running;
+      });
+    }
+    iom.Schedule([&]() {
+      while (true) {
+        std::list<uint64_t> batch;
+        {
+          gudov::Mutex::Locker lock(mutex);
+          batch.swap(queue);
+        }
+        if (batch.empty()) {
+          if (running == 0) {
+            gudov::Mutex::Locker lock(mutex);
+            if (queue.empty()) {
+              break;
+            }
+            continue;
+          }
+          usleep(100);
+          continue;
+        }
+        for (uint64_t value : batch) {
+          sum += value;
+        }
+      }
+    });
+  }
+  uint64_t us = gudov::GetMonotonicUS() - start;
+  std::cout << "fan-in list+mutex polling: " << s_producers * s_items * 1.0 / us << " M items/s, sum " << sum
+            << std::endl;
+}
+
+int main(int argc, char** argv) {
+  LOG_NAME("system")->SetLevel(gudov::LogLevel::ERROR);
+
+  s_threads   = argc > 1 ? atoi(argv[1]) : s_threads;
+  s_rounds    = argc > 2 ? atoll(argv[2]) : s_rounds;
+  s_producers = argc > 3 ? atoi(argv[3]) : s_producers;
+  s_items     = argc > 4 ? atoll(argv[4]) : s_items;
+  s_capacity  = argc > 5 ? atoll(argv[5]) : s_capacity;
+
+  PingPong();
+  FanIn();
+  FanInPolling();
+  return 0;
+}
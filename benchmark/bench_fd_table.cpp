@@ -0,0 +1,171 @@
+/**
+ * @file bench_fd_table.cpp
+ * @brief IOManager fd 表的多线程吞吐量测试
+ * @details
+ * - lookup: 多个线程随机查找 64k 个 fd 的表项，对比旧的 RWMutex + std::vector 与无锁的 FdTable
+ * - add/del: 多个线程在各自的一批 eventfd 上反复 AddEvent/DelEvent。
+ *   开启 iomanager.persistent_epoll，除第一次注册外不调用 epoll_ctl，测到的主要是查表和加锁的开销。
+ *   eventfd 数量受 RLIMIT_NOFILE 限制，不足 64k 时按实际打开的数量测试
+ *
+ * 用法: bench_fd_table [最大线程数]
+ */
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "gudov/config.h"
+#include "gudov/fd_table.h"
+#include "gudov/iomanager.h"
+#include "gudov/log.h"
+#include "gudov/mutex.h"
+#include "gudov/thread.h"
+#include "gudov/util.h"
+
+static const int kFds            = 65536;
+static const int kLookupsPerTask = 2000000;
+static const int kRoundsPerFd    = 20;
+
+struct Entry {
+  explicit Entry(int fd) : fd(fd) {}
+  int fd;
+};
+
+/**
+ * @brief 旧版 IOManager 的 fd 表：读锁查找，越界时加写锁扩容 1.5 倍
+ *
+ */
+class LegacyFdTable {
+ public:
+  ~LegacyFdTable() {
+    for (auto entry : entries_) {
+      delete entry;
+    }
+  }
+
+  Entry* Get(int fd) {
+    gudov::RWMutex::ReadLock lock(mutex_);
+    if ((int)entries_.size() > fd) {
+      return entries_[fd];
+    }
+    lock.Unlock();
+
+    gudov::RWMutex::WriteLock lock2(mutex_);
+    size_t old_size = entries_.size();
+    if ((int)old_size <= fd) {
+      entries_.resize(fd * 1.5 + 1);
+      for (size_t i = old_size; i < entries_.size(); ++i) {
+        entries_[i] = new Entry(i);
+      }
+    }
+    return entries_[fd];
+  }
+
+ private:
+  gudov::RWMutex      mutex_;
+  std::vector<Entry*> entries_;
+};
+
+template <typename Table>
+static double BenchLookup(Table& table, size_t threads) {
+  std::atomic<uint64_t> checksum{0};
+  uint64_t              start = gudov::GetCurrentUS();
+
+  std::vector<gudov::Thread::ptr> workers;
+  for (size_t i = 0; i < threads; ++i) {
+    workers.emplace_back(new gudov::Thread(
+        [&table, &checksum, i]() {
+          std::minstd_rand rand(i + 1);
+          uint64_t         sum = 0;
+          for (int j = 0; j < kLookupsPerTask; ++j) {
+            sum += table.Get(rand() % kFds)->fd;
+          }
+          checksum += sum;
+        },
+        "lookup_" + std::to_string(i)));
+  }
+  for (auto& worker : workers) {
+    worker->Join();
+  }
+  uint64_t cost = gudov::GetCurrentUS() - start;
+  return (double)threads * kLookupsPerTask * 1e6 / cost;
+}
+
+static std::vector<int> OpenEventFds() {
+  rlimit limit;
+  getrlimit(RLIMIT_NOFILE, &limit);
+  limit.rlim_cur = limit.rlim_max;
+  setrlimit(RLIMIT_NOFILE, &limit);
+
+  std::vector<int> fds;
+  size_t           max_fds = std::min<size_t>(kFds, limit.rlim_cur - 64);
+  while (fds.size() < max_fds) {
+    int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (fd < 0) {
+      break;
+    }
+    fds.push_back(fd);
+  }
+  return fds;
+}
+
+static double BenchAddDel(gudov::IOManager& iom, const std::vector<int>& fds, size_t threads) {
+  uint64_t start = gudov::GetCurrentUS();
+
+  std::vector<gudov::Thread::ptr> workers;
+  for (size_t i = 0; i < threads; ++i) {
+    workers.emplace_back(new gudov::Thread(
+        [&iom, &fds, threads, i]() {
+          for (int round = 0; round < kRoundsPerFd; ++round) {
+            for (size_t j = i; j < fds.size(); j += threads) {
+              iom.AddEvent(fds[j], gudov::IOManager::READ, []() {});
+              iom.DelEvent(fds[j], gudov::IOManager::READ);
+            }
+          }
+        },
+        "adddel_" + std::to_string(i)));
+  }
+  for (auto& worker : workers) {
+    worker->Join();
+  }
+  uint64_t cost = gudov::GetCurrentUS() - start;
+  return (double)fds.size() * kRoundsPerFd * 1e6 / cost;
+}
+
+int main(int argc, char** argv) {
+  LOG_NAME("system")->SetLevel(gudov::LogLevel::ERROR);
+
+  size_t max_threads = argc > 1 ? atoi(argv[1]) : 8;
+
+  std::cout << "threads\tlegacy lookup/s\tfd_table lookup/s" << std::endl;
+  for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+    LegacyFdTable         legacy;
+    gudov::FdTable<Entry> table;
+    double                legacy_rate = BenchLookup(legacy, threads);
+    double                table_rate  = BenchLookup(table, threads);
+    std::cout << threads << "\t" << (uint64_t)legacy_rate << "\t" << (uint64_t)table_rate << std::endl;
+  }
+
+  std::vector<int> fds = OpenEventFds();
+  gudov::Config::Lookup<bool>("iomanager.persistent_epoll")->SetValue(true);
+  {
+    gudov::IOManager iom(1, false, "bench");
+    std::cout << "fds=" << fds.size() << std::endl;
+    std::cout << "threads\tadd+del/s" << std::endl;
+    for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+      std::cout << threads << "\t" << (uint64_t)BenchAddDel(iom, fds, threads) << std::endl;
+    }
+    for (int fd : fds) {
+      iom.CancelAll(fd);
+    }
+  }
+  for (int fd : fds) {
+    close(fd);
+  }
+  return 0;
+}
@@ -0,0 +1,77 @@
+/**
+ * @file bench_fiber_local.cpp
+ * @brief 协程局部变量与按协程号查全局表的访问开销
+ * @details
+ * 若干协程各自反复读写一个请求级的追踪号。FiberLocal 直接按下标访问协程内的槽位；
+ * 作为对照，另一组协程把追踪号存放在以协程号为键、由 gudov::Mutex 保护的 std::unordered_map 中
+ *
+ * 用法: bench_fiber_local [线程数] [协程数] [每个协程的访问次数]
+ */
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <unordered_map>
+
+#include "gudov/fiber_local.h"
+#include "gudov/iomanager.h"
+#include "gudov/log.h"
+#include "gudov/util.h"
+
+static int      s_threads = 4;
+static int      s_fibers  = 64;
+static uint64_t s_rounds  = 100000;
+
+static gudov::FiberLocal<uint64_t> s_trace_id;
+
+static void Run(const char* name, void (*body)(uint64_t, std::atomic<uint64_t>&)) {
+  std::atomic<uint64_t> sum{0};
+  uint64_t              start = gudov::GetMonotonicUS();
+  {
+    gudov::IOManager iom(s_threads, false, "bench");
+    for (int f = 0; f < s_fibers; ++f) {
+      iom.Schedule([f, body, &sum]() { body(f, sum); });
+    }
+  }
+  uint64_t us = gudov::GetMonotonicUS() - start;
+  std::cout << name << ": " << us * 1000.0 / (s_fibers * s_rounds) << " ns/set+get, sum " << sum << std::endl;
+}
+
+static void FiberLocalBody(uint64_t id, std::atomic<uint64_t>& sum) {
+  uint64_t local = 0;
+  for (uint64_t i = 0; i < s_rounds; ++i) {
+    s_trace_id.Set(id + i);
+    local += *s_trace_id;
+  }
+  sum += local;
+}
+
+static gudov::Mutex                           s_mutex;
+static std::unordered_map<uint64_t, uint64_t> s_trace_ids;
+
+static void GlobalMapBody(uint64_t id, std::atomic<uint64_t>& sum) {
+  uint64_t fiber_id = gudov::GetFiberId();
+  uint64_t local    = 0;
+  for (uint64_t i = 0; i < s_rounds; ++i) {
+    {
+      gudov::Mutex::Locker lock(s_mutex);
+      s_trace_ids[fiber_id] = id + i;
+    }
+    gudov::Mutex::Locker lock(s_mutex);
+    local += s_trace_ids[fiber_id];
+  }
+  gudov::Mutex::Locker lock(s_mutex);
+  s_trace_ids.erase(fiber_id);
+  sum += local;
+}
+
+int main(int argc, char** argv) {
+  LOG_NAME("system")->SetLevel(gudov::LogLevel::ERROR);
+
+  s_threads = argc > 1 ? atoi(argv[1]) : s_threads;
+  s_fibers  = argc > 2 ? atoi(argv[2]) : s_fibers;
+  s_rounds  = argc > 3 ? atoll(argv[3]) : s_rounds;
+
+  Run("fiber local", FiberLocalBody);
+  Run("mutex + map by fiber id", GlobalMapBody);
+  return 0;
+}
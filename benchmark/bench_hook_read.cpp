@@ -0,0 +1,102 @@
+/**
+ * @file bench_hook_read.cpp
+ * @brief hook 后的 read 在数据已就绪时的开销
+ * @details
+ * 在 socketpair 的一端预先写满数据，另一端每次读 1 字节，对比原始的 readF 与 hook 后的 read。
+ * 两种读法都在 IOManager 的协程里执行，hook 后的 read 走完整的 doIO 流程但不会挂起。
+ * 同时替换全局 operator new 统计每次读产生的内存分配次数
+ *
+ * 用法: bench_hook_read [读取次数]
+ */
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+
+#include "gudov/fdmanager.h"
+#include "gudov/hook.h"
+#include "gudov/iomanager.h"
+#include "gudov/log.h"
+#include "gudov/util.h"
+
+static const size_t kChunk = 4096;
+
+static std::atomic<uint64_t> s_allocs{0};
+
+void* operator new(size_t size) {
+  ++s_allocs;
+  void* p = malloc(size);
+  if (!p) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void operator delete(void* p) noexcept { free(p); }
+
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+struct Result {
+  double ns_per_read     = 0;
+  double allocs_per_read = 0;
+};
+
+/**
+ * @brief 每读完 kChunk 字节就补充一次，只统计读的耗时
+ *
+ */
+template <typename ReadFun>
+static Result BenchRead(int rfd, int wfd, uint64_t reads, ReadFun read_fun) {
+  static char fill[kChunk];
+  char        c;
+  uint64_t    cost   = 0;
+  uint64_t    allocs = 0;
+  for (uint64_t done = 0; done < reads; done += kChunk) {
+    writeF(wfd, fill, sizeof(fill));
+    uint64_t alloc_start = s_allocs;
+    uint64_t start       = gudov::GetMonotonicUS();
+    for (size_t i = 0; i < kChunk; ++i) {
+      read_fun(rfd, &c, 1);
+    }
+    cost += gudov::GetMonotonicUS() - start;
+    allocs += s_allocs - alloc_start;
+  }
+  uint64_t total = (reads + kChunk - 1) / kChunk * kChunk;
+  return {cost * 1000.0 / total, (double)allocs / total};
+}
+
+int main(int argc, char** argv) {
+  LOG_NAME("system")->SetLevel(gudov::LogLevel::ERROR);
+
+  uint64_t reads = argc > 1 ? atoll(argv[1]) : 4000000;
+
+  int fds[2];
+  socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+  int sndbuf = kChunk * 4;
+  setsockopt(fds[1], SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+  // socketpair 没有经过 hook，手动登记后 read 才会走 socket 的处理流程
+  gudov::FdMgr::GetInstance()->Get(fds[0], true);
+
+  Result raw;
+  Result hooked;
+  {
+    gudov::IOManager iom(1, false, "bench");
+    iom.Schedule([&]() {
+      raw    = BenchRead(fds[0], fds[1], reads, readF);
+      hooked = BenchRead(fds[0], fds[1], reads, read);
+    });
+  }
+
+  std::cout << "reads=" << reads << std::endl;
+  std::cout << "method\tns/read\tallocs/read" << std::endl;
+  std::cout << "readF\t" << raw.ns_per_read << "\t" << raw.allocs_per_read << std::endl;
+  std::cout << "read\t" << hooked.ns_per_read << "\t" << hooked.allocs_per_read << std::endl;
+
+  gudov::FdMgr::GetInstance()->Del(fds[0]);
+  close(fds[0]);
+  close(fds[1]);
+  return 0;
+}
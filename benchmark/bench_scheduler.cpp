@@ -0,0 +1,148 @@
+/**
+ * @file bench_scheduler.cpp
+ * @brief 调度器吞吐量测试：每线程本地队列 + 工作窃取 vs 旧的全局链表队列
+ * @details
+ * 每个任务执行完后调度同一条链上的下一个任务，直到总数达到 kTasksPerRound。
+ * - shared: 任务不指定线程，可被任意线程执行
+ * - pinned: 每条链固定在一个工作线程上执行
+ *
+ * 用法: bench_scheduler [最大线程数]
+ */
+#include <atomic>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <list>
+#include <vector>
+
+#include "gudov/fiber.h"
+#include "gudov/log.h"
+#include "gudov/scheduler.h"
+#include "gudov/thread.h"
+#include "gudov/util.h"
+
+static const uint64_t kTasksPerRound = 200000;
+
+/**
+ * @brief 旧版调度器的核心循环：所有线程共享一把锁和一个 std::list
+ *
+ */
+class LegacyScheduler {
+ public:
+  struct Task {
+    std::function<void()> callback;
+    int                   thread;
+  };
+
+  explicit LegacyScheduler(size_t threads) : thread_count_(threads) {}
+
+  void Schedule(std::function<void()> cb, int thread = -1) {
+    gudov::Mutex::Locker lock(mutex_);
+    tasks_.push_back(Task{std::move(cb), thread});
+  }
+
+  void Start() {
+    for (size_t i = 0; i < thread_count_; ++i) {
+      threads_.emplace_back(new gudov::Thread(std::bind(&LegacyScheduler::Run, this), "legacy_" + std::to_string(i)));
+    }
+  }
+
+  void Stop() {
+    stopping_ = true;
+    for (auto& t : threads_) {
+      t->Join();
+    }
+  }
+
+ private:
+  void Run() {
+    gudov::Fiber::GetRunningFiber();
+    int  tid = gudov::GetThreadId();
+    Task task;
+    while (true) {
+      bool found = false;
+      {
+        gudov::Mutex::Locker lock(mutex_);
+        for (auto it = tasks_.begin(); it != tasks_.end(); ++it) {
+          if (it->thread != -1 && it->thread != tid) {
+            continue;
+          }
+          task = std::move(*it);
+          tasks_.erase(it);
+          found = true;
+          break;
+        }
+        if (!found && stopping_ && tasks_.empty()) {
+          break;
+        }
+      }
+      if (found) {
+        gudov::Fiber::ptr fiber(new gudov::Fiber(task.callback, 0, false));
+        fiber->Resume();
+      }
+    }
+  }
+
+ private:
+  size_t                           thread_count_;
+  gudov::Mutex                     mutex_;
+  std::list<Task>                  tasks_;
+  std::vector<gudov::Thread::ptr>  threads_;
+  std::atomic<bool>                stopping_{false};
+};
+
+static thread_local int t_tid = 0;
+
+static int CachedThreadId() {
+  if (!t_tid) {
+    t_tid = gudov::GetThreadId();
+  }
+  return t_tid;
+}
+
+template <typename SchedulerType>
+static void Step(SchedulerType* sched, std::atomic<uint64_t>* done, bool pinned) {
+  if (++(*done) >= kTasksPerRound) {
+    return;
+  }
+  sched->Schedule(std::bind(&Step<SchedulerType>, sched, done, pinned), pinned ? CachedThreadId() : -1);
+}
+
+template <typename SchedulerType>
+static double RunRound(SchedulerType& sched, size_t threads, bool pinned) {
+  std::atomic<uint64_t> done{0};
+  size_t                chains = threads * 4;
+  sched.Start();
+  uint64_t start = gudov::GetCurrentUS();
+  for (size_t i = 0; i < chains; ++i) {
+    // 首个任务不指定线程，由执行它的线程决定后续固定在哪个线程
+    sched.Schedule(std::bind(&Step<SchedulerType>, &sched, &done, pinned));
+  }
+  while (done < kTasksPerRound) {
+    usleep(100);
+  }
+  uint64_t cost = gudov::GetCurrentUS() - start;
+  sched.Stop();
+  return kTasksPerRound * 1e6 / cost;
+}
+
+int main(int argc, char** argv) {
+  LOG_NAME("system")->SetLevel(gudov::LogLevel::ERROR);
+
+  size_t max_threads = argc > 1 ? atoi(argv[1]) : 16;
+
+  std::cout << "threads\tmode\tlegacy(tasks/s)\tstealing(tasks/s)" << std::endl;
+  for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+    for (bool pinned : {false, true}) {
+      LegacyScheduler legacy(threads);
+      double          legacy_rate = RunRound(legacy, threads, pinned);
+
+      gudov::Scheduler sched(threads, false, "bench");
+      double           stealing_rate = RunRound(sched, threads, pinned);
+
+      std::cout << threads << "\t" << (pinned ? "pinned" : "shared") << "\t" << (uint64_t)legacy_rate << "\t"
+                << (uint64_t)stealing_rate << std::endl;
+    }
+  }
+  return 0;
+}
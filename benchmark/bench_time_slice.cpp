@@ -0,0 +1,79 @@
+/**
+ * @file bench_time_slice.cpp
+ * @brief 时间片对混合负载下延迟的影响
+ * @details
+ * 单个调度线程上运行若干计算协程，每个协程不经过 hook IO 地完成固定的计算量，循环中调用 Fiber::MaybeYield；
+ * 同一线程上的探测协程反复 usleep(1ms)，记录每次醒来比预期晚了多少。
+ * 分别在关闭时间片和开启时间片时运行一遍，输出探测延迟的 p50/p99/max 和总耗时
+ *
+ * 用法: bench_time_slice [时间片(us)] [计算协程数] [每个计算协程的计算量(千次迭代)]
+ */
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include "gudov/config.h"
+#include "gudov/iomanager.h"
+#include "gudov/log.h"
+#include "gudov/util.h"
+
+static uint64_t s_slice_us = 2000;
+static int      s_hogs     = 4;
+static uint64_t s_work     = 100000;
+
+/// @brief 保存计算结果，防止计算被优化掉
+static std::atomic<uint64_t> s_sink{0};
+
+static void Run(uint64_t slice_us) {
+  gudov::Config::Lookup<uint64_t>("scheduler.time_slice_us")->SetValue(slice_us);
+
+  std::vector<uint64_t> lateness;
+  std::atomic<int>      running{s_hogs};
+  uint64_t              start = gudov::GetMonotonicUS();
+  {
+    gudov::IOManager iom(1, false, "bench");
+    iom.Schedule([&]() {
+      while (running > 0) {
+        uint64_t before = gudov::GetMonotonicUS();
+        usleep(1000);
+        lateness.push_back(gudov::GetMonotonicUS() - before - 1000);
+      }
+    });
+    for (int i = 0; i < s_hogs; ++i) {
+      iom.Schedule([&]() {
+        uint64_t x = 0;
+        for (uint64_t k = 0; k < s_work; ++k) {
+          for (int j = 0; j < 1000; ++j) {
+            x = x * 6364136223846793005ull + 1442695040888963407ull;
+          }
+          gudov::Fiber::MaybeYield();
+        }
+        s_sink += x;
+        --running;
+      });
+    }
+  }
+  uint64_t us = gudov::GetMonotonicUS() - start;
+
+  std::sort(lateness.begin(), lateness.end());
+  auto pick = [&](double q) { return lateness.empty() ? 0 : lateness[(size_t)(q * (lateness.size() - 1))]; };
+  std::cout << "time slice " << slice_us << "us: probe lateness p50 " << pick(0.5) << "us p99 " << pick(0.99)
+            << "us max " << pick(1) << "us over " << lateness.size() << " wakeups, total " << us / 1000 << "ms"
+            << std::endl;
+}
+
+int main(int argc, char** argv) {
+  LOG_NAME("system")->SetLevel(gudov::LogLevel::ERROR);
+
+  s_slice_us = argc > 1 ? atoll(argv[1]) : s_slice_us;
+  s_hogs     = argc > 2 ? atoi(argv[2]) : s_hogs;
+  s_work     = argc > 3 ? atoll(argv[3]) : s_work;
+
+  Run(0);
+  Run(s_slice_us);
+  return 0;
+}
@@ -0,0 +1,135 @@
+/**
+ * @file bench_timer.cpp
+ * @brief 定时器吞吐量测试：std::set 与分层时间轮
+ * @details
+ * 先加入大量 10~60s 的定时器模拟每个连接一个空闲超时，然后随机 Refresh (收到数据时续期)，
+ * 最后全部 Cancel (连接关闭)。分别统计每秒的 AddTimer、Refresh、Cancel 次数。
+ * 之后在多线程的 IOManager 上模拟带超时的 recv：每个协程反复 AddTimer 再 Cancel，
+ * 对比共享定时器锁与 iomanager.per_thread_timers 的吞吐量。
+ * 最后模拟空闲连接集中超时：大量 100~150ms 的定时器在同一段时间内到期，
+ * 对比不设 slack 与 10ms slack 时调度的回调任务数和 idle 被唤醒的次数
+ *
+ * 用法: bench_timer [定时器数量] [刷新次数] [最大线程数]
+ */
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "gudov/config.h"
+#include "gudov/iomanager.h"
+#include "gudov/log.h"
+#include "gudov/timer.h"
+#include "gudov/util.h"
+
+class BenchTimerManager : public gudov::TimerManager {
+ protected:
+  void OnTimerInsertedAtFront() override {}
+};
+
+static size_t s_timers    = 1000000;
+static size_t s_refreshes = 10000000;
+static size_t s_threads   = 8;
+
+static const int kFibersPerThread = 4;
+static const int kOpsPerFiber     = 200000;
+static const int kReapTimers      = 50000;
+
+static void Bench(const std::string& backend) {
+  gudov::Config::Lookup<std::string>("timer.backend")->SetValue(backend);
+  BenchTimerManager manager;
+
+  std::mt19937                   rand(1);
+  std::vector<gudov::Timer::ptr> timers;
+  timers.reserve(s_timers);
+
+  uint64_t start = gudov::GetCurrentUS();
+  for (size_t i = 0; i < s_timers; ++i) {
+    timers.push_back(manager.AddTimer(10000 + rand() % 50000, []() {}));
+  }
+  uint64_t add_cost = gudov::GetCurrentUS() - start;
+
+  start = gudov::GetCurrentUS();
+  for (size_t i = 0; i < s_refreshes; ++i) {
+    timers[rand() % s_timers]->Refresh();
+  }
+  uint64_t refresh_cost = gudov::GetCurrentUS() - start;
+
+  start = gudov::GetCurrentUS();
+  for (auto& timer : timers) {
+    timer->Cancel();
+  }
+  uint64_t cancel_cost = gudov::GetCurrentUS() - start;
+
+  std::cout << backend << "\t" << (uint64_t)(s_timers * 1e6 / add_cost) << "\t"
+            << (uint64_t)(s_refreshes * 1e6 / refresh_cost) << "\t" << (uint64_t)(s_timers * 1e6 / cancel_cost)
+            << std::endl;
+}
+
+static void BenchThreads(bool per_thread, size_t threads) {
+  gudov::Config::Lookup<bool>("iomanager.per_thread_timers")->SetValue(per_thread);
+  std::atomic<uint64_t> ops{0};
+  uint64_t              start = gudov::GetCurrentUS();
+  {
+    gudov::IOManager iom(threads, false, "bench");
+    for (size_t i = 0; i < threads * kFibersPerThread; ++i) {
+      iom.Schedule([&ops]() {
+        gudov::IOManager* self = gudov::IOManager::GetThis();
+        for (int j = 0; j < kOpsPerFiber; ++j) {
+          // recv 在超时前返回，定时器随即取消
+          self->AddTimer(1000, []() {})->Cancel();
+        }
+        ops += kOpsPerFiber;
+      });
+    }
+  }
+  uint64_t cost = gudov::GetCurrentUS() - start;
+  std::cout << threads << "\t" << (per_thread ? "per-thread" : "shared") << "\t" << (uint64_t)(ops * 1e6 / cost)
+            << std::endl;
+}
+
+static void BenchReap(uint64_t slack_ms) {
+  std::atomic<int> fired{0};
+  uint64_t         tasks   = 0;
+  uint64_t         wakeups = 0;
+  uint64_t         start   = gudov::GetCurrentMS();
+  {
+    gudov::IOManager iom(2, false, "bench");
+    std::mt19937     rand(1);
+    for (int i = 0; i < kReapTimers; ++i) {
+      iom.AddTimer(100 + rand() % 50, [&fired]() { ++fired; }, false, slack_ms);
+    }
+    while (fired < kReapTimers) {
+    }
+    tasks   = iom.GetStats().callback_tasks;
+    wakeups = iom.GetWakeupStats().wakeups;
+  }
+  std::cout << slack_ms << "\t" << tasks << "\t" << wakeups << "\t" << gudov::GetCurrentMS() - start << std::endl;
+}
+
+int main(int argc, char** argv) {
+  LOG_NAME("system")->SetLevel(gudov::LogLevel::ERROR);
+
+  s_timers    = argc > 1 ? atoll(argv[1]) : s_timers;
+  s_refreshes = argc > 2 ? atoll(argv[2]) : s_refreshes;
+  s_threads   = argc > 3 ? atoll(argv[3]) : s_threads;
+
+  std::cout << "timers=" << s_timers << " refreshes=" << s_refreshes << std::endl;
+  std::cout << "backend\tadd/s\trefresh/s\tcancel/s" << std::endl;
+  Bench("set");
+  Bench("wheel");
+
+  gudov::Config::Lookup<std::string>("timer.backend")->SetValue("set");
+  std::cout << "threads\ttimers\tadd+cancel/s" << std::endl;
+  for (size_t threads = 1; threads <= s_threads; threads *= 2) {
+    BenchThreads(false, threads);
+    BenchThreads(true, threads);
+  }
+
+  std::cout << "timers=" << kReapTimers << std::endl;
+  std::cout << "slack(ms)\ttasks\twakeups\tms" << std::endl;
+  BenchReap(0);
+  BenchReap(10);
+  return 0;
+}
@@ -5,8 +5,10 @@
 
 #include <cstddef>
 
+#include "dns.h"
 #include "endian.h"
 #include "log.h"
+#include "scheduler.h"
 
 namespace gudov {
 
@@ -64,7 +66,7 @@ bool Address::Lookup(std::vector<Address::ptr>& result, const std::string& host,
   if (!host.empty() && host[0] == '[') {
     const char* endipv6 = (const char*)memchr(host.c_str() + 1, ']', host.size() - 1);
     if (endipv6) {
-      if (*(endipv6 + 1) == '\0') {
+      if (*(endipv6 + 1) == ':') {
         service = endipv6 + 2;
       }
       node = host.substr(1, endipv6 - host.c_str() - 1);
@@ -85,6 +87,23 @@ bool Address::Lookup(std::vector<Address::ptr>& result, const std::string& host,
   if (node.empty()) {
     node = host;
   }
+
+  // 调度线程里由 DNS 客户端解析，等待应答时只挂起协程；服务名不是端口号时仍交给 getaddrinfo
+  bool numeric_service = !service || (*service && strspn(service, "0123456789") == strlen(service));
+  if (DnsResolver::IsEnabled() && Scheduler::GetWorkerIndex() >= 0 && numeric_service &&
+      (family == AF_INET || family == AF_INET6 || family == AF_UNSPEC)) {
+    std::vector<IPAddress::ptr> addrs;
+    if (!DnsMgr::GetInstance()->Resolve(node, family, addrs)) {
+      LOG_ERROR(g_logger) << "Address::Lookup resolve(" << host << ", " << family << ") fail";
+      return false;
+    }
+    for (auto& addr : addrs) {
+      addr->SetPort(service ? atoi(service) : 0);
+      result.push_back(addr);
+    }
+    return true;
+  }
+
   int error = getaddrinfo(node.c_str(), service, &hints, &results);
   if (error) {
     LOG_ERROR(g_logger) << "Address::Lookup getaddress(" << host << ", " << family << ", " << type << ") err=" << error
@@ -9,6 +9,7 @@
 
 #include "endian.h"
 #include "log.h"
+#include "offload.h"
 
 namespace gudov {
 
@@ -450,6 +451,14 @@ bool ByteArray::ReadFromFile(const std::string& name) {
   return true;
 }
 
+bool ByteArray::WriteToFileAsync(const std::string& name) const {
+  return OffloadPool::GetDefault()->Await([&]() { return WriteToFile(name); });
+}
+
+bool ByteArray::ReadFromFileAsync(const std::string& name) {
+  return OffloadPool::GetDefault()->Await([&]() { return ReadFromFile(name); });
+}
+
 bool ByteArray::IsLittleEndian() const { return endian_ == GUDOV_LITTLE_ENDIAN; }
 
 void ByteArray::SetIsLittleEndian(bool val) {
@@ -83,6 +83,13 @@ class ByteArray {
   bool WriteToFile(const std::string& name) const;
   bool ReadFromFile(const std::string& name);
 
+  /**
+   * @brief 在 OffloadPool::GetDefault() 的线程上读写文件，只挂起调用的协程
+   * @details 等待期间不能在其他协程中访问本对象
+   */
+  bool WriteToFileAsync(const std::string& name) const;
+  bool ReadFromFileAsync(const std::string& name);
+
   size_t GetBaseSize() const { return base_size_; }
   size_t GetReadSize() const { return size_ - position_; }
 
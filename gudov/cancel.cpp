@@ -0,0 +1,107 @@
+#include "cancel.h"
+
+#include <algorithm>
+
+#include "util.h"
+
+namespace gudov {
+
+CancelContext::CancelContext(ptr parent, uint64_t timeout_ms) : parent_(std::move(parent)) {
+  if (timeout_ms != ~0ull) {
+    deadline_us_ = GetMonotonicUS() + timeout_ms * 1000;
+  }
+  if (!parent_) {
+    return;
+  }
+  deadline_us_              = std::min(deadline_us_, parent_->deadline_us_);
+  parent_listener_.callback = [this](int error) { Cancel(error); };
+  if (!parent_->AddListener(parent_listener_)) {
+    error_ = parent_->error_.load();
+  }
+}
+
+CancelContext::~CancelContext() {
+  if (parent_) {
+    parent_->RemoveListener(parent_listener_);
+  }
+}
+
+void CancelContext::Cancel(int error) {
+  MutexType::Locker lock(mutex_);
+  if (error_.load(std::memory_order_relaxed)) {
+    return;
+  }
+  error_.store(error, std::memory_order_release);
+  // 回调可能唤醒监听方，监听方注销时要等这里释放锁，所以摘下节点后不再访问它
+  CancelListener* listener = head_;
+  head_                    = nullptr;
+  while (listener) {
+    CancelListener* next = listener->next;
+    listener->prev       = nullptr;
+    listener->next       = nullptr;
+    listener->linked     = false;
+    listener->callback(error);
+    listener = next;
+  }
+}
+
+int CancelContext::Error() const {
+  int error = error_.load(std::memory_order_acquire);
+  if (error) {
+    return error;
+  }
+  if (deadline_us_ != ~0ull && GetMonotonicUS() >= deadline_us_) {
+    return ETIMEDOUT;
+  }
+  return 0;
+}
+
+uint64_t CancelContext::GetRemainingUS() const {
+  if (deadline_us_ == ~0ull) {
+    return ~0ull;
+  }
+  uint64_t now = GetMonotonicUS();
+  return now >= deadline_us_ ? 0 : deadline_us_ - now;
+}
+
+bool CancelContext::AddListener(CancelListener& listener) {
+  MutexType::Locker lock(mutex_);
+  if (error_.load(std::memory_order_relaxed)) {
+    return false;
+  }
+  listener.prev   = nullptr;
+  listener.next   = head_;
+  listener.linked = true;
+  if (head_) {
+    head_->prev = &listener;
+  }
+  head_ = &listener;
+  return true;
+}
+
+void CancelContext::RemoveListener(CancelListener& listener) {
+  MutexType::Locker lock(mutex_);
+  if (!listener.linked) {
+    return;
+  }
+  if (listener.prev) {
+    listener.prev->next = listener.next;
+  } else {
+    head_ = listener.next;
+  }
+  if (listener.next) {
+    listener.next->prev = listener.prev;
+  }
+  listener.prev   = nullptr;
+  listener.next   = nullptr;
+  listener.linked = false;
+}
+
+CancelScope::CancelScope(CancelContext::ptr context) : fiber_(Fiber::GetRunningFiber()) {
+  previous_ = fiber_->GetCancelContext();
+  fiber_->SetCancelContext(std::move(context));
+}
+
+CancelScope::~CancelScope() { fiber_->SetCancelContext(std::move(previous_)); }
+
+}  // namespace gudov
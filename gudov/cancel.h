@@ -0,0 +1,138 @@
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+#include "fiber.h"
+#include "mutex.h"
+#include "noncopyable.h"
+
+namespace gudov {
+
+/**
+ * @brief 取消上下文上登记的监听方，放在监听方的栈上或作为成员
+ * @details 上下文被取消时在取消方的线程中以错误码调用 callback，调用期间持有上下文的锁，
+ * 回调中只做唤醒之类很短的操作，不要阻塞，也不要再操作同一个上下文
+ *
+ */
+struct CancelListener : NonCopyable {
+  explicit CancelListener(std::function<void(int)> cb = nullptr) : callback(std::move(cb)) {}
+
+  std::function<void(int)> callback;
+
+  CancelListener* prev   = nullptr;
+  CancelListener* next   = nullptr;
+  bool            linked = false;
+};
+
+/**
+ * @brief 协程的取消上下文
+ * @details
+ * 携带一个截止时间和一个取消信号，挂在协程上 (Fiber::GetCancelContext)。
+ * 新建的协程和调度的回调继承创建方当前的上下文，子上下文随父上下文一起取消，截止时间取两者中较早的。
+ * hook 的 socket IO 在挂起前检查当前上下文：已取消时立即返回 -1 并设置 errno 为 ECANCELED 或 ETIMEDOUT，
+ * 挂起时最多等到截止时间，挂起中被取消则通过 IOManager::CancelEvent 唤醒。
+ * 截止时间只在检查时生效，到期不会主动调用监听方
+ *
+ */
+class CancelContext : NonCopyable {
+ public:
+  using ptr       = std::shared_ptr<CancelContext>;
+  using MutexType = Mutex;
+
+  /**
+   * @brief 构造
+   *
+   * @param parent 父上下文，为空时创建根上下文
+   * @param timeout_ms 相对现在的超时时间(ms)，~0ull 表示只继承父上下文的截止时间
+   */
+  explicit CancelContext(ptr parent = nullptr, uint64_t timeout_ms = ~0ull);
+  ~CancelContext();
+
+  /**
+   * @brief 以当前协程的上下文为父上下文创建
+   *
+   */
+  static ptr WithCancel() { return std::make_shared<CancelContext>(GetCurrent()); }
+
+  /**
+   * @brief 以当前协程的上下文为父上下文创建，并在 timeout_ms 毫秒后到期
+   *
+   */
+  static ptr WithTimeout(uint64_t timeout_ms) { return std::make_shared<CancelContext>(GetCurrent(), timeout_ms); }
+
+  /**
+   * @brief 当前协程的取消上下文，没有时返回空
+   *
+   */
+  static ptr GetCurrent() { return Fiber::GetRunningCancelContext(); }
+
+  /**
+   * @brief 取消此上下文及所有子上下文，只有第一次调用生效
+   *
+   * @param error 监听方和 Error() 看到的错误码
+   */
+  void Cancel(int error = ECANCELED);
+
+  /**
+   * @brief 取消原因
+   *
+   * @return int 未取消返回 0，被取消返回 Cancel() 的错误码，超过截止时间返回 ETIMEDOUT
+   */
+  int Error() const;
+
+  bool IsCancelled() const { return Error() != 0; }
+
+  /// @brief 截止时间，GetMonotonicUS() 的时间基准，~0ull 表示没有
+  uint64_t GetDeadlineUS() const { return deadline_us_; }
+
+  /**
+   * @brief 距截止时间的剩余时间(us)
+   *
+   * @return uint64_t 没有截止时间返回 ~0ull，已经到期返回 0
+   */
+  uint64_t GetRemainingUS() const;
+
+  /**
+   * @brief 登记监听方
+   *
+   * @return false 已经取消，没有登记
+   */
+  bool AddListener(CancelListener& listener);
+
+  /**
+   * @brief 注销监听方
+   * @details 返回后监听方的回调不会再被调用，也没有正在执行，之后可以销毁监听方
+   *
+   */
+  void RemoveListener(CancelListener& listener);
+
+ private:
+  ptr              parent_;
+  /// @brief 在父上下文上的监听，父上下文取消时取消自身
+  CancelListener   parent_listener_;
+  uint64_t         deadline_us_ = ~0ull;
+  std::atomic<int> error_{0};
+
+  MutexType       mutex_;
+  CancelListener* head_ = nullptr;
+};
+
+/**
+ * @brief 在作用域内替换当前协程的取消上下文，离开时恢复
+ *
+ */
+class CancelScope : NonCopyable {
+ public:
+  explicit CancelScope(CancelContext::ptr context);
+  ~CancelScope();
+
+ private:
+  Fiber::ptr         fiber_;
+  CancelContext::ptr previous_;
+};
+
+}  // namespace gudov
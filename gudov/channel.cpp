@@ -0,0 +1,240 @@
+#include "channel.h"
+
+#include <vector>
+
+#include "fiber.h"
+#include "fiber_sync.h"
+#include "iomanager.h"
+#include "log.h"
+#include "macro.h"
+#include "scheduler.h"
+#include "util.h"
+
+namespace gudov {
+
+/**
+ * @brief 一次 Select() 的等待方，在它挂着的每个通道上各有一个 Node
+ *
+ */
+struct ChannelBase::Waiter {
+  /// @brief 未决定
+  static const int PENDING = -1;
+  /// @brief 超时
+  static const int TIMEOUT = -2;
+  /// @brief 登记后的再次检查已经完成了某个分支，由自己唤醒自己
+  static const int SELF    = -3;
+
+  FiberWaiter waiter;
+  /// @brief 唤醒方先把它从 PENDING 改为自己的分支下标，只有成功的一方唤醒
+  std::atomic<int> selected{PENDING};
+};
+
+struct ChannelBase::Node {
+  Node*   prev   = nullptr;
+  Node*   next   = nullptr;
+  Waiter* waiter = nullptr;
+  int     index  = 0;
+  bool    linked = false;
+};
+
+void ChannelBase::PushBack(Direction dir, Node* node) {
+  node->prev   = tail_[dir];
+  node->next   = nullptr;
+  node->linked = true;
+  if (tail_[dir]) {
+    tail_[dir]->next = node;
+  } else {
+    head_[dir] = node;
+  }
+  tail_[dir] = node;
+}
+
+void ChannelBase::Remove(Direction dir, Node* node) {
+  if (node->prev) {
+    node->prev->next = node->next;
+  } else {
+    head_[dir] = node->next;
+  }
+  if (node->next) {
+    node->next->prev = node->prev;
+  } else {
+    tail_[dir] = node->prev;
+  }
+  node->prev   = nullptr;
+  node->next   = nullptr;
+  node->linked = false;
+}
+
+ChannelBase::Node* ChannelBase::PopFront(Direction dir) {
+  Node* node = head_[dir];
+  if (node) {
+    Remove(dir, node);
+  }
+  return node;
+}
+
+void ChannelBase::Notify(Direction dir) {
+  Waiter* wake = nullptr;
+  {
+    Mutex::Locker lock(mutex_);
+    while (Node* node = PopFront(dir)) {
+      waiting_[dir].fetch_sub(1, std::memory_order_relaxed);
+      // 同时挂在其他通道上的等待方可能已经被唤醒，跳过它
+      int expected = Waiter::PENDING;
+      if (node->waiter->selected.compare_exchange_strong(expected, node->index)) {
+        wake = node->waiter;
+        break;
+      }
+    }
+  }
+  if (wake) {
+    FiberWaitQueue::Wake(&wake->waiter);
+  }
+}
+
+void ChannelBase::Close() {
+  std::vector<Waiter*> wake;
+  {
+    Mutex::Locker lock(mutex_);
+    write_pos_.fetch_or(CLOSED_BIT, std::memory_order_seq_cst);
+    for (Direction dir : {SEND, RECV}) {
+      while (Node* node = PopFront(dir)) {
+        waiting_[dir].fetch_sub(1, std::memory_order_relaxed);
+        int expected = Waiter::PENDING;
+        if (node->waiter->selected.compare_exchange_strong(expected, node->index)) {
+          wake.push_back(node->waiter);
+        }
+      }
+    }
+  }
+  for (Waiter* waiter : wake) {
+    FiberWaitQueue::Wake(&waiter->waiter);
+  }
+}
+
+int ChannelBase::Select(const SelectCase* cases, size_t count, uint64_t timeout_ms) {
+  static thread_local uint32_t t_seed = 0;
+
+  uint64_t deadline = timeout_ms == ~0ull ? ~0ull : GetMonotonicUS() / 1000 + timeout_ms;
+  size_t   first    = count > 1 ? t_seed++ % count : 0;
+  int      woken_by = -1;
+  while (true) {
+    for (size_t k = 0; k < count; ++k) {
+      size_t i = (first + k) % count;
+      if (cases[i].attempt()) {
+        if (woken_by >= 0 && woken_by != static_cast<int>(i)) {
+          // 唤醒本方的通道可能还有就绪的元素，把唤醒让给那里的其他等待方
+          cases[woken_by].channel->Notify(static_cast<Direction>(cases[woken_by].dir));
+        }
+        return i;
+      }
+    }
+
+    uint64_t remaining = ~0ull;
+    if (deadline != ~0ull) {
+      uint64_t now = GetMonotonicUS() / 1000;
+      if (now >= deadline) {
+        return -1;
+      }
+      remaining = deadline - now;
+    }
+
+    woken_by = -1;
+    int done = Park(cases, count, remaining, woken_by);
+    if (done >= 0) {
+      if (woken_by >= 0 && woken_by != done) {
+        cases[woken_by].channel->Notify(static_cast<Direction>(cases[woken_by].dir));
+      }
+      return done;
+    }
+    if (woken_by >= 0) {
+      first = woken_by;
+    }
+  }
+}
+
+int ChannelBase::Park(const SelectCase* cases, size_t count, uint64_t timeout_ms, int& woken_by) {
+  Waiter            w;
+  std::vector<Node> nodes(count);
+  Scheduler*        scheduler = w.waiter.scheduler;
+  if (scheduler) {
+    scheduler->AddExternalWaiter();
+  }
+  for (size_t i = 0; i < count; ++i) {
+    ChannelBase* channel = cases[i].channel;
+    Direction    dir     = static_cast<Direction>(cases[i].dir);
+    nodes[i].waiter      = &w;
+    nodes[i].index       = i;
+    Mutex::Locker lock(channel->mutex_);
+    channel->PushBack(dir, &nodes[i]);
+    channel->waiting_[dir].fetch_add(1, std::memory_order_relaxed);
+  }
+
+  // 先登记再检查，与 Signal() 的顺序相反
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  int done = -1;
+  for (size_t i = 0; i < count && done < 0; ++i) {
+    if (cases[i].attempt()) {
+      done = i;
+    }
+  }
+  if (done >= 0) {
+    // 已经被其他通道抢先选中时，等它的唤醒即可
+    int expected = Waiter::PENDING;
+    if (w.selected.compare_exchange_strong(expected, Waiter::SELF)) {
+      FiberWaitQueue::Wake(&w.waiter);
+    }
+  }
+
+  if (scheduler) {
+    Timer::ptr timer;
+    if (done < 0 && timeout_ms != ~0ull) {
+      IOManager* iom = IOManager::GetThis();
+      GUDOV_ASSERT2(iom, "timed channel wait needs an IOManager");
+      w.waiter.done.store(false, std::memory_order_relaxed);
+      timer = iom->AddTimer(timeout_ms, [&w]() {
+        int expected = Waiter::PENDING;
+        if (w.selected.compare_exchange_strong(expected, Waiter::TIMEOUT)) {
+          FiberWaitQueue::Wake(&w.waiter);
+        }
+        w.waiter.done.store(true, std::memory_order_release);
+      });
+    }
+
+    Fiber::GetRunningFiber()->Yield();
+
+    if (timer && !timer->Cancel()) {
+      // 回调已经开始执行，让出 CPU 等它结束
+      while (!w.waiter.done.load(std::memory_order_acquire)) {
+        Scheduler::GetScheduler()->Schedule(Fiber::GetRunningFiber());
+        Fiber::GetRunningFiber()->Yield();
+      }
+    }
+  } else if (done < 0 && timeout_ms != ~0ull) {
+    if (!w.waiter.sem.WaitFor(timeout_ms)) {
+      int expected = Waiter::PENDING;
+      if (!w.selected.compare_exchange_strong(expected, Waiter::TIMEOUT)) {
+        // 唤醒方已经选中本方，等它的通知
+        w.waiter.sem.Wait();
+      }
+    }
+  } else {
+    w.waiter.sem.Wait();
+  }
+
+  for (size_t i = 0; i < count; ++i) {
+    ChannelBase*  channel = cases[i].channel;
+    Direction     dir     = static_cast<Direction>(cases[i].dir);
+    Mutex::Locker lock(channel->mutex_);
+    if (nodes[i].linked) {
+      channel->Remove(dir, &nodes[i]);
+      channel->waiting_[dir].fetch_sub(1, std::memory_order_relaxed);
+    }
+  }
+
+  int selected = w.selected.load(std::memory_order_acquire);
+  woken_by     = selected >= 0 ? selected : -1;
+  return done;
+}
+
+}  // namespace gudov
@@ -0,0 +1,408 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "mutex.h"
+#include "noncopyable.h"
+
+namespace gudov {
+
+class ChannelBase;
+
+/**
+ * @brief Select() 的一个分支，由 Channel<T>::SendCase() 或 Channel<T>::RecvCase() 构造
+ *
+ */
+struct SelectCase {
+  ChannelBase*          channel;
+  /// @brief ChannelBase::SEND 或 ChannelBase::RECV
+  int                   dir;
+  /// @brief 不阻塞地尝试完成操作，完成 (包括通道已关闭) 时返回 true
+  std::function<bool()> attempt;
+};
+
+/**
+ * @brief 通道中与元素类型无关的部分：关闭状态、读写位置和等待队列
+ * @details 等待方不接收交接的元素，被唤醒后重新尝试，因此同一个等待方可以同时挂在多个通道上
+ *
+ */
+class ChannelBase : NonCopyable {
+ public:
+  enum Direction { SEND = 0, RECV = 1 };
+
+  /**
+   * @brief 关闭通道，唤醒所有等待方
+   * @details 关闭后发送失败，接收方取完剩余的元素后接收失败
+   *
+   */
+  void Close();
+
+  bool IsClosed() const { return write_pos_.load(std::memory_order_acquire) & CLOSED_BIT; }
+
+  /**
+   * @brief 等待 cases 中的任意一个分支完成
+   * @details 多个分支同时就绪时从随机位置开始选择。timeout_ms 为 0 时不阻塞
+   *
+   * @return 完成的分支下标，超时返回 -1
+   */
+  static int Select(const SelectCase* cases, size_t count, uint64_t timeout_ms = ~0ull);
+
+ protected:
+  enum Status { OK = 0, WOULD_BLOCK, CLOSED };
+
+  /// @brief 写位置的最高位表示通道已关闭，关闭后写位置不再前进
+  static const uint64_t CLOSED_BIT = 1ull << 63;
+
+  /**
+   * @brief 操作成功后调用，dir 方向有等待方时唤醒一个
+   * @details 与等待方 "先登记再检查" 的顺序相反，两者至少有一方看到对方
+   *
+   */
+  void Signal(Direction dir) {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (waiting_[dir].load(std::memory_order_relaxed) != 0) {
+      Notify(dir);
+    }
+  }
+
+  void Notify(Direction dir);
+
+ private:
+  struct Waiter;
+  struct Node;
+
+  static int Park(const SelectCase* cases, size_t count, uint64_t timeout_ms, int& woken_by);
+
+  void  PushBack(Direction dir, Node* node);
+  void  Remove(Direction dir, Node* node);
+  Node* PopFront(Direction dir);
+
+ protected:
+  /// @brief 保护等待队列，以及无界通道的溢出队列
+  Mutex mutex_;
+
+  /// @brief 读写位置分处不同的缓存行
+  std::atomic<uint64_t> read_pos_{0};
+  char                  pad0_[64 - sizeof(std::atomic<uint64_t>)];
+  std::atomic<uint64_t> write_pos_{0};
+  char                  pad1_[64 - sizeof(std::atomic<uint64_t>)];
+
+ private:
+  std::atomic<int64_t> waiting_[2] = {{0}, {0}};
+  Node*                head_[2]    = {nullptr, nullptr};
+  Node*                tail_[2]    = {nullptr, nullptr};
+};
+
+/**
+ * @brief 等待 cases 中的任意一个分支完成
+ *
+ * @return 完成的分支下标，超时返回 -1
+ */
+inline int Select(std::initializer_list<SelectCase> cases, uint64_t timeout_ms = ~0ull) {
+  return ChannelBase::Select(cases.begin(), cases.size(), timeout_ms);
+}
+
+/**
+ * @brief 多生产者多消费者的通道
+ * @details 元素放在环形缓冲区中，既不空也不满时收发只需要一次 CAS，不加锁。
+ * 在调度线程的协程中阻塞时挂起协程，其他线程阻塞线程。
+ * 无界通道的环形缓冲区满了以后，新元素在锁内进入溢出队列，接收方取走环中的元素后再把它们搬回环中
+ *
+ * @tparam T 元素类型
+ */
+template <typename T>
+class Channel : public ChannelBase {
+ public:
+  using ptr = std::shared_ptr<Channel>;
+
+  /**
+   * @brief 构造通道
+   *
+   * @param capacity 容量，为 0 时不限容量
+   */
+  explicit Channel(size_t capacity = 0)
+      : capacity_(capacity),
+        ring_size_(capacity ? capacity : size_t{UNBOUNDED_RING}),
+        pow2_((ring_size_ & (ring_size_ - 1)) == 0),
+        slots_(new Slot[ring_size_]) {
+    for (size_t i = 0; i < ring_size_; ++i) {
+      slots_[i].seq.store(2 * i, std::memory_order_relaxed);
+    }
+  }
+
+  ~Channel() {
+    uint64_t end = write_pos_.load(std::memory_order_relaxed) & ~CLOSED_BIT;
+    for (uint64_t pos = read_pos_.load(std::memory_order_relaxed); pos != end; ++pos) {
+      Item(At(pos))->~T();
+    }
+  }
+
+  /**
+   * @brief 发送，通道满时等待
+   *
+   * @return false 通道已关闭，value 被丢弃
+   */
+  bool Send(T value) { return SendFor(std::move(value), ~0ull); }
+
+  /**
+   * @brief 发送，通道满时最多等待 timeout_ms 毫秒
+   *
+   * @return false 超时或通道已关闭，value 被丢弃
+   */
+  bool SendFor(T value, uint64_t timeout_ms) {
+    int status = Push(value);
+    if (status != WOULD_BLOCK || timeout_ms == 0) {
+      return status == OK;
+    }
+    bool       ok = false;
+    SelectCase send{this, SEND, [this, &value, &ok]() {
+                      int status = Push(value);
+                      ok         = status == OK;
+                      return status != WOULD_BLOCK;
+                    }};
+    return ChannelBase::Select(&send, 1, timeout_ms) == 0 && ok;
+  }
+
+  bool TrySend(T value) { return Push(value) == OK; }
+
+  /**
+   * @brief 接收，通道空时等待
+   *
+   * @return false 通道已关闭且没有剩余元素
+   */
+  bool Recv(T& value) { return RecvFor(value, ~0ull); }
+
+  /**
+   * @brief 接收，通道空时最多等待 timeout_ms 毫秒
+   *
+   * @return false 超时，或通道已关闭且没有剩余元素
+   */
+  bool RecvFor(T& value, uint64_t timeout_ms) {
+    int status = Pop(value);
+    if (status != WOULD_BLOCK || timeout_ms == 0) {
+      return status == OK;
+    }
+    bool       ok = false;
+    SelectCase recv{this, RECV, [this, &value, &ok]() {
+                      int status = Pop(value);
+                      ok         = status == OK;
+                      return status != WOULD_BLOCK;
+                    }};
+    return ChannelBase::Select(&recv, 1, timeout_ms) == 0 && ok;
+  }
+
+  bool TryRecv(T& value) { return Pop(value) == OK; }
+
+  /**
+   * @brief 构造发送分支
+   *
+   * @param ok 分支完成时写入是否发送成功，通道已关闭时为 false
+   */
+  SelectCase SendCase(T value, bool* ok = nullptr) {
+    // std::function 要求可复制，元素放在共享的存储中
+    std::shared_ptr<T> holder = std::make_shared<T>(std::move(value));
+    return SelectCase{this, SEND, [this, holder, ok]() {
+                        int status = Push(*holder);
+                        if (ok) {
+                          *ok = status == OK;
+                        }
+                        return status != WOULD_BLOCK;
+                      }};
+  }
+
+  /**
+   * @brief 构造接收分支
+   *
+   * @param ok 分支完成时写入是否收到元素，通道已关闭且没有剩余元素时为 false
+   */
+  SelectCase RecvCase(T& value, bool* ok = nullptr) {
+    return SelectCase{this, RECV, [this, &value, ok]() {
+                        int status = Pop(value);
+                        if (ok) {
+                          *ok = status == OK;
+                        }
+                        return status != WOULD_BLOCK;
+                      }};
+  }
+
+  /**
+   * @brief 当前的元素个数，并发收发时只是近似值
+   *
+   */
+  size_t Size() const {
+    uint64_t read  = read_pos_.load(std::memory_order_acquire);
+    uint64_t write = write_pos_.load(std::memory_order_acquire) & ~CLOSED_BIT;
+    return write - read + overflow_size_.load(std::memory_order_relaxed);
+  }
+
+  /// @brief 容量，0 表示不限容量
+  size_t Capacity() const { return capacity_; }
+
+ private:
+  /// @brief 无界通道的环形缓冲区大小
+  static const size_t UNBOUNDED_RING = 1024;
+
+  /**
+   * @brief 环形缓冲区的槽位
+   * @details seq 等于 2 * 写位置时可写，写入后加 1 表示可读，读完后前进一圈。
+   * 乘 2 使容量为 1 时可读与下一圈可写的状态也不相同
+   *
+   */
+  struct Slot {
+    std::atomic<uint64_t>                                      seq;
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+  };
+
+  Slot& At(uint64_t pos) { return slots_[pow2_ ? (pos & (ring_size_ - 1)) : (pos % ring_size_)]; }
+
+  static T* Item(Slot& slot) { return reinterpret_cast<T*>(&slot.storage); }
+
+  /**
+   * @brief 不加锁地写入环形缓冲区，成功时移走 value
+   *
+   */
+  int TryPush(T& value) {
+    uint64_t pos = write_pos_.load(std::memory_order_relaxed);
+    Slot*    slot;
+    while (true) {
+      if (pos & CLOSED_BIT) {
+        return CLOSED;
+      }
+      slot         = &At(pos);
+      int64_t diff = static_cast<int64_t>(slot->seq.load(std::memory_order_acquire) - 2 * pos);
+      if (diff == 0) {
+        if (write_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        return WOULD_BLOCK;
+      } else {
+        pos = write_pos_.load(std::memory_order_relaxed);
+      }
+    }
+    new (&slot->storage) T(std::move(value));
+    slot->seq.store(2 * pos + 1, std::memory_order_release);
+    return OK;
+  }
+
+  /**
+   * @brief 不加锁地从环形缓冲区读出
+   *
+   */
+  bool TryPop(T& value) {
+    uint64_t pos = read_pos_.load(std::memory_order_relaxed);
+    Slot*    slot;
+    while (true) {
+      slot         = &At(pos);
+      int64_t diff = static_cast<int64_t>(slot->seq.load(std::memory_order_acquire) - (2 * pos + 1));
+      if (diff == 0) {
+        if (read_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = read_pos_.load(std::memory_order_relaxed);
+      }
+    }
+    T* item = Item(*slot);
+    value   = std::move(*item);
+    item->~T();
+    slot->seq.store(2 * (pos + ring_size_), std::memory_order_release);
+    return true;
+  }
+
+  int Push(T& value) {
+    if (capacity_) {
+      int status = TryPush(value);
+      if (status == OK) {
+        Signal(RECV);
+      }
+      return status;
+    }
+
+    // 溢出队列不为空时直接排在后面，保证同一个发送方的顺序
+    if (overflow_size_.load(std::memory_order_acquire) == 0) {
+      int status = TryPush(value);
+      if (status != WOULD_BLOCK) {
+        if (status == OK) {
+          Signal(RECV);
+        }
+        return status;
+      }
+    }
+    {
+      Mutex::Locker lock(mutex_);
+      if (IsClosed()) {
+        return CLOSED;
+      }
+      overflow_.push_back(std::move(value));
+      overflow_size_.fetch_add(1, std::memory_order_release);
+    }
+    Signal(RECV);
+    return OK;
+  }
+
+  int Pop(T& value) {
+    if (TryPop(value)) {
+      if (capacity_) {
+        Signal(SEND);
+      } else if (overflow_size_.load(std::memory_order_relaxed) != 0) {
+        Mutex::Locker lock(mutex_);
+        Refill();
+      }
+      return OK;
+    }
+
+    if (overflow_size_.load(std::memory_order_acquire) != 0) {
+      Mutex::Locker lock(mutex_);
+      if (TryPop(value)) {
+        return OK;
+      }
+      if (!overflow_.empty()) {
+        value = std::move(overflow_.front());
+        overflow_.pop_front();
+        overflow_size_.fetch_sub(1, std::memory_order_release);
+        return OK;
+      }
+    }
+
+    // 关闭前已经占用槽位的发送方还没写完时仍然等待，它写完后会唤醒接收方
+    uint64_t write = write_pos_.load(std::memory_order_acquire);
+    if ((write & CLOSED_BIT) && (write & ~CLOSED_BIT) == read_pos_.load(std::memory_order_acquire) &&
+        overflow_size_.load(std::memory_order_acquire) == 0) {
+      return CLOSED;
+    }
+    return WOULD_BLOCK;
+  }
+
+  /**
+   * @brief 持有 mutex_，把溢出队列中的元素按顺序搬回环形缓冲区
+   *
+   */
+  void Refill() {
+    while (!overflow_.empty() && TryPush(overflow_.front()) == OK) {
+      overflow_.pop_front();
+      overflow_size_.fetch_sub(1, std::memory_order_release);
+    }
+  }
+
+ private:
+  const size_t            capacity_;
+  const size_t            ring_size_;
+  const bool              pow2_;
+  std::unique_ptr<Slot[]> slots_;
+  /// @brief 无界通道的溢出队列，由 mutex_ 保护
+  std::deque<T>           overflow_;
+  std::atomic<size_t>     overflow_size_{0};
+};
+
+}  // namespace gudov
@@ -0,0 +1,438 @@
+#include "dns.h"
+
+#include <arpa/inet.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+#include "config.h"
+#include "fiber.h"
+#include "log.h"
+#include "scheduler.h"
+#include "socket.h"
+#include "util.h"
+
+namespace gudov {
+
+static Logger::ptr g_logger = LOG_NAME("system");
+
+static ConfigVar<std::vector<std::string>>::ptr g_dnsServers =
+    Config::Lookup("dns.servers", std::vector<std::string>(), "dns servers as ip[:port], /etc/resolv.conf if empty");
+
+static ConfigVar<int>::ptr g_dnsTimeout = Config::Lookup("dns.timeout", 2000, "dns query timeout per attempt in ms");
+
+static ConfigVar<int>::ptr g_dnsRetries = Config::Lookup("dns.retries", 2, "dns query attempts per server");
+
+static ConfigVar<bool>::ptr g_dnsEnable =
+    Config::Lookup("dns.enable", true, "resolve host names with the fiber dns client in Address::Lookup");
+
+static const uint16_t DNS_PORT     = 53;
+static const uint16_t TYPE_A       = 1;
+static const uint16_t TYPE_AAAA    = 28;
+static const uint16_t CLASS_IN     = 1;
+static const int      RCODE_NXNAME = 3;
+static const size_t   MAX_MESSAGE  = 4096;
+
+static uint16_t ReadU16(const uint8_t* p) { return (uint16_t)(p[0] << 8 | p[1]); }
+
+static uint32_t ReadU32(const uint8_t* p) { return (uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3]; }
+
+static void AppendU16(std::string& out, uint16_t v) {
+  out.push_back((char)(v >> 8));
+  out.push_back((char)(v & 0xff));
+}
+
+/**
+ * @brief 转为小写并去掉末尾的 '.'
+ *
+ */
+static std::string NormalizeName(const std::string& host) {
+  std::string name = host;
+  std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+  if (!name.empty() && name.back() == '.') {
+    name.pop_back();
+  }
+  return name;
+}
+
+/**
+ * @brief 构造查询报文，要求服务器递归查询
+ *
+ * @return false 域名不合法
+ */
+static bool BuildQuery(uint16_t id, const std::string& name, uint16_t qtype, std::string& out) {
+  if (name.empty() || name.size() > 253) {
+    return false;
+  }
+  out.clear();
+  AppendU16(out, id);
+  AppendU16(out, 0x0100);  // RD
+  AppendU16(out, 1);       // QDCOUNT
+  AppendU16(out, 0);
+  AppendU16(out, 0);
+  AppendU16(out, 0);
+
+  size_t start = 0;
+  while (start < name.size()) {
+    size_t dot = name.find('.', start);
+    if (dot == std::string::npos) {
+      dot = name.size();
+    }
+    size_t len = dot - start;
+    if (len == 0 || len > 63) {
+      return false;
+    }
+    out.push_back((char)len);
+    out.append(name, start, len);
+    start = dot + 1;
+  }
+  out.push_back('\0');
+  AppendU16(out, qtype);
+  AppendU16(out, CLASS_IN);
+  return true;
+}
+
+/**
+ * @brief 跳过报文中的域名，支持压缩指针
+ *
+ * @return size_t 域名之后的偏移，报文不合法时返回 0
+ */
+static size_t SkipName(const uint8_t* data, size_t len, size_t pos) {
+  while (pos < len) {
+    uint8_t c = data[pos];
+    if (c == 0) {
+      return pos + 1;
+    }
+    if ((c & 0xc0) == 0xc0) {
+      return pos + 2 <= len ? pos + 2 : 0;
+    }
+    if (c & 0xc0) {
+      return 0;
+    }
+    pos += c + 1;
+  }
+  return 0;
+}
+
+/**
+ * @brief 解析应答报文中类型为 qtype 的记录
+ * @details CNAME 链上的记录按类型直接取出，不校验名字
+ *
+ * @param[out] ttl 取出的记录中最小的 TTL
+ * @return int 应答的 RCODE，报文不合法或与查询不匹配时返回 -1
+ */
+static int ParseResponse(const uint8_t* data, size_t len, uint16_t id, uint16_t qtype,
+                         std::vector<IPAddress::ptr>& result, uint32_t& ttl) {
+  if (len < 12 || ReadU16(data) != id || !(data[2] & 0x80)) {
+    return -1;
+  }
+  int      rcode   = data[3] & 0x0f;
+  uint16_t qdcount = ReadU16(data + 4);
+  uint16_t ancount = ReadU16(data + 6);
+
+  size_t pos = 12;
+  for (uint16_t i = 0; i < qdcount; ++i) {
+    pos = SkipName(data, len, pos);
+    if (!pos || pos + 4 > len) {
+      return -1;
+    }
+    pos += 4;
+  }
+
+  for (uint16_t i = 0; i < ancount; ++i) {
+    pos = SkipName(data, len, pos);
+    if (!pos || pos + 10 > len) {
+      return -1;
+    }
+    uint16_t type  = ReadU16(data + pos);
+    uint16_t cls   = ReadU16(data + pos + 2);
+    uint32_t rttl  = ReadU32(data + pos + 4);
+    uint16_t rdlen = ReadU16(data + pos + 8);
+
+    pos += 10;
+    if (pos + rdlen > len) {
+      return -1;
+    }
+    if (cls == CLASS_IN && type == qtype) {
+      if (type == TYPE_A && rdlen == 4) {
+        result.push_back(std::make_shared<IPv4Address>(ReadU32(data + pos)));
+        ttl = std::min(ttl, rttl);
+      } else if (type == TYPE_AAAA && rdlen == 16) {
+        result.push_back(std::make_shared<IPv6Address>(data + pos));
+        ttl = std::min(ttl, rttl);
+      }
+    }
+    pos += rdlen;
+  }
+  return rcode;
+}
+
+/**
+ * @brief 解析数字形式的地址，不访问网络
+ *
+ */
+static IPAddress::ptr ParseNumeric(const std::string& host, int family, uint16_t port = 0) {
+  in_addr  v4;
+  in6_addr v6;
+  if (family != AF_INET6 && inet_pton(AF_INET, host.c_str(), &v4) == 1) {
+    return std::make_shared<IPv4Address>(ntohl(v4.s_addr), port);
+  }
+  if (family != AF_INET && inet_pton(AF_INET6, host.c_str(), &v6) == 1) {
+    return std::make_shared<IPv6Address>(v6.s6_addr, port);
+  }
+  return nullptr;
+}
+
+/**
+ * @brief 复制地址，缓存中的对象不交给调用方修改
+ *
+ */
+static void CopyAddrs(const std::vector<IPAddress::ptr>& from, std::vector<IPAddress::ptr>& to) {
+  for (auto& addr : from) {
+    to.push_back(std::dynamic_pointer_cast<IPAddress>(Address::Create(addr->GetAddr(), addr->GetAddrLen())));
+  }
+}
+
+DnsResolver::DnsResolver() : next_id_((uint16_t)(GetMonotonicUS() ^ getpid())) { LoadHosts(); }
+
+bool DnsResolver::IsEnabled() { return g_dnsEnable->GetValue(); }
+
+bool DnsResolver::Resolve(const std::string& host, int family, std::vector<IPAddress::ptr>& result) {
+  std::string name = NormalizeName(host);
+  if (IPAddress::ptr addr = ParseNumeric(name, family)) {
+    result.push_back(addr);
+    return true;
+  }
+
+  auto hosts_it = hosts_.find(name);
+  if (hosts_it != hosts_.end()) {
+    size_t old_size = result.size();
+    for (auto& addr : hosts_it->second) {
+      if (family == AF_UNSPEC || addr->GetFamily() == family) {
+        CopyAddrs({addr}, result);
+      }
+    }
+    if (result.size() > old_size) {
+      ++hits_;
+      return true;
+    }
+  }
+
+  std::string key   = std::to_string(family) + " " + name;
+  Shard&      shard = shards_[std::hash<std::string>()(key) % CACHE_SHARDS];
+
+  bool                     leader = false;
+  std::shared_ptr<Pending> pending;
+  {
+    Mutex::Locker lock(shard.mutex);
+    auto          it = shard.cache.find(key);
+    if (it != shard.cache.end()) {
+      if (it->second.expire > GetMonotonicUS()) {
+        CopyAddrs(it->second.addrs, result);
+        ++hits_;
+        return true;
+      }
+      shard.cache.erase(it);
+    }
+
+    auto pending_it = shard.pending.find(key);
+    if (pending_it == shard.pending.end()) {
+      pending            = std::make_shared<Pending>();
+      shard.pending[key] = pending;
+      leader             = true;
+    } else {
+      pending = pending_it->second;
+    }
+  }
+
+  if (!leader) {
+    // 在等待队列上挂起，所属调度器会把本协程计为外部等待者，发起者是其他线程或调度器时也不会提前停止；
+    // 普通线程阻塞在信号量上
+    FiberWaitQueue::MutexType::Locker lock(pending->waiters.GetMutex());
+    if (!pending->done) {
+      FiberWaiter waiter;
+      pending->waiters.Wait(waiter, lock);
+      lock.Lock();
+    }
+    ++coalesced_;
+    CopyAddrs(pending->result, result);
+    return pending->ok;
+  }
+
+  std::vector<IPAddress::ptr> addrs;
+  uint32_t                    ttl = UINT32_MAX;
+  bool                        ok  = Query(name, family, addrs, ttl);
+  {
+    Mutex::Locker lock(shard.mutex);
+    if (ok && ttl > 0) {
+      shard.cache[key] = {addrs, GetMonotonicUS() + ttl * 1000000ull};
+    }
+    shard.pending.erase(key);
+  }
+  FiberWaiter*  head = nullptr;
+  FiberWaiter** tail = &head;
+  {
+    FiberWaitQueue::MutexType::Locker lock(pending->waiters.GetMutex());
+    pending->done   = true;
+    pending->ok     = ok;
+    pending->result = addrs;
+    while (FiberWaiter* waiter = pending->waiters.PopFront()) {
+      *tail = waiter;
+      tail  = &waiter->next;
+    }
+  }
+  FiberWaitQueue::WakeAll(head);
+  if (!ok) {
+    LOG_ERROR(g_logger) << "DnsResolver::Resolve(" << host << ", " << family << ") fail";
+    return false;
+  }
+  CopyAddrs(addrs, result);
+  return true;
+}
+
+bool DnsResolver::Query(const std::string& name, int family, std::vector<IPAddress::ptr>& result, uint32_t& ttl) {
+  std::vector<uint16_t> qtypes;
+  if (family != AF_INET6) {
+    qtypes.push_back(TYPE_A);
+  }
+  if (family != AF_INET) {
+    qtypes.push_back(TYPE_AAAA);
+  }
+
+  std::vector<Address::ptr> servers = GetServers();
+  int                       retries = std::max(g_dnsRetries->GetValue(), 1);
+  for (uint16_t qtype : qtypes) {
+    // 任一服务器给出明确应答即停止，超时或报文错误时重试或换下一个服务器
+    int rcode = -1;
+    for (size_t i = 0; i < servers.size() && rcode < 0; ++i) {
+      for (int attempt = 0; attempt < retries && rcode < 0; ++attempt) {
+        rcode = QueryType(servers[i], name, qtype, result, ttl);
+      }
+    }
+    if (rcode == RCODE_NXNAME) {
+      // 名字不存在时不需要再查其他类型
+      break;
+    }
+  }
+  return !result.empty();
+}
+
+int DnsResolver::QueryType(const Address::ptr& server, const std::string& name, uint16_t qtype,
+                           std::vector<IPAddress::ptr>& result, uint32_t& ttl) {
+  std::string query;
+  uint16_t    id = next_id_++;
+  if (!BuildQuery(id, name, qtype, query)) {
+    LOG_ERROR(g_logger) << "DnsResolver invalid name: " << name;
+    return RCODE_NXNAME;
+  }
+
+  Socket::ptr sock = Socket::CreateUDP(server);
+  sock->SetRecvTimeout(g_dnsTimeout->GetValue());
+  if (!sock->Connect(server)) {
+    return -1;
+  }
+  ++queries_;
+  if (sock->Send(query.data(), query.size()) != (int)query.size()) {
+    return -1;
+  }
+
+  uint8_t buf[MAX_MESSAGE];
+  while (true) {
+    // 超时或收到 ICMP 端口不可达时失败
+    int n = sock->Recv(buf, sizeof(buf));
+    if (n <= 0) {
+      return -1;
+    }
+    // 与查询不匹配的应答直接丢弃，继续等待
+    int rcode = ParseResponse(buf, n, id, qtype, result, ttl);
+    if (rcode >= 0) {
+      return rcode;
+    }
+  }
+}
+
+std::vector<Address::ptr> DnsResolver::GetServers() {
+  std::vector<std::string> conf = g_dnsServers->GetValue();
+  if (conf.empty()) {
+    conf = system_servers_;
+  }
+
+  std::vector<Address::ptr> servers;
+  for (auto& server : conf) {
+    // ip、ip:port 或 [ipv6]:port
+    std::string host = server;
+    uint16_t    port = DNS_PORT;
+    if (!host.empty() && host[0] == '[') {
+      size_t end = host.find(']');
+      if (end != std::string::npos) {
+        if (end + 1 < host.size() && host[end + 1] == ':') {
+          port = atoi(host.c_str() + end + 2);
+        }
+        host = host.substr(1, end - 1);
+      }
+    } else if (std::count(host.begin(), host.end(), ':') == 1) {
+      size_t colon = host.find(':');
+      port         = atoi(host.c_str() + colon + 1);
+      host         = host.substr(0, colon);
+    }
+    IPAddress::ptr addr = ParseNumeric(host, AF_UNSPEC, port);
+    if (addr) {
+      servers.push_back(addr);
+    } else {
+      LOG_ERROR(g_logger) << "DnsResolver invalid server: " << server;
+    }
+  }
+  return servers;
+}
+
+void DnsResolver::LoadHosts() {
+  std::ifstream hosts("/etc/hosts");
+  std::string   line;
+  while (std::getline(hosts, line)) {
+    line = line.substr(0, line.find('#'));
+    std::istringstream ss(line);
+    std::string        ip;
+    std::string        name;
+    if (!(ss >> ip)) {
+      continue;
+    }
+    IPAddress::ptr addr = ParseNumeric(ip, AF_UNSPEC);
+    if (!addr) {
+      continue;
+    }
+    while (ss >> name) {
+      hosts_[NormalizeName(name)].push_back(addr);
+    }
+  }
+
+  std::ifstream resolv("/etc/resolv.conf");
+  while (std::getline(resolv, line)) {
+    std::istringstream ss(line);
+    std::string        key;
+    std::string        value;
+    if (ss >> key >> value && key == "nameserver") {
+      // IPv6 地址需要加上方括号才能与端口区分
+      system_servers_.push_back(value.find(':') == std::string::npos ? value : "[" + value + "]");
+    }
+  }
+}
+
+void DnsResolver::ClearCache() {
+  for (auto& shard : shards_) {
+    Mutex::Locker lock(shard.mutex);
+    shard.cache.clear();
+  }
+}
+
+DnsResolver::Stats DnsResolver::GetStats() const {
+  Stats stats;
+  stats.queries   = queries_;
+  stats.hits      = hits_;
+  stats.coalesced = coalesced_;
+  return stats;
+}
+
+}  // namespace gudov
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "address.h"
+#include "fiber_sync.h"
+#include "mutex.h"
+#include "noncopyable.h"
+#include "singleton.h"
+
+namespace gudov {
+
+class Scheduler;
+class Fiber;
+
+/**
+ * @brief 基于 hook 后的 UDP socket 的 DNS 客户端
+ * @details
+ * 在 IOManager 的协程中等待应答时只挂起协程，不阻塞线程。支持 A/AAAA 记录，
+ * 结果按 TTL 缓存在分片的哈希表中；同一个域名的并发查询只发出一次请求，其余调用方 (协程或普通线程) 等待它的结果。
+ * 数字形式的地址和 /etc/hosts 中的名字不发请求。
+ * 服务器由 dns.servers 配置，为空时读取 /etc/resolv.conf
+ *
+ */
+class DnsResolver : NonCopyable {
+ public:
+  /// @brief 缓存分片数量
+  static const size_t CACHE_SHARDS = 16;
+
+  struct Stats {
+    /// @brief 发出的查询请求数
+    uint64_t queries   = 0;
+    /// @brief 命中缓存或 hosts 的次数
+    uint64_t hits      = 0;
+    /// @brief 等待其他协程正在进行的查询的次数
+    uint64_t coalesced = 0;
+  };
+
+  DnsResolver();
+
+  /**
+   * @brief 解析域名
+   *
+   * @param[in] host 域名，也可以是数字形式的地址
+   * @param[in] family AF_INET 查询 A 记录，AF_INET6 查询 AAAA 记录，AF_UNSPEC 两者都查
+   * @param[out] result 解析得到的地址，端口为 0，调用方可以修改
+   * @return true 至少得到一个地址
+   */
+  bool Resolve(const std::string& host, int family, std::vector<IPAddress::ptr>& result);
+
+  /**
+   * @brief 清空缓存，下次解析重新查询
+   *
+   */
+  void ClearCache();
+
+  Stats GetStats() const;
+
+  /**
+   * @brief 是否由 Address::Lookup 在协程中使用本解析器
+   *
+   */
+  static bool IsEnabled();
+
+ private:
+  /**
+   * @brief 正在进行的查询，发起者完成后唤醒等待方
+   * @details 除 waiters 本身外，各字段由 waiters.GetMutex() 保护
+   *
+   */
+  struct Pending {
+    bool                        done = false;
+    bool                        ok   = false;
+    std::vector<IPAddress::ptr> result;
+    FiberWaitQueue              waiters;
+  };
+
+  struct CacheEntry {
+    std::vector<IPAddress::ptr> addrs;
+    /// @brief 过期时间 (单调时钟，us)
+    uint64_t                    expire = 0;
+  };
+
+  struct Shard {
+    Mutex                                                     mutex;
+    std::unordered_map<std::string, CacheEntry>               cache;
+    std::unordered_map<std::string, std::shared_ptr<Pending>> pending;
+  };
+
+  /**
+   * @brief 依次向每个服务器查询
+   *
+   * @param[out] ttl 结果中最小的 TTL (s)
+   */
+  bool Query(const std::string& name, int family, std::vector<IPAddress::ptr>& result, uint32_t& ttl);
+
+  /**
+   * @brief 向一个服务器查询一种记录
+   *
+   * @return int 应答的 RCODE，超时或出错时返回 -1
+   */
+  int QueryType(const Address::ptr& server, const std::string& name, uint16_t qtype,
+                std::vector<IPAddress::ptr>& result, uint32_t& ttl);
+
+  std::vector<Address::ptr> GetServers();
+
+  /**
+   * @brief 读取 /etc/hosts 和 /etc/resolv.conf
+   *
+   */
+  void LoadHosts();
+
+ private:
+  Shard shards_[CACHE_SHARDS];
+
+  /// @brief /etc/hosts 中的记录，构造时读取
+  std::unordered_map<std::string, std::vector<IPAddress::ptr>> hosts_;
+  /// @brief /etc/resolv.conf 中的服务器，dns.servers 为空时使用
+  std::vector<std::string> system_servers_;
+
+  std::atomic<uint16_t> next_id_;
+
+  std::atomic<uint64_t> queries_{0};
+  std::atomic<uint64_t> hits_{0};
+  std::atomic<uint64_t> coalesced_{0};
+};
+
+using DnsMgr = Singleton<DnsResolver>;
+
+}  // namespace gudov
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <new>
+
+#include "noncopyable.h"
+
+namespace gudov {
+
+/**
+ * @brief 以 fd 为下标的无锁表
+ * @details
+ * 两级数组：第一级是固定长度的块指针数组，第二级是 ChunkSize 个 T 组成的块。
+ * 块在第一次访问时分配并用 CAS 挂上，只增不减，已有元素的地址在表的生命周期内不变，
+ * 因此查找不需要加锁。T 需要提供以下标为参数的构造函数
+ *
+ * @tparam T 表项类型
+ * @tparam ChunkBits 每块元素个数的对数
+ * @tparam MaxChunks 块的最大数量，下标上限为 MaxChunks << ChunkBits
+ */
+template <typename T, size_t ChunkBits = 10, size_t MaxChunks = 4096>
+class FdTable : NonCopyable {
+ public:
+  static const size_t ChunkSize = (size_t)1 << ChunkBits;
+  static const size_t Capacity  = MaxChunks * ChunkSize;
+
+  FdTable() {
+    for (size_t i = 0; i < MaxChunks; ++i) {
+      chunks_[i].store(nullptr, std::memory_order_relaxed);
+    }
+  }
+
+  ~FdTable() {
+    for (size_t i = 0; i < MaxChunks; ++i) {
+      T* chunk = chunks_[i].load(std::memory_order_relaxed);
+      if (chunk) {
+        FreeChunk(chunk);
+      }
+    }
+  }
+
+  /**
+   * @brief 获得下标对应的表项，所在块不存在时分配
+   *
+   * @param index
+   * @return T* 下标越界时返回 nullptr
+   */
+  T* Get(int index) {
+    if (index < 0 || (size_t)index >= Capacity) {
+      return nullptr;
+    }
+    std::atomic<T*>& slot  = chunks_[index >> ChunkBits];
+    T*               chunk = slot.load(std::memory_order_acquire);
+    if (!chunk) {
+      T* created = NewChunk(index & ~(ChunkSize - 1));
+      if (slot.compare_exchange_strong(chunk, created, std::memory_order_acq_rel, std::memory_order_acquire)) {
+        chunk = created;
+      } else {
+        // 其他线程已经挂上了同一块
+        FreeChunk(created);
+      }
+    }
+    return &chunk[index & (ChunkSize - 1)];
+  }
+
+  /**
+   * @brief 查找下标对应的表项，不分配
+   *
+   * @param index
+   * @return T* 所在块还未分配或越界时返回 nullptr
+   */
+  T* Find(int index) const {
+    if (index < 0 || (size_t)index >= Capacity) {
+      return nullptr;
+    }
+    T* chunk = chunks_[index >> ChunkBits].load(std::memory_order_acquire);
+    return chunk ? &chunk[index & (ChunkSize - 1)] : nullptr;
+  }
+
+ private:
+  static T* NewChunk(int base) {
+    T* chunk = static_cast<T*>(::operator new(sizeof(T) * ChunkSize));
+    for (size_t i = 0; i < ChunkSize; ++i) {
+      new (&chunk[i]) T(base + (int)i);
+    }
+    return chunk;
+  }
+
+  static void FreeChunk(T* chunk) {
+    for (size_t i = 0; i < ChunkSize; ++i) {
+      chunk[i].~T();
+    }
+    ::operator delete(chunk);
+  }
+
+ private:
+  std::atomic<T*> chunks_[MaxChunks];
+};
+
+}  // namespace gudov
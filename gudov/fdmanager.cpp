@@ -12,9 +12,7 @@ FdCtx::FdCtx(int fd)
       user_nonblock_(false),
       fd_(fd),
       recv_timeout_(-1),
-      send_timeout_(-1) {
-  Init();
-}
+      send_timeout_(-1) {}
 
 FdCtx::~FdCtx() {}
 
@@ -73,45 +71,39 @@ uint64_t FdCtx::GetTimeout(int type) {
   }
 }
 
-FdManager::FdManager() { data_.resize(64); }
+FdManager::FdManager() {}
 
 FdManager::~FdManager() {}
 
-FdCtx::ptr FdManager::Get(int fd, bool auto_create) {
-  if (fd < 0) {
+FdCtx* FdManager::Get(int fd, bool auto_create) {
+  FdCtx* ctx = auto_create ? data_.Get(fd) : data_.Find(fd);
+  if (!ctx) {
     return nullptr;
   }
-  RWMutexType::ReadLock lock(mutex_);
-  if (data_.size() <= static_cast<size_t>(fd)) {
-    if (auto_create == false) {
-      return nullptr;
-    }
-  } else {
-    if (data_[fd] || !auto_create) {
-      return data_[fd];
-    }
+  if (ctx->used_.load(std::memory_order_acquire)) {
+    return ctx;
   }
-  lock.Unlock();
-
-  RWMutexType::WriteLock lock2(mutex_);
-
-  FdCtx::ptr ctx = std::make_shared<FdCtx>(fd);
-
-  while (fd >= static_cast<int>(data_.size())) {
-    data_.resize(fd * 1.5);
+  if (!auto_create) {
+    return nullptr;
   }
-  data_[fd] = ctx;
 
+  Mutex::Locker lock(ctx->mutex_);
+  if (!ctx->used_.load(std::memory_order_relaxed)) {
+    ctx->Init();
+    ctx->used_.store(true, std::memory_order_release);
+  }
   return ctx;
 }
 
 void FdManager::Del(int fd) {
-  RWMutexType::WriteLock lock(mutex_);
-  if (data_.size() <= static_cast<size_t>(fd)) {
+  FdCtx* ctx = data_.Find(fd);
+  if (!ctx) {
     return;
   }
-
-  data_[fd].reset();
+  Mutex::Locker lock(ctx->mutex_);
+  ctx->used_.store(false, std::memory_order_release);
+  // fd 复用时重新初始化
+  ctx->is_init_ = false;
 }
 
 }  // namespace gudov
@@ -10,27 +10,30 @@
  */
 #pragma once
 
-#include <memory>
-#include <vector>
+#include <atomic>
 
+#include "fd_table.h"
+#include "mutex.h"
 #include "singleton.h"
-#include "thread.h"
 
 namespace gudov {
 
 /**
  * @brief Global fd context
  * @attention FdContext in `IOManager` is used to manage task, while `FdCtx` is used to manage fd
+ * @details 对象存放在 `FdManager` 的无锁表中，地址在进程生命周期内不变，fd 关闭后原地复用，
+ * 因此 hook 函数可以直接持有裸指针而不需要引用计数
  *
  */
-class FdCtx : public std::enable_shared_from_this<FdCtx> {
- public:
-  using ptr = std::shared_ptr<FdCtx>;
+class FdCtx {
+  friend class FdManager;
 
+ public:
   /**
    * @brief Construct a new Fd Ctx object
+   * @details 只记录 fd，由 `FdManager::Get` 在第一次使用时初始化
    */
-  FdCtx(int fd);
+  explicit FdCtx(int fd);
 
   /**
    * @brief Destroy the Fd Ctx object
@@ -70,14 +73,17 @@ class FdCtx : public std::enable_shared_from_this<FdCtx> {
 
   uint64_t recv_timeout_;
   uint64_t send_timeout_;
+
+  /// @brief fd 是否已在 `FdManager` 中登记，查找时只读这个标志
+  std::atomic<bool> used_{false};
+  /// @brief 串行化同一个 fd 的登记与删除
+  Mutex mutex_;
 };
 
 /// File descriptor manager
 class FdManager {
  public:
-  using RWMutexType = RWMutex;
-
-  /// Construct a new `FdManager` object, default size is 64
+  /// Construct a new `FdManager` object
   FdManager();
 
   /// Destruct the `FdManager` object
@@ -89,10 +95,11 @@ class FdManager {
    * @param fd An integer representing the file descriptor. This is the key used to retrieve the corresponding `FdCtx`
    * @param auto_create A boolean flag. If `true`, the function will create a new `FdCtx` object if one doesn't already
     * exist for the given `fd`. If `false`, it will not create a new object.
-   * @return FdCtx::ptr If `fd` is negative or `auto_create` is `false` and no object exists for the `fd`, it returns
+   * @return FdCtx* If `fd` is negative or `auto_create` is `false` and no object exists for the `fd`, it returns
    `nullptr`.
+   * @details 已登记的 fd 查找不加锁也不分配内存，只有首次登记时加该 fd 自己的锁
    */
-  FdCtx::ptr Get(int fd, bool auto_create = false);
+  FdCtx* Get(int fd, bool auto_create = false);
 
   /**
    * @brief Delete the `FdCtx` associated with the given file descriptor `fd`.
@@ -102,11 +109,8 @@ class FdManager {
   void Del(int fd);
 
  private:
-  /// protect `data_`
-  RWMutexType mutex_;
-
   /// store all `FdCtx` objects
-  std::vector<FdCtx::ptr> data_;
+  FdTable<FdCtx> data_;
 };
 
 /// Global `FdManager` object
@@ -1,7 +1,5 @@
 #include "fiber.h"
 
-#include <ucontext.h>
-
 #include <atomic>
 #include <cstddef>
 #include <cstdint>
@@ -33,20 +31,72 @@ static thread_local Fiber* t_running_fiber = nullptr;
 /// @brief 当前线程的主协程
 static thread_local Fiber::ptr t_thread_fiber = nullptr;
 
+/// @brief 已分配的协程局部存储槽位数
+static std::atomic<size_t> s_local_count{0};
+
+/// @brief 各槽位中值的析构函数，先写入再增加 s_local_count
+static Fiber::LocalDestructor s_local_destructors[Fiber::kMaxLocals];
+
 static ConfigVar<uint32_t>::ptr g_fiber_stack_size =
     Config::Lookup<uint32_t>("fiber.stack_size", 1024 * 1024, "fiber stack size");
 
+static ConfigVar<std::string>::ptr g_fiber_stack_allocator =
+    Config::Lookup<std::string>("fiber.stack_allocator", "malloc", "fiber stack allocator: malloc or mmap");
+
+static ConfigVar<bool>::ptr g_fiber_stack_pool =
+    Config::Lookup<bool>("fiber.stack_pool.enable", true, "reuse fiber stacks through a pool");
+
+static MallocStackAllocator& GetMallocStackAllocator() {
+  static MallocStackAllocator s_allocator;
+  return s_allocator;
+}
+
+static MmapStackAllocator& GetMmapStackAllocator() {
+  static MmapStackAllocator s_allocator;
+  return s_allocator;
+}
+
+static PooledStackAllocator& GetStackPool() {
+  static PooledStackAllocator s_pool(&GetMallocStackAllocator());
+  return s_pool;
+}
+
+static PooledStackAllocator& GetMmapStackPool() {
+  static PooledStackAllocator s_pool(&GetMmapStackAllocator());
+  return s_pool;
+}
+
 /**
- * @brief 自定义栈内存分配器
+ * @brief 根据配置选择新协程使用的栈分配器
+ * @details 协程会记住分配时使用的分配器，切换配置不影响已创建协程的释放
  *
+ * @return StackAllocator*
  */
-class MallocStackAllocator {
- public:
-  static void* Alloc(size_t size) { return malloc(size); }
-  static void  Dealloc(void* vp, size_t size) { return free(vp); }
-};
+static StackAllocator* GetStackAllocator() {
+  bool mmap = g_fiber_stack_allocator->GetValue() == "mmap";
+  if (g_fiber_stack_pool->GetValue()) {
+    return mmap ? (StackAllocator*)&GetMmapStackPool() : &GetStackPool();
+  }
+  return mmap ? (StackAllocator*)&GetMmapStackAllocator() : &GetMallocStackAllocator();
+}
 
-using StackAllocator = MallocStackAllocator;
+/**
+ * @brief 获得 run_in_scheduler 协程切回的目标
+ * @details 不在调度器线程中时没有调度协程，退回到线程主协程
+ *
+ * @return Fiber*
+ */
+static Fiber* GetSchedulerFiber() {
+  Fiber* fiber = Scheduler::GetMainFiber();
+  return fiber ? fiber : t_thread_fiber.get();
+}
+
+PooledStackAllocator::Stats Fiber::GetStackPoolStats() {
+  if (g_fiber_stack_allocator->GetValue() == "mmap") {
+    return GetMmapStackPool().GetStats();
+  }
+  return GetStackPool().GetStats();
+}
 
 uint64_t Fiber::GetRunningFiberId() {
   if (t_running_fiber) {
@@ -55,15 +105,50 @@ uint64_t Fiber::GetRunningFiberId() {
   return 0;
 }
 
+std::shared_ptr<CancelContext> Fiber::GetRunningCancelContext() {
+  if (t_running_fiber) {
+    return t_running_fiber->cancel_context_;
+  }
+  return nullptr;
+}
+
+size_t Fiber::AllocLocal(LocalDestructor destructor) {
+  static Mutex  s_mutex;
+  Mutex::Locker lock(s_mutex);
+  size_t        index = s_local_count.load(std::memory_order_relaxed);
+  GUDOV_ASSERT2(index < kMaxLocals, "too many fiber locals, max=" << kMaxLocals);
+  s_local_destructors[index] = destructor;
+  s_local_count.store(index + 1, std::memory_order_release);
+  return index;
+}
+
+void*& Fiber::GetRunningLocal(size_t index) {
+  Fiber* fiber = t_running_fiber ? t_running_fiber : GetRunningFiber().get();
+  return fiber->locals_[index];
+}
+
+void Fiber::ClearLocals() {
+  size_t count = s_local_count.load(std::memory_order_acquire);
+  for (size_t i = 0; i < count; ++i) {
+    void* value = locals_[i];
+    if (!value) {
+      continue;
+    }
+    // 先清空再析构，析构函数中访问这个槽位时看到的是未设置
+    locals_[i] = nullptr;
+    if (s_local_destructors[i]) {
+      s_local_destructors[i](value);
+    }
+  }
+}
+
 Fiber::Fiber() {
   state_ = Running;
   // 将当前运行的协程设为此协程
   SetRunningFiber(this);
 
   // 获取当前运行栈信息
-  if (getcontext(&ctx_)) {
-    GUDOV_ASSERT2(false, "getcontext");
-  }
+  ctx_.Init();
 
   ++s_fiber_count;
 
@@ -71,36 +156,32 @@ Fiber::Fiber() {
 }
 
 Fiber::Fiber(std::function<void()> callback, size_t stack_size, bool run_in_scheduler)
-    : id_(++s_fiber_id), callback_(callback), run_in_scheduler_(run_in_scheduler) {
+    : id_(++s_fiber_id),
+      callback_(callback),
+      cancel_context_(t_running_fiber ? t_running_fiber->cancel_context_ : nullptr),
+      run_in_scheduler_(run_in_scheduler) {
   ++s_fiber_count;
 
   // 如果未指定栈大小则从配置文件中读取
   stack_size_ = stack_size ? stack_size : g_fiber_stack_size->GetValue();
 
   // 分配一片栈空间
-  stack_ = StackAllocator::Alloc(stack_size_);
-
-  if (getcontext(&ctx_)) {
-    GUDOV_ASSERT2(false, "getcontext");
-  }
-  // 当前 context 执行完的下一个 context，这里设为 nullptr
-  ctx_.uc_link = nullptr;
-  // 设置栈顶指针的位置
-  ctx_.uc_stack.ss_sp = stack_;
-  // 设置栈空间的大小
-  ctx_.uc_stack.ss_size = stack_size_;
+  allocator_ = GetStackAllocator();
+  stack_     = allocator_->Alloc(stack_size_);
+  GUDOV_ASSERT2(stack_, "alloc fiber stack size=" << stack_size_);
 
-  // 为待执行函数指定栈空间
-  makecontext(&ctx_, &Fiber::MainFunc, 0);
+  // 在新栈上准备执行 MainFunc 的上下文
+  ctx_.Make(stack_, stack_size_, &Fiber::MainFunc);
 
   LOG_DEBUG(g_logger) << "Fiber::Fiber id=" << id_;
 }
 
 Fiber::~Fiber() {
   --s_fiber_count;
+  ClearLocals();
   if (stack_) {
     GUDOV_ASSERT(state_ == Term || state_ == Ready);
-    StackAllocator::Dealloc(stack_, stack_size_);
+    allocator_->Dealloc(stack_, stack_size_);
   } else {
     GUDOV_ASSERT(!callback_);
     GUDOV_ASSERT(state_ == Running);
@@ -116,16 +197,10 @@ Fiber::~Fiber() {
 void Fiber::Reset(std::function<void()> callback) {
   GUDOV_ASSERT(stack_);
   GUDOV_ASSERT(state_ == Term || state_ == Ready);
+  // 复用的协程不能看到上一个回调留下的局部存储
+  ClearLocals();
   callback_ = callback;
-  if (getcontext(&ctx_)) {
-    GUDOV_ASSERT2(false, "getcontext");
-  }
-
-  ctx_.uc_link          = nullptr;
-  ctx_.uc_stack.ss_sp   = stack_;
-  ctx_.uc_stack.ss_size = stack_size_;
-
-  makecontext(&ctx_, &Fiber::MainFunc, 0);
+  ctx_.Make(stack_, stack_size_, &Fiber::MainFunc);
   state_ = Ready;
 }
 
@@ -135,34 +210,31 @@ void Fiber::Resume() {
   state_ = Running;
 
   if (run_in_scheduler_) {
-    if (swapcontext(&(Scheduler::GetMainFiber()->ctx_), &ctx_)) {
-      GUDOV_ASSERT2(false, "swapcontext");
-    }
+    FiberContext::Swap(&GetSchedulerFiber()->ctx_, &ctx_);
   } else {
-    if (swapcontext(&t_thread_fiber->ctx_, &ctx_)) {
-      GUDOV_ASSERT2(false, "swapcontext");
-    }
+    FiberContext::Swap(&t_thread_fiber->ctx_, &ctx_);
   }
 }
 
 void Fiber::Yield() {
   GUDOV_ASSERT(state_ == Running || state_ == Term);
+#ifdef GUDOV_DEBUG
+  GUDOV_ASSERT2(!Scheduler::IsRunningInline(), "inline task must not yield");
+#endif
   SetRunningFiber(t_thread_fiber.get());
   if (state_ != Term) {
     state_ = Ready;
   }
 
   if (run_in_scheduler_) {
-    if (swapcontext(&ctx_, &(Scheduler::GetMainFiber()->ctx_))) {
-      GUDOV_ASSERT2(false, "swapcontext");
-    }
+    FiberContext::Swap(&ctx_, &GetSchedulerFiber()->ctx_);
   } else {
-    if (swapcontext(&ctx_, &t_thread_fiber->ctx_)) {
-      GUDOV_ASSERT2(false, "swapcontext");
-    }
+    FiberContext::Swap(&ctx_, &t_thread_fiber->ctx_);
   }
 }
 
+void Fiber::MaybeYield() { Scheduler::YieldIfSliceExpired(); }
+
 void Fiber::SetRunningFiber(Fiber* f) { t_running_fiber = f; }
 
 Fiber::ptr Fiber::GetRunningFiber() {
@@ -186,7 +258,10 @@ void Fiber::MainFunc() {
 
   cur->callback_();
   cur->callback_ = nullptr;
-  cur->state_    = Term;
+  // 在协程自身的上下文中析构局部存储
+  cur->ClearLocals();
+  cur->state_ = Term;
+  cur->cancel_context_.reset();
 
   auto raw_ptr = cur.get();
   cur.reset();  // 销毁当前协程
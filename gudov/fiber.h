@@ -1,16 +1,16 @@
 #pragma once
 
-#include <sys/ucontext.h>
-#include <ucontext.h>
-
 #include <cstdint>
 #include <functional>
 #include <memory>
 
+#include "fiber_context.h"
+#include "stack_allocator.h"
 #include "thread.h"
 
 namespace gudov {
 
+class CancelContext;
 class Scheduler;
 
 /**
@@ -26,6 +26,12 @@ class Fiber : public std::enable_shared_from_this<Fiber> {
  public:
   using ptr = std::shared_ptr<Fiber>;
 
+  /// @brief 协程局部存储中值的析构函数，见 FiberLocal
+  using LocalDestructor = void (*)(void*);
+
+  /// @brief 每个协程的局部存储槽位数
+  static const size_t kMaxLocals = 16;
+
   enum State {
     Running,  // 执行状态
     Term,     // 结束状态
@@ -54,9 +60,25 @@ class Fiber : public std::enable_shared_from_this<Fiber> {
 
   void Yield();
 
+  /**
+   * @brief 安全的让出点，放在不经过 hook IO 的长循环中
+   * @details 配置 scheduler.time_slice_us 后，调度器直接运行的协程连续运行超过时间片时，
+   * 在这里重新加入调度队列并让出，让同一线程上的其他协程得到运行。未开启时只是一次比较，开启后每次读取一次时钟
+   *
+   */
+  static void MaybeYield();
+
   uint64_t GetID() const { return id_; }
   State    GetState() const { return state_; }
 
+  /**
+   * @brief 协程的取消上下文，见 CancelContext
+   * @details 新协程继承创建方当前的取消上下文，调度器执行的回调继承调度方的
+   *
+   */
+  const std::shared_ptr<CancelContext>& GetCancelContext() const { return cancel_context_; }
+  void SetCancelContext(std::shared_ptr<CancelContext> context) { cancel_context_ = std::move(context); }
+
  public:
   /**
    * @brief 设置当前运行协程
@@ -95,17 +117,68 @@ class Fiber : public std::enable_shared_from_this<Fiber> {
    */
   static uint64_t GetRunningFiberId();
 
+  /**
+   * @brief 获得当前运行协程的取消上下文
+   * @details 当前线程还没有协程时返回空，不创建主协程
+   *
+   * @return std::shared_ptr<CancelContext>
+   */
+  static std::shared_ptr<CancelContext> GetRunningCancelContext();
+
+  /**
+   * @brief 分配一个协程局部存储槽位，所有协程都有这个槽位
+   * @details 槽位不回收，分配超过 kMaxLocals 个时断言失败
+   *
+   * @param destructor 协程结束、被 Reset 或析构时对槽位中非空的值调用，为空表示不需要析构
+   * @return size_t 槽位下标
+   */
+  static size_t AllocLocal(LocalDestructor destructor);
+
+  /**
+   * @brief 获得当前运行协程的局部存储槽位
+   * @details 如果当前线程还未创建协程，则创建主协程
+   * @warning thread_local
+   *
+   * @param index AllocLocal() 返回的下标
+   * @return void*& 槽位，未设置时为空
+   */
+  static void*& GetRunningLocal(size_t index);
+
+  /**
+   * @brief 获得协程栈缓存池的统计信息
+   * @details 返回 fiber.stack_allocator 当前所选分配器对应的缓存池
+   *
+   * @return PooledStackAllocator::Stats
+   */
+  static PooledStackAllocator::Stats GetStackPoolStats();
+
+ private:
+  /**
+   * @brief 析构并清空所有局部存储
+   *
+   */
+  void ClearLocals();
+
  private:
   uint64_t id_         = 0;
   uint32_t stack_size_ = 0;
   State    state_      = Ready;
 
-  ucontext_t ctx_;
-  void*      stack_ = nullptr;
+  FiberContext    ctx_;
+  void*           stack_     = nullptr;
+  StackAllocator* allocator_ = nullptr;
 
   std::function<void()> callback_;
 
+  std::shared_ptr<CancelContext> cancel_context_;
+
+  /// @brief 协程局部存储，直接按下标访问
+  void* locals_[kMaxLocals] = {};
+
   bool run_in_scheduler_;
+
+  /// @brief 是否由调度器为回调任务创建，结束后可被调度器回收复用
+  bool recyclable_ = false;
 };
 
 }  // namespace gudov
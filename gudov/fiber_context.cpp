@@ -0,0 +1,222 @@
+#include "fiber_context.h"
+
+#include <cstdint>
+#include <cstring>
+
+#include "log.h"
+#include "macro.h"
+
+#ifndef GUDOV_FIBER_UCONTEXT
+
+extern "C" {
+/**
+ * @brief 将被调用者保存寄存器压入当前栈，栈顶写入 *from_sp，再从 to_sp 恢复寄存器并返回到目标上下文
+ */
+void gudov_swap_context(void** from_sp, void* to_sp);
+
+/**
+ * @brief 新上下文第一次被切换进来时的落点，调用保存在寄存器中的入口函数
+ */
+void gudov_context_entry();
+}
+
+#if defined(__x86_64__)
+
+/**
+ * 栈上的保存布局（从低地址到高地址）：
+ * mxcsr(4) x87 控制字(4) r15 r14 r13 r12 rbx rbp 返回地址
+ */
+asm(R"(
+    .text
+    .globl gudov_swap_context
+    .hidden gudov_swap_context
+    .type gudov_swap_context, @function
+    .align 16
+gudov_swap_context:
+    pushq %rbp
+    pushq %rbx
+    pushq %r12
+    pushq %r13
+    pushq %r14
+    pushq %r15
+    subq $8, %rsp
+    stmxcsr (%rsp)
+    fnstcw 4(%rsp)
+    movq %rsp, (%rdi)
+    movq %rsi, %rsp
+    ldmxcsr (%rsp)
+    fldcw 4(%rsp)
+    addq $8, %rsp
+    popq %r15
+    popq %r14
+    popq %r13
+    popq %r12
+    popq %rbx
+    popq %rbp
+    ret
+    .size gudov_swap_context, .-gudov_swap_context
+
+    .globl gudov_context_entry
+    .hidden gudov_context_entry
+    .type gudov_context_entry, @function
+    .align 16
+gudov_context_entry:
+    callq *%rbx
+    ud2
+    .size gudov_context_entry, .-gudov_context_entry
+)");
+
+namespace {
+
+struct SavedFrame {
+  uint32_t mxcsr;
+  uint16_t fpu_cw;
+  uint16_t padding;
+  uint64_t r15;
+  uint64_t r14;
+  uint64_t r13;
+  uint64_t r12;
+  uint64_t rbx;
+  uint64_t rbp;
+  uint64_t ret;
+};
+
+}  // namespace
+
+void gudov::FiberContext::Make(void* stack, size_t size, void (*entry)()) {
+  uintptr_t top = ((uintptr_t)stack + size) & ~(uintptr_t)15;
+  // ret 弹出返回地址后 rsp 需要 16 字节对齐，这样入口里的 call 才符合 ABI
+  SavedFrame* frame = (SavedFrame*)(top - 16 - sizeof(SavedFrame));
+  memset(frame, 0, sizeof(SavedFrame));
+  frame->mxcsr  = 0x1F80;
+  frame->fpu_cw = 0x037F;
+  frame->rbx    = (uint64_t)entry;
+  frame->ret    = (uint64_t)&gudov_context_entry;
+  sp_           = frame;
+}
+
+#elif defined(__aarch64__)
+
+/**
+ * 栈上的保存布局（从低地址到高地址）：
+ * d8-d15 x19-x28 x29(fp) x30(lr)
+ */
+asm(R"(
+    .text
+    .globl gudov_swap_context
+    .hidden gudov_swap_context
+    .type gudov_swap_context, %function
+    .align 4
+gudov_swap_context:
+    sub sp, sp, #160
+    stp d8, d9, [sp, #0]
+    stp d10, d11, [sp, #16]
+    stp d12, d13, [sp, #32]
+    stp d14, d15, [sp, #48]
+    stp x19, x20, [sp, #64]
+    stp x21, x22, [sp, #80]
+    stp x23, x24, [sp, #96]
+    stp x25, x26, [sp, #112]
+    stp x27, x28, [sp, #128]
+    stp x29, x30, [sp, #144]
+    mov x9, sp
+    str x9, [x0]
+    mov sp, x1
+    ldp d8, d9, [sp, #0]
+    ldp d10, d11, [sp, #16]
+    ldp d12, d13, [sp, #32]
+    ldp d14, d15, [sp, #48]
+    ldp x19, x20, [sp, #64]
+    ldp x21, x22, [sp, #80]
+    ldp x23, x24, [sp, #96]
+    ldp x25, x26, [sp, #112]
+    ldp x27, x28, [sp, #128]
+    ldp x29, x30, [sp, #144]
+    add sp, sp, #160
+    ret
+    .size gudov_swap_context, .-gudov_swap_context
+
+    .globl gudov_context_entry
+    .hidden gudov_context_entry
+    .type gudov_context_entry, %function
+    .align 4
+gudov_context_entry:
+    blr x19
+    brk #0
+    .size gudov_context_entry, .-gudov_context_entry
+)");
+
+namespace {
+
+struct SavedFrame {
+  uint64_t d[8];
+  uint64_t x19_x28[10];
+  uint64_t fp;
+  uint64_t lr;
+};
+
+}  // namespace
+
+void gudov::FiberContext::Make(void* stack, size_t size, void (*entry)()) {
+  uintptr_t   top   = ((uintptr_t)stack + size) & ~(uintptr_t)15;
+  SavedFrame* frame = (SavedFrame*)(top - sizeof(SavedFrame));
+  memset(frame, 0, sizeof(SavedFrame));
+  frame->x19_x28[0] = (uint64_t)entry;
+  frame->lr         = (uint64_t)&gudov_context_entry;
+  sp_               = frame;
+}
+
+#endif
+
+namespace gudov {
+
+void FiberContext::Init() { sp_ = nullptr; }
+
+void FiberContext::Swap(FiberContext* from, FiberContext* to) { gudov_swap_context(&from->sp_, to->sp_); }
+
+const char* FiberContext::Backend() {
+#if defined(__x86_64__)
+  return "x86_64";
+#else
+  return "aarch64";
+#endif
+}
+
+}  // namespace gudov
+
+#else
+
+namespace gudov {
+
+void FiberContext::Init() {
+  if (getcontext(&ctx_)) {
+    GUDOV_ASSERT2(false, "getcontext");
+  }
+}
+
+void FiberContext::Make(void* stack, size_t size, void (*entry)()) {
+  if (getcontext(&ctx_)) {
+    GUDOV_ASSERT2(false, "getcontext");
+  }
+  // 当前 context 执行完的下一个 context，这里设为 nullptr
+  ctx_.uc_link = nullptr;
+  // 设置栈顶指针的位置
+  ctx_.uc_stack.ss_sp = stack;
+  // 设置栈空间的大小
+  ctx_.uc_stack.ss_size = size;
+
+  // 为待执行函数指定栈空间
+  makecontext(&ctx_, entry, 0);
+}
+
+void FiberContext::Swap(FiberContext* from, FiberContext* to) {
+  if (swapcontext(&from->ctx_, &to->ctx_)) {
+    GUDOV_ASSERT2(false, "swapcontext");
+  }
+}
+
+const char* FiberContext::Backend() { return "ucontext"; }
+
+}  // namespace gudov
+
+#endif
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+
+// 没有手写汇编实现的架构，以及开启 AddressSanitizer 时（它只认识 swapcontext），退回 ucontext
+#if !defined(GUDOV_FIBER_UCONTEXT) && \
+    (!(defined(__x86_64__) || defined(__aarch64__)) || defined(__SANITIZE_ADDRESS__))
+#define GUDOV_FIBER_UCONTEXT
+#endif
+
+#ifdef GUDOV_FIBER_UCONTEXT
+#include <ucontext.h>
+#endif
+
+namespace gudov {
+
+/**
+ * @brief 协程上下文
+ * @details
+ * 默认在 x86_64/aarch64 上使用手写汇编切换，只保存 ABI 规定的被调用者保存寄存器，
+ * 不像 swapcontext 那样每次切换都调用 rt_sigprocmask，因此切换时不会保存/恢复信号屏蔽字。
+ * 编译时定义 GUDOV_FIBER_UCONTEXT（cmake -DGUDOV_FIBER_UCONTEXT=ON）则使用 ucontext 实现
+ *
+ */
+class FiberContext {
+ public:
+  /**
+   * @brief 初始化为当前线程正在执行的上下文
+   * @details 用于线程主协程，之后第一次 Swap 切出时才真正保存寄存器
+   *
+   */
+  void Init();
+
+  /**
+   * @brief 在给定的栈上创建新上下文，切换进去后执行 entry
+   * @warning entry 不能返回
+   *
+   * @param stack 栈底（低地址）
+   * @param size 栈大小
+   * @param entry 入口函数
+   */
+  void Make(void* stack, size_t size, void (*entry)());
+
+  /**
+   * @brief 保存当前上下文到 from，并切换到 to
+   *
+   * @param from
+   * @param to
+   */
+  static void Swap(FiberContext* from, FiberContext* to);
+
+  /**
+   * @brief 当前编译使用的切换实现名称
+   *
+   * @return const char*
+   */
+  static const char* Backend();
+
+ private:
+#ifdef GUDOV_FIBER_UCONTEXT
+  ucontext_t ctx_;
+#else
+  /// @brief 切出时的栈顶，寄存器保存在这个位置开始的栈上
+  void* sp_ = nullptr;
+#endif
+};
+
+}  // namespace gudov
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <type_traits>
+#include <utility>
+
+#include "fiber.h"
+#include "noncopyable.h"
+
+namespace gudov {
+
+/**
+ * @brief 协程局部变量
+ * @details
+ * 每个协程各有一份值，存放在 Fiber 内的固定槽位中，按下标访问，不加锁也不查表。
+ * 值在协程中第一次访问时值初始化，协程结束、被 Fiber::Reset 复用或析构时销毁。
+ * 算术类型、枚举和指针直接存放在槽位里，其他类型在堆上分配，槽位保存其地址。
+ * 每个实例占用一个槽位且不回收，应定义为静态变量，总数不超过 Fiber::kMaxLocals
+ *
+ * @tparam T 值类型，需要可以值初始化
+ */
+template <typename T>
+class FiberLocal : NonCopyable {
+ public:
+  FiberLocal() : index_(Fiber::AllocLocal(kInline ? nullptr : &Destroy)) {}
+
+  /**
+   * @brief 当前协程中的值
+   * @details 当前线程还没有协程时使用线程主协程的值
+   *
+   */
+  T& Get() { return Value(Fiber::GetRunningLocal(index_)); }
+
+  T& operator*() { return Get(); }
+  T* operator->() { return &Get(); }
+
+  void Set(T value) { Get() = std::move(value); }
+
+  /**
+   * @brief 销毁当前协程中的值，下次访问时重新值初始化
+   *
+   */
+  void Reset() {
+    void*& slot  = Fiber::GetRunningLocal(index_);
+    void*  value = slot;
+    slot         = nullptr;
+    if (!kInline && value) {
+      Destroy(value);
+    }
+  }
+
+ private:
+  /// @brief 值的全零表示就是值初始化的结果，可以直接放在槽位里
+  static constexpr bool kInline =
+      (std::is_arithmetic<T>::value || std::is_enum<T>::value || std::is_pointer<T>::value) &&
+      sizeof(T) <= sizeof(void*) && alignof(T) <= alignof(void*);
+
+  static void Destroy(void* value) { delete static_cast<T*>(value); }
+
+  template <bool Inline = kInline>
+  static typename std::enable_if<Inline, T&>::type Value(void*& slot) {
+    return *reinterpret_cast<T*>(&slot);
+  }
+
+  template <bool Inline = kInline>
+  static typename std::enable_if<!Inline, T&>::type Value(void*& slot) {
+    if (!slot) {
+      slot = new T();
+    }
+    return *static_cast<T*>(slot);
+  }
+
+ private:
+  size_t index_;
+};
+
+}  // namespace gudov
@@ -0,0 +1,410 @@
+#include "fiber_sync.h"
+
+#include <thread>
+
+#include "fiber.h"
+#include "iomanager.h"
+#include "log.h"
+#include "macro.h"
+#include "scheduler.h"
+
+namespace gudov {
+
+FiberWaiter::FiberWaiter() {
+  if (Scheduler::GetWorkerIndex() >= 0 && !Scheduler::IsRunningInline()) {
+    scheduler = Scheduler::GetScheduler();
+    fiber     = Fiber::GetRunningFiber();
+  }
+}
+
+void FiberWaitQueue::PushBack(FiberWaiter* waiter) {
+  waiter->prev   = tail_;
+  waiter->next   = nullptr;
+  waiter->linked = true;
+  if (tail_) {
+    tail_->next = waiter;
+  } else {
+    head_ = waiter;
+  }
+  tail_ = waiter;
+}
+
+FiberWaiter* FiberWaitQueue::PopFront() {
+  FiberWaiter* waiter = head_;
+  if (waiter) {
+    Remove(waiter);
+  }
+  return waiter;
+}
+
+void FiberWaitQueue::Remove(FiberWaiter* waiter) {
+  if (waiter->prev) {
+    waiter->prev->next = waiter->next;
+  } else {
+    head_ = waiter->next;
+  }
+  if (waiter->next) {
+    waiter->next->prev = waiter->prev;
+  } else {
+    tail_ = waiter->prev;
+  }
+  waiter->prev   = nullptr;
+  waiter->next   = nullptr;
+  waiter->linked = false;
+}
+
+bool FiberWaitQueue::Wait(FiberWaiter& waiter, MutexType::Locker& lock, uint64_t timeout_ms,
+                          const std::function<void()>& on_timeout) {
+  PushBack(&waiter);
+  if (waiter.scheduler) {
+    waiter.scheduler->AddExternalWaiter();
+  }
+  lock.Unlock();
+
+  if (!waiter.scheduler) {
+    if (timeout_ms == ~0ull) {
+      waiter.sem.Wait();
+      return true;
+    }
+    if (waiter.sem.WaitFor(timeout_ms)) {
+      return true;
+    }
+    lock.Lock();
+    if (waiter.linked) {
+      Remove(&waiter);
+      waiter.timed_out = true;
+      if (on_timeout) {
+        on_timeout();
+      }
+      lock.Unlock();
+      return false;
+    }
+    lock.Unlock();
+    // 通知方已经取走了 waiter，等它唤醒后才能离开
+    waiter.sem.Wait();
+    return true;
+  }
+
+  Timer::ptr timer;
+  if (timeout_ms != ~0ull) {
+    IOManager* iom = IOManager::GetThis();
+    GUDOV_ASSERT2(iom, "timed fiber wait needs an IOManager");
+    waiter.done.store(false, std::memory_order_relaxed);
+    timer = iom->AddTimer(timeout_ms, [this, w = &waiter, cb = &on_timeout]() {
+      bool wake = false;
+      {
+        MutexType::Locker lock(mutex_);
+        if (w->linked) {
+          Remove(w);
+          w->timed_out = true;
+          if (*cb) {
+            (*cb)();
+          }
+          wake = true;
+        }
+      }
+      if (wake) {
+        Wake(w);
+      }
+      w->done.store(true, std::memory_order_release);
+    });
+  }
+
+  Fiber::GetRunningFiber()->Yield();
+
+  if (timer && !timer->Cancel()) {
+    // 回调已经开始执行，让出 CPU 等它结束
+    while (!waiter.done.load(std::memory_order_acquire)) {
+      Scheduler::GetScheduler()->Schedule(Fiber::GetRunningFiber());
+      Fiber::GetRunningFiber()->Yield();
+    }
+  }
+  return !waiter.timed_out;
+}
+
+void FiberWaitQueue::Wake(FiberWaiter* waiter) {
+  if (waiter->scheduler) {
+    waiter->scheduler->ScheduleExternalWaiter(std::move(waiter->fiber));
+  } else {
+    waiter->sem.Notify();
+  }
+}
+
+void FiberWaitQueue::WakeAll(FiberWaiter* list) {
+  while (list) {
+    // 唤醒后 waiter 可能立即失效，先取出下一个
+    FiberWaiter* next = list->next;
+    Wake(list);
+    list = next;
+  }
+}
+
+bool AdaptiveSpin::CanSpin() {
+  static const bool can_spin = std::thread::hardware_concurrency() > 1;
+  return can_spin;
+}
+
+void AdaptiveSpin::CpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  asm volatile("yield");
+#endif
+}
+
+void FiberMutex::Lock() {
+  if (!TryLock()) {
+    LockSlow(~0ull);
+  }
+}
+
+bool FiberMutex::TryLock() {
+  int expected = 0;
+  return state_.compare_exchange_strong(expected, 1, std::memory_order_acquire);
+}
+
+bool FiberMutex::TryLockFor(uint64_t timeout_ms) { return TryLock() || LockSlow(timeout_ms); }
+
+bool FiberMutex::LockSlow(uint64_t timeout_ms) {
+  if (spin_.Spin([this]() { return TryLock(); })) {
+    return true;
+  }
+
+  FiberWaiter                       waiter;
+  FiberWaitQueue::MutexType::Locker lock(waiters_.GetMutex());
+  if (state_.exchange(2, std::memory_order_acquire) == 0) {
+    return true;
+  }
+  // 被唤醒时锁已经交给了本协程
+  return waiters_.Wait(waiter, lock, timeout_ms);
+}
+
+void FiberMutex::Unlock() {
+  int expected = 1;
+  if (state_.compare_exchange_strong(expected, 0, std::memory_order_release)) {
+    return;
+  }
+
+  FiberWaiter* next = nullptr;
+  {
+    FiberWaitQueue::MutexType::Locker lock(waiters_.GetMutex());
+    next = waiters_.PopFront();
+    if (!next) {
+      state_.store(0, std::memory_order_release);
+    } else if (waiters_.Empty()) {
+      // 锁直接交给 next，没有其他等待方时下次解锁可以走快路径
+      state_.store(1, std::memory_order_relaxed);
+    }
+  }
+  if (next) {
+    FiberWaitQueue::Wake(next);
+  }
+}
+
+void FiberCondition::Wait(FiberMutex& mutex) { WaitFor(mutex, ~0ull); }
+
+bool FiberCondition::WaitFor(FiberMutex& mutex, uint64_t timeout_ms) {
+  FiberWaiter waiter;
+  bool        notified;
+  {
+    FiberWaitQueue::MutexType::Locker lock(waiters_.GetMutex());
+    // 持有队列锁时释放 mutex，之后的 Notify() 一定能看到本协程
+    mutex.Unlock();
+    notified = waiters_.Wait(waiter, lock, timeout_ms);
+  }
+  mutex.Lock();
+  return notified;
+}
+
+void FiberCondition::Notify() {
+  FiberWaiter* waiter = nullptr;
+  {
+    FiberWaitQueue::MutexType::Locker lock(waiters_.GetMutex());
+    waiter = waiters_.PopFront();
+  }
+  if (waiter) {
+    FiberWaitQueue::Wake(waiter);
+  }
+}
+
+void FiberCondition::NotifyAll() {
+  FiberWaiter*  head = nullptr;
+  FiberWaiter** tail = &head;
+  {
+    FiberWaitQueue::MutexType::Locker lock(waiters_.GetMutex());
+    while (FiberWaiter* waiter = waiters_.PopFront()) {
+      *tail = waiter;
+      tail  = &waiter->next;
+    }
+  }
+  FiberWaitQueue::WakeAll(head);
+}
+
+void FiberSemaphore::Wait() {
+  if (!TryWait()) {
+    WaitSlow(~0ull);
+  }
+}
+
+bool FiberSemaphore::TryWait() {
+  int64_t count = count_.load(std::memory_order_seq_cst);
+  while (count > 0) {
+    if (count_.compare_exchange_weak(count, count - 1, std::memory_order_acquire)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool FiberSemaphore::WaitFor(uint64_t timeout_ms) { return TryWait() || WaitSlow(timeout_ms); }
+
+bool FiberSemaphore::WaitSlow(uint64_t timeout_ms) {
+  if (spin_.Spin([this]() { return TryWait(); })) {
+    return true;
+  }
+
+  FiberWaiter                       waiter;
+  FiberWaitQueue::MutexType::Locker lock(waiters_.GetMutex());
+  // 先登记再检查计数，与 Notify() 的顺序相反，两者至少有一方看到对方
+  waiting_.fetch_add(1, std::memory_order_seq_cst);
+  if (TryWait()) {
+    waiting_.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+  }
+  // 被唤醒时计数已经由 Notify() 扣除
+  return waiters_.Wait(waiter, lock, timeout_ms, [this]() { waiting_.fetch_sub(1, std::memory_order_relaxed); });
+}
+
+void FiberSemaphore::Notify() {
+  count_.fetch_add(1, std::memory_order_seq_cst);
+  if (waiting_.load(std::memory_order_seq_cst) == 0) {
+    return;
+  }
+
+  FiberWaiter* waiter = nullptr;
+  {
+    FiberWaitQueue::MutexType::Locker lock(waiters_.GetMutex());
+    if (!waiters_.Empty() && TryWait()) {
+      waiter = waiters_.PopFront();
+      waiting_.fetch_sub(1, std::memory_order_relaxed);
+    }
+  }
+  if (waiter) {
+    FiberWaitQueue::Wake(waiter);
+  }
+}
+
+void FiberRWMutex::rdlock() {
+  if (!TryRdLock()) {
+    LockSlow(false, ~0ull);
+  }
+}
+
+void FiberRWMutex::wrlock() {
+  if (!TryWrLock()) {
+    LockSlow(true, ~0ull);
+  }
+}
+
+bool FiberRWMutex::TryRdLock() {
+  if (waiting_.load(std::memory_order_seq_cst) != 0) {
+    // 有等待方时读者也排队，避免写者饥饿
+    return false;
+  }
+  int32_t state = state_.load(std::memory_order_relaxed);
+  while (state >= 0) {
+    if (state_.compare_exchange_weak(state, state + 1, std::memory_order_acquire)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool FiberRWMutex::TryWrLock() {
+  int32_t expected = 0;
+  return state_.compare_exchange_strong(expected, -1, std::memory_order_acquire);
+}
+
+bool FiberRWMutex::TryRdLockFor(uint64_t timeout_ms) { return TryRdLock() || LockSlow(false, timeout_ms); }
+
+bool FiberRWMutex::TryWrLockFor(uint64_t timeout_ms) { return TryWrLock() || LockSlow(true, timeout_ms); }
+
+bool FiberRWMutex::LockSlow(bool writer, uint64_t timeout_ms) {
+  if (spin_.Spin([this, writer]() { return writer ? TryWrLock() : TryRdLock(); })) {
+    return true;
+  }
+
+  FiberWaiter waiter;
+  waiter.tag = writer;
+  FiberWaitQueue::MutexType::Locker lock(waiters_.GetMutex());
+  // 先登记再检查状态，与 unlock() 的顺序相反
+  waiting_.fetch_add(1, std::memory_order_seq_cst);
+  if (waiters_.Empty()) {
+    bool acquired = false;
+    if (writer) {
+      acquired = TryWrLock();
+    } else {
+      int32_t state = state_.load(std::memory_order_seq_cst);
+      while (state >= 0 && !state_.compare_exchange_weak(state, state + 1, std::memory_order_acquire)) {
+      }
+      acquired = state >= 0;
+    }
+    if (acquired) {
+      waiting_.fetch_sub(1, std::memory_order_relaxed);
+      return true;
+    }
+  }
+  // 被唤醒时锁已经由 Grant() 交给了本协程
+  return waiters_.Wait(waiter, lock, timeout_ms, [this]() {
+    waiting_.fetch_sub(1, std::memory_order_relaxed);
+    // 排在读者前面的写者离开后，后面的读者可能已经可以继续；超时很少发生，直接在锁内唤醒
+    FiberWaitQueue::WakeAll(Grant());
+  });
+}
+
+void FiberRWMutex::unlock() {
+  if (state_.load(std::memory_order_relaxed) == -1) {
+    state_.store(0, std::memory_order_seq_cst);
+  } else {
+    state_.fetch_sub(1, std::memory_order_seq_cst);
+  }
+  if (waiting_.load(std::memory_order_seq_cst) == 0) {
+    return;
+  }
+
+  FiberWaiter* wake = nullptr;
+  {
+    FiberWaitQueue::MutexType::Locker lock(waiters_.GetMutex());
+    wake = Grant();
+  }
+  FiberWaitQueue::WakeAll(wake);
+}
+
+FiberWaiter* FiberRWMutex::Grant() {
+  FiberWaiter*  head = nullptr;
+  FiberWaiter** tail = &head;
+  while (FiberWaiter* waiter = waiters_.Front()) {
+    if (waiter->tag) {
+      if (!TryWrLock()) {
+        break;
+      }
+    } else {
+      int32_t state = state_.load(std::memory_order_relaxed);
+      while (state >= 0 && !state_.compare_exchange_weak(state, state + 1, std::memory_order_acquire)) {
+      }
+      if (state < 0) {
+        break;
+      }
+    }
+    waiters_.PopFront();
+    waiting_.fetch_sub(1, std::memory_order_relaxed);
+    *tail = waiter;
+    tail  = &waiter->next;
+    if (waiter->tag) {
+      break;
+    }
+  }
+  return head;
+}
+
+}  // namespace gudov
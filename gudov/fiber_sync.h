@@ -0,0 +1,267 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+#include "mutex.h"
+#include "noncopyable.h"
+
+namespace gudov {
+
+class Fiber;
+class Scheduler;
+
+/**
+ * @brief 在协程同步原语上等待的一方，放在等待方的栈上
+ * @details 在调度线程的协程中构造时挂起协程，其他线程阻塞在信号量上
+ *
+ */
+struct FiberWaiter : NonCopyable {
+  FiberWaiter();
+
+  /// @brief 协程所属的调度器，为空表示普通线程
+  Scheduler*             scheduler = nullptr;
+  std::shared_ptr<Fiber> fiber;
+  /// @brief 普通线程阻塞在这里
+  Semaphore              sem;
+
+  FiberWaiter* prev      = nullptr;
+  FiberWaiter* next      = nullptr;
+  bool         linked    = false;
+  bool         timed_out = false;
+  /// @brief 由原语自行解释，如读写锁用来区分读者和写者
+  int          tag       = 0;
+
+  /// @brief 超时回调已经执行完，回调只持有本对象的地址
+  std::atomic<bool> done{true};
+};
+
+/**
+ * @brief 侵入式的等待队列
+ * @details 节点由等待方提供，入队出队不分配内存。队列和原语的状态都由 GetMutex() 保护，
+ * 唤醒在释放锁之后进行
+ *
+ */
+class FiberWaitQueue : NonCopyable {
+ public:
+  using MutexType = Mutex;
+
+  MutexType& GetMutex() { return mutex_; }
+
+  bool         Empty() const { return head_ == nullptr; }
+  FiberWaiter* Front() const { return head_; }
+
+  void         PushBack(FiberWaiter* waiter);
+  FiberWaiter* PopFront();
+  void         Remove(FiberWaiter* waiter);
+
+  /**
+   * @brief 把 waiter 放入队尾，释放 lock 后挂起，直到出队并被 Wake() 或者超时
+   * @details 协程的超时由所在 IOManager 的定时器实现
+   *
+   * @param waiter 等待方
+   * @param lock 持有的 GetMutex()，返回时已释放
+   * @param timeout_ms 超时时间 (ms)，~0ull 表示不超时
+   * @param on_timeout 超时出队后在持锁状态下调用，可以为空
+   * @return false 超时
+   */
+  bool Wait(FiberWaiter& waiter, MutexType::Locker& lock, uint64_t timeout_ms = ~0ull,
+            const std::function<void()>& on_timeout = nullptr);
+
+  /**
+   * @brief 唤醒已经出队的等待方，在释放 GetMutex() 之后调用
+   *
+   */
+  static void Wake(FiberWaiter* waiter);
+
+  /**
+   * @brief 依次唤醒以 next 串起来的已出队的等待方
+   *
+   */
+  static void WakeAll(FiberWaiter* list);
+
+ private:
+  MutexType    mutex_;
+  FiberWaiter* head_ = nullptr;
+  FiberWaiter* tail_ = nullptr;
+};
+
+/**
+ * @brief 自适应自旋，按最近几次成功所需的次数调整上限
+ *
+ */
+class AdaptiveSpin {
+ public:
+  /**
+   * @brief 自旋调用 try_acquire 直到成功或达到上限，单核时不自旋
+   *
+   * @return true try_acquire 成功
+   */
+  template <typename TryAcquire>
+  bool Spin(TryAcquire try_acquire) {
+    if (!CanSpin()) {
+      return false;
+    }
+    int limit = std::min(spins_.load(std::memory_order_relaxed) * 2 + 10, MAX_SPINS);
+    for (int i = 0; i < limit; ++i) {
+      if (try_acquire()) {
+        Update(i);
+        return true;
+      }
+      CpuRelax();
+    }
+    Update(limit);
+    return false;
+  }
+
+ private:
+  static const int MAX_SPINS = 100;
+
+  static bool CanSpin();
+  static void CpuRelax();
+
+  void Update(int count) {
+    int spins = spins_.load(std::memory_order_relaxed);
+    spins_.store(spins + (count - spins) / 8, std::memory_order_relaxed);
+  }
+
+  std::atomic<int> spins_{0};
+};
+
+/**
+ * @brief 协程互斥锁
+ * @details 竞争时挂起协程而不是阻塞线程，解锁时把锁直接交给队首的等待方
+ *
+ */
+class FiberMutex : NonCopyable {
+ public:
+  using Locker = ScopedLockImpl<FiberMutex>;
+
+  void Lock();
+  bool TryLock();
+
+  /**
+   * @brief 最多等待 timeout_ms 毫秒
+   *
+   * @return false 超时
+   */
+  bool TryLockFor(uint64_t timeout_ms);
+
+  void Unlock();
+
+ private:
+  bool LockSlow(uint64_t timeout_ms);
+
+ private:
+  /// @brief 0 未加锁，1 已加锁，2 已加锁且可能有等待方
+  std::atomic<int> state_{0};
+  FiberWaitQueue   waiters_;
+  AdaptiveSpin     spin_;
+};
+
+/**
+ * @brief 协程条件变量，配合 FiberMutex 使用
+ *
+ */
+class FiberCondition : NonCopyable {
+ public:
+  /**
+   * @brief 释放 mutex 并挂起，被唤醒后重新加锁
+   *
+   */
+  void Wait(FiberMutex& mutex);
+
+  /**
+   * @brief 最多等待 timeout_ms 毫秒，返回前总会重新加锁
+   *
+   * @return false 超时
+   */
+  bool WaitFor(FiberMutex& mutex, uint64_t timeout_ms);
+
+  void Notify();
+  void NotifyAll();
+
+ private:
+  FiberWaitQueue waiters_;
+};
+
+/**
+ * @brief 协程信号量
+ * @details 有等待方时 Notify() 把计数直接交给队首的等待方
+ *
+ */
+class FiberSemaphore : NonCopyable {
+ public:
+  explicit FiberSemaphore(uint32_t count = 0) : count_(count) {}
+
+  void Wait();
+  bool TryWait();
+
+  /**
+   * @brief 最多等待 timeout_ms 毫秒
+   *
+   * @return false 超时
+   */
+  bool WaitFor(uint64_t timeout_ms);
+
+  void Notify();
+
+ private:
+  bool WaitSlow(uint64_t timeout_ms);
+
+ private:
+  std::atomic<int64_t> count_;
+  /// @brief 进入慢路径的等待方数量，为 0 时 Notify() 不加锁
+  std::atomic<int64_t> waiting_{0};
+  FiberWaitQueue       waiters_;
+  AdaptiveSpin         spin_;
+};
+
+/**
+ * @brief 协程读写锁，写优先
+ * @details 有写者排队时新的读者也排队，写者解锁后唤醒队首连续的读者
+ *
+ */
+class FiberRWMutex : NonCopyable {
+ public:
+  using ReadLock  = ReadScopedLockImpl<FiberRWMutex>;
+  using WriteLock = WriteScopedLockImpl<FiberRWMutex>;
+
+  void rdlock();
+  void wrlock();
+  void unlock();
+
+  bool TryRdLock();
+  bool TryWrLock();
+
+  /**
+   * @brief 最多等待 timeout_ms 毫秒
+   *
+   * @return false 超时
+   */
+  bool TryRdLockFor(uint64_t timeout_ms);
+  bool TryWrLockFor(uint64_t timeout_ms);
+
+ private:
+  bool LockSlow(bool writer, uint64_t timeout_ms);
+
+  /**
+   * @brief 持有 waiters_ 的锁，按当前状态把锁交给队首的等待方
+   *
+   * @return 出队的等待方，以 next 串起来，释放锁后唤醒
+   */
+  FiberWaiter* Grant();
+
+ private:
+  /// @brief -1 写者持有，否则为持有的读者数
+  std::atomic<int32_t> state_{0};
+  /// @brief 进入慢路径的等待方数量，不为 0 时读者不走快路径
+  std::atomic<int32_t> waiting_{0};
+  FiberWaitQueue       waiters_;
+  AdaptiveSpin         spin_;
+};
+
+}  // namespace gudov
@@ -0,0 +1,124 @@
+#include "future.h"
+
+namespace gudov {
+
+bool FutureStateBase::WaitFor(uint64_t timeout_ms) {
+  if (IsReady()) {
+    return true;
+  }
+  FiberWaiter                       waiter;
+  FiberWaitQueue::MutexType::Locker lock(waiters_.GetMutex());
+  if (IsReady()) {
+    return true;
+  }
+  return waiters_.Wait(waiter, lock, timeout_ms);
+}
+
+void FutureStateBase::OnReady(std::function<void()> callback) {
+  {
+    FiberWaitQueue::MutexType::Locker lock(waiters_.GetMutex());
+    if (!IsReady()) {
+      callbacks_.push_back(std::move(callback));
+      return;
+    }
+  }
+  callback();
+}
+
+void FutureStateBase::SetException(std::exception_ptr error) {
+  Claim();
+  error_ = error;
+  Complete();
+}
+
+void FutureStateBase::Claim() {
+  if (claimed_.exchange(true)) {
+    throw std::logic_error("future result already set");
+  }
+}
+
+void FutureStateBase::Complete() {
+  FiberWaiter*                       head = nullptr;
+  FiberWaiter**                      tail = &head;
+  std::vector<std::function<void()>> callbacks;
+  {
+    FiberWaitQueue::MutexType::Locker lock(waiters_.GetMutex());
+    ready_.store(true, std::memory_order_release);
+    while (FiberWaiter* waiter = waiters_.PopFront()) {
+      *tail = waiter;
+      tail  = &waiter->next;
+    }
+    callbacks.swap(callbacks_);
+  }
+  FiberWaitQueue::WakeAll(head);
+  for (auto& callback : callbacks) {
+    callback();
+  }
+}
+
+Future<void> WhenAll(std::vector<Future<void>> futures) {
+  struct Context {
+    std::vector<Future<void>> futures;
+    std::atomic<size_t>       remaining;
+    Promise<void>             promise;
+  };
+  auto context       = std::make_shared<Context>();
+  context->futures   = std::move(futures);
+  context->remaining = context->futures.size() + 1;
+
+  auto finish = [context]() {
+    if (--context->remaining != 0) {
+      return;
+    }
+    try {
+      for (auto& future : context->futures) {
+        future.Get();
+      }
+    } catch (...) {
+      context->promise.SetException(std::current_exception());
+      return;
+    }
+    context->promise.SetValue();
+  };
+  for (auto& future : context->futures) {
+    future.OnReady(finish);
+  }
+  finish();
+  return context->promise.GetFuture();
+}
+
+void WaitGroup::Add(int64_t delta) {
+  int64_t count = count_.fetch_add(delta) + delta;
+  if (count < 0) {
+    throw std::logic_error("negative WaitGroup counter");
+  }
+  if (count != 0) {
+    return;
+  }
+
+  FiberWaiter*  head = nullptr;
+  FiberWaiter** tail = &head;
+  {
+    FiberWaitQueue::MutexType::Locker lock(waiters_.GetMutex());
+    while (FiberWaiter* waiter = waiters_.PopFront()) {
+      *tail = waiter;
+      tail  = &waiter->next;
+    }
+  }
+  FiberWaitQueue::WakeAll(head);
+}
+
+bool WaitGroup::WaitFor(uint64_t timeout_ms) {
+  if (count_.load() == 0) {
+    return true;
+  }
+  FiberWaiter                       waiter;
+  FiberWaitQueue::MutexType::Locker lock(waiters_.GetMutex());
+  // 计数在锁外归零，归零方随后加锁，一定能看到这里登记的等待方
+  if (count_.load() == 0) {
+    return true;
+  }
+  return waiters_.Wait(waiter, lock, timeout_ms);
+}
+
+}  // namespace gudov
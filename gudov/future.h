@@ -0,0 +1,335 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "fiber_sync.h"
+#include "noncopyable.h"
+#include "scheduler.h"
+
+namespace gudov {
+
+/**
+ * @brief Future 共享状态中与结果类型无关的部分
+ * @details 等待方在调度线程的协程中挂起协程，其他线程阻塞线程。结果只能设置一次
+ *
+ */
+class FutureStateBase : NonCopyable {
+ public:
+  bool IsReady() const { return ready_.load(std::memory_order_acquire); }
+
+  void Wait() { WaitFor(~0ull); }
+
+  /**
+   * @brief 最多等待 timeout_ms 毫秒
+   *
+   * @return false 超时
+   */
+  bool WaitFor(uint64_t timeout_ms);
+
+  /**
+   * @brief 结果就绪后调用 callback
+   * @details 已经就绪时在当前上下文中立即调用，否则由设置结果的一方在设置完成后调用，回调中不要阻塞
+   *
+   */
+  void OnReady(std::function<void()> callback);
+
+  void SetException(std::exception_ptr error);
+
+ protected:
+  /**
+   * @brief 抢占设置结果的权利，重复设置时抛出 std::logic_error
+   *
+   */
+  void Claim();
+
+  /**
+   * @brief 结果写好后调用，唤醒等待方并执行回调
+   *
+   */
+  void Complete();
+
+  void RethrowIfError() const {
+    if (error_) {
+      std::rethrow_exception(error_);
+    }
+  }
+
+ private:
+  std::atomic<bool>                  claimed_{false};
+  std::atomic<bool>                  ready_{false};
+  std::exception_ptr                 error_;
+  FiberWaitQueue                     waiters_;
+  std::vector<std::function<void()>> callbacks_;
+};
+
+/**
+ * @brief Future 的共享状态
+ *
+ * @tparam T 结果类型
+ */
+template <typename T>
+class FutureState : public FutureStateBase {
+ public:
+  using ptr = std::shared_ptr<FutureState>;
+
+  void SetValue(T value) {
+    Claim();
+    value_.reset(new T(std::move(value)));
+    Complete();
+  }
+
+  /**
+   * @brief 执行 func，把返回值或抛出的异常设置为结果
+   *
+   */
+  template <typename Func>
+  void SetWith(Func& func) {
+    std::unique_ptr<T> value;
+    try {
+      value.reset(new T(func()));
+    } catch (...) {
+      SetException(std::current_exception());
+      return;
+    }
+    Claim();
+    value_ = std::move(value);
+    Complete();
+  }
+
+  T& Get() {
+    Wait();
+    RethrowIfError();
+    return *value_;
+  }
+
+ private:
+  std::unique_ptr<T> value_;
+};
+
+template <>
+class FutureState<void> : public FutureStateBase {
+ public:
+  using ptr = std::shared_ptr<FutureState>;
+
+  void SetValue() {
+    Claim();
+    Complete();
+  }
+
+  template <typename Func>
+  void SetWith(Func& func) {
+    try {
+      func();
+    } catch (...) {
+      SetException(std::current_exception());
+      return;
+    }
+    SetValue();
+  }
+
+  void Get() {
+    Wait();
+    RethrowIfError();
+  }
+};
+
+/**
+ * @brief 异步结果，可以复制，副本共享同一个结果
+ *
+ * @tparam T 结果类型
+ */
+template <typename T>
+class Future {
+ public:
+  Future() = default;
+  explicit Future(typename FutureState<T>::ptr state) : state_(std::move(state)) {}
+
+  bool Valid() const { return state_ != nullptr; }
+  bool IsReady() const { return state_->IsReady(); }
+
+  void Wait() const { state_->Wait(); }
+
+  /**
+   * @brief 最多等待 timeout_ms 毫秒
+   *
+   * @return false 超时
+   */
+  bool WaitFor(uint64_t timeout_ms) const { return state_->WaitFor(timeout_ms); }
+
+  /**
+   * @brief 等待并返回结果，结果是异常时重新抛出
+   * @details 返回共享状态中结果的引用，需要时可以移走
+   *
+   */
+  typename std::add_lvalue_reference<T>::type Get() const { return state_->Get(); }
+
+  void OnReady(std::function<void()> callback) const { state_->OnReady(std::move(callback)); }
+
+ private:
+  typename FutureState<T>::ptr state_;
+};
+
+/**
+ * @brief Future 的写入端，可以复制后交给执行方
+ *
+ * @tparam T 结果类型
+ */
+template <typename T>
+class Promise {
+ public:
+  Promise() : state_(std::make_shared<FutureState<T>>()) {}
+
+  Future<T> GetFuture() const { return Future<T>(state_); }
+
+  template <typename... Args>
+  void SetValue(Args&&... args) const {
+    state_->SetValue(std::forward<Args>(args)...);
+  }
+
+  void SetException(std::exception_ptr error) const { state_->SetException(error); }
+
+  /**
+   * @brief 执行 func，把返回值或抛出的异常设置为结果
+   *
+   */
+  template <typename Func>
+  void SetWith(Func& func) const {
+    state_->SetWith(func);
+  }
+
+ private:
+  typename FutureState<T>::ptr state_;
+};
+
+/**
+ * @brief 在新协程中执行 func，返回它的结果
+ *
+ * @param func 可调用对象
+ * @param scheduler 执行的调度器，为空时使用当前线程的调度器，都没有时在调用方直接执行
+ */
+template <typename Func>
+auto Async(Func func, Scheduler* scheduler = nullptr) -> Future<decltype(func())> {
+  using R = decltype(func());
+  Promise<R> promise;
+  if (!scheduler) {
+    scheduler = Scheduler::GetScheduler();
+  }
+  if (scheduler) {
+    scheduler->Schedule([promise, func]() mutable { promise.SetWith(func); });
+  } else {
+    promise.SetWith(func);
+  }
+  return promise.GetFuture();
+}
+
+/**
+ * @brief 所有 futures 都就绪后就绪
+ * @details 结果按 futures 的顺序复制出来。有 future 失败时结果为其中位置最靠前的那个异常
+ *
+ */
+template <typename T>
+Future<std::vector<T>> WhenAll(std::vector<Future<T>> futures) {
+  struct Context {
+    std::vector<Future<T>>  futures;
+    std::atomic<size_t>     remaining;
+    Promise<std::vector<T>> promise;
+  };
+  auto context       = std::make_shared<Context>();
+  context->futures   = std::move(futures);
+  context->remaining = context->futures.size() + 1;
+
+  auto finish = [context]() {
+    if (--context->remaining != 0) {
+      return;
+    }
+    std::vector<T> values;
+    values.reserve(context->futures.size());
+    try {
+      for (auto& future : context->futures) {
+        values.push_back(future.Get());
+      }
+    } catch (...) {
+      context->promise.SetException(std::current_exception());
+      return;
+    }
+    context->promise.SetValue(std::move(values));
+  };
+  for (auto& future : context->futures) {
+    future.OnReady(finish);
+  }
+  // 多计的一次保证注册完所有回调之前不会完成
+  finish();
+  return context->promise.GetFuture();
+}
+
+/**
+ * @brief 所有 futures 都就绪后就绪，有 future 失败时结果为其中位置最靠前的那个异常
+ *
+ */
+Future<void> WhenAll(std::vector<Future<void>> futures);
+
+/**
+ * @brief 任意一个 future 就绪后就绪，结果为它在 futures 中的下标
+ * @details futures 不能为空
+ *
+ */
+template <typename T>
+Future<size_t> WhenAny(const std::vector<Future<T>>& futures) {
+  if (futures.empty()) {
+    throw std::invalid_argument("WhenAny needs at least one future");
+  }
+  struct Context {
+    std::atomic<bool> done{false};
+    Promise<size_t>   promise;
+  };
+  auto context = std::make_shared<Context>();
+  for (size_t i = 0; i < futures.size(); ++i) {
+    futures[i].OnReady([context, i]() {
+      if (!context->done.exchange(true)) {
+        context->promise.SetValue(i);
+      }
+    });
+  }
+  return context->promise.GetFuture();
+}
+
+/**
+ * @brief 等待一组任务全部完成
+ * @details 计数归零时唤醒所有等待方
+ *
+ */
+class WaitGroup : NonCopyable {
+ public:
+  explicit WaitGroup(int64_t count = 0) : count_(count) {}
+
+  /**
+   * @brief 计数加 delta，计数小于 0 时抛出 std::logic_error
+   *
+   */
+  void Add(int64_t delta = 1);
+
+  void Done() { Add(-1); }
+
+  void Wait() { WaitFor(~0ull); }
+
+  /**
+   * @brief 最多等待 timeout_ms 毫秒
+   *
+   * @return false 超时
+   */
+  bool WaitFor(uint64_t timeout_ms);
+
+ private:
+  std::atomic<int64_t> count_;
+  FiberWaitQueue       waiters_;
+};
+
+}  // namespace gudov
@@ -2,9 +2,15 @@
 
 #include "address.h"
 #include "bytearray.h"
+#include "cancel.h"
+#include "channel.h"
 #include "config.h"
+#include "dns.h"
 #include "env.h"
 #include "fiber.h"
+#include "fiber_local.h"
+#include "fiber_sync.h"
+#include "future.h"
 #include "http/http.h"
 #include "http/http_connection.h"
 #include "http/http_parser.h"
@@ -14,6 +20,7 @@
 #include "iomanager.h"
 #include "log.h"
 #include "macro.h"
+#include "offload.h"
 #include "scheduler.h"
 #include "singleton.h"
 #include "socket.h"
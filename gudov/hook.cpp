@@ -1,16 +1,20 @@
 #include "hook.h"
 
 #include <dlfcn.h>
+#include <linux/io_uring.h>
 #include <stdarg.h>
 
-#include <string>
+#include <algorithm>
+#include <atomic>
 
+#include "cancel.h"
 #include "config.h"
 #include "fdmanager.h"
 #include "fiber.h"
 #include "gudov/macro.h"
 #include "iomanager.h"
 #include "log.h"
+#include "util.h"
 
 gudov::Logger::ptr g_logger = LOG_NAME("system");
 
@@ -18,6 +22,9 @@ namespace gudov {
 
 static ConfigVar<int>::ptr g_tcpConnectTimeout = Config::Lookup("tcp.connect.timeout", 5000, "tcp connect timeout");
 
+static ConfigVar<int>::ptr g_tcpTimeoutSlack =
+    Config::Lookup("tcp.timeout.slack", 0, "socket timeouts may fire this many ms late so that they can be coalesced");
+
 static thread_local bool t_hookEnable = false;
 
 #define HOOK_FUN(XX) \
@@ -37,6 +44,10 @@ static thread_local bool t_hookEnable = false;
   XX(send)           \
   XX(sendto)         \
   XX(sendmsg)        \
+  XX(poll)           \
+  XX(ppoll)          \
+  XX(select)         \
+  XX(epoll_wait)     \
   XX(close)          \
   XX(fcntl)          \
   XX(ioctl)          \
@@ -57,6 +68,7 @@ void hookInit() {
 }
 
 static uint64_t s_connectTimeout = -1;
+static uint64_t s_timeoutSlack   = 0;
 
 struct _HookIniter {
   _HookIniter() {
@@ -67,6 +79,12 @@ struct _HookIniter {
       LOG_INFO(g_logger) << "tcp connect timeout changed from " << oldValue << " to " << newValue;
       s_connectTimeout = newValue;
     });
+
+    s_timeoutSlack = g_tcpTimeoutSlack->GetValue();
+    g_tcpTimeoutSlack->AddListener([](const int& oldValue, const int& newValue) {
+      LOG_INFO(g_logger) << "tcp timeout slack changed from " << oldValue << " to " << newValue;
+      s_timeoutSlack = newValue;
+    });
   }
 };
 
@@ -79,112 +97,386 @@ void SetHookEnable(bool flag) { t_hookEnable = flag; }
 
 }  // namespace gudov
 
-struct TimerInfo {
-  int cancelled = 0;
+/**
+ * @brief 读写 errno，挂起协程之后必须使用
+ * @details 协程可能在另一个线程上恢复，而 __errno_location 声明为 const，
+ * 编译器会复用挂起前算出的地址，导致读写到原线程的 errno。放到不内联的函数里每次重新取地址
+ *
+ */
+__attribute__((noinline)) static int GetErrno() { return errno; }
+
+__attribute__((noinline)) static void SetErrno(int e) { errno = e; }
+
+/**
+ * @brief 毫秒超时转换为微秒，-1 表示不超时
+ *
+ */
+static uint64_t ToTimeoutUS(uint64_t timeout_ms) { return timeout_ms == (uint64_t)-1 ? timeout_ms : timeout_ms * 1000; }
+
+/**
+ * @brief 挂起中的 IO 的等待状态，放在发起 IO 的协程栈上
+ * @details 超时回调只持有它的地址。协程恢复后如果取消定时器失败，说明回调已经取出或正在执行，
+ * 必须等回调置位 done 之后才能离开所在的栈帧
+ *
+ */
+struct IOWait {
+  IOWait(gudov::IOManager* iom, int fd, gudov::IOManager::Event event) : iom(iom), fd(fd), event(event) {}
+
+  gudov::IOManager*       iom;
+  int                     fd;
+  gudov::IOManager::Event event;
+  /// @brief 超时时置为 ETIMEDOUT，取消上下文被取消时置为其错误码
+  std::atomic<int>        cancelled{0};
+  std::atomic<bool>       done{false};
+  /// @brief 该事件已有其他等待者时不注册也不挂起，WaitEvent 返回 false
+  bool                    try_add = false;
 };
 
+/**
+ * @brief 在 fd 上注册事件并挂起当前协程，直到事件就绪、超时或当前的取消上下文被取消
+ * @details
+ * 定时器回调只捕获 IOWait 的地址，能放进 std::function 的内部存储，不再额外分配。
+ * 取消上下文已经取消时不挂起，直接把错误码写入 wait.cancelled；超时时间截短到上下文的截止时间
+ *
+ * @param wait 位于调用方栈上的等待状态
+ * @param timeout_us 超时时间(us)，-1 表示不超时
+ * @param slack_us 允许超时推迟的时间(us)
+ * @return false 注册事件失败，没有挂起
+ */
+static bool WaitEvent(IOWait& wait, uint64_t timeout_us, uint64_t slack_us) {
+  gudov::CancelContext::ptr cancel = gudov::CancelContext::GetCurrent();
+  if (cancel) {
+    int error = cancel->Error();
+    if (error) {
+      wait.cancelled = error;
+      return true;
+    }
+    timeout_us = std::min(timeout_us, cancel->GetRemainingUS());
+  }
+
+  gudov::Timer::ptr timer;
+  if (timeout_us != (uint64_t)-1) {
+    timer = wait.iom->AddTimerUS(
+        timeout_us,
+        [w = &wait]() {
+          w->cancelled = ETIMEDOUT;
+          w->iom->CancelEvent(w->fd, w->event);
+          w->done.store(true, std::memory_order_release);
+        },
+        false, slack_us);
+  }
+
+  int rt = wait.try_add ? wait.iom->TryAddEvent(wait.fd, wait.event) : wait.iom->AddEvent(wait.fd, wait.event);
+  if (rt == 0) {
+    // 事件注册之后再登记，取消回调触发的 CancelEvent 才一定能唤醒这里
+    gudov::CancelListener listener([w = &wait](int error) {
+      w->cancelled = error;
+      w->iom->CancelEvent(w->fd, w->event);
+    });
+    if (cancel && !cancel->AddListener(listener)) {
+      wait.cancelled = cancel->Error();
+      wait.iom->CancelEvent(wait.fd, wait.event);
+    }
+    gudov::Fiber::GetRunningFiber()->Yield();
+    if (cancel) {
+      // 回调正在执行时等它结束，之后 listener 才能离开栈帧
+      cancel->RemoveListener(listener);
+    }
+  }
+  if (timer && !timer->Cancel()) {
+    // 回调已经开始执行，让出 CPU 等它结束
+    while (!wait.done.load(std::memory_order_acquire)) {
+      wait.iom->Schedule(gudov::Fiber::GetRunningFiber());
+      gudov::Fiber::GetRunningFiber()->Yield();
+    }
+  }
+  return rt == 0;
+}
+
+/**
+ * @brief io_uring 请求提交前检查当前的取消上下文
+ * @details 已提交的请求不会因取消而中止，只能把超时截短到上下文的截止时间
+ *
+ * @param timeout_ms 超时时间(ms)，~0ull 表示不超时
+ * @return false 上下文已经取消，errno 为取消原因
+ */
+static bool ClampUringTimeout(uint64_t& timeout_ms) {
+  gudov::CancelContext::ptr cancel = gudov::CancelContext::GetCurrent();
+  if (!cancel) {
+    return true;
+  }
+  int error = cancel->Error();
+  if (error) {
+    SetErrno(error);
+    return false;
+  }
+  uint64_t remaining_us = cancel->GetRemainingUS();
+  if (remaining_us != ~0ull) {
+    timeout_ms = std::min(timeout_ms, (remaining_us + 999) / 1000);
+  }
+  return true;
+}
+
+/**
+ * @brief 没有对应 io_uring 操作的 hook 函数使用，总是等待就绪后重试
+ *
+ */
+struct NoUringOp {};
+
+static bool SubmitUringIO(gudov::IOManager* iom, int fd, const NoUringOp& prepare, uint64_t timeout, ssize_t& n) {
+  return false;
+}
+
+/**
+ * @brief io_uring 后端下把请求直接提交给内核，完成后再唤醒协程
+ *
+ * @return false 不是 io_uring 后端，需要走就绪通知的流程
+ */
+template <typename Prepare>
+static bool SubmitUringIO(gudov::IOManager* iom, int fd, const Prepare& prepare, uint64_t timeout, ssize_t& n) {
+  if (!iom->IsUring()) {
+    return false;
+  }
+  int rt = iom->SubmitIO(fd, prepare, timeout);
+  if (rt < 0) {
+    SetErrno(-rt);
+    n = -1;
+  } else {
+    n = rt;
+  }
+  return true;
+}
+
 /**
  * @brief 通用的 IO 处理函数
+ * @details
+ * 先以非阻塞方式调用原始函数，返回 EAGAIN 时挂起协程：
+ * epoll 后端等待 fd 就绪后重试；io_uring 后端且提供了 prepare 时，直接提交对应的请求等待完成
  *
  * @tparam OriginFun 原始函数的函数指针
+ * @tparam Prepare 填写 io_uring 请求的函数，没有对应请求时为 NoUringOp
  * @tparam Args 原始函数所带参数
  * @param fd 待操作句柄
  * @param fun 原始的函数
  * @param hookFunName 要 hook 的函数名
  * @param event 处理的事件
  * @param timeoutSo 超时事件
+ * @param prepare 填写 io_uring 请求
  * @param args 函数的参数
  * @return ssize_t
  */
-template <typename OriginFun, typename... Args>
-static ssize_t doIO(int fd, OriginFun fun, const std::string& hook_fun_name, uint32_t event, int timeout_so,
-                    Args&&... args) {
+template <typename OriginFun, typename Prepare, typename... Args>
+static ssize_t doIOWithUring(int fd, OriginFun fun, const char* hook_fun_name, uint32_t event, int timeout_so,
+                             const Prepare& prepare, Args&&... args) {
   if (!gudov::t_hookEnable) {
     // 未启用 hook 时直接调用原有函数
     return fun(fd, std::forward<Args>(args)...);
   }
 
-  // 尝试在 FdManager 中获得该 fd 句柄
-  gudov::FdCtx::ptr ctx = gudov::FdMgr::GetInstance()->Get(fd);
+  // 尝试在 FdManager 中获得该 fd 句柄，无锁且不增加引用计数
+  gudov::FdCtx* ctx = gudov::FdMgr::GetInstance()->Get(fd);
   if (!ctx) {
     // 没找到则直接调用
     return fun(fd, std::forward<Args>(args)...);
   }
 
-  // 如果句柄已关闭则发生错误
-  if (ctx->IsClose()) {
-    errno = EBADF;
-    return -1;
-  }
-
   // 1. 只处理 socket
   // 2. 如果已经在用户态设置过非阻塞(fcntl or ioctl)，也不继续处理
+  // 已关闭的句柄不单独检查，原始函数会返回 EBADF
   if (!ctx->IsSocket() || ctx->GetUserNonblock()) {
     return fun(fd, std::forward<Args>(args)...);
   }
 
-  // 设置超时时间
-  uint64_t timeout = ctx->GetTimeout(timeout_so);
-
-  std::shared_ptr<TimerInfo> tinfo(new TimerInfo);
+  // 一直有数据可读写时不会挂起，在这里检查时间片
+  gudov::Fiber::MaybeYield();
 
 retry:
   // 尝试执行原始函数
   ssize_t n = fun(fd, std::forward<Args>(args)...);
-  while (n == -1 && errno == EINTR) {
+  while (n == -1 && GetErrno() == EINTR) {
     // 发生中断，重试
     n = fun(fd, std::forward<Args>(args)...);
   }
 
-  if (n == -1 && errno == EAGAIN) {
-    // EAGAIN 表示暂无数据课操作，可稍后再试
-    // 需要异步操作
+  if (n == -1 && GetErrno() == EAGAIN) {
+    // EAGAIN 表示暂无数据可操作，挂起协程等待，到这里才需要超时时间和定时器
+    uint64_t          timeout = ctx->GetTimeout(timeout_so);
+    gudov::IOManager* iom     = gudov::IOManager::GetThis();
+    if (iom->IsUring() && !ClampUringTimeout(timeout)) {
+      return -1;
+    }
+    if (SubmitUringIO(iom, fd, prepare, timeout, n)) {
+      return n;
+    }
+
+    IOWait wait(iom, fd, (gudov::IOManager::Event)event);
+    if (GUDOV_UNLICKLY(!WaitEvent(wait, ToTimeoutUS(timeout), gudov::s_timeoutSlack * 1000))) {
+      LOG_ERROR(g_logger) << hook_fun_name << " AddEvent(" << fd << ", " << event << ")";
+      return n;
+    }
+    if (wait.cancelled) {
+      SetErrno(wait.cancelled);
+      return -1;
+    }
+    goto retry;
+  }
 
-    // 获取 IOManager 和定时器
-    gudov::IOManager*        iom = gudov::IOManager::GetThis();
-    gudov::Timer::ptr        timer;
-    std::weak_ptr<TimerInfo> winfo(tinfo);
+  return n;
+}
 
-    if (timeout != (uint64_t)-1) {
-      // 设置了超时
-      timer = iom->AddConditionTimer(
-          timeout,
-          [winfo, fd, iom, event]() {
-            auto t = winfo.lock();
-            if (!t || t->cancelled) {
-              return;
-            }
+template <typename OriginFun, typename... Args>
+static ssize_t doIO(int fd, OriginFun fun, const char* hook_fun_name, uint32_t event, int timeout_so, Args&&... args) {
+  return doIOWithUring(fd, fun, hook_fun_name, event, timeout_so, NoUringOp(), std::forward<Args>(args)...);
+}
 
-            t->cancelled = ETIMEDOUT;
-            iom->CancelEvent(fd, (gudov::IOManager::Event)(event));
-          },
-          winfo);
-    }
+/// @brief 有 fd 无法加入临时 epoll 时，每隔这么久重新检查一次 (us)
+static const uint64_t kPollRecheckUS = 10000;
 
-    // 为 fd 添加一个协程并且 hold
-    int rt = iom->AddEvent(fd, (gudov::IOManager::Event)(event));
-    if (GUDOV_UNLICKLY(rt)) {
-      LOG_ERROR(g_logger) << hook_fun_name << " AddEvent(" << fd << ", " << event << ")";
-      if (timer) {
-        timer->Cancel();
-      }
-    } else {
-      gudov::Fiber::GetRunningFiber()->Yield();
-      if (timer) {
-        timer->Cancel();
+/**
+ * @brief poll/select/epoll_wait 等多路复用函数的通用处理
+ * @details
+ * 先以 0 超时检查一次，有结果或不需要等待时直接返回。
+ * 只等待一个 fd 的一种事件时 (epoll_wait 等待的 epoll 本身、单个 fd 的 poll/select)，直接在该 fd 上 AddEvent
+ * 并挂起协程，不额外产生系统调用；该事件已有其他协程在等待或 fd 无法注册时改用临时 epoll。
+ * 多个 fd 时仍把它们注册到一个临时的 epoll 实例，只把这个 epoll 的可读事件交给当前 IOManager，
+ * 临时 epoll 只属于本次调用，其他协程同时在这些 fd 上等待也不会冲突。
+ * 就绪或超时后重新检查，无法挂起时退回到以剩余时间阻塞调用原始函数
+ *
+ * @param hook_fun_name 要 hook 的函数名
+ * @param timeout_us 超时时间(us)，-1 表示一直等待
+ * @param fd 只等待一个 fd 时为该 fd，否则为 -1
+ * @param event fd 上等待的事件
+ * @param add 把要等待的 fd 注册到临时 epoll，参数为 epfd，有 fd 注册失败时返回 false，改为定期重新检查
+ * @param check 以给定的毫秒超时调用原始函数并返回其结果，-1 表示一直等待
+ * @return int 原始函数的返回值
+ */
+template <typename Add, typename Check>
+static int doPoll(const char* hook_fun_name, uint64_t timeout_us, int fd, gudov::IOManager::Event event,
+                  const Add& add, const Check& check) {
+  int n = check(0);
+  if (n != 0 || timeout_us == 0) {
+    return n;
+  }
+
+  uint64_t deadline = timeout_us == (uint64_t)-1 ? timeout_us : gudov::GetMonotonicUS() + timeout_us;
+  // 剩余时间向上取整为毫秒，用于阻塞调用原始函数
+  auto remain_ms = [deadline]() {
+    if (deadline == (uint64_t)-1) {
+      return -1;
+    }
+    uint64_t now = gudov::GetMonotonicUS();
+    return now >= deadline ? 0 : (int)std::min<uint64_t>((deadline - now + 999) / 1000, INT32_MAX);
+  };
+
+  gudov::IOManager* iom = gudov::IOManager::GetThis();
+  // 常驻 epoll 模式下注册保留到 CancelAll，只对 close 时会撤销注册的 fd 直接等待
+  if (fd >= 0 && iom->IsPersistentEpoll() && !gudov::FdMgr::GetInstance()->Get(fd)) {
+    fd = -1;
+  }
+  int  epfd    = -1;
+  bool watched = true;
+
+  while (true) {
+    if (fd < 0 && epfd < 0) {
+      epfd = epoll_create1(EPOLL_CLOEXEC);
+      if (GUDOV_UNLICKLY(epfd < 0)) {
+        LOG_ERROR(g_logger) << hook_fun_name << " epoll_create1 errno=" << GetErrno();
+        return check(remain_ms());
       }
-      if (tinfo->cancelled) {
-        errno = tinfo->cancelled;
-        return -1;
+      watched = add(epfd);
+    }
+
+    uint64_t wait_us = (uint64_t)-1;
+    if (deadline != (uint64_t)-1) {
+      uint64_t now = gudov::GetMonotonicUS();
+      if (now >= deadline) {
+        break;
       }
+      wait_us = deadline - now;
+    }
+    if (!watched) {
+      wait_us = std::min(wait_us, kPollRecheckUS);
+    }
 
-      goto retry;
+    IOWait wait(iom, fd >= 0 ? fd : epfd, fd >= 0 ? event : gudov::IOManager::READ);
+    wait.try_add = fd >= 0;
+    if (GUDOV_UNLICKLY(!WaitEvent(wait, wait_us, 0))) {
+      if (fd >= 0) {
+        // 该事件已有其他协程在等待，或者 fd 不支持 epoll，改用临时 epoll
+        fd = -1;
+        continue;
+      }
+      LOG_ERROR(g_logger) << hook_fun_name << " AddEvent(" << epfd << ", READ)";
+      iom->CancelAll(epfd);
+      closeF(epfd);
+      return check(remain_ms());
+    }
+    // 常驻 epoll 模式下可能有之前残留的就绪标记，没有结果时继续等待
+    n = check(0);
+    if (n != 0) {
+      break;
+    }
+    // 超时由本函数的截止时间判断，只有取消上下文的原因才提前返回
+    gudov::CancelContext::ptr cancel = gudov::CancelContext::GetCurrent();
+    int                       error  = cancel ? cancel->Error() : 0;
+    if (error) {
+      SetErrno(error);
+      n = -1;
+      break;
     }
   }
 
+  if (epfd >= 0) {
+    iom->CancelAll(epfd);
+    closeF(epfd);
+  }
   return n;
 }
 
+/**
+ * @brief pollfd 数组中只有一个 fd 且只等待可读或可写时，返回该 fd 和对应的事件
+ *
+ * @param[out] fd 不满足条件时为 -1
+ */
+static gudov::IOManager::Event SinglePollFd(const pollfd* fds, nfds_t nfds, int& fd) {
+  fd                            = -1;
+  gudov::IOManager::Event event = gudov::IOManager::NONE;
+  for (nfds_t i = 0; i < nfds; ++i) {
+    if (fds[i].fd < 0) {
+      continue;
+    }
+    if (fd >= 0 || (fds[i].events != POLLIN && fds[i].events != POLLOUT)) {
+      fd = -1;
+      return gudov::IOManager::NONE;
+    }
+    fd    = fds[i].fd;
+    event = fds[i].events == POLLIN ? gudov::IOManager::READ : gudov::IOManager::WRITE;
+  }
+  return event;
+}
+
+/**
+ * @brief 把 pollfd 数组中的 fd 注册到临时 epoll
+ * @details POLLIN/POLLOUT/POLLPRI 等与对应的 EPOLL 标志取值相同，可以直接使用
+ *
+ * @return false 有 fd 注册失败，比如同一个 fd 出现了多次
+ */
+static bool AddPollFds(int epfd, const pollfd* fds, nfds_t nfds) {
+  bool ok = true;
+  for (nfds_t i = 0; i < nfds; ++i) {
+    if (fds[i].fd < 0) {
+      continue;
+    }
+    epoll_event event;
+    event.events   = (uint16_t)fds[i].events;
+    event.data.u64 = i;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, fds[i].fd, &event)) {
+      ok = false;
+    }
+  }
+  return ok;
+}
+
 extern "C" {
 
 // 在这里声明函数指针变量
@@ -214,9 +506,9 @@ int usleep(useconds_t usec) {
 
   gudov::Fiber::ptr fiber = gudov::Fiber::GetRunningFiber();
   gudov::IOManager* iom   = gudov::IOManager::GetThis();
-  iom->AddTimer(usec / 1000,
-                std::bind((void(gudov::Scheduler::*)(gudov::Fiber::ptr, int thread)) & gudov::IOManager::Schedule, iom,
-                          fiber, -1));
+  iom->AddTimerUS(usec,
+                  std::bind((void(gudov::Scheduler::*)(gudov::Fiber::ptr, int thread)) & gudov::IOManager::Schedule,
+                            iom, fiber, -1));
   gudov::Fiber::GetRunningFiber()->Yield();
   return 0;
 }
@@ -226,13 +518,14 @@ int nanosleep(const struct timespec* req, struct timespec* rem) {
     return nanosleepF(req, rem);
   }
 
-  int timeoutMs = req->tv_sec * 1000 + req->tv_nsec / 1000000;
+  // 定时器精度为微秒，不足 1us 的部分向上取整
+  uint64_t timeout_us = req->tv_sec * 1000000ull + (req->tv_nsec + 999) / 1000;
 
   gudov::Fiber::ptr fiber = gudov::Fiber::GetRunningFiber();
   gudov::IOManager* iom   = gudov::IOManager::GetThis();
-  iom->AddTimer(timeoutMs,
-                std::bind((void(gudov::Scheduler::*)(gudov::Fiber::ptr, int thread)) & gudov::IOManager::Schedule, iom,
-                          fiber, -1));
+  iom->AddTimerUS(timeout_us,
+                  std::bind((void(gudov::Scheduler::*)(gudov::Fiber::ptr, int thread)) & gudov::IOManager::Schedule,
+                            iom, fiber, -1));
   gudov::Fiber::GetRunningFiber()->Yield();
   return 0;
 }
@@ -256,7 +549,7 @@ int connectWithTimeout(int fd, const struct sockaddr* addr, socklen_t addrlen, u
   }
 
   // 得到对应的 Fd 信息
-  gudov::FdCtx::ptr ctx = gudov::FdMgr::GetInstance()->Get(fd);
+  gudov::FdCtx* ctx = gudov::FdMgr::GetInstance()->Get(fd);
   if (!ctx || ctx->IsClose()) {
     errno = EBADF;
     return -1;
@@ -270,6 +563,28 @@ int connectWithTimeout(int fd, const struct sockaddr* addr, socklen_t addrlen, u
     return connectF(fd, addr, addrlen);
   }
 
+  gudov::IOManager* iom = gudov::IOManager::GetThis();
+  if (iom && iom->IsUring()) {
+    if (!ClampUringTimeout(timeoutMs)) {
+      return -1;
+    }
+    // io_uring 直接返回连接结果，不需要等可写后再查询 SO_ERROR
+    int rt = iom->SubmitIO(
+        fd,
+        [=](io_uring_sqe* sqe) {
+          sqe->opcode = IORING_OP_CONNECT;
+          sqe->fd     = fd;
+          sqe->addr   = (uint64_t)addr;
+          sqe->off    = addrlen;
+        },
+        timeoutMs);
+    if (rt < 0) {
+      SetErrno(-rt);
+      return -1;
+    }
+    return 0;
+  }
+
   int n = connectF(fd, addr, addrlen);
   if (n == 0) {
     return 0;
@@ -278,41 +593,13 @@ int connectWithTimeout(int fd, const struct sockaddr* addr, socklen_t addrlen, u
   }
 
   // Connect 超时，此时正在建立连接，连接成功 epoll 触发可写事件
-  gudov::IOManager*          iom = gudov::IOManager::GetThis();
-  gudov::Timer::ptr          timer;
-  std::shared_ptr<TimerInfo> tinfo(new TimerInfo);
-  std::weak_ptr<TimerInfo>   winfo(tinfo);
-
-  if (timeoutMs != (uint64_t)-1) {
-    // 添加一个定时器
-    timer = iom->AddConditionTimer(
-        timeoutMs,
-        [winfo, fd, iom]() {
-          auto t = winfo.lock();
-          if (!t || t->cancelled) {
-            return;
-          }
-          t->cancelled = ETIMEDOUT;
-          iom->CancelEvent(fd, gudov::IOManager::Event::WRITE);
-        },
-        winfo);
-  }
-
-  // ~ 在这里将该 fd 加入 epoll 监听中
-  int rt = iom->AddEvent(fd, gudov::IOManager::WRITE);
-  if (rt == 0) {
-    gudov::Fiber::GetRunningFiber()->Yield();
-    if (timer) {
-      timer->Cancel();
-    }
-    if (tinfo->cancelled) {
-      errno = tinfo->cancelled;
+  IOWait wait(iom, fd, gudov::IOManager::WRITE);
+  if (WaitEvent(wait, ToTimeoutUS(timeoutMs), gudov::s_timeoutSlack * 1000)) {
+    if (wait.cancelled) {
+      SetErrno(wait.cancelled);
       return -1;
     }
   } else {
-    if (timer) {
-      timer->Cancel();
-    }
     LOG_ERROR(g_logger) << "connect AddEvent(" << fd << ", WRITE) error";
   }
 
@@ -324,7 +611,7 @@ int connectWithTimeout(int fd, const struct sockaddr* addr, socklen_t addrlen, u
   if (!error) {
     return 0;
   } else {
-    errno = error;
+    SetErrno(error);
     return -1;
   }
 }
@@ -334,7 +621,14 @@ int connect(int sockfd, const struct sockaddr* addr, socklen_t addrlen) {
 }
 
 int accept(int sockfd, struct sockaddr* addr, socklen_t* addrlen) {
-  int fd = doIO(sockfd, acceptF, "accept", gudov::IOManager::Event::READ, SO_RCVTIMEO, addr, addrlen);
+  auto prepare = [=](io_uring_sqe* sqe) {
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd     = sockfd;
+    sqe->addr   = (uint64_t)addr;
+    sqe->addr2  = (uint64_t)addrlen;
+  };
+  int fd = doIOWithUring(sockfd, acceptF, "accept", gudov::IOManager::Event::READ, SO_RCVTIMEO, prepare, addr,
+                         addrlen);
   if (fd >= 0) {
     gudov::FdMgr::GetInstance()->Get(fd, true);
   }
@@ -342,7 +636,14 @@ int accept(int sockfd, struct sockaddr* addr, socklen_t* addrlen) {
 }
 
 ssize_t read(int fd, void* buf, size_t count) {
-  return doIO(fd, readF, "read", gudov::IOManager::Event::READ, SO_RCVTIMEO, buf, count);
+  auto prepare = [=](io_uring_sqe* sqe) {
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd     = fd;
+    sqe->addr   = (uint64_t)buf;
+    sqe->len    = count;
+    sqe->off    = (uint64_t)-1;
+  };
+  return doIOWithUring(fd, readF, "read", gudov::IOManager::Event::READ, SO_RCVTIMEO, prepare, buf, count);
 }
 
 ssize_t readv(int fd, const struct iovec* iov, int iovcnt) {
@@ -350,7 +651,14 @@ ssize_t readv(int fd, const struct iovec* iov, int iovcnt) {
 }
 
 ssize_t recv(int sockfd, void* buf, size_t len, int flags) {
-  return doIO(sockfd, recvF, "recv", gudov::IOManager::Event::READ, SO_RCVTIMEO, buf, len, flags);
+  auto prepare = [=](io_uring_sqe* sqe) {
+    sqe->opcode    = IORING_OP_RECV;
+    sqe->fd        = sockfd;
+    sqe->addr      = (uint64_t)buf;
+    sqe->len       = len;
+    sqe->msg_flags = flags;
+  };
+  return doIOWithUring(sockfd, recvF, "recv", gudov::IOManager::Event::READ, SO_RCVTIMEO, prepare, buf, len, flags);
 }
 
 ssize_t recvfrom(int sockfd, void* buf, size_t len, int flags, struct sockaddr* src_addr, socklen_t* addrlen) {
@@ -363,7 +671,14 @@ ssize_t recvmsg(int sockfd, struct msghdr* msg, int flags) {
 }
 
 ssize_t write(int fd, const void* buf, size_t count) {
-  return doIO(fd, writeF, "write", gudov::IOManager::Event::WRITE, SO_SNDTIMEO, buf, count);
+  auto prepare = [=](io_uring_sqe* sqe) {
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd     = fd;
+    sqe->addr   = (uint64_t)buf;
+    sqe->len    = count;
+    sqe->off    = (uint64_t)-1;
+  };
+  return doIOWithUring(fd, writeF, "write", gudov::IOManager::Event::WRITE, SO_SNDTIMEO, prepare, buf, count);
 }
 
 ssize_t writev(int fd, const struct iovec* iov, int iovcnt) {
@@ -371,7 +686,14 @@ ssize_t writev(int fd, const struct iovec* iov, int iovcnt) {
 }
 
 ssize_t send(int s, const void* msg, size_t len, int flags) {
-  return doIO(s, sendF, "send", gudov::IOManager::Event::WRITE, SO_SNDTIMEO, msg, len, flags);
+  auto prepare = [=](io_uring_sqe* sqe) {
+    sqe->opcode    = IORING_OP_SEND;
+    sqe->fd        = s;
+    sqe->addr      = (uint64_t)msg;
+    sqe->len       = len;
+    sqe->msg_flags = flags;
+  };
+  return doIOWithUring(s, sendF, "send", gudov::IOManager::Event::WRITE, SO_SNDTIMEO, prepare, msg, len, flags);
 }
 
 ssize_t sendto(int s, const void* msg, size_t len, int flags, const struct sockaddr* to, socklen_t tolen) {
@@ -382,12 +704,124 @@ ssize_t sendmsg(int s, const struct msghdr* msg, int flags) {
   return doIO(s, sendmsgF, "sendmsg", gudov::IOManager::Event::WRITE, SO_SNDTIMEO, msg, flags);
 }
 
+int poll(struct pollfd* fds, nfds_t nfds, int timeout) {
+  if (!gudov::IsHookEnable() || !gudov::IOManager::GetThis()) {
+    return pollF(fds, nfds, timeout);
+  }
+
+  int                     wait_fd    = -1;
+  gudov::IOManager::Event wait_event = SinglePollFd(fds, nfds, wait_fd);
+
+  auto add   = [=](int epfd) { return AddPollFds(epfd, fds, nfds); };
+  auto check = [=](int ms) { return pollF(fds, nfds, ms); };
+  return doPoll("poll", timeout < 0 ? (uint64_t)-1 : timeout * 1000ull, wait_fd, wait_event, add, check);
+}
+
+int ppoll(struct pollfd* fds, nfds_t nfds, const struct timespec* tmo_p, const sigset_t* sigmask) {
+  if (!gudov::IsHookEnable() || !gudov::IOManager::GetThis()) {
+    return ppollF(fds, nfds, tmo_p, sigmask);
+  }
+
+  int                     wait_fd    = -1;
+  gudov::IOManager::Event wait_event = SinglePollFd(fds, nfds, wait_fd);
+
+  auto add = [=](int epfd) { return AddPollFds(epfd, fds, nfds); };
+  // sigmask 只在每次检查时生效，协程挂起期间不改变线程的信号掩码
+  auto check = [=](int ms) {
+    timespec ts = {ms / 1000, (ms % 1000) * 1000000L};
+    return ppollF(fds, nfds, ms < 0 ? nullptr : &ts, sigmask);
+  };
+  uint64_t timeout_us = tmo_p ? tmo_p->tv_sec * 1000000ull + (tmo_p->tv_nsec + 999) / 1000 : (uint64_t)-1;
+  return doPoll("ppoll", timeout_us, wait_fd, wait_event, add, check);
+}
+
+int select(int nfds, fd_set* readfds, fd_set* writefds, fd_set* exceptfds, struct timeval* timeout) {
+  if (!gudov::IsHookEnable() || !gudov::IOManager::GetThis()) {
+    return selectF(nfds, readfds, writefds, exceptfds, timeout);
+  }
+
+  // selectF 会改写传入的集合，每次检查前恢复
+  fd_set  in[3];
+  fd_set* sets[3] = {readfds, writefds, exceptfds};
+  for (int i = 0; i < 3; ++i) {
+    if (sets[i]) {
+      in[i] = *sets[i];
+    }
+  }
+
+  // 只有一个 fd 且只在读或写集合中时直接等待该 fd
+  int                     wait_fd    = -1;
+  gudov::IOManager::Event wait_event = gudov::IOManager::NONE;
+  for (int i = 0; i < nfds; ++i) {
+    bool read   = readfds && FD_ISSET(i, &in[0]);
+    bool write  = writefds && FD_ISSET(i, &in[1]);
+    bool except = exceptfds && FD_ISSET(i, &in[2]);
+    if (!read && !write && !except) {
+      continue;
+    }
+    if (wait_fd >= 0 || except || (read && write)) {
+      wait_fd = -1;
+      break;
+    }
+    wait_fd    = i;
+    wait_event = read ? gudov::IOManager::READ : gudov::IOManager::WRITE;
+  }
+
+  auto add = [&](int epfd) {
+    static const uint32_t kEvents[3] = {EPOLLIN, EPOLLOUT, EPOLLPRI};
+
+    bool ok = true;
+    for (int fd = 0; fd < nfds; ++fd) {
+      epoll_event event;
+      event.events   = 0;
+      event.data.u64 = fd;
+      for (int i = 0; i < 3; ++i) {
+        if (sets[i] && FD_ISSET(fd, &in[i])) {
+          event.events |= kEvents[i];
+        }
+      }
+      if (event.events && epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &event)) {
+        ok = false;
+      }
+    }
+    return ok;
+  };
+  auto check = [&](int ms) {
+    for (int i = 0; i < 3; ++i) {
+      if (sets[i]) {
+        *sets[i] = in[i];
+      }
+    }
+    timeval tv = {ms / 1000, (ms % 1000) * 1000L};
+    return selectF(nfds, readfds, writefds, exceptfds, ms < 0 ? nullptr : &tv);
+  };
+  uint64_t timeout_us = timeout ? timeout->tv_sec * 1000000ull + timeout->tv_usec : (uint64_t)-1;
+  return doPoll("select", timeout_us, wait_fd, wait_event, add, check);
+}
+
+int epoll_wait(int epfd, struct epoll_event* events, int maxevents, int timeout) {
+  if (!gudov::IsHookEnable() || !gudov::IOManager::GetThis()) {
+    return epoll_waitF(epfd, events, maxevents, timeout);
+  }
+
+  // epoll 实例本身可读表示有就绪的事件
+  auto add = [=](int tmp_epfd) {
+    epoll_event event;
+    event.events   = EPOLLIN;
+    event.data.u64 = 0;
+    return epoll_ctl(tmp_epfd, EPOLL_CTL_ADD, epfd, &event) == 0;
+  };
+  auto check = [=](int ms) { return epoll_waitF(epfd, events, maxevents, ms); };
+  return doPoll("epoll_wait", timeout < 0 ? (uint64_t)-1 : timeout * 1000ull, epfd, gudov::IOManager::READ, add,
+                check);
+}
+
 int close(int fd) {
   if (!gudov::IsHookEnable()) {
     return closeF(fd);
   }
 
-  gudov::FdCtx::ptr ctx = gudov::FdMgr::GetInstance()->Get(fd);
+  gudov::FdCtx* ctx = gudov::FdMgr::GetInstance()->Get(fd);
   if (ctx) {
     auto iom = gudov::IOManager::GetThis();
     if (iom) {
@@ -405,7 +839,7 @@ int fcntl(int fd, int cmd, ...) {
     case F_SETFL: {
       int arg = va_arg(va, int);
       va_end(va);
-      gudov::FdCtx::ptr ctx = gudov::FdMgr::GetInstance()->Get(fd);
+      gudov::FdCtx* ctx = gudov::FdMgr::GetInstance()->Get(fd);
       if (!ctx || ctx->IsClose() || !ctx->IsSocket()) {
         return fcntlF(fd, cmd, arg);
       }
@@ -419,8 +853,8 @@ int fcntl(int fd, int cmd, ...) {
     }
     case F_GETFL: {
       va_end(va);
-      int               arg = fcntlF(fd, cmd);
-      gudov::FdCtx::ptr ctx = gudov::FdMgr::GetInstance()->Get(fd);
+      int           arg = fcntlF(fd, cmd);
+      gudov::FdCtx* ctx = gudov::FdMgr::GetInstance()->Get(fd);
       if (!ctx || ctx->IsClose() || !ctx->IsSocket()) {
         return arg;
       }
@@ -483,8 +917,8 @@ int ioctl(int d, unsigned long request, ...) {
   va_end(va);
 
   if (FIONBIO == request) {
-    bool              userNonblock = !!*(int*)arg;
-    gudov::FdCtx::ptr ctx          = gudov::FdMgr::GetInstance()->Get(d);
+    bool          userNonblock = !!*(int*)arg;
+    gudov::FdCtx* ctx          = gudov::FdMgr::GetInstance()->Get(d);
     if (!ctx || ctx->IsClose() || !ctx->IsSocket()) {
       return ioctlF(d, request, arg);
     }
@@ -503,7 +937,7 @@ int setsockopt(int sockfd, int level, int optname, const void* optval, socklen_t
   }
   if (level == SOL_SOCKET) {
     if (optname == SO_RCVTIMEO || optname == SO_SNDTIMEO) {
-      gudov::FdCtx::ptr ctx = gudov::FdMgr::GetInstance()->Get(sockfd);
+      gudov::FdCtx* ctx = gudov::FdMgr::GetInstance()->Get(sockfd);
       if (ctx) {
         const timeval* v = (const timeval*)optval;
         ctx->SetTimeout(optname, v->tv_sec * 1000 + v->tv_usec / 1000);
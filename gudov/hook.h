@@ -1,8 +1,12 @@
 #pragma once
 
 #include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
 #include <stdint.h>
+#include <sys/epoll.h>
 #include <sys/ioctl.h>
+#include <sys/select.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -83,6 +87,19 @@ extern sendtoFun sendtoF;
 typedef ssize_t (*sendmsgFun)(int s, const struct msghdr *msg, int flags);
 extern sendmsgFun sendmsgF;
 
+// poll
+typedef int (*pollFun)(struct pollfd *fds, nfds_t nfds, int timeout);
+extern pollFun pollF;
+
+typedef int (*ppollFun)(struct pollfd *fds, nfds_t nfds, const struct timespec *tmo_p, const sigset_t *sigmask);
+extern ppollFun ppollF;
+
+typedef int (*selectFun)(int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds, struct timeval *timeout);
+extern selectFun selectF;
+
+typedef int (*epoll_waitFun)(int epfd, struct epoll_event *events, int maxevents, int timeout);
+extern epoll_waitFun epoll_waitF;
+
 // close
 typedef int (*closeFun)(int fd);
 extern closeFun closeF;
@@ -1,6 +1,8 @@
 #include "http_connection.h"
 
 #include "gudov/bytearray.h"
+#include "gudov/cancel.h"
+#include "gudov/future.h"
 #include "gudov/log.h"
 #include "http_parser.h"
 
@@ -95,6 +97,8 @@ HttpResponse::ptr HttpConnection::RecvResponse() {
         }
         len = 0;
       }
+      // 大量小分块可能一直不需要等待数据，每个分块之后检查一次时间片
+      Fiber::MaybeYield();
     } while (!client_parser.chunks_done);
     parser->GetData()->SetBody(body);
   } else {
@@ -198,6 +202,8 @@ HttpResult::ptr HttpConnection::DoRequest(HttpMethod method, Uri::ptr uri, uint6
 }
 
 HttpResult::ptr HttpConnection::DoRequest(HttpRequest::ptr req, Uri::ptr uri, uint64_t timeout_ms) {
+  // 连接、发送、接收共用一个截止时间，调用方的上下文被取消时请求随之中止
+  CancelScope  scope(CancelContext::WithTimeout(timeout_ms));
   Address::ptr addr = uri->CreateAddress();
   if (!addr) {
     return std::make_shared<HttpResult>((int)HttpResult::Error::INVALID_HOST, nullptr,
@@ -372,7 +378,8 @@ HttpResult::ptr HttpConnectionPool::doRequest(HttpMethod method, Uri::ptr uri, u
 }
 
 HttpResult::ptr HttpConnectionPool::doRequest(HttpRequest::ptr req, uint64_t timeout_ms) {
-  auto conn = GetConnection();
+  CancelScope scope(CancelContext::WithTimeout(timeout_ms));
+  auto        conn = GetConnection();
   if (!conn) {
     return std::make_shared<HttpResult>((int)HttpResult::Error::POOL_GET_CONNECTION, nullptr,
                                         "pool host:" + host_ + " port:" + std::to_string(port_));
@@ -402,6 +409,16 @@ HttpResult::ptr HttpConnectionPool::doRequest(HttpRequest::ptr req, uint64_t tim
   return std::make_shared<HttpResult>((int)HttpResult::Error::OK, rsp, "ok");
 }
 
+std::vector<HttpResult::ptr> HttpConnectionPool::doRequests(const std::vector<HttpRequest::ptr>& reqs,
+                                                            uint64_t                             timeout_ms) {
+  std::vector<Future<HttpResult::ptr>> futures;
+  futures.reserve(reqs.size());
+  for (auto& req : reqs) {
+    futures.push_back(Async([this, req, timeout_ms]() { return doRequest(req, timeout_ms); }));
+  }
+  return WhenAll(std::move(futures)).Get();
+}
+
 }  // namespace http
 
 }  // namespace gudov
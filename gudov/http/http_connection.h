@@ -1,6 +1,7 @@
 #pragma once
 
 #include <list>
+#include <vector>
 
 #include "gudov/socket_stream.h"
 #include "gudov/thread.h"
@@ -118,6 +119,13 @@ class HttpConnectionPool {
 
   HttpResult::ptr doRequest(HttpRequest::ptr req, uint64_t timeout_ms);
 
+  /**
+   * @brief 在当前调度器的协程中并发发出 reqs，全部返回后按顺序给出结果
+   * @details 总耗时取决于最慢的一个请求，而不是所有请求之和
+   *
+   */
+  std::vector<HttpResult::ptr> doRequests(const std::vector<HttpRequest::ptr>& reqs, uint64_t timeout_ms);
+
  private:
   static void ReleasePtr(HttpConnection* ptr, HttpConnectionPool* pool);
 
@@ -1,5 +1,7 @@
 #include "http_server.h"
 
+#include "gudov/cancel.h"
+#include "gudov/config.h"
 #include "gudov/log.h"
 
 namespace gudov {
@@ -8,6 +10,9 @@ namespace http {
 
 static gudov::Logger::ptr g_logger = LOG_NAME("system");
 
+static ConfigVar<uint64_t>::ptr g_http_request_timeout = Config::Lookup(
+    "http.server.request_timeout", (uint64_t)0, "deadline in ms for handling one http request, 0 means none");
+
 HttpServer::HttpServer(bool keepalive, IOManager* worker, IOManager* accept_worker)
     : TcpServer(worker, accept_worker), is_keep_alive_(keepalive) {
   dispatch_.reset(new ServletDispatch);
@@ -41,7 +46,12 @@ void HttpServer::HandleClient(Socket::ptr client) {
 
     rsp->SetHeader("Server", GetName());
 
-    dispatch_->Handle(req, rsp, session);
+    {
+      // 处理函数中发起的 hook IO 和派生的协程都受这个截止时间约束
+      uint64_t    timeout = g_http_request_timeout->GetValue();
+      CancelScope scope(CancelContext::WithTimeout(timeout ? timeout : ~0ull));
+      dispatch_->Handle(req, rsp, session);
+    }
 
     session->SendResponse(rsp);
 
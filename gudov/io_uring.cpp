@@ -0,0 +1,145 @@
+#include "io_uring.h"
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include "log.h"
+
+namespace gudov {
+
+static Logger::ptr g_logger = LOG_NAME("system");
+
+IoUring::~IoUring() {
+  if (sqes_) {
+    munmap(sqes_, sqes_size_);
+  }
+  if (cq_ring_ && cq_ring_ != sq_ring_) {
+    munmap(cq_ring_, cq_ring_size_);
+  }
+  if (sq_ring_) {
+    munmap(sq_ring_, sq_ring_size_);
+  }
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+}
+
+bool IoUring::Init(unsigned entries) {
+  io_uring_params params;
+  memset(&params, 0, sizeof(params));
+
+  fd_ = syscall(__NR_io_uring_setup, entries, &params);
+  if (fd_ < 0) {
+    LOG_WARN(g_logger) << "io_uring_setup errno=" << errno << " errstr=" << strerror(errno);
+    fd_ = -1;
+    return false;
+  }
+
+  sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  // 新内核上 SQ 和 CQ 共用一次映射
+  bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+  if (single_mmap) {
+    sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+  }
+
+  sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+  if (sq_ring_ == MAP_FAILED) {
+    sq_ring_ = nullptr;
+    LOG_WARN(g_logger) << "mmap io_uring sq ring errno=" << errno << " errstr=" << strerror(errno);
+    return false;
+  }
+  if (single_mmap) {
+    cq_ring_ = sq_ring_;
+  } else {
+    cq_ring_ =
+        mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+    if (cq_ring_ == MAP_FAILED) {
+      cq_ring_ = nullptr;
+      LOG_WARN(g_logger) << "mmap io_uring cq ring errno=" << errno << " errstr=" << strerror(errno);
+      return false;
+    }
+  }
+
+  sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+  sqes_      = (io_uring_sqe*)mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_,
+                                   IORING_OFF_SQES);
+  if (sqes_ == MAP_FAILED) {
+    sqes_ = nullptr;
+    LOG_WARN(g_logger) << "mmap io_uring sqes errno=" << errno << " errstr=" << strerror(errno);
+    return false;
+  }
+
+  char* sq    = (char*)sq_ring_;
+  sq_head_    = (unsigned*)(sq + params.sq_off.head);
+  sq_tail_    = (unsigned*)(sq + params.sq_off.tail);
+  sq_mask_    = (unsigned*)(sq + params.sq_off.ring_mask);
+  sq_array_   = (unsigned*)(sq + params.sq_off.array);
+  sq_entries_ = params.sq_entries;
+
+  char* cq = (char*)cq_ring_;
+  cq_head_ = (unsigned*)(cq + params.cq_off.head);
+  cq_tail_ = (unsigned*)(cq + params.cq_off.tail);
+  cq_mask_ = (unsigned*)(cq + params.cq_off.ring_mask);
+  cqes_    = (io_uring_cqe*)(cq + params.cq_off.cqes);
+  return true;
+}
+
+io_uring_sqe* IoUring::GetSqe() {
+  unsigned head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+  unsigned tail = *sq_tail_ + to_submit_;
+  if (tail - head >= sq_entries_) {
+    return nullptr;
+  }
+  unsigned      index = tail & *sq_mask_;
+  io_uring_sqe* sqe   = &sqes_[index];
+  memset(sqe, 0, sizeof(io_uring_sqe));
+  sq_array_[index] = index;
+  ++to_submit_;
+  return sqe;
+}
+
+void IoUring::Discard() { to_submit_ = 0; }
+
+int IoUring::Submit() {
+  if (!to_submit_) {
+    return 0;
+  }
+  unsigned tail  = *sq_tail_;
+  unsigned count = to_submit_;
+  __atomic_store_n(sq_tail_, tail + count, __ATOMIC_RELEASE);
+  to_submit_ = 0;
+
+  int rt = 0;
+  do {
+    rt = syscall(__NR_io_uring_enter, fd_, count, 0, 0, nullptr, 0);
+  } while (rt < 0 && errno == EINTR);
+  int error = rt < 0 ? errno : 0;
+
+  unsigned submitted = rt < 0 ? 0 : rt;
+  if (submitted < count) {
+    // 没有 SQPOLL，内核只在 io_uring_enter 中取 sqe。剩下的撤回，调用方返回后其中的指针就会失效
+    __atomic_store_n(sq_tail_, tail + submitted, __ATOMIC_RELEASE);
+    LOG_ERROR(g_logger) << "io_uring_enter submitted " << submitted << "/" << count << " errno=" << error
+                        << " errstr=" << strerror(error);
+  }
+  return rt < 0 ? -error : rt;
+}
+
+size_t IoUring::Reap(std::vector<io_uring_cqe>& cqes) {
+  unsigned head = *cq_head_;
+  unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+  size_t   n    = tail - head;
+  for (; head != tail; ++head) {
+    cqes.push_back(cqes_[head & *cq_mask_]);
+  }
+  __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+  return n;
+}
+
+}  // namespace gudov
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <linux/io_uring.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "noncopyable.h"
+
+namespace gudov {
+
+/**
+ * @brief io_uring 的简单封装
+ * @details 直接使用 io_uring_setup/io_uring_enter 系统调用和 mmap 映射的环形队列，不依赖 liburing。
+ * 本类不加锁，多线程使用时由调用方保证提交和收割各自串行
+ *
+ */
+class IoUring : NonCopyable {
+ public:
+  IoUring() = default;
+  ~IoUring();
+
+  /**
+   * @brief 创建 io_uring 实例
+   *
+   * @param entries 提交队列长度
+   * @return false 内核不支持或被禁用
+   */
+  bool Init(unsigned entries);
+
+  int GetFd() const { return fd_; }
+
+  /**
+   * @brief 取一个空闲的 sqe，内容已清零
+   *
+   * @return io_uring_sqe* 队列已满时返回 nullptr，需要先 Submit()
+   */
+  io_uring_sqe* GetSqe();
+
+  /**
+   * @brief 丢弃所有已填写但还未提交的 sqe
+   *
+   */
+  void Discard();
+
+  /**
+   * @brief 提交所有已填写的 sqe
+   * @details 内核没有取走的 sqe (出错或只提交了一部分) 会被撤回，不会在之后的 Submit() 中提交
+   *
+   * @return int 提交的数量，失败返回 -errno
+   */
+  int Submit();
+
+  /**
+   * @brief 取出所有已完成的 cqe
+   *
+   * @param cqes
+   * @return size_t 取出的数量
+   */
+  size_t Reap(std::vector<io_uring_cqe>& cqes);
+
+ private:
+  int fd_ = -1;
+
+  void*  sq_ring_      = nullptr;
+  size_t sq_ring_size_ = 0;
+  void*  cq_ring_      = nullptr;
+  size_t cq_ring_size_ = 0;
+
+  io_uring_sqe* sqes_      = nullptr;
+  size_t        sqes_size_ = 0;
+
+  unsigned* sq_head_    = nullptr;
+  unsigned* sq_tail_    = nullptr;
+  unsigned* sq_mask_    = nullptr;
+  unsigned* sq_array_   = nullptr;
+  unsigned  sq_entries_ = 0;
+
+  unsigned*     cq_head_ = nullptr;
+  unsigned*     cq_tail_ = nullptr;
+  unsigned*     cq_mask_ = nullptr;
+  io_uring_cqe* cqes_    = nullptr;
+
+  /// @brief 已填写但还未提交的 sqe 数量
+  unsigned to_submit_ = 0;
+};
+
+}  // namespace gudov
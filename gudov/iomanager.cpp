@@ -1,12 +1,18 @@
 #include "iomanager.h"
 
 #include <fcntl.h>
+#include <poll.h>
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
 #include <unistd.h>
 
 #include <cerrno>
 #include <cstring>
 
+#include "config.h"
+#include "hook.h"
+#include "io_uring.h"
 #include "log.h"
 #include "macro.h"
 
@@ -18,6 +24,51 @@ static const int MAX_TIMEOUT = 2000;
 
 static const uint64_t MAX_EVENTS = 10000;
 
+static ConfigVar<std::string>::ptr g_iomanager_backend =
+    Config::Lookup<std::string>("iomanager.backend", "epoll", "io backend: epoll or io_uring");
+
+static ConfigVar<bool>::ptr g_iomanager_per_thread_reactor = Config::Lookup<bool>(
+    "iomanager.per_thread_reactor", false, "each worker thread owns its epoll and the fds registered from it");
+
+static ConfigVar<bool>::ptr g_iomanager_persistent_epoll =
+    Config::Lookup<bool>("iomanager.persistent_epoll", false,
+                         "register fds once with EPOLLIN|EPOLLOUT|EPOLLET and latch readiness until close");
+
+static ConfigVar<bool>::ptr g_iomanager_per_thread_timers = Config::Lookup<bool>(
+    "iomanager.per_thread_timers", false, "each worker thread owns the timers it creates and checks them alone");
+
+static ConfigVar<bool>::ptr g_iomanager_timerfd = Config::Lookup<bool>(
+    "iomanager.timerfd", false, "wait for timers with a per-worker timerfd at microsecond precision");
+
+/// @brief 工作线程 epoll 中 eventfd 的 data.u64
+static const uint64_t WAKER_EVENT_DATA = 0;
+/// @brief 工作线程 epoll 中嵌套的 epfd_ 或 ring fd 的 data.u64，fd 事件的 data.ptr 为 FdContext*
+static const uint64_t NESTED_EVENT_DATA = 1;
+/// @brief 工作线程 epoll 中 timerfd 的 data.u64
+static const uint64_t TIMER_EVENT_DATA = 2;
+
+/// @brief io_uring 提交队列长度
+static const unsigned URING_ENTRIES = 1024;
+
+/// @brief user_data 最高位为 1 表示 fd 的 POLL_ADD，为 0 表示 SubmitIO 的请求 (UringOp 指针) 或无需处理
+static const uint64_t URING_POLL_TAG = 1ull << 63;
+
+static uint64_t EncodeUringPoll(int fd, uint32_t seq, IOManager::Event event) {
+  return URING_POLL_TAG | ((uint64_t)(uint32_t)fd << 32) | ((uint64_t)(seq & 0x7fffffff) << 1) |
+         (event == IOManager::WRITE ? 1 : 0);
+}
+
+/**
+ * @brief SubmitIO 提交的请求，位于发起协程的栈上，完成后由收割线程填写结果并唤醒协程
+ *
+ */
+struct UringOp {
+  Fiber::ptr        fiber;
+  std::atomic<int>* inflight = nullptr;
+  int               thread   = -1;  // 提交请求的线程，完成后回到该线程继续执行
+  int               res      = 0;
+};
+
 IOManager::FdContext::EventContext& IOManager::FdContext::GetContext(IOManager::Event event) {
   switch (event) {
     case IOManager::Event::READ:
@@ -32,6 +83,7 @@ IOManager::FdContext::EventContext& IOManager::FdContext::GetContext(IOManager::
 
 void IOManager::FdContext::ReSetContext(IOManager::FdContext::EventContext& ctx) {
   ctx.scheduler = nullptr;
+  ctx.thread    = -1;
   ctx.fiber.reset();
   ctx.callback = nullptr;
 }
@@ -43,9 +95,9 @@ void IOManager::FdContext::TriggerEvent(IOManager::Event event) {
   EventContext& ctx = GetContext(event);
 
   if (ctx.callback) {
-    ctx.scheduler->Schedule(&ctx.callback);
+    ctx.scheduler->Schedule(&ctx.callback, ctx.thread);
   } else {
-    ctx.scheduler->Schedule(&ctx.fiber);
+    ctx.scheduler->Schedule(&ctx.fiber, ctx.thread);
   }
   ReSetContext(ctx);
 }
@@ -54,86 +106,160 @@ IOManager::IOManager(size_t threads, bool use_caller, const std::string& name) :
   epfd_ = epoll_create(5);
   GUDOV_ASSERT(epfd_ > 0);
 
-  int rt = pipe(tickle_fds_);
-  GUDOV_ASSERT(!rt);
-
-  // 将管道读端放入 epoll 进行监听
-  epoll_event event;
-  memset(&event, 0, sizeof(epoll_event));
-  event.events  = EPOLLIN | EPOLLET;
-  event.data.fd = tickle_fds_[0];
+  // 每个工作线程一个 ring，任意一个创建失败都退回 epoll
+  std::vector<std::unique_ptr<IoUring>> rings;
+  if (g_iomanager_backend->GetValue() == "io_uring") {
+    for (size_t i = 0; i < GetWorkerCount(); ++i) {
+      std::unique_ptr<IoUring> ring(new IoUring);
+      if (!ring->Init(URING_ENTRIES)) {
+        LOG_WARN(g_logger) << "io_uring is not supported, fall back to epoll";
+        rings.clear();
+        break;
+      }
+      rings.push_back(std::move(ring));
+    }
+    uring_ = !rings.empty();
+  }
+  if (g_iomanager_per_thread_reactor->GetValue()) {
+    if (uring_) {
+      LOG_WARN(g_logger) << "iomanager.per_thread_reactor is ignored by the io_uring backend";
+    } else {
+      per_thread_reactor_ = true;
+    }
+  }
+  if (g_iomanager_persistent_epoll->GetValue()) {
+    if (uring_) {
+      LOG_WARN(g_logger) << "iomanager.persistent_epoll is ignored by the io_uring backend";
+    } else {
+      persistent_epoll_ = true;
+    }
+  }
+  timer_fd_ = g_iomanager_timerfd->GetValue();
+
+  // 每个工作线程一个 eventfd 和一个只属于自己的 epoll，共享模式下 epfd_ 嵌套在其中
+  for (size_t i = 0; i < GetWorkerCount(); ++i) {
+    std::unique_ptr<Waker> waker(new Waker);
+    waker->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    GUDOV_ASSERT(waker->event_fd >= 0);
+    waker->epfd = epoll_create1(EPOLL_CLOEXEC);
+    GUDOV_ASSERT(waker->epfd >= 0);
+
+    epoll_event event;
+    memset(&event, 0, sizeof(epoll_event));
+    event.events   = EPOLLIN;
+    event.data.u64 = WAKER_EVENT_DATA;
+    int rt         = epoll_ctl(waker->epfd, EPOLL_CTL_ADD, waker->event_fd, &event);
+    GUDOV_ASSERT(!rt);
+
+    if (uring_) {
+      // ring fd 在有完成事件时可读，代替 epfd_ 嵌套进本线程的 epoll
+      waker->uring   = std::move(rings[i]);
+      event.data.u64 = NESTED_EVENT_DATA;
+      rt             = epoll_ctl(waker->epfd, EPOLL_CTL_ADD, waker->uring->GetFd(), &event);
+      GUDOV_ASSERT(!rt);
+    } else if (!per_thread_reactor_) {
+      event.data.u64 = NESTED_EVENT_DATA;
+      rt             = epoll_ctl(waker->epfd, EPOLL_CTL_ADD, epfd_, &event);
+      GUDOV_ASSERT(!rt);
+    }
 
-  // 非阻塞方式，配合边缘触发
-  rt = fcntl(tickle_fds_[0], F_SETFL, O_NONBLOCK);
-  GUDOV_ASSERT(!rt);
+    if (timer_fd_) {
+      waker->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+      GUDOV_ASSERT(waker->timer_fd >= 0);
+      event.data.u64 = TIMER_EVENT_DATA;
+      rt             = epoll_ctl(waker->epfd, EPOLL_CTL_ADD, waker->timer_fd, &event);
+      GUDOV_ASSERT(!rt);
+    }
 
-  // 如果管道可读，epoll_wait() 就会返回
-  rt = epoll_ctl(epfd_, EPOLL_CTL_ADD, tickle_fds_[0], &event);
-  GUDOV_ASSERT(!rt);
+    wakers_.push_back(std::move(waker));
+  }
 
-  ContextResize(32);
+  if (g_iomanager_per_thread_timers->GetValue()) {
+    InitTimerShards(GetWorkerCount());
+  }
 
   Start();
 }
 
 IOManager::~IOManager() {
   Stop();
-  close(epfd_);
-  close(tickle_fds_[0]);
-  close(tickle_fds_[1]);
-
-  for (size_t i = 0; i < fd_contexts_.size(); ++i) {
-    if (fd_contexts_[i]) {
-      delete fd_contexts_[i];
+  for (auto& waker : wakers_) {
+    close(waker->epfd);
+    close(waker->event_fd);
+    if (waker->timer_fd >= 0) {
+      close(waker->timer_fd);
     }
+    waker->uring.reset();
   }
+  close(epfd_);
 }
 
-void IOManager::ContextResize(size_t size) {
-  fd_contexts_.resize(size);
-
-  for (size_t i = 0; i < fd_contexts_.size(); ++i) {
-    if (!fd_contexts_[i]) {
-      fd_contexts_[i]     = new FdContext;
-      fd_contexts_[i]->fd = i;
-    }
-  }
+int IOManager::AddEvent(int fd, Event event, std::function<void()> callback) {
+  return RegisterEvent(fd, event, std::move(callback), false);
 }
 
-int IOManager::AddEvent(int fd, Event event, std::function<void()> callback) {
-  FdContext* fd_ctx = nullptr;
-  // 得到对应 fd 下标的 context，如果越界就将 _fdContexts 扩容
-  RWMutexType::ReadLock lock(mutex_);
-  if ((int)fd_contexts_.size() > fd) {
-    fd_ctx = fd_contexts_[fd];
-    lock.Unlock();
-  } else {
-    lock.Unlock();
-    RWMutexType::WriteLock lock2(mutex_);
-    ContextResize(fd * 1.5);
-    GUDOV_ASSERT((int)fd_contexts_.size() > fd);
-    fd_ctx = fd_contexts_[fd];
+int IOManager::TryAddEvent(int fd, Event event) { return RegisterEvent(fd, event, nullptr, true); }
+
+int IOManager::RegisterEvent(int fd, Event event, std::function<void()> callback, bool may_exist) {
+  // 得到对应 fd 下标的 context，所在的块不存在时分配
+  FdContext* fd_ctx = fd_contexts_.Get(fd);
+  if (!fd_ctx) {
+    LOG_ERROR(g_logger) << "AddEvent fd=" << fd << " out of range";
+    return -1;
   }
 
   FdContext::MutexType::Locker lock2(fd_ctx->mutex);
   if (fd_ctx->events & event) {
+    if (may_exist) {
+      return 1;
+    }
     // 已经添加过该事件
     LOG_ERROR(g_logger) << "AddEvent assert fd=" << fd << " event=" << event << " fdCtx.event=" << fd_ctx->events;
     GUDOV_ASSERT(!(fd_ctx->events & event));
   }
 
-  // 判断是修改还是添加
-  int op = fd_ctx->events ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+  int thread = -1;
+  if (uring_) {
+    if (!UringPollAdd(fd_ctx, event)) {
+      return -1;
+    }
+  } else if (persistent_epoll_) {
+    // 第一次等待时同时注册读写，之后不再修改，直到 CancelAll
+    int epfd = SelectReactor(thread);
+    if (fd_ctx->epfd < 0) {
+      epoll_event epevent;
+      epevent.events   = EPOLLIN | EPOLLOUT | EPOLLET;
+      epevent.data.ptr = fd_ctx;
+
+      int rt = EpollCtl(epfd, EPOLL_CTL_ADD, fd, &epevent);
+      if (rt) {
+        LOG_ERROR(g_logger) << "epoll_ctl(" << epfd << ", " << EPOLL_CTL_ADD << "," << fd << "," << epevent.events
+                            << "):" << rt << " (" << errno << ") (" << strerror(errno) << ")";
+        return -1;
+      }
+      fd_ctx->epfd  = epfd;
+      fd_ctx->ready = NONE;
+    }
+  } else {
+    // 判断是修改还是添加，已有事件时继续使用原来注册的 epoll
+    int epfd = SelectReactor(thread);
+    int op   = EPOLL_CTL_ADD;
+    if (fd_ctx->events) {
+      op   = EPOLL_CTL_MOD;
+      epfd = fd_ctx->epfd;
+    }
 
-  epoll_event epevent;
-  epevent.events   = EPOLLET | fd_ctx->events | event;
-  epevent.data.ptr = fd_ctx;
+    epoll_event epevent;
+    epevent.events   = EPOLLET | fd_ctx->events | event;
+    epevent.data.ptr = fd_ctx;
 
-  int rt = epoll_ctl(epfd_, op, fd, &epevent);
-  if (rt) {
-    LOG_ERROR(g_logger) << "epoll_ctl(" << epfd_ << ", " << op << "," << fd << "," << epevent.events << "):" << rt
-                        << " (" << errno << ") (" << strerror(errno) << ")";
-    return -1;
+    int rt = EpollCtl(epfd, op, fd, &epevent);
+    if (rt) {
+      LOG_ERROR(g_logger) << "epoll_ctl(" << epfd << ", " << op << "," << fd << "," << epevent.events << "):" << rt
+                          << " (" << errno << ") (" << strerror(errno) << ")";
+      return -1;
+    }
+    fd_ctx->epfd = epfd;
   }
 
   // 待执行 IO 事件数量加 1
@@ -147,6 +273,7 @@ int IOManager::AddEvent(int fd, Event event, std::function<void()> callback) {
 
   // 为该事件分配调用资源
   event_ctx.scheduler = Scheduler::GetScheduler();
+  event_ctx.thread    = thread;
   if (callback) {
     // 如果指定了调度函数则执行该函数
     event_ctx.callback.swap(callback);
@@ -155,17 +282,22 @@ int IOManager::AddEvent(int fd, Event event, std::function<void()> callback) {
     event_ctx.fiber = Fiber::GetRunningFiber();
     GUDOV_ASSERT2(event_ctx.fiber->GetState() == Fiber::Running, "state=" << event_ctx.fiber->GetState());
   }
+
+  if (fd_ctx->ready & event) {
+    // 等待之前已经就绪过，不再等 epoll，直接调度；协程 Yield 后立即恢复
+    fd_ctx->ready = (Event)(fd_ctx->ready & ~event);
+    fd_ctx->TriggerEvent(event);
+    --pending_event_cnt_;
+  }
   return 0;
 }
 
 bool IOManager::DelEvent(int fd, Event event) {
-  RWMutexType::ReadLock lock(mutex_);
-  if ((int)fd_contexts_.size() <= fd) {
-    // 该 fd 超出范围
+  FdContext* fd_ctx = fd_contexts_.Find(fd);
+  if (!fd_ctx) {
+    // 该 fd 从未注册过
     return false;
   }
-  FdContext* fd_ctx = fd_contexts_[fd];
-  lock.Unlock();
 
   FdContext::MutexType::Locker lock2(fd_ctx->mutex);
   if (!(fd_ctx->events & event)) {
@@ -174,17 +306,24 @@ bool IOManager::DelEvent(int fd, Event event) {
   }
 
   Event new_events = (Event)(fd_ctx->events & ~event);
-  int   op         = new_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
-
-  epoll_event epevent;
-  epevent.events   = EPOLLET | new_events;
-  epevent.data.ptr = fd_ctx;
-
-  int rt = epoll_ctl(epfd_, op, fd, &epevent);
-  if (rt) {
-    LOG_ERROR(g_logger) << "epoll_ctl(" << epfd_ << ", " << op << "," << fd << "," << epevent.events << "):" << rt
-                        << " (" << errno << ") (" << strerror(errno) << ")";
-    return false;
+  if (uring_) {
+    UringPollRemove(fd_ctx, event);
+  } else if (!persistent_epoll_) {
+    int op = new_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
+
+    epoll_event epevent;
+    epevent.events   = EPOLLET | new_events;
+    epevent.data.ptr = fd_ctx;
+
+    int rt = EpollCtl(fd_ctx->epfd, op, fd, &epevent);
+    if (rt) {
+      LOG_ERROR(g_logger) << "epoll_ctl(" << fd_ctx->epfd << ", " << op << "," << fd << "," << epevent.events
+                          << "):" << rt << " (" << errno << ") (" << strerror(errno) << ")";
+      return false;
+    }
+    if (!new_events) {
+      fd_ctx->epfd = -1;
+    }
   }
 
   --pending_event_cnt_;
@@ -198,29 +337,34 @@ bool IOManager::DelEvent(int fd, Event event) {
 }
 
 bool IOManager::CancelEvent(int fd, Event event) {
-  RWMutexType::ReadLock lock(mutex_);
-  if ((int)fd_contexts_.size() <= fd) {
+  FdContext* fd_ctx = fd_contexts_.Find(fd);
+  if (!fd_ctx) {
     return false;
   }
-  FdContext* fd_ctx = fd_contexts_[fd];
-  lock.Unlock();
 
   FdContext::MutexType::Locker lock2(fd_ctx->mutex);
   if (!(fd_ctx->events & event)) {
     return false;
   }
 
-  Event       new_events = (Event)(fd_ctx->events & ~event);
-  int         op         = new_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
-  epoll_event epevent;
-  epevent.events   = EPOLLET | new_events;
-  epevent.data.ptr = fd_ctx;
-
-  int rt = epoll_ctl(epfd_, op, fd, &epevent);
-  if (rt) {
-    LOG_ERROR(g_logger) << "epoll_ctl(" << epfd_ << ", " << op << "," << fd << "," << epevent.events << "):" << rt
-                        << " (" << errno << ") (" << strerror(errno) << ")";
-    return false;
+  if (uring_) {
+    UringPollRemove(fd_ctx, event);
+  } else if (!persistent_epoll_) {
+    Event       new_events = (Event)(fd_ctx->events & ~event);
+    int         op         = new_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
+    epoll_event epevent;
+    epevent.events   = EPOLLET | new_events;
+    epevent.data.ptr = fd_ctx;
+
+    int rt = EpollCtl(fd_ctx->epfd, op, fd, &epevent);
+    if (rt) {
+      LOG_ERROR(g_logger) << "epoll_ctl(" << fd_ctx->epfd << ", " << op << "," << fd << "," << epevent.events
+                          << "):" << rt << " (" << errno << ") (" << strerror(errno) << ")";
+      return false;
+    }
+    if (!new_events) {
+      fd_ctx->epfd = -1;
+    }
   }
 
   // 删除前触发一次
@@ -230,28 +374,58 @@ bool IOManager::CancelEvent(int fd, Event event) {
 }
 
 bool IOManager::CancelAll(int fd) {
-  RWMutexType::ReadLock lock(mutex_);
-  if ((int)fd_contexts_.size() <= fd) {
+  FdContext* fd_ctx = fd_contexts_.Find(fd);
+  if (!fd_ctx) {
     return false;
   }
-  FdContext* fd_ctx = fd_contexts_[fd];
-  lock.Unlock();
 
   FdContext::MutexType::Locker lock2(fd_ctx->mutex);
+  if (uring_ && fd_ctx->inflight) {
+    // 取消该 fd 上通过 SubmitIO 提交的所有请求，协程会收到 -ECANCELED；
+    // 请求可能由不同线程提交到各自的 ring，每个 ring 都要取消
+    for (auto& waker : wakers_) {
+      Mutex::Locker lock3(waker->uring_mutex);
+      io_uring_sqe* sqe = waker->uring->GetSqe();
+      if (sqe) {
+        sqe->opcode       = IORING_OP_ASYNC_CANCEL;
+        sqe->fd           = fd;
+        sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+        waker->uring->Submit();
+      }
+    }
+  }
+  if (persistent_epoll_ && fd_ctx->epfd >= 0) {
+    // 常驻注册只在这里撤销，fd 可能已经被关闭，不关心结果
+    epoll_event epevent;
+    memset(&epevent, 0, sizeof(epoll_event));
+    EpollCtl(fd_ctx->epfd, EPOLL_CTL_DEL, fd, &epevent);
+    fd_ctx->epfd  = -1;
+    fd_ctx->ready = NONE;
+  }
   if (!fd_ctx->events) {
     return false;
   }
 
-  int         op = EPOLL_CTL_DEL;
-  epoll_event epevent;
-  epevent.events   = 0;
-  epevent.data.ptr = fd_ctx;
-
-  int rt = epoll_ctl(epfd_, op, fd, &epevent);
-  if (rt) {
-    LOG_ERROR(g_logger) << "epoll_ctl(" << epfd_ << ", " << op << "," << fd << "," << epevent.events << "):" << rt
-                        << " (" << errno << ") (" << strerror(errno) << ")";
-    return false;
+  if (uring_) {
+    if (fd_ctx->events & READ) {
+      UringPollRemove(fd_ctx, READ);
+    }
+    if (fd_ctx->events & WRITE) {
+      UringPollRemove(fd_ctx, WRITE);
+    }
+  } else if (!persistent_epoll_) {
+    int         op = EPOLL_CTL_DEL;
+    epoll_event epevent;
+    epevent.events   = 0;
+    epevent.data.ptr = fd_ctx;
+
+    int rt = EpollCtl(fd_ctx->epfd, op, fd, &epevent);
+    if (rt) {
+      LOG_ERROR(g_logger) << "epoll_ctl(" << fd_ctx->epfd << ", " << op << "," << fd << "," << epevent.events
+                          << "):" << rt << " (" << errno << ") (" << strerror(errno) << ")";
+      return false;
+    }
+    fd_ctx->epfd = -1;
   }
 
   if (fd_ctx->events & READ) {
@@ -267,26 +441,275 @@ bool IOManager::CancelAll(int fd) {
   return true;
 }
 
+int IOManager::EpollCtl(int epfd, int op, int fd, epoll_event* event) {
+  ++epoll_ctl_count_;
+  return epoll_ctl(epfd, op, fd, event);
+}
+
+int IOManager::SelectReactor(int& thread) {
+  thread = -1;
+  if (!per_thread_reactor_) {
+    return epfd_;
+  }
+  int index = Scheduler::GetScheduler() == this ? GetWorkerIndex() : -1;
+  if (index < 0) {
+    index = next_waker_++ % wakers_.size();
+  }
+  thread = GetWorkerThreadId(index);
+  return wakers_[index]->epfd;
+}
+
+int IOManager::SelectRing() {
+  int index = Scheduler::GetScheduler() == this ? GetWorkerIndex() : -1;
+  if (index < 0) {
+    index = next_waker_++ % wakers_.size();
+  }
+  return index;
+}
+
+bool IOManager::UringPollAdd(FdContext* fd_ctx, Event event) {
+  FdContext::EventContext& event_ctx = fd_ctx->GetContext(event);
+  ++event_ctx.seq;
+  event_ctx.ring = SelectRing();
+
+  Waker&        waker = *wakers_[event_ctx.ring];
+  Mutex::Locker lock(waker.uring_mutex);
+  io_uring_sqe* sqe = waker.uring->GetSqe();
+  if (!sqe) {
+    LOG_ERROR(g_logger) << "io_uring submission queue full, fd=" << fd_ctx->fd;
+    return false;
+  }
+  sqe->opcode        = IORING_OP_POLL_ADD;
+  sqe->fd            = fd_ctx->fd;
+  sqe->poll32_events = event == READ ? POLLIN : POLLOUT;
+  sqe->user_data     = EncodeUringPoll(fd_ctx->fd, event_ctx.seq, event);
+  return waker.uring->Submit() > 0;
+}
+
+void IOManager::UringPollRemove(FdContext* fd_ctx, Event event) {
+  // POLL_REMOVE 只能撤销同一个 ring 中的请求
+  FdContext::EventContext& event_ctx = fd_ctx->GetContext(event);
+  Waker&                   waker     = *wakers_[event_ctx.ring];
+
+  Mutex::Locker lock(waker.uring_mutex);
+  io_uring_sqe* sqe = waker.uring->GetSqe();
+  if (!sqe) {
+    LOG_ERROR(g_logger) << "io_uring submission queue full, fd=" << fd_ctx->fd;
+    return;
+  }
+  // 被撤销的 POLL_ADD 以 -ECANCELED 完成，收割时按 seq 忽略
+  sqe->opcode    = IORING_OP_POLL_REMOVE;
+  sqe->addr      = EncodeUringPoll(fd_ctx->fd, event_ctx.seq, event);
+  sqe->user_data = 0;
+  waker.uring->Submit();
+}
+
+int IOManager::SubmitIO(int fd, const PrepareFunc& prepare, uint64_t timeout_ms) {
+  GUDOV_ASSERT(uring_);
+  FdContext* fd_ctx = fd_contexts_.Get(fd);
+  if (!fd_ctx) {
+    return -EBADF;
+  }
+
+  UringOp op;
+  op.fiber    = Fiber::GetRunningFiber();
+  op.inflight = &fd_ctx->inflight;
+  op.thread   = GetThreadId();
+
+  // 提交到当前线程的 ring，完成事件也由当前线程收割
+  int      index = SelectRing();
+  Waker&   waker = *wakers_[index];
+  IoUring* uring = waker.uring.get();
+
+  bool linked = false;
+  {
+    Mutex::Locker lock(waker.uring_mutex);
+    io_uring_sqe* sqe = uring->GetSqe();
+    if (!sqe) {
+      return -EAGAIN;
+    }
+    prepare(sqe);
+    sqe->user_data = (uint64_t)&op;
+
+    // 超时通过链接在请求后的 IORING_OP_LINK_TIMEOUT 实现，时间参数在提交时就被内核读取
+    __kernel_timespec ts;
+    if (timeout_ms != ~0ull) {
+      io_uring_sqe* timeout_sqe = uring->GetSqe();
+      if (!timeout_sqe) {
+        // 不能不带超时地提交，撤回已填写的请求，由调用方重试
+        uring->Discard();
+        return -EAGAIN;
+      }
+      ts.tv_sec              = timeout_ms / 1000;
+      ts.tv_nsec             = timeout_ms % 1000 * 1000000;
+      sqe->flags            |= IOSQE_IO_LINK;
+      timeout_sqe->opcode    = IORING_OP_LINK_TIMEOUT;
+      timeout_sqe->addr      = (uint64_t)&ts;
+      timeout_sqe->len       = 1;
+      timeout_sqe->user_data = 0;
+    }
+
+    ++fd_ctx->inflight;
+    ++pending_event_cnt_;
+    // 没有被内核取走的 sqe 由 Submit() 撤回，op 和 ts 只在内核取走后才会被访问
+    int rt = uring->Submit();
+    if (rt <= 0) {
+      --fd_ctx->inflight;
+      --pending_event_cnt_;
+      return rt < 0 ? rt : -EAGAIN;
+    }
+    linked = timeout_ms == ~0ull || rt > 1;
+  }
+
+  // 请求已被取走但 LINK_TIMEOUT 被撤回时必须等到请求完成，改由定时器到期后取消请求。
+  // waiting 在 waker.uring_mutex 下读写，op 返回后定时器不会再按它的地址取消其他请求
+  Timer::ptr            timer;
+  std::shared_ptr<bool> waiting;
+  if (!linked) {
+    LOG_WARN(g_logger) << "io_uring link timeout not submitted, fd=" << fd << " fallback to timer";
+    uint64_t data = (uint64_t)&op;
+    waiting       = std::make_shared<bool>(true);
+
+    timer = AddTimer(timeout_ms, [this, index, waiting, data]() {
+      // 定时器可能在其他线程上到期，取消请求要提交到发起请求的 ring
+      IoUring*      uring = wakers_[index]->uring.get();
+      Mutex::Locker lock(wakers_[index]->uring_mutex);
+      io_uring_sqe* sqe = *waiting ? uring->GetSqe() : nullptr;
+      if (sqe) {
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->addr   = data;
+        uring->Submit();
+      }
+    });
+  }
+
+  Fiber::GetRunningFiber()->Yield();
+
+  if (timer) {
+    timer->Cancel();
+    Mutex::Locker lock(waker.uring_mutex);
+    *waiting = false;
+  }
+
+  // 超时可能由 LINK_TIMEOUT 取消 (-ECANCELED/-EINTR)，也可能是 io-wq 中阻塞执行时
+  // 内核自身的 SO_RCVTIMEO/SO_SNDTIMEO 先到期 (-EAGAIN)，统一按超时返回
+  if (timeout_ms != ~0ull && (op.res == -ECANCELED || op.res == -EINTR || op.res == -EAGAIN)) {
+    return -ETIMEDOUT;
+  }
+  return op.res;
+}
+
+size_t IOManager::ProcessUringCompletions(Waker& waker) {
+  static thread_local std::vector<io_uring_cqe> cqes;
+  cqes.clear();
+  // 只有本线程收割自己的 ring，完成队列与提交队列互不影响，不需要加锁
+  waker.uring->Reap(cqes);
+
+  for (auto& cqe : cqes) {
+    uint64_t data = cqe.user_data;
+    if (!data) {
+      continue;
+    }
+
+    if (!(data & URING_POLL_TAG)) {
+      // SubmitIO 的请求完成，写回结果后唤醒协程，之后不能再访问 op
+      UringOp*   op     = (UringOp*)data;
+      Fiber::ptr fiber  = std::move(op->fiber);
+      int        thread = op->thread;
+      op->res           = cqe.res;
+      --(*op->inflight);
+      --pending_event_cnt_;
+      // hook 函数返回后在调用线程设置 errno，不能换线程恢复
+      Schedule(std::move(fiber), thread);
+      continue;
+    }
+
+    int      fd    = (data >> 32) & 0x7fffffff;
+    uint32_t seq   = (data >> 1) & 0x7fffffff;
+    Event    event = (data & 1) ? WRITE : READ;
+    if (cqe.res == -ECANCELED) {
+      continue;
+    }
+
+    FdContext* fd_ctx = fd_contexts_.Find(fd);
+    if (!fd_ctx) {
+      continue;
+    }
+
+    FdContext::MutexType::Locker lock2(fd_ctx->mutex);
+    if (!(fd_ctx->events & event) || (fd_ctx->GetContext(event).seq & 0x7fffffff) != seq) {
+      // 事件已被删除或重新注册，这是之前一次注册的结果
+      continue;
+    }
+    fd_ctx->TriggerEvent(event);
+    --pending_event_cnt_;
+  }
+  return cqes.size();
+}
+
 IOManager* IOManager::GetThis() { return dynamic_cast<IOManager*>(Scheduler::GetScheduler()); }
 
+IOManager::WakeupStats IOManager::GetWakeupStats() const {
+  WakeupStats stats;
+  stats.tickles  = tickle_count_;
+  stats.wakeups  = wakeup_count_;
+  stats.spurious = spurious_count_;
+  return stats;
+}
+
+size_t IOManager::GetSleepingCount() const {
+  size_t count = 0;
+  for (auto& waker : wakers_) {
+    if (waker->sleeping) {
+      ++count;
+    }
+  }
+  return count;
+}
+
+uint64_t IOManager::GetEpollCtlCount() const { return epoll_ctl_count_; }
+
 /**
  * 通知调度协程、也就是Scheduler::run()从idle中退出
- * Scheduler::run()每次从idle协程中退出之后，都会重新把任务队列里的所有任务执行完了再重新进入idle
- * 如果没有调度线程处理于idle状态，那也就没必要发通知了
+ * 工作线程在进入 epoll_wait 前会先把 sleeping 置为 true 再检查一遍队列，
+ * 这里在任务入队之后再读 sleeping，两边至少有一方能看到对方，不会丢失唤醒
  */
+bool IOManager::WakeUp(Waker& waker) {
+  bool sleeping = true;
+  if (!waker.sleeping.compare_exchange_strong(sleeping, false)) {
+    return false;
+  }
+  int rt = eventfd_write(waker.event_fd, 1);
+  GUDOV_ASSERT(rt == 0);
+  ++tickle_count_;
+  LOG_DEBUG(g_logger) << "write eventfd=" << waker.event_fd;
+  return true;
+}
+
 void IOManager::Tickle() {
-  if (HasIdleThreads()) {
+  // 任务不指定线程，唤醒任意一个空闲线程即可
+  size_t count = wakers_.size();
+  size_t start = next_waker_++;
+  for (size_t i = 0; i < count; ++i) {
+    if (WakeUp(*wakers_[(start + i) % count])) {
+      return;
+    }
+  }
+}
+
+void IOManager::TickleThread(int thread) {
+  int index = FindWorker(thread);
+  if (index < 0) {
+    Tickle();
     return;
   }
-  int rt = write(tickle_fds_[1], "T", 1);
-  LOG_DEBUG(g_logger) << "write data to tickleFds[1]";
-  GUDOV_ASSERT(rt == 1);
+  WakeUp(*wakers_[index]);
 }
 
 bool IOManager::Stopping(uint64_t& timeout) {
   // 对于IOManager而言，必须等所有待调度的IO事件都执行完了才可以退出
   // 增加定时器功能后，还应该保证没有剩余的定时器待触发
-  timeout = GetNextTimeout();
+  timeout = GetNextTimeoutUS();
   return timeout == ~0ull && pending_event_cnt_ == 0 && Scheduler::Stopping();
 }
 
@@ -295,6 +718,26 @@ bool IOManager::Stopping() {
   return Stopping(timeout);
 }
 
+int IOManager::FilterWakerEvents(Waker& waker, epoll_event* events, int n, bool& tickled) {
+  // 挑出 eventfd、timerfd 和嵌套的 epoll，剩下的是注册在本线程上的 fd 事件
+  int count = 0;
+  for (int i = 0; i < n; ++i) {
+    if (events[i].data.u64 == WAKER_EVENT_DATA) {
+      eventfd_t dummy;
+      eventfd_read(waker.event_fd, &dummy);
+      tickled = true;
+    } else if (events[i].data.u64 == TIMER_EVENT_DATA) {
+      uint64_t expirations;
+      readF(waker.timer_fd, &expirations, sizeof(expirations));
+      // 已经触发，下次需要重新设置
+      waker.deadline = 0;
+    } else if (events[i].data.u64 != NESTED_EVENT_DATA) {
+      events[count++] = events[i];
+    }
+  }
+  return count;
+}
+
 /**
  * 调度器无调度任务时会阻塞idle协程上，对IO调度器而言，idle状态应该关注两件事，一是有没有新的调度任务，对应Schduler::schedule()，
  * 如果有新的调度任务，那应该立即退出idle状态，并执行对应的任务；二是关注当前注册的所有IO事件有没有触发，如果有触发，那么应该执行
@@ -308,30 +751,92 @@ void IOManager::Idle() {
   // 函数结束时删除 event
   std::shared_ptr<epoll_event> shared_events(events, [](epoll_event* ptr) { delete[] ptr; });
 
+  size_t index = GetWorkerIndex();
+  Waker& waker = *wakers_[index];
+
   while (true) {
-    // 获取下一个定时器的超时时间，顺便判断调度器是否停止
+    // 先声明即将休眠，再检查停止条件和队列，与 WakeUp() 的顺序相反
+    waker.sleeping = true;
+
+    // 每轮刷新一次缓存的时间，本轮的定时器计算都以它为准
+    UpdateLoopTimeUS();
+
+    // 获取下一个定时器的超时时间 (微秒)，顺便判断调度器是否停止
     uint64_t next_timeout = 0;
     if (GUDOV_UNLICKLY(Stopping(next_timeout))) {
+      waker.sleeping = false;
+      ClearLoopTime();
+      // Stop() 时的 tickle 可能早已被消耗，其余线程还在 epoll_wait 中，叫醒它们重新检查
+      for (auto& other : wakers_) {
+        WakeUp(*other);
+      }
       LOG_INFO(g_logger) << "name=" << GetName() << " idle stopping exit";
       break;
     }
 
-    // 阻塞在epoll_wait上，等待事件发生或定时器超时
-    int rt = 0;
-    do {
-      if (next_timeout != ~0ull) {
-        next_timeout = std::min((int)next_timeout, MAX_TIMEOUT);
+    int  rt          = 0;
+    bool has_pending = HasPendingTask(index);
+    if (per_thread_reactor_ && has_pending) {
+      // 本线程的 fd 只能由本线程取出，有任务时也不阻塞地检查一次
+      waker.sleeping = false;
+      bool tickled   = false;
+      rt             = FilterWakerEvents(waker, events, epoll_waitF(waker.epfd, events, MAX_EVENTS, 0), tickled);
+    } else if (has_pending) {
+      // 有任务时被调度协程叫来 (如协程时间片用完让出后)，不阻塞地取一次事件，不让一直有任务时 IO 得不到处理
+      waker.sleeping = false;
+      if (uring_) {
+        ProcessUringCompletions(waker);
       } else {
-        next_timeout = MAX_TIMEOUT;
+        rt = epoll_waitF(epfd_, events, MAX_EVENTS, 0);
+        if (rt < 0) {
+          rt = 0;
+        }
       }
-      // 等待事件发生，即 tickle() 函数往管道写端写入数据或者
-      rt = epoll_wait(epfd_, events, MAX_EVENTS, (int)next_timeout);
-      if (rt < 0 && errno == EINTR) {
-        continue;
-      } else {
-        break;
+    } else {
+      // 阻塞在自己的 epoll 上，等待 tickle、IO 事件或定时器超时
+      int timeout_ms = MAX_TIMEOUT;
+      if (timer_fd_) {
+        ArmTimerFd(waker, next_timeout);
+        if (next_timeout == 0) {
+          timeout_ms = 0;
+        }
+      } else if (next_timeout != ~0ull) {
+        // epoll_wait 只有毫秒精度，向上取整避免提前醒来后空转
+        timeout_ms = (int)std::min<uint64_t>((next_timeout + 999) / 1000, MAX_TIMEOUT);
+      }
+      // 调用原始的 epoll_wait，hook 后的版本会挂起当前协程
+      int n = 0;
+      do {
+        n = epoll_waitF(waker.epfd, events, MAX_EVENTS, timeout_ms);
+        if (n < 0 && errno == EINTR) {
+          continue;
+        } else {
+          break;
+        }
+      } while (true);
+      UpdateLoopTimeUS();
+
+      bool tickled = false;
+      rt           = FilterWakerEvents(waker, events, n, tickled);
+      if (tickled) {
+        ++wakeup_count_;
       }
-    } while (true);
+
+      size_t completed = 0;
+      if (uring_) {
+        completed = ProcessUringCompletions(waker);
+      } else if (!per_thread_reactor_) {
+        // 共享的 epfd_ 由被唤醒的线程非阻塞地取出事件
+        rt = epoll_waitF(epfd_, events, MAX_EVENTS, 0);
+        if (rt < 0) {
+          rt = 0;
+        }
+      }
+      if (tickled && rt == 0 && completed == 0 && !HasPendingTask(index) && GetNextTimeoutUS() != 0) {
+        ++spurious_count_;
+      }
+    }
+    waker.sleeping = false;
 
     // 收集所有已超时的定时器，执行回调函数
     std::vector<std::function<void()>> expired_callbacks;
@@ -345,12 +850,6 @@ void IOManager::Idle() {
     // 遍历所有发生的事件，根据epoll_event的私有指针找到对应的FdContext，进行事件处理
     for (int i = 0; i < rt; ++i) {
       epoll_event& event = events[i];
-      if (event.data.fd == tickle_fds_[0]) {
-        uint8_t dummy[256];
-        while (read(tickle_fds_[0], dummy, sizeof(dummy)) > 0)
-          ;
-        continue;
-      }
 
       // 获得事件对应句柄内容(包括执行体)
       FdContext* fd_ctx = (FdContext*)event.data.ptr;
@@ -363,7 +862,7 @@ void IOManager::Idle() {
        * 出现这两种事件，应该同时触发fd的读和写事件，否则有可能出现注册的事件永远执行不到的情况
        */
       if (event.events & (EPOLLERR | EPOLLHUP)) {
-        event.events |= (EPOLLIN | EPOLLOUT) & fd_ctx->events;
+        event.events |= persistent_epoll_ ? (EPOLLIN | EPOLLOUT) : (EPOLLIN | EPOLLOUT) & fd_ctx->events;
       }
 
       int real_events = NONE;
@@ -374,6 +873,21 @@ void IOManager::Idle() {
         real_events |= WRITE;
       }
 
+      if (persistent_epoll_) {
+        // 注册保持不变，没有等待者的就绪先记下来，供下次 AddEvent 直接使用
+        fd_ctx->ready = (Event)(fd_ctx->ready | (real_events & ~fd_ctx->events));
+        real_events &= fd_ctx->events;
+        if (real_events & READ) {
+          fd_ctx->TriggerEvent(READ);
+          --pending_event_cnt_;
+        }
+        if (real_events & WRITE) {
+          fd_ctx->TriggerEvent(WRITE);
+          --pending_event_cnt_;
+        }
+        continue;
+      }
+
       if ((fd_ctx->events & real_events) == NONE) {
         continue;
       }
@@ -383,12 +897,15 @@ void IOManager::Idle() {
       int op          = left_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
       event.events    = EPOLLET | left_events;
 
-      int rt2 = epoll_ctl(epfd_, op, fd_ctx->fd, &event);
+      int rt2 = EpollCtl(fd_ctx->epfd, op, fd_ctx->fd, &event);
       if (rt2) {
-        LOG_ERROR(g_logger) << "epoll_ctl(" << epfd_ << ", " << op << "," << fd_ctx->fd << "," << event.events
-                            << "):" << rt2 << " (" << errno << ") (" << strerror(errno) << ")";
+        LOG_ERROR(g_logger) << "epoll_ctl(" << fd_ctx->epfd << ", " << op << "," << fd_ctx->fd << ","
+                            << event.events << "):" << rt2 << " (" << errno << ") (" << strerror(errno) << ")";
         continue;
       }
+      if (!left_events) {
+        fd_ctx->epfd = -1;
+      }
 
       // 处理已经发生的事件，也就是让调度器调度指定的函数或协程
       if (real_events & READ) {
@@ -413,6 +930,32 @@ void IOManager::Idle() {
   }
 }
 
+void IOManager::ArmTimerFd(Waker& waker, uint64_t timeout) {
+  uint64_t deadline = timeout == ~0ull ? 0 : GetLoopTimeUS() + timeout;
+  if (deadline == waker.deadline) {
+    return;
+  }
+  // it_value 为 0 时取消
+  itimerspec spec;
+  memset(&spec, 0, sizeof(spec));
+  spec.it_value.tv_sec  = deadline / 1000000;
+  spec.it_value.tv_nsec = deadline % 1000000 * 1000;
+  if (timerfd_settime(waker.timer_fd, TFD_TIMER_ABSTIME, &spec, nullptr)) {
+    LOG_ERROR(g_logger) << "timerfd_settime(" << waker.timer_fd << ") errno=" << errno << " " << strerror(errno);
+    return;
+  }
+  waker.deadline = deadline;
+}
+
 void IOManager::OnTimerInsertedAtFront() { Tickle(); }
 
+void IOManager::OnTimerRequestPosted(size_t shard, bool urgent) {
+  // 取消不需要提前处理；停止时所属线程要处理完请求才能退出
+  if (urgent || stopping_) {
+    WakeUp(*wakers_[shard]);
+  }
+}
+
+int IOManager::GetTimerShard() const { return GetScheduler() == this ? GetWorkerIndex() : -1; }
+
 }  // namespace gudov
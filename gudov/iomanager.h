@@ -1,13 +1,32 @@
 #pragma once
 
+#include <memory>
+
+#include "fd_table.h"
 #include "scheduler.h"
 #include "timer.h"
 
+struct epoll_event;
+struct io_uring_sqe;
+
 namespace gudov {
 
+class IoUring;
+
 /**
  * @brief 基于 epoll 的 IO 管理器
- * @details 当
+ * @details
+ * 配置 iomanager.backend 为 io_uring 时改用 io_uring：AddEvent 提交 IORING_OP_POLL_ADD，
+ * hook 的 read/recv/write/send/accept/connect 通过 SubmitIO 直接提交请求，
+ * 每个工作线程一个 ring，请求提交到当前线程的 ring 并由该线程收割，内核不支持时自动退回 epoll。
+ * 配置 iomanager.per_thread_reactor 为 true 时 (仅 epoll 后端)，每个工作线程是一个独立的 reactor：
+ * 事件注册到发起 AddEvent 的线程自己的 epoll 上，触发后也只在该线程上恢复执行。
+ * 配置 iomanager.persistent_epoll 为 true 时 (仅 epoll 后端)，fd 第一次等待时以 EPOLLIN|EPOLLOUT|EPOLLET
+ * 注册，直到 CancelAll (hook 的 close) 才撤销，触发事件时不再 epoll_ctl，没有等待者的就绪会被记录下来。
+ * 该模式要求 fd 通过 hook 的 close 关闭，否则复用的 fd 号会被误认为已经注册。
+ * 配置 iomanager.per_thread_timers 为 true 时，工作线程创建的定时器只由该线程管理，
+ * 各线程不再争用同一把定时器锁，idle 时也只计算自己的超时时间。
+ * epoll_wait 的超时只有毫秒精度，配置 iomanager.timerfd 为 true 时每个工作线程用一个 timerfd 按微秒等待定时器
  *
  */
 class IOManager : public Scheduler, public TimerManager {
@@ -32,8 +51,13 @@ class IOManager : public Scheduler, public TimerManager {
       Scheduler*            scheduler = nullptr;  // 待执行的 scheduler
       Fiber::ptr            fiber;                // 事件携程
       std::function<void()> callback;             // 事件的回调函数
+      uint32_t              seq    = 0;           // io_uring 下区分同一事件的多次注册
+      int                   thread = -1;          // 事件触发后在该线程上执行，-1 表示不限
+      int                   ring   = -1;          // io_uring 下 POLL_ADD 所在 ring 的工作线程下标
     };
 
+    explicit FdContext(int fd) : fd(fd) {}
+
     EventContext& GetContext(Event event);
     void          ReSetContext(EventContext& ctx);
 
@@ -48,14 +72,91 @@ class IOManager : public Scheduler, public TimerManager {
     EventContext read;
     EventContext write;
     int          fd;
+    int          epfd   = -1;    // fd 当前注册在哪个 epoll 上，没有事件时为 -1
     Event        events = NONE;
+    Event        ready  = NONE;  // persistent_epoll 下已就绪但还没有等待者的事件
     MutexType    mutex;
+
+    std::atomic<int> inflight{0};  // 通过 SubmitIO 提交还未完成的请求数
+  };
+
+  /**
+   * @brief 工作线程的唤醒句柄
+   * @details 每个工作线程一个 eventfd，idle 时在自己的 epoll 上等待，
+   * 该 epoll 同时监听 eventfd 和共享的 epfd_，这样 tickle 只会唤醒目标线程；
+   * per_thread_reactor 模式下不嵌套 epfd_，fd 直接注册在这个 epoll 上；
+   * io_uring 后端下嵌套的是本线程自己的 ring
+   *
+   */
+  struct Waker {
+    int                      event_fd = -1;
+    int                      epfd     = -1;
+    int                      timer_fd = -1;     // iomanager.timerfd 开启时用于微秒级的定时器超时
+    uint64_t                 deadline = 0;      // timer_fd 当前设置的到期时间 (单调时钟微秒)，0 表示未设置
+    std::atomic<bool>        sleeping{false};  // 是否已进入 (或即将进入) epoll_wait
+    std::unique_ptr<IoUring> uring;            // io_uring 后端下本线程的 ring，只由本线程收割
+    Mutex                    uring_mutex;      // 提交时加锁，只有其他线程撤销事件或取消请求时才会争用
   };
 
  public:
+  /**
+   * @brief 唤醒统计
+   *
+   */
+  struct WakeupStats {
+    uint64_t tickles  = 0;  // 写 eventfd 的次数
+    uint64_t wakeups  = 0;  // 因 eventfd 从 epoll_wait 返回的次数
+    uint64_t spurious = 0;  // 被唤醒后既没有任务也没有 IO 事件和定时器的次数
+  };
+
+  /// @brief 填写 io_uring 请求的函数
+  using PrepareFunc = std::function<void(io_uring_sqe*)>;
+
   IOManager(size_t threads = 1, bool useCaller = true, const std::string& name = "");
   ~IOManager();
 
+  /**
+   * @brief 是否使用 io_uring 后端
+   *
+   */
+  bool IsUring() const { return uring_; }
+
+  /**
+   * @brief 当前使用的后端名称
+   *
+   * @return const char* "epoll" 或 "io_uring"
+   */
+  const char* GetBackend() const { return uring_ ? "io_uring" : "epoll"; }
+
+  /**
+   * @brief 是否每个工作线程使用独立的 epoll
+   *
+   */
+  bool IsPerThreadReactor() const { return per_thread_reactor_; }
+
+  /**
+   * @brief 是否使用常驻的 epoll 注册
+   *
+   */
+  bool IsPersistentEpoll() const { return persistent_epoll_; }
+
+  /**
+   * @brief 是否用 timerfd 等待定时器
+   *
+   */
+  bool IsTimerFd() const { return timer_fd_; }
+
+  /**
+   * @brief 通过 io_uring 提交一个 IO 请求，挂起当前协程直到请求完成
+   * @pre IsUring()，且在本 IOManager 调度的协程中调用；请求完成后协程回到提交时的线程继续执行
+   *
+   * @param fd 请求操作的句柄，关闭时会取消其上未完成的请求
+   * @param prepare 填写 sqe 的操作码和参数，user_data 由本函数设置
+   * @param timeout_ms 超时时间，~0ull 表示不超时
+   * @return int 请求的结果，失败时为 -errno，超时为 -ETIMEDOUT
+   */
+  int SubmitIO(int fd, const PrepareFunc& prepare, uint64_t timeout_ms = ~0ull);
+
   /**
    * @brief
    *
@@ -66,6 +167,15 @@ class IOManager : public Scheduler, public TimerManager {
    */
   int AddEvent(int fd, Event event, std::function<void()> callback = nullptr);
 
+  /**
+   * @brief 为当前协程注册事件，该事件已经有其他等待者时不注册
+   *
+   * @param fd
+   * @param event
+   * @return int 0 success, 1 已经注册过该事件, -1 error
+   */
+  int TryAddEvent(int fd, Event event);
+
   /**
    * @brief 删除 fd 对应事件
    * @attention 删除时不会触发事件
@@ -99,13 +209,34 @@ class IOManager : public Scheduler, public TimerManager {
 
   static IOManager* GetThis();
 
+  WakeupStats GetWakeupStats() const;
+
+  /**
+   * @brief 已经 (或即将) 阻塞在 epoll_wait 中的工作线程数
+   *
+   */
+  size_t GetSleepingCount() const;
+
+  /**
+   * @brief 注册、修改、删除 fd 事件累计调用 epoll_ctl 的次数
+   *
+   */
+  uint64_t GetEpollCtlCount() const;
+
  protected:
   /**
    * @brief 提醒有事件待处理
-   * @details 会触发一次 epoll_wait
+   * @details 只唤醒一个处于 idle 的工作线程，没有空闲线程时什么也不做
    *
    */
   void Tickle() override;
+
+  /**
+   * @brief 只唤醒指定线程
+   *
+   * @param thread
+   */
+  void TickleThread(int thread) override;
   bool Stopping() override;
   void Idle() override;
 
@@ -116,20 +247,132 @@ class IOManager : public Scheduler, public TimerManager {
    */
   void OnTimerInsertedAtFront() override;
 
-  void ContextResize(size_t size);
+  /**
+   * @brief 其他线程修改了某个工作线程的定时器
+   * @details 可能提前到期或正在停止时唤醒该线程
+   *
+   */
+  void OnTimerRequestPosted(size_t shard, bool urgent) override;
+
+  /**
+   * @brief 定时器分片即工作线程下标
+   *
+   */
+  int GetTimerShard() const override;
+
+  /**
+   * @brief 是否可以停止
+   *
+   * @param[out] timeout 距离下一个定时器到期的微秒数
+   */
   bool Stopping(uint64_t& timeout);
 
+  /**
+   * @brief 唤醒正在休眠的工作线程
+   *
+   * @param waker
+   * @return false 该线程没有在休眠
+   */
+  bool WakeUp(Waker& waker);
+
+  /**
+   * @brief AddEvent 和 TryAddEvent 的实现
+   *
+   * @param may_exist 为 true 时已经注册过该事件返回 1，否则断言失败
+   */
+  int RegisterEvent(int fd, Event event, std::function<void()> callback, bool may_exist);
+
+  /**
+   * @brief 选择 AddEvent 注册到的 epoll 以及事件触发后执行的线程
+   * @details 共享模式下为 epfd_ 和任意线程；per_thread_reactor 模式下为当前工作线程，
+   * 不是本调度器的线程调用时轮流分配给各工作线程
+   *
+   * @param[out] thread
+   * @return int epoll 句柄
+   */
+  int SelectReactor(int& thread);
+
+  /**
+   * @brief 按下一个定时器的超时时间设置 waker 的 timerfd，与已设置的相同时不调用
+   *
+   * @param waker
+   * @param timeout 微秒，~0ull 表示取消
+   */
+  void ArmTimerFd(Waker& waker, uint64_t timeout);
+
+  /**
+   * @brief 从 waker.epfd 取出的事件中挑出 eventfd、timerfd 和嵌套 epoll 的条目，排空前两者，
+   * 其余的 fd 事件按顺序移到数组前部
+   *
+   * @param waker
+   * @param events epoll_wait 的结果，原地修改
+   * @param n epoll_wait 的返回值，小于 0 时视为没有事件
+   * @param[out] tickled 有 eventfd 条目时置为 true
+   * @return int fd 事件的数量
+   */
+  int FilterWakerEvents(Waker& waker, epoll_event* events, int n, bool& tickled);
+
+  /**
+   * @brief 调用 epoll_ctl 并计数
+   *
+   */
+  int EpollCtl(int epfd, int op, int fd, epoll_event* event);
+
+  /**
+   * @brief 选择提交 io_uring 请求的 ring
+   * @details 本调度器的工作线程使用自己的 ring，其他线程调用时轮流分配给各工作线程
+   *
+   * @return int ring 所属工作线程的下标
+   */
+  int SelectRing();
+
+  /**
+   * @brief 为事件提交 IORING_OP_POLL_ADD
+   * @pre 已持有 fd_ctx->mutex
+   */
+  bool UringPollAdd(FdContext* fd_ctx, Event event);
+
+  /**
+   * @brief 撤销事件对应的 IORING_OP_POLL_ADD，提交到 POLL_ADD 所在的 ring
+   * @pre 已持有 fd_ctx->mutex
+   */
+  void UringPollRemove(FdContext* fd_ctx, Event event);
+
+  /**
+   * @brief 处理本线程 ring 的完成事件
+   *
+   * @param waker 当前工作线程的 waker
+   * @return size_t 处理的数量
+   */
+  size_t ProcessUringCompletions(Waker& waker);
+
  private:
   int epfd_ = 0;
 
-  // 0 为读端  1 为写端
-  int tickle_fds_[2];
+  /// @brief 每个工作线程用自己 Waker 中的 epoll 作为 reactor
+  bool per_thread_reactor_ = false;
+  /// @brief fd 常驻注册在 epoll 上，就绪状态记录在 FdContext::ready
+  bool persistent_epoll_ = false;
+  /// @brief 用 timerfd 代替 epoll_wait 的毫秒超时
+  bool timer_fd_ = false;
+
+  std::atomic<uint64_t> epoll_ctl_count_{0};
+
+  std::vector<std::unique_ptr<Waker>> wakers_;
+  std::atomic<size_t>                 next_waker_{0};
+
+  std::atomic<uint64_t> tickle_count_{0};
+  std::atomic<uint64_t> wakeup_count_{0};
+  std::atomic<uint64_t> spurious_count_{0};
 
   // 当前未执行的 IO 事件数量
   std::atomic<size_t> pending_event_cnt_{0};
-  RWMutexType         mutex_;
 
-  std::vector<FdContext*> fd_contexts_;
+  /// @brief 以 fd 为下标的 FdContext 表，查找不加锁
+  FdTable<FdContext> fd_contexts_;
+
+  /// @brief 是否使用 io_uring 后端，ring 位于各工作线程的 Waker 中
+  bool uring_ = false;
 };
 
 }  // namespace gudov
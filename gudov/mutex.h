@@ -29,6 +29,13 @@ class Semaphore : public NonCopyable {
    */
   void Wait();
 
+  /**
+   * @brief 最多等待 timeout_ms 毫秒
+   *
+   * @return false 超时
+   */
+  bool WaitFor(uint64_t timeout_ms);
+
   /**
    * @brief 信号量加 1
    *
@@ -0,0 +1,115 @@
+#include "offload.h"
+
+#include <algorithm>
+
+#include "config.h"
+#include "fiber.h"
+#include "scheduler.h"
+#include "util.h"
+
+namespace gudov {
+
+static ConfigVar<int>::ptr g_offloadThreads =
+    Config::Lookup("offload.threads", 4, "threads of the default pool for blocking calls");
+
+static ConfigVar<int>::ptr g_offloadMaxQueue =
+    Config::Lookup("offload.max_queue", 1024, "queued calls of the default offload pool before callers run inline");
+
+OffloadPool::OffloadPool(size_t threads, size_t max_queue, const std::string& name) : max_queue_(max_queue) {
+  threads = std::max<size_t>(threads, 1);
+  for (size_t i = 0; i < threads; ++i) {
+    threads_.emplace_back(new Thread([this]() { Run(); }, name + "_" + std::to_string(i)));
+  }
+}
+
+OffloadPool::~OffloadPool() {
+  {
+    Mutex::Locker lock(mutex_);
+    stopping_ = true;
+  }
+  for (size_t i = 0; i < threads_.size(); ++i) {
+    sem_.Notify();
+  }
+  for (auto& thread : threads_) {
+    thread->Join();
+  }
+}
+
+bool OffloadPool::Park(const std::function<void()>& task) {
+  if (Scheduler::GetWorkerIndex() < 0) {
+    // 调用方本身就可以阻塞，不需要换线程
+    return false;
+  }
+
+  Task item;
+  item.callback   = &task;
+  item.scheduler  = Scheduler::GetScheduler();
+  item.fiber      = Fiber::GetRunningFiber();
+  item.enqueue_us = GetMonotonicUS();
+
+  Fiber* fiber = item.fiber.get();
+  {
+    Mutex::Locker lock(mutex_);
+    if (stopping_ || tasks_.size() >= max_queue_) {
+      return false;
+    }
+    item.scheduler->AddExternalWaiter();
+    tasks_.push_back(std::move(item));
+    max_queue_depth_ = std::max(max_queue_depth_, tasks_.size());
+  }
+  sem_.Notify();
+  fiber->Yield();
+  return true;
+}
+
+void OffloadPool::Run() {
+  while (true) {
+    sem_.Wait();
+    Task     task;
+    uint64_t start;
+    {
+      Mutex::Locker lock(mutex_);
+      if (tasks_.empty()) {
+        if (stopping_) {
+          break;
+        }
+        continue;
+      }
+      task = std::move(tasks_.front());
+      tasks_.pop_front();
+
+      start        = GetMonotonicUS();
+      max_wait_us_ = std::max(max_wait_us_, start - task.enqueue_us);
+    }
+    total_wait_us_ += start - task.enqueue_us;
+
+    (*task.callback)();
+
+    total_run_us_ += GetMonotonicUS() - start;
+    ++completed_;
+    // 统计完成后再恢复协程，之后不能再访问调用方栈上的对象
+    task.scheduler->ScheduleExternalWaiter(std::move(task.fiber));
+  }
+}
+
+OffloadPool::Stats OffloadPool::GetStats() {
+  Stats stats;
+  {
+    Mutex::Locker lock(mutex_);
+    stats.queue_depth     = tasks_.size();
+    stats.max_queue_depth = max_queue_depth_;
+    stats.max_wait_us     = max_wait_us_;
+  }
+  stats.completed     = completed_;
+  stats.inline_runs   = inline_runs_;
+  stats.total_wait_us = total_wait_us_;
+  stats.total_run_us  = total_run_us_;
+  return stats;
+}
+
+OffloadPool* OffloadPool::GetDefault() {
+  static OffloadPool pool(g_offloadThreads->GetValue(), g_offloadMaxQueue->GetValue(), "offload");
+  return &pool;
+}
+
+}  // namespace gudov
@@ -0,0 +1,176 @@
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "mutex.h"
+#include "noncopyable.h"
+#include "thread.h"
+
+namespace gudov {
+
+class Fiber;
+class Scheduler;
+
+/**
+ * @brief 卸载调用的结果，值或异常
+ *
+ * @tparam R 返回值类型
+ */
+template <typename R>
+class OffloadResult {
+  static_assert(!std::is_reference<R>::value, "offloaded callable must return by value");
+
+ public:
+  template <typename Func>
+  void Run(Func& func) {
+    try {
+      value_.reset(new R(func()));
+    } catch (...) {
+      error_ = std::current_exception();
+    }
+  }
+
+  R Get() {
+    if (error_) {
+      std::rethrow_exception(error_);
+    }
+    return std::move(*value_);
+  }
+
+ private:
+  std::unique_ptr<R> value_;
+  std::exception_ptr error_;
+};
+
+template <>
+class OffloadResult<void> {
+ public:
+  template <typename Func>
+  void Run(Func& func) {
+    try {
+      func();
+    } catch (...) {
+      error_ = std::current_exception();
+    }
+  }
+
+  void Get() {
+    if (error_) {
+      std::rethrow_exception(error_);
+    }
+  }
+
+ private:
+  std::exception_ptr error_;
+};
+
+/**
+ * @brief 阻塞调用的卸载线程池
+ * @details
+ * 文件 IO、压缩、加密等无法改成非阻塞的调用放到独立的线程上执行，发起调用的协程挂起等待结果，
+ * 不占用 IOManager 的线程。线程数固定，排队的任务数有上限。
+ * 不在调度线程的协程中调用，或者队列已满时，直接在调用方执行
+ *
+ */
+class OffloadPool : NonCopyable {
+ public:
+  struct Stats {
+    /// @brief 当前排队的任务数
+    size_t   queue_depth     = 0;
+    /// @brief 排队任务数的最大值
+    size_t   max_queue_depth = 0;
+    /// @brief 在线程池中执行完的任务数
+    uint64_t completed       = 0;
+    /// @brief 直接在调用方执行的任务数
+    uint64_t inline_runs     = 0;
+    /// @brief 累计排队时间 (us)
+    uint64_t total_wait_us   = 0;
+    /// @brief 最长排队时间 (us)
+    uint64_t max_wait_us     = 0;
+    /// @brief 累计执行时间 (us)
+    uint64_t total_run_us    = 0;
+  };
+
+  /**
+   * @brief 创建线程池并启动线程
+   *
+   * @param threads 线程数
+   * @param max_queue 排队任务数上限
+   * @param name 线程名前缀
+   */
+  OffloadPool(size_t threads, size_t max_queue, const std::string& name = "offload");
+
+  /**
+   * @brief 执行完已排队的任务后退出线程
+   *
+   */
+  ~OffloadPool();
+
+  /**
+   * @brief 在线程池中执行 func，挂起当前协程直到完成
+   *
+   * @return func 的返回值，func 抛出的异常在调用方重新抛出
+   */
+  template <typename Func>
+  auto Await(Func&& func) -> decltype(func()) {
+    OffloadResult<decltype(func())> result;
+    std::function<void()>           task = [&func, &result]() { result.Run(func); };
+    if (!Park(task)) {
+      ++inline_runs_;
+      task();
+    }
+    return result.Get();
+  }
+
+  Stats GetStats();
+
+  /**
+   * @brief 全局的线程池，由 offload.threads 和 offload.max_queue 配置，第一次使用时创建
+   *
+   */
+  static OffloadPool* GetDefault();
+
+ private:
+  struct Task {
+    /// @brief 位于调用方栈上，协程在任务完成前不会返回
+    const std::function<void()>* callback = nullptr;
+    /// @brief 完成后在这个调度器上恢复协程
+    Scheduler*                   scheduler = nullptr;
+    std::shared_ptr<Fiber>       fiber;
+    /// @brief 入队时间 (us)
+    uint64_t                     enqueue_us = 0;
+  };
+
+  /**
+   * @brief 把任务放入队列并挂起当前协程，任务完成后恢复
+   *
+   * @return false 不在调度线程的协程中或队列已满，没有挂起
+   */
+  bool Park(const std::function<void()>& task);
+
+  void Run();
+
+ private:
+  Mutex                    mutex_;
+  Semaphore                sem_;
+  std::deque<Task>         tasks_;
+  std::vector<Thread::ptr> threads_;
+  size_t                   max_queue_;
+  bool                     stopping_ = false;
+
+  size_t                max_queue_depth_ = 0;
+  uint64_t              max_wait_us_     = 0;
+  std::atomic<uint64_t> completed_{0};
+  std::atomic<uint64_t> inline_runs_{0};
+  std::atomic<uint64_t> total_wait_us_{0};
+  std::atomic<uint64_t> total_run_us_{0};
+};
+
+}  // namespace gudov
@@ -1,7 +1,12 @@
 #include "scheduler.h"
 
+#include <cxxabi.h>
+
+#include <algorithm>
+#include <cstdlib>
 #include <string>
 
+#include "config.h"
 #include "gudov/util.h"
 #include "hook.h"
 #include "log.h"
@@ -20,6 +25,61 @@ static thread_local Scheduler* t_scheduler = nullptr;
  */
 static thread_local Fiber* t_scheduler_fiber = nullptr;
 
+/// @brief 当前线程在调度器中的工作线程下标
+static thread_local int t_worker_index = -1;
+
+/// @brief 选择窃取对象用的随机数状态 (xorshift)
+static thread_local uint32_t t_steal_seed = 0;
+
+/// @brief 当前线程是否正在调度协程上直接执行回调
+static thread_local bool t_running_inline = false;
+
+/// @brief 每个工作线程缓存的已结束回调协程上限
+static const size_t kMaxFreeFibers = 64;
+
+static ConfigVar<uint64_t>::ptr g_time_slice = Config::Lookup<uint64_t>(
+    "scheduler.time_slice_us", 0,
+    "a fiber running longer than this yields at Fiber::MaybeYield and is reported as an offender, 0 disables");
+
+/// @brief g_time_slice 的缓存，每次切换任务时读取，避免加配置的读锁
+static std::atomic<uint64_t> s_time_slice_us{0};
+
+struct TimeSliceIniter {
+  TimeSliceIniter() {
+    s_time_slice_us = g_time_slice->GetValue();
+    g_time_slice->AddListener([](const uint64_t& old_value, const uint64_t& new_value) {
+      LOG_INFO(g_logger) << "scheduler time slice changed from " << old_value << "us to " << new_value << "us";
+      s_time_slice_us = new_value;
+    });
+  }
+};
+
+static TimeSliceIniter s_time_slice_initer;
+
+/**
+ * @brief 当前线程正在运行的任务的时间片
+ * @details 只在开启时间片时由 Scheduler::ResumeTask 设置，fiber_id 为 0 表示没有
+ *
+ */
+struct TimeSlice {
+  uint64_t fiber_id    = 0;
+  int      thread      = -1;
+  uint64_t deadline_us = 0;
+  bool     preempted   = false;  // 协程在 MaybeYield 中让出
+};
+
+static thread_local TimeSlice t_time_slice;
+
+static uint32_t NextStealRandom() {
+  if (t_steal_seed == 0) {
+    t_steal_seed = static_cast<uint32_t>(GetThreadId()) * 2654435761u | 1;
+  }
+  t_steal_seed ^= t_steal_seed << 13;
+  t_steal_seed ^= t_steal_seed >> 17;
+  t_steal_seed ^= t_steal_seed << 5;
+  return t_steal_seed;
+}
+
 Scheduler::Scheduler(size_t threads, bool use_caller, const std::string& name) : name_(name), use_caller_(use_caller) {
   GUDOV_ASSERT(threads > 0);
 
@@ -33,7 +93,7 @@ Scheduler::Scheduler(size_t threads, bool use_caller, const std::string& name) :
     GUDOV_ASSERT(GetScheduler() == nullptr);
     t_scheduler = this;
 
-    root_fiber_.reset(new Fiber(std::bind(&Scheduler::Run, this), 0, false));
+    root_fiber_.reset(new Fiber(std::bind(&Scheduler::Run, this, 0), 0, false));
     gudov::Thread::SetRunningThreadName(name_);
 
     t_scheduler_fiber = root_fiber_.get();
@@ -43,6 +103,15 @@ Scheduler::Scheduler(size_t threads, bool use_caller, const std::string& name) :
     root_thread_ = -1;
   }
   thread_count_ = threads;
+
+  // 每个工作线程一个本地队列，use_caller 时主线程占用下标 0
+  size_t workers = threads + (use_caller ? 1 : 0);
+  for (size_t i = 0; i < workers; ++i) {
+    queues_.emplace_back(new WorkerQueue);
+  }
+  if (use_caller) {
+    queues_[0]->thread_id = root_thread_;
+  }
 }
 
 Scheduler::~Scheduler() {
@@ -56,6 +125,10 @@ Scheduler* Scheduler::GetScheduler() { return t_scheduler; }
 
 Fiber* Scheduler::GetMainFiber() { return t_scheduler_fiber; }
 
+int Scheduler::GetWorkerIndex() { return t_worker_index; }
+
+bool Scheduler::IsRunningInline() { return t_running_inline; }
+
 void Scheduler::Start() {
   MutexType::Locker lock(mutex_);
   if (stopping_) {
@@ -65,9 +138,11 @@ void Scheduler::Start() {
   GUDOV_ASSERT(threads_.empty());
 
   threads_.resize(thread_count_);
+  size_t offset = use_caller_ ? 1 : 0;
   for (size_t i = 0; i < thread_count_; ++i) {
     // 创建指定数量的线程并执行 run
-    threads_[i].reset(new Thread(std::bind(&Scheduler::Run, this), name_ + "_" + std::to_string(i)));
+    threads_[i].reset(new Thread(std::bind(&Scheduler::Run, this, i + offset), name_ + "_" + std::to_string(i)));
+    queues_[i + offset]->thread_id = threads_[i]->GetID();
     thread_ids_.push_back(threads_[i]->GetID());
   }
 }
@@ -112,9 +187,148 @@ void Scheduler::Stop() {
 
 void Scheduler::SetThis() { t_scheduler = this; }
 
-void Scheduler::Run() {
+int Scheduler::FindWorker(int thread) const {
+  for (size_t i = 0; i < queues_.size(); ++i) {
+    if (queues_[i]->thread_id == thread) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+bool Scheduler::HasPendingTask(size_t index) const {
+  if (queues_[index]->pinned_size) {
+    return true;
+  }
+  for (auto& queue : queues_) {
+    if (queue->stealable) {
+      return true;
+    }
+  }
+  return false;
+}
+
+Scheduler::WorkerQueue* Scheduler::FindQueue(int thread) {
+  for (auto& queue : queues_) {
+    if (queue->thread_id == thread) {
+      return queue.get();
+    }
+  }
+  return nullptr;
+}
+
+bool Scheduler::PushTask(Task& task) {
+  WorkerQueue* queue = nullptr;
+  bool         pin   = false;
+  if (task.thread != -1) {
+    queue = FindQueue(task.thread);
+    if (GUDOV_LICKLY(queue)) {
+      pin = true;
+    } else {
+      LOG_WARN(g_logger) << "Schedule to unknown thread=" << task.thread << ", run on any thread";
+      task.thread = -1;
+    }
+  }
+  if (!queue) {
+    if (t_scheduler == this && t_worker_index >= 0) {
+      // 调度线程内产生的任务放入自己的本地队列
+      queue = queues_[t_worker_index].get();
+    } else {
+      queue = queues_[next_queue_++ % queues_.size()].get();
+    }
+  }
+
+  // 先计数再入队，保证 Stopping() 不会在任务可见前误判为空
+  ++task_count_;
+
+  MutexType::Locker lock(queue->mutex);
+  bool              need_tickle = queue->tasks.empty() && queue->pinned.empty();
+  if (pin) {
+    queue->pinned.push_back(std::move(task));
+    queue->pinned_size = queue->pinned.size();
+  } else {
+    queue->tasks.push_back(std::move(task));
+    queue->stealable = queue->tasks.size();
+  }
+  return need_tickle;
+}
+
+bool Scheduler::TakeRunnable(std::deque<Task>& queue, Task& task, bool from_back) {
+  if (queue.empty()) {
+    return false;
+  }
+
+  // 正在运行中的协程 (已被重新调度但还未切换出去) 需要跳过
+  auto runnable = [](const Task& t) { return !t.fiber || t.fiber->GetState() != Fiber::Running; };
+
+  if (from_back) {
+    for (auto it = queue.rbegin(); it != queue.rend(); ++it) {
+      if (runnable(*it)) {
+        task = std::move(*it);
+        queue.erase(std::next(it).base());
+        break;
+      }
+    }
+  } else {
+    for (auto it = queue.begin(); it != queue.end(); ++it) {
+      if (runnable(*it)) {
+        task = std::move(*it);
+        queue.erase(it);
+        break;
+      }
+    }
+  }
+
+  if (!task.fiber && !task.callback) {
+    return false;
+  }
+  // 先增加活跃线程数再减少任务数，与 Stopping() 的读取顺序相反
+  ++active_thread_count_;
+  --task_count_;
+  return true;
+}
+
+bool Scheduler::TakeTask(size_t index, Task& task, bool& tickle_me) {
+  WorkerQueue& local = *queues_[index];
+  {
+    MutexType::Locker lock(local.mutex);
+    if (TakeRunnable(local.pinned, task, false) || TakeRunnable(local.tasks, task, false)) {
+      local.stealable   = local.tasks.size();
+      local.pinned_size = local.pinned.size();
+      // 本地还有剩余任务，唤醒其他线程来窃取
+      tickle_me = !local.tasks.empty();
+      return true;
+    }
+  }
+
+  size_t count = queues_.size();
+  if (count <= 1) {
+    return false;
+  }
+  size_t start = NextStealRandom() % count;
+  for (size_t i = 0; i < count; ++i) {
+    size_t victim = (start + i) % count;
+    if (victim == index) {
+      continue;
+    }
+    WorkerQueue& queue = *queues_[victim];
+    if (queue.stealable == 0) {
+      continue;
+    }
+    MutexType::Locker lock(queue.mutex);
+    if (TakeRunnable(queue.tasks, task, true)) {
+      queue.stealable = queue.tasks.size();
+      tickle_me       = !queue.tasks.empty();
+      return true;
+    }
+  }
+  return false;
+}
+
+void Scheduler::Run(size_t index) {
   SetHookEnable(true);
   SetThis();
+  t_worker_index = index;
 
   // 获得主协程
   if (GetThreadId() != root_thread_) {
@@ -123,63 +337,53 @@ void Scheduler::Run() {
 
   // 新建 idle 协程
   Fiber::ptr idle_fiber(new Fiber(std::bind(&Scheduler::Idle, this)));
-  Fiber::ptr callback_fiber;
+
+  // 已结束的回调协程，供后续回调任务复用
+  std::vector<Fiber::ptr> free_fibers;
+  WorkerQueue&            local = *queues_[index];
+
+  // 只有调度器创建、已结束且没有其他持有者的协程才能回收
+  auto recycle = [&free_fibers](Fiber::ptr& fiber) {
+    if (fiber->recyclable_ && fiber->GetState() == Fiber::Term && fiber.use_count() == 1 &&
+        free_fibers.size() < kMaxFreeFibers) {
+      free_fibers.push_back(std::move(fiber));
+    }
+    fiber.reset();
+  };
 
   Task task;
   while (true) {
     task.Reset();
     bool tickle_me = false;
+    bool preempted = false;
 
-    // ~ 拿到一个未调度的 Task
-    {
-      MutexType::Locker lock(mutex_);
-
-      // 遍历执行队列中的所有执行体
-      auto it = tasks_.begin();
-      while (it != tasks_.end()) {
-        if (it->thread != -1 && it->thread != GetThreadId()) {
-          // 指定了处理线程，但不是当前线程则跳过
-          ++it;
-          tickle_me = true;
-          continue;
-        }
-
-        GUDOV_ASSERT(it->fiber || it->callback);
-
-        if (it->fiber && it->fiber->GetState() == Fiber::Running) {
-          // 正在运行中的协程
-          ++it;
-          continue;
-        }
-
-        // 找到未调度任务，将其从队列中取出
-        task = *it;
-        tasks_.erase(it);
-        ++active_thread_count_;
-        break;
-      }
-      // 当前线程拿完一个任务后，发现队列还有剩余，需要唤醒其他线程
-      tickle_me |= (it != tasks_.end());
-    }
+    // ~ 拿到一个未调度的 Task：专属队列 -> 本地队列 -> 窃取
+    TakeTask(index, task, tickle_me);
 
     if (tickle_me) {
       Tickle();
     }
 
     if (task.fiber) {
-      task.fiber->Resume();
+      preempted = ResumeTask(task.fiber.get(), task.thread);
+      --active_thread_count_;
+      recycle(task.fiber);
+      task.Reset();
+    } else if (task.callback && task.run_inline) {
+      t_running_inline = true;
+      task.callback();
+      t_running_inline = false;
       --active_thread_count_;
       task.Reset();
     } else if (task.callback) {
-      if (callback_fiber) {
-        callback_fiber->Reset(task.callback);
-      } else {
-        callback_fiber.reset(new Fiber(task.callback));
-      }
+      Fiber::ptr callback_fiber = AcquireCallbackFiber(local, free_fibers, task.callback);
+      int        thread         = task.thread;
+      callback_fiber->SetCancelContext(std::move(task.cancel));
       task.Reset();
-      callback_fiber->Resume();
+      preempted = ResumeTask(callback_fiber.get(), thread);
       --active_thread_count_;
-      callback_fiber.reset();
+      // 回调中途 Yield 的协程由等待方持有，这里不回收
+      recycle(callback_fiber);
     } else {
       // 没有待调度的执行体
       if (idle_fiber->GetState() == Fiber::Term) {
@@ -190,16 +394,147 @@ void Scheduler::Run() {
       idle_fiber->Resume();
       --idle_thread_count_;
     }
+
+    if (preempted && idle_fiber->GetState() != Fiber::Term) {
+      // 让出的协程已经回到队列，队列不会变空，让 idle 协程不阻塞地处理一轮定时器和 IO 事件
+      ++idle_thread_count_;
+      idle_fiber->Resume();
+      --idle_thread_count_;
+    }
   }
 
+  free_fibers.clear();
+  t_worker_index = -1;
   LOG_DEBUG(g_logger) << "Scheduler::run end";
 }
 
+Fiber::ptr Scheduler::AcquireCallbackFiber(WorkerQueue& queue, std::vector<Fiber::ptr>& free_fibers,
+                                           std::function<void()>& callback) {
+  ++queue.callback_tasks;
+  if (!free_fibers.empty()) {
+    Fiber::ptr fiber = std::move(free_fibers.back());
+    free_fibers.pop_back();
+    fiber->Reset(std::move(callback));
+    ++queue.fibers_reused;
+    return fiber;
+  }
+
+  Fiber::ptr fiber(new Fiber(std::move(callback)));
+  fiber->recyclable_ = true;
+  ++queue.fibers_created;
+  return fiber;
+}
+
+bool Scheduler::ResumeTask(Fiber* fiber, int thread) {
+  uint64_t slice_us = s_time_slice_us.load(std::memory_order_relaxed);
+  if (!slice_us) {
+    fiber->Resume();
+    return false;
+  }
+
+  // 协程中途挂起后 callback_ 仍然保留，可以标识任务；结束时才清空，要在恢复前取出
+  const char* task  = fiber->callback_ ? fiber->callback_.target_type().name() : "";
+  uint64_t    start = GetMonotonicUS();
+
+  t_time_slice.fiber_id    = fiber->GetID();
+  t_time_slice.thread      = thread;
+  t_time_slice.deadline_us = start + slice_us;
+  t_time_slice.preempted   = false;
+  fiber->Resume();
+  t_time_slice.fiber_id = 0;
+
+  // 在 MaybeYield 处按时让出的协程只会略微超出，超过两倍才算没有及时让出
+  uint64_t elapsed_us = GetMonotonicUS() - start;
+  if (elapsed_us >= 2 * slice_us) {
+    RecordOverrun(task, elapsed_us);
+  }
+  return t_time_slice.preempted;
+}
+
+/**
+ * @brief 把 type_info::name 还原成可读的类型名
+ *
+ */
+static std::string DemangleTask(const char* task) {
+  int         status    = 0;
+  char*       demangled = abi::__cxa_demangle(task, nullptr, nullptr, &status);
+  std::string name      = status == 0 && demangled ? demangled : task;
+  free(demangled);
+  return name;
+}
+
+void Scheduler::RecordOverrun(const char* task, uint64_t elapsed_us) {
+  bool new_max = false;
+  {
+    MutexType::Locker lock(offenders_mutex_);
+    SliceOffender&    offender = offenders_[task];
+    ++offender.overruns;
+    offender.total_us += elapsed_us;
+    if (elapsed_us > offender.max_us) {
+      offender.max_us = elapsed_us;
+      new_max         = true;
+    }
+  }
+  if (new_max) {
+    LOG_WARN(g_logger) << "fiber ran " << elapsed_us << "us without yielding, scheduler=" << name_
+                       << " task=" << DemangleTask(task);
+  }
+}
+
+void Scheduler::YieldIfSliceExpired() {
+  uint64_t fiber_id = t_time_slice.fiber_id;
+  if (!fiber_id || fiber_id != Fiber::GetRunningFiberId()) {
+    // 没有开启时间片，或者不是调度器直接运行的协程 (如任务中手动切换的子协程)
+    return;
+  }
+  if (GetMonotonicUS() < t_time_slice.deadline_us) {
+    return;
+  }
+
+  ++t_scheduler->queues_[t_worker_index]->preemptions;
+  t_time_slice.preempted = true;
+  // 调度器在协程让出之前不会再次运行它，先放回队尾再让出
+  Fiber::ptr self = Fiber::GetRunningFiber();
+  t_scheduler->Schedule(self, t_time_slice.thread);
+  self->Yield();
+}
+
+std::vector<Scheduler::SliceOffender> Scheduler::GetSliceOffenders(size_t top) const {
+  std::vector<SliceOffender> offenders;
+  {
+    MutexType::Locker lock(offenders_mutex_);
+    for (auto& item : offenders_) {
+      offenders.push_back(item.second);
+      offenders.back().task = item.first;
+    }
+  }
+  std::sort(offenders.begin(), offenders.end(),
+            [](const SliceOffender& a, const SliceOffender& b) { return a.max_us > b.max_us; });
+  if (offenders.size() > top) {
+    offenders.resize(top);
+  }
+  for (auto& offender : offenders) {
+    offender.task = DemangleTask(offender.task.c_str());
+  }
+  return offenders;
+}
+
+Scheduler::Stats Scheduler::GetStats() const {
+  Stats stats;
+  for (auto& queue : queues_) {
+    stats.callback_tasks += queue->callback_tasks;
+    stats.fibers_created += queue->fibers_created;
+    stats.fibers_reused += queue->fibers_reused;
+    stats.preemptions += queue->preemptions;
+  }
+  return stats;
+}
+
 void Scheduler::Tickle() { LOG_INFO(g_logger) << "tickle"; }
 
 bool Scheduler::Stopping() {
-  MutexType::Locker lock(mutex_);
-  return stopping_ && tasks_.empty() && active_thread_count_ == 0;
+  // 先读任务数再读活跃线程数，与 TakeRunnable() 的修改顺序相反；外部等待者同理
+  return stopping_ && external_waiters_ == 0 && task_count_ == 0 && active_thread_count_ == 0;
 }
 
 void Scheduler::Idle() {
@@ -1,9 +1,11 @@
 #pragma once
 
+#include <atomic>
+#include <deque>
 #include <functional>
-#include <list>
 #include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "fiber.h"
@@ -22,6 +24,28 @@ class Scheduler {
   using ptr       = std::shared_ptr<Scheduler>;
   using MutexType = Mutex;
 
+  /**
+   * @brief 调度器统计信息
+   *
+   */
+  struct Stats {
+    uint64_t callback_tasks = 0;  // 执行的回调任务数
+    uint64_t fibers_created = 0;  // 为回调任务新建的协程数
+    uint64_t fibers_reused  = 0;  // 复用已结束协程的次数
+    uint64_t preemptions    = 0;  // 时间片用完在 Fiber::MaybeYield 中让出的次数
+  };
+
+  /**
+   * @brief 连续运行达到时间片两倍的任务，按回调的类型归类
+   *
+   */
+  struct SliceOffender {
+    std::string task;          // 回调的类型名
+    uint64_t    overruns = 0;  // 没有及时让出的次数
+    uint64_t    max_us   = 0;  // 最长的一次连续运行时间(us)
+    uint64_t    total_us = 0;  // 没有及时让出的各次运行时间之和(us)
+  };
+
   /**
    * @brief 创建一个线程协程调度器
    *
@@ -60,6 +84,7 @@ class Scheduler {
 
   /**
    * @brief 将待调度的协程或执行体加入调度队列中
+   * @details 指定了线程的任务进入目标线程的专属队列，其余任务优先进入当前工作线程的本地队列
    *
    * @tparam FiberOrCb
    * @param fc
@@ -67,17 +92,68 @@ class Scheduler {
    */
   template <typename FiberOrCb>
   void Schedule(FiberOrCb fc, int thread = -1) {
-    bool need_tickle = false;
-    {
-      MutexType::Locker lock(mutex_);
-      need_tickle = ScheduleNoLock(fc, thread);
+    if (ScheduleNoLock(fc, thread)) {
+      if (thread == -1) {
+        Tickle();
+      } else {
+        TickleThread(thread);
+      }
     }
+  }
 
+  /**
+   * @brief 调度一个直接在调度协程上运行的回调
+   * @details 不为回调创建协程，省去两次上下文切换，适合计数、统计之类很短的回调
+   * @warning 回调中不能 Yield，也不能调用会被 hook 挂起的 IO/sleep，GUDOV_DEBUG 下会断言
+   *
+   * @param callback
+   * @param thread
+   */
+  void ScheduleInline(std::function<void()> callback, int thread = -1) {
+    Task task(&callback, thread);
+    if (!task.callback) {
+      return;
+    }
+    task.run_inline = true;
+    if (PushTask(task)) {
+      if (thread == -1) {
+        Tickle();
+      } else {
+        TickleThread(thread);
+      }
+    }
+  }
+
+  /**
+   * @brief 登记一个挂起后由调度器之外的线程唤醒的协程
+   * @details 登记期间 Stopping() 返回 false，避免 Stop() 在协程被唤醒前结束。
+   * 必须与 ScheduleExternalWaiter() 成对调用
+   *
+   */
+  void AddExternalWaiter() { ++external_waiters_; }
+
+  /**
+   * @brief 重新调度 AddExternalWaiter() 登记的协程并注销
+   *
+   * @param fiber
+   */
+  void ScheduleExternalWaiter(Fiber::ptr fiber) {
+    // 先入队再注销，Stopping() 不会同时看到两者为零；注销后再唤醒，避免线程醒来时仍看到登记而继续休眠
+    bool need_tickle = ScheduleNoLock(std::move(fiber), -1);
+    --external_waiters_;
     if (need_tickle) {
       Tickle();
     }
   }
 
+  /**
+   * @brief 当前线程是否正在执行 ScheduleInline 调度的回调
+   * @warning thread_local
+   *
+   * @return true
+   */
+  static bool IsRunningInline();
+
   /**
    * @brief 添加多个协程或执行体
    *
@@ -88,12 +164,9 @@ class Scheduler {
   template <typename InputIterator>
   void Schedule(InputIterator begin, InputIterator end) {
     bool need_tickle = false;
-    {
-      MutexType::Locker lock(mutex_);
-      while (begin != end) {
-        need_tickle = ScheduleNoLock(&*begin, -1) || need_tickle;
-        ++begin;
-      }
+    while (begin != end) {
+      need_tickle = ScheduleNoLock(&*begin, -1) || need_tickle;
+      ++begin;
     }
 
     if (need_tickle) {
@@ -101,6 +174,37 @@ class Scheduler {
     }
   }
 
+  /**
+   * @brief 获取当前线程在所属调度器中的工作线程下标
+   * @warning thread_local
+   *
+   * @return int 不是调度线程时返回 -1
+   */
+  static int GetWorkerIndex();
+
+  /**
+   * @brief 汇总各工作线程的统计信息
+   *
+   * @return Stats
+   */
+  Stats GetStats() const;
+
+  /**
+   * @brief 连续运行时间最长的若干任务
+   * @details 只在 scheduler.time_slice_us 不为 0 时统计，按 max_us 从大到小排列
+   *
+   * @param top 最多返回的个数
+   * @return std::vector<SliceOffender>
+   */
+  std::vector<SliceOffender> GetSliceOffenders(size_t top = 10) const;
+
+  /**
+   * @brief 当前协程的时间片用完时重新调度自身并让出执行权，见 Fiber::MaybeYield
+   * @warning thread_local
+   *
+   */
+  static void YieldIfSliceExpired();
+
  protected:
   /**
    * @brief 通知协程有未执行任务
@@ -108,11 +212,20 @@ class Scheduler {
    */
   virtual void Tickle();
 
+  /**
+   * @brief 通知指定线程有专属任务
+   * @details 默认与 Tickle() 相同，子类可以只唤醒目标线程
+   *
+   * @param thread 线程 id
+   */
+  virtual void TickleThread(int thread) { Tickle(); }
+
   /**
    * @brief 处理调度的函数
    *
+   * @param index 工作线程下标，对应其本地队列
    */
-  void Run();
+  void Run(size_t index);
 
   virtual bool Stopping();
 
@@ -126,26 +239,57 @@ class Scheduler {
 
   bool HasIdleThreads() { return idle_thread_count_ > 0; }
 
+  /**
+   * @brief 工作线程数量 (包括 use_caller 的主线程)
+   *
+   */
+  size_t GetWorkerCount() const { return queues_.size(); }
+
+  /**
+   * @brief 根据线程 id 查找工作线程下标
+   *
+   * @param thread
+   * @return int 不是本调度器的线程时返回 -1
+   */
+  int FindWorker(int thread) const;
+
+  /**
+   * @brief 获得工作线程的线程 id
+   *
+   * @param index 工作线程下标
+   * @return int 线程还未启动时返回 -1
+   */
+  int GetWorkerThreadId(size_t index) const { return queues_[index]->thread_id; }
+
+  /**
+   * @brief 工作线程是否有可以执行的任务 (自己的队列或可窃取的队列非空)
+   * @details 无锁判断，供 idle 在休眠前检查，避免丢失唤醒
+   *
+   * @param index
+   */
+  bool HasPendingTask(size_t index) const;
+
  private:
   /**
    * @brief 将执行体加入队列中
-   * @details 将执行体加入 fibers 队列，如果队列为空则返回 true 等待 tickle
+   * @details 各工作线程的队列分别加锁，不再竞争同一把全局锁
    *
    * @tparam FiberOrCb
    * @param fc
    * @param thread
-   * @return true 执行队列为空
-   * @return false 执行队列非空
+   * @return true 目标队列原本为空，需要 tickle
+   * @return false 目标队列非空
    */
   template <typename FiberOrCb>
   bool ScheduleNoLock(FiberOrCb fc, int thread) {
-    bool need_tickle = tasks_.empty();
     Task task(fc, thread);
-    if (task.fiber || task.callback) {
-      tasks_.push_back(task);
+    if (!task.fiber && !task.callback) {
+      return false;
     }
-
-    return need_tickle;
+    if (task.callback) {
+      task.cancel = Fiber::GetRunningCancelContext();
+    }
+    return PushTask(task);
   }
 
  private:
@@ -157,6 +301,10 @@ class Scheduler {
     Fiber::ptr            fiber;
     std::function<void()> callback;
     int                   thread;
+    bool                  run_inline = false;  // 直接在调度协程上执行回调
+
+    /// @brief 回调继承调度方的取消上下文
+    std::shared_ptr<CancelContext> cancel;
 
     Task(Fiber::ptr f, int thr) : fiber(f), thread(thr) {}
     Task(Fiber::ptr* f, int thr) : thread(thr) { fiber.swap(*f); }
@@ -166,12 +314,85 @@ class Scheduler {
     Task() : thread(-1) {}
 
     void Reset() {
-      fiber    = nullptr;
-      callback = nullptr;
-      thread   = -1;
+      fiber      = nullptr;
+      callback   = nullptr;
+      thread     = -1;
+      run_inline = false;
+      cancel     = nullptr;
     }
   };
 
+ private:
+  /**
+   * @brief 工作线程的任务队列
+   * @details tasks 为本地双端队列，所有者从队头取任务，空闲线程从队尾窃取；
+   * pinned 只存放指定由该线程执行的任务，其他线程不会扫描
+   *
+   */
+  struct WorkerQueue {
+    MutexType           mutex;
+    std::deque<Task>    tasks;
+    std::deque<Task>    pinned;
+    std::atomic<size_t> stealable{0};    // tasks 的长度，窃取前无锁判断
+    std::atomic<size_t> pinned_size{0};  // pinned 的长度
+    std::atomic<int>    thread_id{-1};
+
+    // 以下统计只由所属工作线程修改
+    std::atomic<uint64_t> callback_tasks{0};
+    std::atomic<uint64_t> fibers_created{0};
+    std::atomic<uint64_t> fibers_reused{0};
+    std::atomic<uint64_t> preemptions{0};
+  };
+
+  bool PushTask(Task& task);
+
+  /**
+   * @brief 为工作线程取一个可执行任务
+   * @details 依次检查专属队列、本地队列，最后随机选择其他线程的队列窃取
+   *
+   * @param index 工作线程下标
+   * @param task 取到的任务
+   * @param tickle_me 被取任务的队列是否还有剩余任务
+   * @return true 取到了任务
+   */
+  bool TakeTask(size_t index, Task& task, bool& tickle_me);
+
+  /**
+   * @brief 从队列中取出第一个可运行的任务，跳过仍在其他线程运行中的协程
+   *
+   * @param queue
+   * @param task
+   * @param from_back 是否从队尾开始查找 (窃取)
+   */
+  bool TakeRunnable(std::deque<Task>& queue, Task& task, bool from_back);
+
+  WorkerQueue* FindQueue(int thread);
+
+  /**
+   * @brief 为回调任务取一个协程，优先复用空闲列表中已结束的协程
+   *
+   * @param queue 当前工作线程的队列，用于记录统计
+   * @param free_fibers 当前工作线程的空闲协程列表
+   * @param callback
+   */
+  Fiber::ptr AcquireCallbackFiber(WorkerQueue& queue, std::vector<Fiber::ptr>& free_fibers,
+                                  std::function<void()>& callback);
+
+  /**
+   * @brief 切换到任务协程执行，开启时间片时记录这一段连续运行的时间
+   *
+   * @param fiber 任务协程
+   * @param thread 任务指定的线程，时间片用完让出后仍调度到这里
+   * @return true 协程因时间片用完而让出
+   */
+  bool ResumeTask(Fiber* fiber, int thread);
+
+  /**
+   * @brief 记录一次没有及时让出的运行
+   *
+   */
+  void RecordOverrun(const char* task, uint64_t elapsed_us);
+
  private:
   MutexType mutex_;
 
@@ -182,10 +403,35 @@ class Scheduler {
   std::vector<Thread::ptr> threads_;
 
   /**
-   * @brief 待处理的协程(业务)
+   * @brief 每个工作线程一个队列 (包括 use_caller 的主线程)
+   *
+   */
+  std::vector<std::unique_ptr<WorkerQueue>> queues_;
+
+  /**
+   * @brief 所有队列中待处理的任务总数
+   *
+   */
+  std::atomic<size_t> task_count_{0};
+
+  /**
+   * @brief 非调度线程提交任务时轮询选择队列
+   *
+   */
+  std::atomic<size_t> next_queue_{0};
+
+  /**
+   * @brief 由 AddExternalWaiter() 登记、尚未唤醒的协程数
+   *
+   */
+  std::atomic<size_t> external_waiters_{0};
+
+  /**
+   * @brief 没有及时让出的任务，键为回调类型名 (type_info::name) 的地址
    *
    */
-  std::list<Task> tasks_;
+  mutable MutexType                              offenders_mutex_;
+  std::unordered_map<const char*, SliceOffender> offenders_;
 
   /**
    * @brief 主协程
@@ -201,7 +447,7 @@ class Scheduler {
   // 所有线程的 id (包括主协程)
   std::vector<int> thread_ids_;
   // 待调度的线程数
-  size_t              thread_count_ = 0;
+  size_t              thread_count_        = 0;
   std::atomic<size_t> active_thread_count_ = {0};
   std::atomic<size_t> idle_thread_count_   = {0};
   bool                stopping_            = false;
@@ -73,7 +73,7 @@ bool Socket::CheckConnected() {
 }
 
 int64_t Socket::GetSendTimeout() {
-  FdCtx::ptr ctx = FdMgr::GetInstance()->Get(sock_);
+  FdCtx* ctx = FdMgr::GetInstance()->Get(sock_);
   if (ctx) {
     return ctx->GetTimeout(SO_SNDTIMEO);
   }
@@ -88,7 +88,7 @@ void Socket::SetSendTimeout(int64_t v) {
 }
 
 int64_t Socket::GetRecvTimeout() {
-  FdCtx::ptr ctx = FdMgr::GetInstance()->Get(sock_);
+  FdCtx* ctx = FdMgr::GetInstance()->Get(sock_);
   if (ctx) {
     return ctx->GetTimeout(SO_RCVTIMEO);
   }
@@ -416,7 +416,7 @@ void Socket::NewSock() {
 }
 
 bool Socket::Init(int sock) {
-  FdCtx::ptr ctx = FdMgr::GetInstance()->Get(sock);
+  FdCtx* ctx = FdMgr::GetInstance()->Get(sock);
   if (ctx && ctx->IsSocket() && !ctx->IsClose()) {
     sock_         = sock;
     is_connected_ = true;
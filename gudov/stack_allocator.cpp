@@ -0,0 +1,320 @@
+#include "stack_allocator.h"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#include "config.h"
+#include "log.h"
+#include "macro.h"
+
+namespace gudov {
+
+static Logger::ptr g_logger = LOG_NAME("system");
+
+static ConfigVar<uint32_t>::ptr g_stack_pool_thread_cache = Config::Lookup<uint32_t>(
+    "fiber.stack_pool.thread_cache", 16, "max cached fiber stacks per size class in each thread");
+
+static ConfigVar<uint32_t>::ptr g_stack_pool_global_cache =
+    Config::Lookup<uint32_t>("fiber.stack_pool.global_cache", 128, "max cached fiber stacks per size class globally");
+
+static std::atomic<uint32_t> s_thread_cache_limit{16};
+static std::atomic<uint32_t> s_global_cache_limit{128};
+
+struct _StackPoolIniter {
+  _StackPoolIniter() {
+    s_thread_cache_limit = g_stack_pool_thread_cache->GetValue();
+    s_global_cache_limit = g_stack_pool_global_cache->GetValue();
+
+    g_stack_pool_thread_cache->AddListener([](const uint32_t& old_value, const uint32_t& new_value) {
+      LOG_INFO(g_logger) << "fiber stack pool thread cache changed from " << old_value << " to " << new_value;
+      s_thread_cache_limit = new_value;
+    });
+    g_stack_pool_global_cache->AddListener([](const uint32_t& old_value, const uint32_t& new_value) {
+      LOG_INFO(g_logger) << "fiber stack pool global cache changed from " << old_value << " to " << new_value;
+      s_global_cache_limit = new_value;
+    });
+  }
+};
+
+static _StackPoolIniter s_stack_pool_initer;
+
+void* MallocStackAllocator::Alloc(size_t size) { return malloc(size); }
+
+void MallocStackAllocator::Dealloc(void* vp, size_t size) { free(vp); }
+
+/// @brief 回收时保留栈顶的热页不归还，协程复用时大概率会再次用到
+static const size_t kMmapStackHotBytes = 16 * 1024;
+
+static size_t AlignToPage(size_t size) {
+  size_t page = MmapStackAllocator::PageSize();
+  return (size + page - 1) / page * page;
+}
+
+size_t MmapStackAllocator::PageSize() {
+  static size_t s_page_size = sysconf(_SC_PAGESIZE);
+  return s_page_size;
+}
+
+void* MmapStackAllocator::Alloc(size_t size) {
+  size_t page  = PageSize();
+  size_t total = AlignToPage(size) + page;
+
+  void* base = mmap(nullptr, total, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK,
+                    -1, 0);
+  if (base == MAP_FAILED) {
+    LOG_ERROR(g_logger) << "mmap stack size=" << total << " errno=" << errno << " errstr=" << strerror(errno);
+    return nullptr;
+  }
+
+  // 栈从高地址向低地址增长，保护页放在最低处
+  if (mprotect(base, page, PROT_NONE)) {
+    LOG_ERROR(g_logger) << "mprotect guard page errno=" << errno << " errstr=" << strerror(errno);
+    munmap(base, total);
+    return nullptr;
+  }
+  return (char*)base + page;
+}
+
+void MmapStackAllocator::Dealloc(void* vp, size_t size) {
+  size_t page = PageSize();
+  if (munmap((char*)vp - page, AlignToPage(size) + page)) {
+    LOG_ERROR(g_logger) << "munmap stack errno=" << errno << " errstr=" << strerror(errno);
+  }
+}
+
+void MmapStackAllocator::Recycle(void* vp, size_t size) {
+  size = AlignToPage(size);
+  if (size <= kMmapStackHotBytes) {
+    return;
+  }
+  size_t len = size - kMmapStackHotBytes;
+
+#ifdef MADV_FREE
+  // MADV_FREE 只在内存紧张时才真正回收，开销比 MADV_DONTNEED 小，内核不支持时退回 MADV_DONTNEED
+  static std::atomic<bool> s_madv_free{true};
+  if (s_madv_free) {
+    if (madvise(vp, len, MADV_FREE) == 0) {
+      return;
+    }
+    if (errno != EINVAL) {
+      LOG_ERROR(g_logger) << "madvise(MADV_FREE) errno=" << errno << " errstr=" << strerror(errno);
+      return;
+    }
+    s_madv_free = false;
+  }
+#endif
+  if (madvise(vp, len, MADV_DONTNEED)) {
+    LOG_ERROR(g_logger) << "madvise(MADV_DONTNEED) errno=" << errno << " errstr=" << strerror(errno);
+  }
+}
+
+/// @brief 同时存在的缓存池实例上限，每个实例在线程内有独立的缓存
+static const size_t kMaxPools = 8;
+
+/// @brief 已被占用的缓存池编号
+static std::atomic<uint32_t> s_pool_ids{0};
+
+/// @brief 每个编号上实例的代数，实例创建和析构时各加一，线程缓存据此识别已析构的实例留下的栈
+static std::atomic<uint32_t> s_pool_generations[kMaxPools];
+
+static size_t AcquirePoolId() {
+  uint32_t ids = s_pool_ids;
+  while (true) {
+    size_t id = 0;
+    while (id < kMaxPools && (ids & (1u << id))) {
+      ++id;
+    }
+    GUDOV_ASSERT2(id < kMaxPools, "too many PooledStackAllocator instances");
+    if (s_pool_ids.compare_exchange_weak(ids, ids | (1u << id))) {
+      return id;
+    }
+  }
+}
+
+struct PooledStackAllocator::ThreadCache {
+  PooledStackAllocator* owner      = nullptr;
+  uint32_t              generation = 0;
+  std::vector<void*>    stacks[kClassCount];
+
+  /**
+   * @brief 丢弃缓存的栈而不归还
+   * @details 用于所属实例已经析构的情况，它的底层分配器可能也已不在，只能泄漏这些栈
+   */
+  void Drop() {
+    for (auto& list : stacks) {
+      list.clear();
+    }
+    owner = nullptr;
+  }
+
+  void Flush() {
+    if (!owner) {
+      return;
+    }
+    for (size_t cls = 0; cls < kClassCount; ++cls) {
+      if (!stacks[cls].empty()) {
+        owner->ReturnToGlobal(cls, stacks[cls].data(), stacks[cls].size());
+        stacks[cls].clear();
+      }
+    }
+  }
+};
+
+/// @brief 线程退出后的标记，POD 类型不会被析构，线程结束前都可以安全读取
+static thread_local bool t_cache_destroyed = false;
+
+struct ThreadCacheHolder {
+  PooledStackAllocator::ThreadCache caches[kMaxPools];
+
+  ~ThreadCacheHolder() {
+    t_cache_destroyed = true;
+    for (size_t id = 0; id < kMaxPools; ++id) {
+      if (caches[id].generation == s_pool_generations[id]) {
+        caches[id].Flush();
+      } else {
+        caches[id].Drop();
+      }
+    }
+  }
+};
+
+static thread_local ThreadCacheHolder t_cache_holder;
+
+static size_t SizeClass(size_t size) {
+  size_t cls = 0;
+  while (((size_t)1 << cls) < size) {
+    ++cls;
+  }
+  GUDOV_ASSERT2(cls < PooledStackAllocator::kClassCount, "stack size too large: " << size);
+  return cls;
+}
+
+size_t PooledStackAllocator::RoundUp(size_t size) { return (size_t)1 << SizeClass(size); }
+
+PooledStackAllocator::PooledStackAllocator(StackAllocator* backing)
+    : backing_(backing), id_(AcquirePoolId()), generation_(++s_pool_generations[id_]) {}
+
+/**
+ * 缓存池通常与进程同生命周期，析构时只能回收当前线程的本地缓存。
+ * 其他线程本地缓存中的栈无法回收，代数改变后这些线程不再使用它们，也不会再访问本对象
+ */
+PooledStackAllocator::~PooledStackAllocator() {
+  ThreadCache* cache = GetThreadCache();
+  if (cache) {
+    cache->Flush();
+    cache->owner = nullptr;
+  }
+  ++s_pool_generations[id_];
+  for (size_t cls = 0; cls < kClassCount; ++cls) {
+    for (void* vp : global_[cls]) {
+      backing_->Dealloc(vp, (size_t)1 << cls);
+    }
+  }
+  s_pool_ids &= ~(1u << id_);
+}
+
+PooledStackAllocator::ThreadCache* PooledStackAllocator::GetThreadCache() {
+  if (GUDOV_UNLICKLY(t_cache_destroyed)) {
+    return nullptr;
+  }
+  ThreadCache* cache = &t_cache_holder.caches[id_];
+  if (GUDOV_UNLICKLY(cache->generation != generation_)) {
+    // 同一编号上之前的实例留下的栈，底层分配器可能与本实例不同
+    cache->Drop();
+    cache->owner      = this;
+    cache->generation = generation_;
+  }
+  return cache;
+}
+
+size_t PooledStackAllocator::TakeFromGlobal(size_t cls, std::vector<void*>& out, size_t count) {
+  Mutex::Locker lock(mutex_);
+  auto&         stacks = global_[cls];
+  size_t        n      = std::min(count, stacks.size());
+  out.insert(out.end(), stacks.end() - n, stacks.end());
+  stacks.resize(stacks.size() - n);
+  cached_ -= n;
+  return n;
+}
+
+void PooledStackAllocator::ReturnToGlobal(size_t cls, void* const* stacks, size_t count) {
+  size_t kept = 0;
+  {
+    Mutex::Locker lock(mutex_);
+    auto&         global = global_[cls];
+    size_t        limit  = s_global_cache_limit;
+    if (global.size() < limit) {
+      kept = std::min(count, limit - global.size());
+      global.insert(global.end(), stacks, stacks + kept);
+      cached_ += kept;
+    }
+  }
+  for (size_t i = kept; i < count; ++i) {
+    backing_->Dealloc(stacks[i], (size_t)1 << cls);
+    ++releases_;
+  }
+}
+
+void* PooledStackAllocator::Alloc(size_t size) {
+  size_t       cls   = SizeClass(size);
+  ThreadCache* cache = GetThreadCache();
+  if (GUDOV_LICKLY(cache)) {
+    auto& stacks = cache->stacks[cls];
+    if (stacks.empty()) {
+      // 本地缓存为空时从全局池批量补充
+      TakeFromGlobal(cls, stacks, std::max<size_t>(1, s_thread_cache_limit / 2));
+    }
+    if (!stacks.empty()) {
+      void* vp = stacks.back();
+      stacks.pop_back();
+      ++hits_;
+      return vp;
+    }
+  } else {
+    std::vector<void*> stacks;
+    if (TakeFromGlobal(cls, stacks, 1)) {
+      ++hits_;
+      return stacks.back();
+    }
+  }
+
+  ++misses_;
+  return backing_->Alloc((size_t)1 << cls);
+}
+
+void PooledStackAllocator::Dealloc(void* vp, size_t size) {
+  size_t cls = SizeClass(size);
+  backing_->Recycle(vp, (size_t)1 << cls);
+
+  ThreadCache* cache = GetThreadCache();
+  size_t       limit = s_thread_cache_limit;
+  if (GUDOV_UNLICKLY(!cache || limit == 0)) {
+    ReturnToGlobal(cls, &vp, 1);
+    return;
+  }
+
+  auto& stacks = cache->stacks[cls];
+  stacks.push_back(vp);
+  if (stacks.size() > limit) {
+    // 本地缓存超出上限，将一半转移到全局池供其他线程使用
+    size_t half = stacks.size() / 2;
+    ReturnToGlobal(cls, stacks.data() + stacks.size() - half, half);
+    stacks.resize(stacks.size() - half);
+  }
+}
+
+PooledStackAllocator::Stats PooledStackAllocator::GetStats() const {
+  Stats stats;
+  stats.hits     = hits_;
+  stats.misses   = misses_;
+  stats.releases = releases_;
+  stats.cached   = cached_;
+  return stats;
+}
+
+}  // namespace gudov
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "mutex.h"
+
+namespace gudov {
+
+struct ThreadCacheHolder;
+
+/**
+ * @brief 协程栈分配器接口
+ *
+ */
+class StackAllocator {
+ public:
+  virtual ~StackAllocator() = default;
+
+  virtual void* Alloc(size_t size)             = 0;
+  virtual void  Dealloc(void* vp, size_t size) = 0;
+
+  /**
+   * @brief 栈被放入缓存等待复用时调用
+   * @details 此时栈上的数据已无用，实现可以借此归还物理内存
+   *
+   * @param vp
+   * @param size
+   */
+  virtual void Recycle(void* vp, size_t size) {}
+};
+
+/**
+ * @brief 直接使用 malloc/free 的栈分配器
+ *
+ */
+class MallocStackAllocator : public StackAllocator {
+ public:
+  void* Alloc(size_t size) override;
+  void  Dealloc(void* vp, size_t size) override;
+};
+
+/**
+ * @brief 基于 mmap 的栈分配器
+ * @details
+ * 每个栈额外预留一个 PROT_NONE 的保护页放在栈底，栈溢出时直接触发 SIGSEGV 而不是悄悄破坏堆内存。
+ * 映射时使用 MAP_NORESERVE，物理页在协程第一次访问时才由内核分配，进程 RSS 只包含协程实际用到的栈。
+ * 栈被缓存复用时通过 madvise(MADV_FREE/MADV_DONTNEED) 归还协程弄脏的页
+ *
+ */
+class MmapStackAllocator : public StackAllocator {
+ public:
+  void* Alloc(size_t size) override;
+  void  Dealloc(void* vp, size_t size) override;
+  void  Recycle(void* vp, size_t size) override;
+
+  static size_t PageSize();
+};
+
+/**
+ * @brief 可复用栈的缓存池
+ * @details
+ * 栈大小向上取整到 2 的幂作为大小级别，释放的栈先放入线程本地缓存，
+ * 本地缓存满了后一半转移到全局池，全局池也满了才真正归还给底层分配器。
+ * 申请时依次查找线程本地缓存、全局池，都未命中再向底层分配器申请。
+ * 缓存上限由 fiber.stack_pool.thread_cache / fiber.stack_pool.global_cache 配置
+ *
+ */
+class PooledStackAllocator : public StackAllocator {
+ public:
+  /// 大小级别数量，最大支持 2^kClassCount 字节的栈
+  static const size_t kClassCount = 32;
+
+  struct Stats {
+    uint64_t hits     = 0;  // 命中缓存次数
+    uint64_t misses   = 0;  // 向底层分配器申请次数
+    uint64_t releases = 0;  // 归还给底层分配器次数
+    uint64_t cached   = 0;  // 全局池中缓存的栈数量
+  };
+
+  /**
+   * @param backing 底层分配器，生命周期需长于本对象
+   */
+  explicit PooledStackAllocator(StackAllocator* backing);
+  ~PooledStackAllocator();
+
+  void* Alloc(size_t size) override;
+  void  Dealloc(void* vp, size_t size) override;
+
+  Stats GetStats() const;
+
+  /**
+   * @brief 将栈大小向上取整到所在大小级别
+   *
+   * @param size
+   * @return size_t
+   */
+  static size_t RoundUp(size_t size);
+
+ private:
+  struct ThreadCache;
+
+  ThreadCache* GetThreadCache();
+
+  /**
+   * @brief 从全局池批量取出至多 count 个栈放入 out
+   */
+  size_t TakeFromGlobal(size_t cls, std::vector<void*>& out, size_t count);
+
+  /**
+   * @brief 将栈放回全局池，超过上限的部分归还底层分配器
+   */
+  void ReturnToGlobal(size_t cls, void* const* stacks, size_t count);
+
+  friend struct ThreadCacheHolder;
+
+ private:
+  StackAllocator* backing_;
+  size_t          id_;
+  /// @brief 本实例在 id_ 上的代数，线程缓存的代数不同时说明属于已析构的实例
+  uint32_t        generation_;
+
+  Mutex              mutex_;
+  std::vector<void*> global_[kClassCount];
+
+  std::atomic<uint64_t> hits_{0};
+  std::atomic<uint64_t> misses_{0};
+  std::atomic<uint64_t> releases_{0};
+  std::atomic<uint64_t> cached_{0};
+};
+
+}  // namespace gudov
@@ -1,6 +1,8 @@
 #include "thread.h"
 
+#include <errno.h>
 #include <semaphore.h>
+#include <time.h>
 
 #include "log.h"
 #include "util.h"
@@ -28,6 +30,35 @@ void Semaphore::Wait() {
   }
 }
 
+// 截止时间基于单调时钟，调整系统时间不会让等待提前结束或一直不结束
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 30)
+#define GUDOV_SEM_CLOCK         CLOCK_MONOTONIC
+#define GUDOV_SEM_WAIT(sem, ts) sem_clockwait(sem, CLOCK_MONOTONIC, ts)
+#else
+#define GUDOV_SEM_CLOCK         CLOCK_REALTIME
+#define GUDOV_SEM_WAIT(sem, ts) sem_timedwait(sem, ts)
+#endif
+
+bool Semaphore::WaitFor(uint64_t timeout_ms) {
+  timespec ts;
+  clock_gettime(GUDOV_SEM_CLOCK, &ts);
+  ts.tv_sec += timeout_ms / 1000;
+  ts.tv_nsec += (timeout_ms % 1000) * 1000000;
+  if (ts.tv_nsec >= 1000000000) {
+    ++ts.tv_sec;
+    ts.tv_nsec -= 1000000000;
+  }
+  while (GUDOV_SEM_WAIT(&semaphore_, &ts)) {
+    if (errno == ETIMEDOUT) {
+      return false;
+    }
+    if (errno != EINTR) {
+      throw std::logic_error("Semaphore::WaitFor error");
+    }
+  }
+  return true;
+}
+
 void Semaphore::Notify() {
   if (sem_post(&semaphore_)) {
     throw std::logic_error("sem_post error");
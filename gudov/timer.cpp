@@ -1,5 +1,8 @@
 #include "timer.h"
 
+#include <algorithm>
+
+#include "config.h"
 #include "log.h"
 #include "util.h"
 
@@ -7,92 +10,493 @@ namespace gudov {
 
 static Logger::ptr g_logger = LOG_NAME("system");
 
-Timer::Timer(uint64_t ms, std::function<void()> callback, bool recurring, TimerManager *manager)
-    : recurring_(recurring), ms_(ms), callback_(callback), manager_(manager) {
-  next_ = GetCurrentMS() + ms_;
+static ConfigVar<std::string>::ptr g_timer_backend =
+    Config::Lookup<std::string>("timer.backend", "set", "timer backend: set or wheel");
+
+/// @brief 一个批处理回调最多包含的定时器数量，批次太大时其他工作线程无法分担
+static const size_t MAX_TIMER_BATCH = 256;
+
+Timer::Timer(uint64_t us, std::function<void()> callback, bool recurring, uint64_t slack, TimerManager *manager)
+    : recurring_(recurring), us_(us), slack_(slack), callback_(callback), manager_(manager) {
+  next_ = Deadline(GetMonotonicUS());
 }
 
 Timer::Timer(uint64_t next) : next_(next) {}
 
-bool Timer::Cancel() {
-  TimerManager::RWMutexType::WriteLock lock(manager_->mutex_);
-  if (callback_) {
-    callback_ = nullptr;
-    auto it   = manager_->timers_.find(shared_from_this());
-    manager_->timers_.erase(it);
-    return true;
+uint64_t Timer::Deadline(uint64_t start) const {
+  uint64_t next = start + us_;
+  if (slack_) {
+    next = (next + slack_ - 1) / slack_ * slack_;
   }
-  return false;
+  return next;
 }
 
-bool Timer::Refresh() {
-  TimerManager::RWMutexType::WriteLock lock(manager_->mutex_);
-  if (!callback_) {
+bool Timer::Cancel() { return manager_->CancelTimer(this); }
+
+bool Timer::Refresh() { return manager_->RefreshTimer(this); }
+
+bool Timer::Reset(uint64_t ms, bool fromNow) { return ResetUS(ms * 1000, fromNow); }
+
+bool Timer::ResetUS(uint64_t us, bool fromNow) { return manager_->ResetTimer(this, us, fromNow); }
+
+bool Timer::Comparator::operator()(const Timer::ptr &lhs, const Timer::ptr &rhs) const {
+  if (!lhs && !rhs) {
     return false;
   }
-  auto it = manager_->timers_.find(shared_from_this());
-  if (it == manager_->timers_.end()) {
+  if (!lhs) {
+    return true;
+  }
+  if (!rhs) {
     return false;
   }
-  manager_->timers_.erase(it);
-  next_ = GetCurrentMS() + ms_;
-  manager_->timers_.insert(shared_from_this());
-  return true;
-}
-
-bool Timer::Reset(uint64_t ms, bool fromNow) {
-  if (ms == ms_ && !fromNow) {
+  if (lhs->next_ < rhs->next_) {
     return true;
   }
-  TimerManager::RWMutexType::WriteLock lock(manager_->mutex_);
-  if (!callback_) {
+  if (lhs->next_ > rhs->next_) {
     return false;
   }
-  auto it = manager_->timers_.find(shared_from_this());
-  if (it == manager_->timers_.end()) {
-    return false;
+  return lhs.get() < rhs.get();
+}
+
+TimingWheel::TimingWheel(uint64_t now_us) : current_(now_us / kTickUS) {
+  std::fill(std::begin(slots_), std::end(slots_), nullptr);
+  std::fill(std::begin(bitmap_), std::end(bitmap_), 0);
+}
+
+TimingWheel::~TimingWheel() {
+  std::vector<Timer::ptr> timers;
+  TakeAll(timers);
+}
+
+size_t TimingWheel::SlotFor(uint64_t expire) const {
+  if ((expire >> kLevel0Bits) == (current_ >> kLevel0Bits)) {
+    return expire & (kLevel0Size - 1);
+  }
+  for (size_t level = 1; level < kLevels; ++level) {
+    size_t shift = kLevel0Bits + level * kLevelBits;
+    if ((expire >> shift) == (current_ >> shift)) {
+      return kLevel0Size + (level - 1) * kLevelSize + ((expire >> (shift - kLevelBits)) & (kLevelSize - 1));
+    }
+  }
+  return kOverflow;
+}
+
+void TimingWheel::Link(Timer *timer, size_t slot) {
+  timer->wheel_prev_ = nullptr;
+  timer->wheel_next_ = slots_[slot];
+  if (slots_[slot]) {
+    slots_[slot]->wheel_prev_ = timer;
+  }
+  slots_[slot]       = timer;
+  timer->wheel_slot_ = slot;
+  if (slot < kSlots) {
+    bitmap_[slot / 64] |= 1ull << (slot % 64);
   }
-  manager_->timers_.erase(it);
-  uint64_t start = 0;
-  if (fromNow) {
-    start = GetCurrentMS();
+}
+
+void TimingWheel::Unlink(Timer *timer) {
+  size_t slot = timer->wheel_slot_;
+  if (timer->wheel_prev_) {
+    timer->wheel_prev_->wheel_next_ = timer->wheel_next_;
   } else {
-    start = next_ - ms_;
+    slots_[slot] = timer->wheel_next_;
+  }
+  if (timer->wheel_next_) {
+    timer->wheel_next_->wheel_prev_ = timer->wheel_prev_;
+  }
+  timer->wheel_prev_ = timer->wheel_next_ = nullptr;
+  if (!slots_[slot] && slot < kSlots) {
+    bitmap_[slot / 64] &= ~(1ull << (slot % 64));
   }
-  ms_   = ms;
-  next_ = start + ms_;
-  manager_->AddTimer(shared_from_this(), lock);
-  return true;
 }
 
-bool Timer::Comparator::operator()(const Timer::ptr &lhs, const Timer::ptr &rhs) const {
-  if (!lhs && !rhs) {
+void TimingWheel::Insert(const Timer::ptr &timer) {
+  timer->wheel_self_   = timer;
+  timer->wheel_expire_ = std::max(ToTick(timer->next_), current_);
+  Link(timer.get(), SlotFor(timer->wheel_expire_));
+  ++size_;
+}
+
+bool TimingWheel::Erase(Timer *timer) {
+  if (!timer->wheel_self_) {
     return false;
   }
-  if (!lhs) {
+  Unlink(timer);
+  --size_;
+  timer->wheel_self_.reset();
+  return true;
+}
+
+void TimingWheel::Delay(Timer *timer, uint64_t next_us) {
+  uint64_t tick = ToTick(next_us);
+  if (tick >= timer->wheel_expire_) {
+    // 到槽时再检查 next_，不必移动
+    timer->next_ = next_us;
+    return;
+  }
+  Unlink(timer);
+  timer->next_         = next_us;
+  timer->wheel_expire_ = std::max(tick, current_);
+  Link(timer, SlotFor(timer->wheel_expire_));
+}
+
+void TimingWheel::Cascade(size_t slot) {
+  Timer *timer = slots_[slot];
+  while (timer) {
+    Timer *next = timer->wheel_next_;
+    Unlink(timer);
+    timer->wheel_expire_ = std::max(ToTick(timer->next_), current_);
+    Link(timer, SlotFor(timer->wheel_expire_));
+    timer = next;
+  }
+}
+
+int TimingWheel::FindSlot(size_t from, size_t to) const {
+  size_t i = from;
+  while (i < to) {
+    uint64_t word = bitmap_[i / 64] >> (i % 64);
+    if (word) {
+      size_t slot = i + __builtin_ctzll(word);
+      return slot < to ? (int)slot : -1;
+    }
+    i = (i / 64 + 1) * 64;
+  }
+  return -1;
+}
+
+uint64_t TimingWheel::NextExpire() const {
+  if (!size_) {
+    return ~0ull;
+  }
+  int slot = FindSlot(current_ & (kLevel0Size - 1), kLevel0Size);
+  if (slot >= 0) {
+    return ((current_ & ~(uint64_t)(kLevel0Size - 1)) + slot) * kTickUS;
+  }
+  // 上层的定时器只可能在当前槽及之后，当前槽非空说明 current_ 刚到块的开头，还没有 cascade
+  for (size_t level = 1; level < kLevels; ++level) {
+    size_t shift = kLevel0Bits + (level - 1) * kLevelBits;
+    size_t base  = kLevel0Size + (level - 1) * kLevelSize;
+    size_t index = (current_ >> shift) & (kLevelSize - 1);
+    slot         = FindSlot(base + index, base + kLevelSize);
+    if (slot >= 0) {
+      uint64_t block = current_ >> (shift + kLevelBits) << (shift + kLevelBits);
+      return (block + ((uint64_t)(slot - base) << shift)) * kTickUS;
+    }
+  }
+  size_t shift = kLevel0Bits + (kLevels - 1) * kLevelBits;
+  if ((current_ & ((1ull << shift) - 1)) == 0) {
+    return current_ * kTickUS;
+  }
+  return (((current_ >> shift) + 1) << shift) * kTickUS;
+}
+
+void TimingWheel::Advance(uint64_t now_us, std::vector<Timer::ptr> &expired) {
+  uint64_t now_tick = now_us / kTickUS;
+  if (!size_) {
+    current_ = std::max(current_, now_tick + 1);
+    return;
+  }
+  while (current_ <= now_tick) {
+    size_t index = current_ & (kLevel0Size - 1);
+    if (index == 0) {
+      // 从最高层开始，把到了当前块的上层槽重新分配
+      size_t top_shift = kLevel0Bits + (kLevels - 1) * kLevelBits;
+      if ((current_ & ((1ull << top_shift) - 1)) == 0) {
+        Cascade(kOverflow);
+      }
+      for (size_t level = kLevels - 1; level >= 1; --level) {
+        size_t shift = kLevel0Bits + (level - 1) * kLevelBits;
+        if ((current_ & ((1ull << shift) - 1)) == 0) {
+          size_t base = kLevel0Size + (level - 1) * kLevelSize;
+          Cascade(base + ((current_ >> shift) & (kLevelSize - 1)));
+        }
+      }
+    }
+
+    Timer *timer = slots_[index];
+    while (timer) {
+      Timer *next = timer->wheel_next_;
+      Unlink(timer);
+      if (ToTick(timer->next_) > now_tick) {
+        // 被 Delay 推后过，按新的到期时间重新放入
+        timer->wheel_expire_ = ToTick(timer->next_);
+        Link(timer, SlotFor(timer->wheel_expire_));
+      } else {
+        --size_;
+        expired.push_back(std::move(timer->wheel_self_));
+      }
+      timer = next;
+    }
+
+    // 跳过本块中后面的空槽
+    int      slot = FindSlot(index + 1, kLevel0Size);
+    uint64_t next = slot >= 0 ? (current_ & ~(uint64_t)(kLevel0Size - 1)) + slot
+                              : (current_ | (kLevel0Size - 1)) + 1;
+    current_      = std::min(next, now_tick + 1);
+  }
+}
+
+void TimingWheel::TakeAll(std::vector<Timer::ptr> &expired) {
+  for (size_t slot = 0; slot <= kOverflow; ++slot) {
+    Timer *timer = slots_[slot];
+    while (timer) {
+      Timer *next = timer->wheel_next_;
+      Unlink(timer);
+      expired.push_back(std::move(timer->wheel_self_));
+      timer = next;
+    }
+  }
+  size_ = 0;
+}
+
+/**
+ * @brief 一组定时器
+ * @details 共享分片的所有操作都持有 mutex；线程分片的定时器只由所属线程访问，mutex 只保护 requests
+ *
+ */
+struct TimerManager::Shard {
+  enum RequestType {
+    CANCEL,
+    REFRESH,
+    RESET,
+  };
+
+  /**
+   * @brief 其他线程投递的操作
+   *
+   */
+  struct Request {
+    RequestType type;
+    Timer::ptr  timer;
+    uint64_t    us;        // RESET 的新周期
+    bool        from_now;  // RESET 是否从 now_us 开始计时
+    uint64_t    now_us;    // 投递时的时间
+  };
+
+  Shard(uint64_t now_us, bool use_wheel) {
+    if (use_wheel) {
+      wheel.reset(new TimingWheel(now_us));
+    }
+  }
+
+  /**
+   * @brief 放入定时器
+   *
+   * @return true 成为最早到期的定时器
+   */
+  bool Insert(const Timer::ptr &timer) {
+    if (wheel) {
+      bool at_front = timer->next_ < wheel->NextExpire();
+      wheel->Insert(timer);
+      return at_front;
+    }
+    auto it = timers.insert(timer).first;
+    return it == timers.begin();
+  }
+
+  /**
+   * @brief 移出定时器
+   *
+   * @return false 不在分片中
+   */
+  bool Remove(Timer *timer) {
+    if (wheel) {
+      return wheel->Erase(timer);
+    }
+    auto it = timers.find(timer->shared_from_this());
+    if (it == timers.end()) {
+      return false;
+    }
+    timers.erase(it);
     return true;
   }
-  if (!rhs) {
-    return false;
+
+  bool Refresh(Timer *timer, uint64_t next_us) {
+    if (wheel) {
+      if (!timer->wheel_self_) {
+        return false;
+      }
+      wheel->Delay(timer, next_us);
+      return true;
+    }
+    auto it = timers.find(timer->shared_from_this());
+    if (it == timers.end()) {
+      return false;
+    }
+    timers.erase(it);
+    timer->next_ = next_us;
+    timers.insert(timer->shared_from_this());
+    return true;
   }
-  if (lhs->next_ < rhs->next_) {
+
+  /**
+   * @brief 修改周期后重新放入
+   *
+   * @param[out] at_front 成为最早到期的定时器
+   * @return false 不在分片中
+   */
+  bool Reset(Timer *timer, uint64_t us, bool from_now, uint64_t now_us, bool &at_front) {
+    Timer::ptr self = timer->shared_from_this();
+    if (!Remove(timer)) {
+      return false;
+    }
+    uint64_t start = from_now ? now_us : timer->next_ - timer->us_;
+    timer->us_     = us;
+    timer->next_   = timer->Deadline(start);
+    at_front       = Insert(self);
     return true;
   }
-  if (lhs->next_ > rhs->next_) {
-    return false;
+
+  uint64_t NextExpire() const {
+    if (wheel) {
+      return wheel->NextExpire();
+    }
+    return timers.empty() ? ~0ull : (*timers.begin())->next_;
+  }
+
+  /**
+   * @brief 修改共享分片后更新缓存的最早到期时间
+   *
+   */
+  void UpdateNextExpire() { next_expire.store(NextExpire(), std::memory_order_release); }
+
+  /**
+   * @brief 不加锁地判断共享分片是否可能有到期的定时器
+   *
+   */
+  bool MayExpire(uint64_t now_us) const { return next_expire.load(std::memory_order_acquire) <= now_us; }
+
+  void ListExpired(uint64_t now_us, std::vector<std::function<void()>> &callbacks);
+
+  Mutex mutex;
+
+  std::set<Timer::ptr, Timer::Comparator> timers;
+
+  /// @brief 时间轮，为空时使用 timers
+  std::unique_ptr<TimingWheel> wheel;
+
+  /// @brief 最早到期时间的缓存，只在共享分片中维护
+  std::atomic<uint64_t> next_expire{~0ull};
+
+  std::vector<Request> requests;
+  std::atomic<bool>    has_request{false};
+};
+
+void TimerManager::Shard::ListExpired(uint64_t now_us, std::vector<std::function<void()>> &callbacks) {
+  std::vector<Timer::ptr> expired;
+  if (wheel) {
+    if (wheel->NextExpire() > now_us) {
+      return;
+    }
+    wheel->Advance(now_us, expired);
+  } else {
+    // 单调时钟不会回退，不需要检测时间被调后
+    if (timers.empty() || (*timers.begin())->next_ > now_us) {
+      return;
+    }
+
+    Timer::ptr now_timer(new Timer(now_us));
+    auto       it = timers.lower_bound(now_timer);
+    while (it != timers.end() && (*it)->next_ == now_us) {
+      ++it;
+    }
+    expired.insert(expired.begin(), timers.begin(), it);
+    timers.erase(timers.begin(), it);
+  }
+  callbacks.reserve(callbacks.size() + expired.size());
+
+  // 设置了 slack 且到期时间相同的定时器放进同一个批次，作为一个回调执行
+  std::shared_ptr<std::vector<std::function<void()>>> batch;
+  uint64_t                                            batch_deadline = 0;
+
+  for (auto &timer : expired) {
+    std::function<void()> callback;
+    uint64_t              deadline = timer->next_;
+    if (timer->recurring_) {
+      // 其他线程取消的请求还没有处理
+      if (!timer->active_) {
+        timer->callback_ = nullptr;
+        continue;
+      }
+      callback     = timer->callback_;
+      timer->next_ = timer->Deadline(now_us);
+      Insert(timer);
+    } else {
+      if (!timer->active_.exchange(false)) {
+        timer->callback_ = nullptr;
+        continue;
+      }
+      callback         = std::move(timer->callback_);
+      timer->callback_ = nullptr;
+    }
+
+    if (!timer->slack_) {
+      callbacks.push_back(std::move(callback));
+      continue;
+    }
+    if (!batch || deadline != batch_deadline || batch->size() >= MAX_TIMER_BATCH) {
+      batch          = std::make_shared<std::vector<std::function<void()>>>();
+      batch_deadline = deadline;
+      callbacks.push_back([batch]() {
+        for (auto &cb : *batch) {
+          cb();
+        }
+      });
+    }
+    batch->push_back(std::move(callback));
   }
-  return lhs.get() < rhs.get();
 }
 
-TimerManager::TimerManager() { previous_time_ = GetCurrentMS(); }
+TimerManager::TimerManager() : shared_(new Shard(GetMonotonicUS(), g_timer_backend->GetValue() == "wheel")) {}
 
 TimerManager::~TimerManager() {}
 
-Timer::ptr TimerManager::AddTimer(uint64_t ms, std::function<void()> callback, bool recurring) {
+bool TimerManager::IsWheel() const { return shared_->wheel != nullptr; }
+
+void TimerManager::InitTimerShards(size_t count) {
+  uint64_t now_us = GetMonotonicUS();
+  for (size_t i = 0; i < count; ++i) {
+    shards_.emplace_back(new Shard(now_us, IsWheel()));
+  }
+}
+
+TimerManager::Shard *TimerManager::GetLocalShard() {
+  if (shards_.empty()) {
+    return nullptr;
+  }
+  int index = GetTimerShard();
+  if (index < 0 || (size_t)index >= shards_.size()) {
+    return nullptr;
+  }
+  return shards_[index].get();
+}
+
+Timer::ptr TimerManager::AddTimer(uint64_t ms, std::function<void()> callback, bool recurring, uint64_t slack_ms) {
+  return AddTimerUS(ms * 1000, callback, recurring, slack_ms * 1000);
+}
+
+Timer::ptr TimerManager::AddTimerUS(uint64_t us, std::function<void()> callback, bool recurring, uint64_t slack_us) {
   LOG_DEBUG(g_logger) << "TimerManager::AddTimer";
-  Timer::ptr             timer(new Timer(ms, callback, recurring, this));
-  RWMutexType::WriteLock lock(mutex_);
-  AddTimer(timer, lock);
+  Timer::ptr timer(new Timer(us, callback, recurring, slack_us, this));
+
+  Shard *local = GetLocalShard();
+  if (local) {
+    // 所属线程正在运行，回到 idle 前会重新计算超时时间，不需要 tickle
+    timer->shard_ = GetTimerShard();
+    local->Insert(timer);
+    return timer;
+  }
+
+  Mutex::Locker lock(shared_->mutex);
+  bool          at_front = shared_->Insert(timer);
+  shared_->UpdateNextExpire();
+  // 新定时器是最早的一个并且未 tickle
+  at_front = at_front && !tickled_.exchange(true);
+  lock.Unlock();
+
+  if (at_front) {
+    OnTimerInsertedAtFront();
+  }
   return timer;
 }
 
@@ -110,93 +514,173 @@ static void OnTimer(std::weak_ptr<void> weak_cond, std::function<void()> callbac
 }
 
 Timer::ptr TimerManager::AddConditionTimer(uint64_t ms, std::function<void()> callback, std::weak_ptr<void> weak_cond,
-                                           bool recurring) {
-  return AddTimer(ms, std::bind(&OnTimer, weak_cond, callback), recurring);
+                                           bool recurring, uint64_t slack_ms) {
+  return AddTimer(ms, std::bind(&OnTimer, weak_cond, callback), recurring, slack_ms);
 }
 
-uint64_t TimerManager::GetNextTimeout() {
-  RWMutexType::ReadLock lock(mutex_);
-  tickled_ = false;
-  if (timers_.empty()) {
-    return ~0ull;
+bool TimerManager::PostRequest(Timer *timer, int type, uint64_t us, bool from_now) {
+  if (!timer->active_) {
+    return false;
   }
-
-  const Timer::ptr &next   = *timers_.begin();
-  uint64_t          now_ms = GetCurrentMS();
-  if (now_ms >= next->next_) {
-    return 0;
-  } else {
-    return next->next_ - now_ms;
+  if (type == Shard::CANCEL && !timer->active_.exchange(false)) {
+    return false;
+  }
+  Shard &shard = *shards_[timer->shard_];
+  {
+    Mutex::Locker lock(shard.mutex);
+    shard.requests.push_back({(Shard::RequestType)type, timer->shared_from_this(), us, from_now, GetMonotonicUS()});
+    shard.has_request.store(true, std::memory_order_release);
   }
+  OnTimerRequestPosted(timer->shard_, type == Shard::RESET);
+  return true;
 }
 
-void TimerManager::ListExpiredCallbacks(std::vector<std::function<void()>> &callbacks) {
-  uint64_t now_ms = GetCurrentMS();
-
-  std::vector<Timer::ptr> expired;
+void TimerManager::ProcessRequests(Shard &shard) {
+  if (!shard.has_request.load(std::memory_order_acquire)) {
+    return;
+  }
+  std::vector<Shard::Request> requests;
   {
-    RWMutexType::ReadLock lock(mutex_);
-    if (timers_.empty()) {
-      return;
+    Mutex::Locker lock(shard.mutex);
+    requests.swap(shard.requests);
+    shard.has_request.store(false, std::memory_order_relaxed);
+  }
+  for (auto &request : requests) {
+    Timer *timer = request.timer.get();
+    switch (request.type) {
+      case Shard::CANCEL:
+        timer->callback_ = nullptr;
+        shard.Remove(timer);
+        break;
+      case Shard::REFRESH:
+        if (timer->active_) {
+          shard.Refresh(timer, timer->Deadline(request.now_us));
+        }
+        break;
+      case Shard::RESET:
+        if (timer->active_) {
+          bool at_front = false;
+          shard.Reset(timer, request.us, request.from_now, request.now_us, at_front);
+        }
+        break;
     }
   }
-  RWMutexType::WriteLock lock(mutex_);
+}
 
-  if (timers_.empty()) {
-    return;
+bool TimerManager::CancelTimer(Timer *timer) {
+  if (timer->shard_ < 0) {
+    Mutex::Locker lock(shared_->mutex);
+    if (!timer->active_.exchange(false)) {
+      return false;
+    }
+    timer->callback_ = nullptr;
+    shared_->Remove(timer);
+    shared_->UpdateNextExpire();
+    return true;
   }
-  bool roll_over = DetectClockRollover(now_ms);
-  if (!roll_over && ((*timers_.begin())->next_ > now_ms)) {
-    return;
+  if (timer->shard_ != GetTimerShard()) {
+    return PostRequest(timer, Shard::CANCEL, 0, false);
   }
-
-  Timer::ptr now_timer(new Timer(now_ms));
-  auto       it = roll_over ? timers_.end() : timers_.lower_bound(now_timer);
-  while (it != timers_.end() && (*it)->next_ == now_ms) {
-    ++it;
+  if (!timer->active_.exchange(false)) {
+    return false;
   }
-  expired.insert(expired.begin(), timers_.begin(), it);
-  timers_.erase(timers_.begin(), it);
-  callbacks.reserve(expired.size());
+  timer->callback_ = nullptr;
+  shards_[timer->shard_]->Remove(timer);
+  return true;
+}
 
-  for (auto &timer : expired) {
-    callbacks.push_back(timer->callback_);
-    if (timer->recurring_) {
-      timer->next_ = now_ms + timer->ms_;
-      timers_.insert(timer);
-    } else {
-      timer->callback_ = nullptr;
+bool TimerManager::RefreshTimer(Timer *timer) {
+  if (timer->shard_ < 0) {
+    Mutex::Locker lock(shared_->mutex);
+    if (!timer->active_ || !shared_->Refresh(timer, timer->Deadline(GetMonotonicUS()))) {
+      return false;
     }
+    shared_->UpdateNextExpire();
+    return true;
   }
+  if (timer->shard_ != GetTimerShard()) {
+    return PostRequest(timer, Shard::REFRESH, 0, false);
+  }
+  return timer->active_ && shards_[timer->shard_]->Refresh(timer, timer->Deadline(GetMonotonicUS()));
 }
 
-void TimerManager::AddTimer(Timer::ptr val, RWMutexType::WriteLock &lock) {
-  auto it = timers_.insert(val).first;
+bool TimerManager::ResetTimer(Timer *timer, uint64_t us, bool from_now) {
+  if (timer->shard_ >= 0 && timer->shard_ != GetTimerShard()) {
+    return PostRequest(timer, Shard::RESET, us, from_now);
+  }
+  if (us == timer->us_ && !from_now) {
+    return true;
+  }
+  if (timer->shard_ >= 0) {
+    bool at_front = false;
+    return timer->active_ && shards_[timer->shard_]->Reset(timer, us, from_now, GetMonotonicUS(), at_front);
+  }
 
-  // timers_ 原本为空并且未 tickle
-  bool at_front = (it == timers_.begin()) && !tickled_;
-  if (at_front) {
-    tickled_ = true;
+  Mutex::Locker lock(shared_->mutex);
+  bool          at_front = false;
+  if (!timer->active_ || !shared_->Reset(timer, us, from_now, GetMonotonicUS(), at_front)) {
+    return false;
   }
+  shared_->UpdateNextExpire();
+  at_front = at_front && !tickled_.exchange(true);
   lock.Unlock();
 
   if (at_front) {
     OnTimerInsertedAtFront();
   }
+  return true;
+}
+
+uint64_t TimerManager::GetNextTimeout() {
+  uint64_t timeout = GetNextTimeoutUS();
+  // 向上取整，避免提前醒来后空转
+  return timeout == ~0ull ? ~0ull : (timeout + 999) / 1000;
+}
+
+uint64_t TimerManager::GetNextTimeoutUS() {
+  if (tickled_.load(std::memory_order_relaxed)) {
+    tickled_ = false;
+  }
+  uint64_t next  = shared_->next_expire.load(std::memory_order_acquire);
+  Shard   *local = GetLocalShard();
+  if (local) {
+    ProcessRequests(*local);
+    next = std::min(next, local->NextExpire());
+  }
+  if (next == ~0ull) {
+    return ~0ull;
+  }
+  uint64_t now_us = GetLoopTimeUS();
+  return now_us >= next ? 0 : next - now_us;
 }
 
-bool TimerManager::DetectClockRollover(uint64_t now_ms) {
-  bool roll_over = false;
-  if (now_ms < previous_time_ && now_ms < (previous_time_ - 60 * 60 * 1000)) {
-    roll_over = true;
+void TimerManager::ListExpiredCallbacks(std::vector<std::function<void()>> &callbacks) {
+  uint64_t now_us = GetLoopTimeUS();
+
+  Shard *local = GetLocalShard();
+  if (local) {
+    ProcessRequests(*local);
+    local->ListExpired(now_us, callbacks);
   }
-  previous_time_ = now_ms;
-  return roll_over;
+
+  if (!shared_->MayExpire(now_us)) {
+    return;
+  }
+  Mutex::Locker lock(shared_->mutex);
+  shared_->ListExpired(now_us, callbacks);
+  shared_->UpdateNextExpire();
 }
 
 bool TimerManager::HasTimer() {
-  RWMutexType::ReadLock lock(mutex_);
-  return !timers_.empty();
+  if (shared_->next_expire.load(std::memory_order_acquire) != ~0ull) {
+    return true;
+  }
+  Shard *local = GetLocalShard();
+  if (local) {
+    ProcessRequests(*local);
+    return local->NextExpire() != ~0ull;
+  }
+  return false;
 }
 
 }  // namespace gudov
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <atomic>
+#include <functional>
 #include <memory>
 #include <set>
 #include <vector>
@@ -9,9 +11,11 @@
 namespace gudov {
 
 class TimerManager;
+class TimingWheel;
 
 class Timer : public std::enable_shared_from_this<Timer> {
   friend class TimerManager;
+  friend class TimingWheel;
 
  public:
   using ptr = std::shared_ptr<Timer>;
@@ -20,26 +24,159 @@ class Timer : public std::enable_shared_from_this<Timer> {
   bool Refresh();
   bool Reset(uint64_t ms, bool fromNow);
 
+  /**
+   * @brief 以微秒为单位修改周期
+   *
+   */
+  bool ResetUS(uint64_t us, bool fromNow);
+
  private:
-  Timer(uint64_t ms, std::function<void()> callback, bool recurring, TimerManager *manager);
+  Timer(uint64_t us, std::function<void()> callback, bool recurring, uint64_t slack, TimerManager *manager);
   Timer(uint64_t next);
 
+  /**
+   * @brief 从 start 开始经过一个周期的到期时间，设置了 slack 时向上取整到 slack 的整数倍
+   *
+   */
+  uint64_t Deadline(uint64_t start) const;
+
  private:
   bool     recurring_ = false;  // 是否是循环定时器
-  uint64_t ms_        = 0;      // 执行周期
-  uint64_t next_      = 0;      // 精确的执行时间
+  uint64_t us_        = 0;      // 执行周期 (微秒)
+  uint64_t slack_     = 0;      // 允许推迟的粒度 (微秒)，0 表示精确到期
+  uint64_t next_      = 0;      // 精确的执行时间，单调时钟的微秒数
 
   std::function<void()> callback_;  // 待执行的回调函数
   TimerManager         *manager_ = nullptr;
 
+  int               shard_ = -1;     // 所在的分片，-1 为共享分片
+  std::atomic<bool> active_{true};  // 取消或单次定时器触发后为 false，其他线程取消时据此判断
+
+  // 以下只在时间轮中使用
+  Timer     *wheel_prev_   = nullptr;
+  Timer     *wheel_next_   = nullptr;
+  uint64_t   wheel_expire_ = 0;   // 放入槽时的到期刻度，next_ 推后时不移动 (惰性刷新)
+  size_t     wheel_slot_   = 0;   // 所在槽的下标
+  Timer::ptr wheel_self_;         // 在时间轮中时持有自身，出轮时释放
+
  private:
   struct Comparator {
     bool operator()(const Timer::ptr &lhs, const Timer::ptr &rhs) const;
   };
 };
 
+/**
+ * @brief 分层时间轮
+ * @details
+ * 刻度 1ms，定时器的到期时间向上取整到刻度，因此最多晚 1ms 触发，需要亚毫秒精度时使用 std::set。
+ * 第 0 层 256 个槽，第 1~3 层各 64 个槽，覆盖约 18.6 小时，更远的放入溢出链表。
+ * 定时器按到期刻度与当前刻度最高的不同位决定所在层，低层转完一圈时把上层对应槽的定时器重新分配 (cascade)。
+ * 每个槽是定时器的侵入式双向链表，插入、删除都是 O(1) 且不分配内存。
+ * Refresh 把到期时间推后时不移动定时器，到槽时发现还未到期再重新放入
+ * @attention 不加锁，由 TimerManager 保护
+ *
+ */
+class TimingWheel {
+ public:
+  static const size_t kLevel0Bits = 8;
+  static const size_t kLevelBits  = 6;
+  static const size_t kLevels     = 4;
+  static const size_t kLevel0Size = (size_t)1 << kLevel0Bits;
+  static const size_t kLevelSize  = (size_t)1 << kLevelBits;
+  static const size_t kSlots      = kLevel0Size + (kLevels - 1) * kLevelSize;
+  static const size_t kOverflow   = kSlots;  // 溢出链表的槽下标
+
+  static const uint64_t kTickUS = 1000;  // 每个刻度的微秒数
+
+  explicit TimingWheel(uint64_t now_us);
+  ~TimingWheel();
+
+  /**
+   * @brief 按 timer->next_ 放入对应的槽
+   *
+   */
+  void Insert(const Timer::ptr &timer);
+
+  /**
+   * @brief 从所在槽中删除
+   *
+   * @return false 不在时间轮中
+   */
+  bool Erase(Timer *timer);
+
+  /**
+   * @brief 定时器到期时间推后
+   * @details 新的到期时间不早于所在槽时只修改 next_
+   *
+   */
+  void Delay(Timer *timer, uint64_t next_us);
+
+  bool   Empty() const { return size_ == 0; }
+  size_t Size() const { return size_; }
+
+  /**
+   * @brief 最早的到期时间 (微秒) 的下界
+   * @details 上层的定时器以所在槽开始的时间计，可能提前醒来，但不会晚
+   *
+   * @return uint64_t 为空时返回 ~0ull
+   */
+  uint64_t NextExpire() const;
+
+  /**
+   * @brief 推进到 now_us，取出所有已到期的定时器
+   *
+   * @param now_us
+   * @param expired
+   */
+  void Advance(uint64_t now_us, std::vector<Timer::ptr> &expired);
+
+  /**
+   * @brief 取出所有定时器
+   *
+   * @param expired
+   */
+  void TakeAll(std::vector<Timer::ptr> &expired);
+
+ private:
+  /**
+   * @brief 到期时间向上取整到刻度
+   *
+   */
+  static uint64_t ToTick(uint64_t us) { return (us + kTickUS - 1) / kTickUS; }
+
+  size_t SlotFor(uint64_t expire) const;
+  void   Link(Timer *timer, size_t slot);
+  void   Unlink(Timer *timer);
+
+  /**
+   * @brief 把槽中的定时器重新放入时间轮
+   *
+   */
+  void Cascade(size_t slot);
+
+  /**
+   * @brief 在 [from, to) 范围内查找第一个非空的槽
+   *
+   * @return int 没有时返回 -1
+   */
+  int FindSlot(size_t from, size_t to) const;
+
+ private:
+  Timer   *slots_[kSlots + 1];
+  uint64_t bitmap_[(kSlots + 63) / 64];
+  uint64_t current_;  // 下一个要处理的刻度
+  size_t   size_ = 0;
+};
+
 /**
  * @brief 定时器管理器
+ * @details
+ * 定时器使用单调时钟，精度为微秒。
+ * 配置 timer.backend 为 wheel 时使用分层时间轮，否则使用按到期时间排序的 std::set。
+ * 默认所有定时器放在一个加锁的共享分片中。子类调用 InitTimerShards() 后，每个线程有自己的分片：
+ * 定时器归创建它的线程所有，只由该线程不加锁地增删和检查到期；
+ * 其他线程的 Cancel/Refresh/Reset 放入所属分片的请求队列，由所属线程下次检查定时器时处理。
+ * 不属于任何分片的线程创建的定时器仍然放在共享分片中
  *
  */
 class TimerManager {
@@ -51,37 +188,124 @@ class TimerManager {
   TimerManager();
   virtual ~TimerManager();
 
-  Timer::ptr AddTimer(uint64_t ms, std::function<void()> callback, bool recurring = false);
+  /**
+   * @brief 添加定时器
+   *
+   * @param ms 周期
+   * @param callback
+   * @param recurring 是否循环
+   * @param slack_ms 允许推迟的毫秒数。到期时间向上取整到 slack_ms 的整数倍，
+   * 大量超时定时器因此落在相同的时间点，一起到期时合并为少量批处理任务
+   */
+  Timer::ptr AddTimer(uint64_t ms, std::function<void()> callback, bool recurring = false, uint64_t slack_ms = 0);
+
+  /**
+   * @brief 添加以微秒为单位的定时器
+   *
+   */
+  Timer::ptr AddTimerUS(uint64_t us, std::function<void()> callback, bool recurring = false, uint64_t slack_us = 0);
   Timer::ptr AddConditionTimer(uint64_t ms, std::function<void()> callback, std::weak_ptr<void> weakCond,
-                               bool recurring = false);
+                               bool recurring = false, uint64_t slack_ms = 0);
 
+  /**
+   * @brief 是否使用时间轮
+   *
+   */
+  bool IsWheel() const;
+
+  /**
+   * @brief 是否每个线程有自己的定时器分片
+   *
+   */
+  bool IsPerThreadTimers() const { return !shards_.empty(); }
+
+  /**
+   * @brief 距离最早的定时器到期的毫秒数
+   * @details 分片模式下只考虑当前线程的分片和共享分片
+   *
+   * @return uint64_t 没有定时器时返回 ~0ull
+   */
   uint64_t GetNextTimeout();
-  void     ListExpiredCallbacks(std::vector<std::function<void()>> &cbs);
-  bool     HasTimer();
+
+  /**
+   * @brief 距离最早的定时器到期的微秒数
+   * @details 以 GetLoopTimeUS() 为当前时间
+   *
+   * @return uint64_t 没有定时器时返回 ~0ull
+   */
+  uint64_t GetNextTimeoutUS();
+
+  /**
+   * @brief 取出已到期定时器的回调
+   * @details 分片模式下只处理当前线程的分片和共享分片。
+   * 设置了 slack 且到期时间相同的定时器合并为一个回调，依次执行各自的回调
+   *
+   */
+  void ListExpiredCallbacks(std::vector<std::function<void()>> &cbs);
+  bool HasTimer();
 
  protected:
   virtual void OnTimerInsertedAtFront() = 0;
-  void         AddTimer(Timer::ptr val, RWMutexType::WriteLock &lock);
 
- private:
   /**
-   * @brief 服务器时间是否调后
+   * @brief 其他线程向分片投递了请求
    *
-   * @param now_ms
-   * @return true
-   * @return false
+   * @param shard 分片下标
+   * @param urgent 定时器可能提前到期，需要唤醒所属线程
    */
-  bool DetectClockRollover(uint64_t now_ms);
+  virtual void OnTimerRequestPosted(size_t shard, bool urgent) {
+    if (urgent) {
+      OnTimerInsertedAtFront();
+    }
+  }
 
- protected:
-  bool tickled_ = false;
+  /**
+   * @brief 当前线程所属的分片
+   *
+   * @return int -1 表示使用共享分片
+   */
+  virtual int GetTimerShard() const { return -1; }
+
+  /**
+   * @brief 建立 count 个线程分片
+   * @pre 还没有添加定时器，也没有其他线程在使用
+   */
+  void InitTimerShards(size_t count);
 
  private:
-  RWMutexType mutex_;
+  struct Shard;
 
-  std::set<Timer::ptr, Timer::Comparator> timers_;
+  /**
+   * @brief 当前线程的分片，没有时返回 nullptr
+   *
+   */
+  Shard *GetLocalShard();
 
-  uint64_t previous_time_ = 0;
+  /**
+   * @brief 定时器不属于当前线程时投递到所属分片
+   *
+   * @return false 定时器已被取消或已触发
+   */
+  bool PostRequest(Timer *timer, int type, uint64_t us, bool from_now);
+
+  /**
+   * @brief 在所属线程上处理其他线程投递的请求
+   *
+   */
+  void ProcessRequests(Shard &shard);
+
+  bool CancelTimer(Timer *timer);
+  bool RefreshTimer(Timer *timer);
+  bool ResetTimer(Timer *timer, uint64_t us, bool from_now);
+
+ protected:
+  std::atomic<bool> tickled_{false};
+
+ private:
+  /// @brief 共享分片，访问时加锁
+  std::unique_ptr<Shard> shared_;
+  /// @brief 线程分片，下标为 GetTimerShard() 的返回值
+  std::vector<std::unique_ptr<Shard>> shards_;
 };
 
 }  // namespace gudov
@@ -17,6 +17,7 @@
 
 #include "fiber.h"
 #include "log.h"
+#include "offload.h"
 
 namespace gudov {
 
@@ -66,6 +67,24 @@ uint64_t GetCurrentUS() {
   return tv.tv_sec * 1000 * 1000ul + tv.tv_usec;
 }
 
+uint64_t GetMonotonicUS() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000 * 1000ul + ts.tv_nsec / 1000;
+}
+
+/// @brief 0 表示没有缓存
+static thread_local uint64_t t_loop_time_us = 0;
+
+uint64_t GetLoopTimeUS() { return t_loop_time_us ? t_loop_time_us : GetMonotonicUS(); }
+
+uint64_t UpdateLoopTimeUS() {
+  t_loop_time_us = GetMonotonicUS();
+  return t_loop_time_us;
+}
+
+void ClearLoopTime() { t_loop_time_us = 0; }
+
 void FSUtil::ListAllFile(std::vector<std::string> &files, const std::string &path, const std::string &subfix) {
   if (access(path.c_str(), 0) != 0) {
     return;
@@ -266,4 +285,28 @@ bool FSUtil::OpenForWrite(std::ofstream &ofs, const std::string &filename, std::
   return ofs.is_open();
 }
 
+void FSUtil::ListAllFileAsync(std::vector<std::string> &files, const std::string &path, const std::string &subfix) {
+  OffloadPool::GetDefault()->Await([&]() { ListAllFile(files, path, subfix); });
+}
+
+bool FSUtil::MkdirAsync(const std::string &dirname) {
+  return OffloadPool::GetDefault()->Await([&]() { return Mkdir(dirname); });
+}
+
+bool FSUtil::RmAsync(const std::string &path) {
+  return OffloadPool::GetDefault()->Await([&]() { return Rm(path); });
+}
+
+bool FSUtil::MvAsync(const std::string &from, const std::string &to) {
+  return OffloadPool::GetDefault()->Await([&]() { return Mv(from, to); });
+}
+
+bool FSUtil::UnlinkAsync(const std::string &filename, bool exist) {
+  return OffloadPool::GetDefault()->Await([&]() { return Unlink(filename, exist); });
+}
+
+std::string FSUtil::ReadFileAsync(const std::string &filename) {
+  return OffloadPool::GetDefault()->Await([&]() { return ReadFile(filename); });
+}
+
 }  // namespace gudov
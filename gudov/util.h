@@ -28,6 +28,34 @@ uint64_t GetCurrentMS();
 
 uint64_t GetCurrentUS();
 
+/**
+ * @brief 单调时钟 (CLOCK_MONOTONIC) 的微秒数
+ * @details 不受系统时间调整的影响，定时器使用这个时钟
+ *
+ */
+uint64_t GetMonotonicUS();
+
+/**
+ * @brief 当前线程缓存的单调时间 (微秒)
+ * @details IOManager 的 idle 循环每轮刷新一次，同一轮中的定时器计算使用同一个时间，没有缓存时读取时钟
+ * @warning thread_local
+ *
+ */
+uint64_t GetLoopTimeUS();
+
+/**
+ * @brief 读取单调时钟并刷新当前线程缓存的时间
+ *
+ * @return uint64_t 新的时间
+ */
+uint64_t UpdateLoopTimeUS();
+
+/**
+ * @brief 清除当前线程缓存的时间，之后 GetLoopTimeUS() 直接读取时钟
+ *
+ */
+void ClearLoopTime();
+
 /**
  * @brief 文件系统操作类
  */
@@ -132,6 +160,18 @@ class FSUtil {
     std::ifstream f(filename);
     return std::string((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
   }
+
+  /**
+   * @brief 以下接口与同名的同步接口相同，在 OffloadPool::GetDefault() 的线程上执行，只挂起调用的协程
+   * @details 不在调度线程的协程中调用时直接在当前线程执行
+   */
+  static void        ListAllFileAsync(std::vector<std::string> &files, const std::string &path,
+                                      const std::string &subfix);
+  static bool        MkdirAsync(const std::string &dirname);
+  static bool        RmAsync(const std::string &path);
+  static bool        MvAsync(const std::string &from, const std::string &to);
+  static bool        UnlinkAsync(const std::string &filename, bool exist = false);
+  static std::string ReadFileAsync(const std::string &filename);
 };
 
 }  // namespace gudov
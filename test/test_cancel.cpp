@@ -0,0 +1,153 @@
+#include <gtest/gtest.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+
+#include "gudov/cancel.h"
+#include "gudov/fdmanager.h"
+#include "gudov/iomanager.h"
+#include "gudov/util.h"
+
+using namespace gudov;
+
+/**
+ * @brief 创建一对交给 FdManager 管理的 socket，读写会被 hook 挂起
+ *
+ */
+static void MakeSocketPair(int fds[2]) {
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+  FdMgr::GetInstance()->Get(fds[0], true);
+  FdMgr::GetInstance()->Get(fds[1], true);
+}
+
+TEST(CancelTest, CancelWakesBlockedRecv) {
+  CancelContext::ptr context = std::make_shared<CancelContext>();
+  ssize_t            n       = 0;
+  int                error   = 0;
+  uint64_t           elapsed = 0;
+  {
+    IOManager iom(2, false, "cancel");
+    iom.Schedule([&]() {
+      int fds[2];
+      MakeSocketPair(fds);
+      char     buf[16];
+      uint64_t start = GetCurrentMS();
+      {
+        CancelScope scope(context);
+        n     = recv(fds[0], buf, sizeof(buf), 0);
+        error = errno;
+      }
+      elapsed = GetCurrentMS() - start;
+      EXPECT_EQ(CancelContext::GetCurrent(), nullptr);
+      close(fds[0]);
+      close(fds[1]);
+    });
+    iom.Schedule([&]() {
+      usleep(20 * 1000);
+      context->Cancel();
+    });
+  }
+  EXPECT_EQ(n, -1);
+  EXPECT_EQ(error, ECANCELED);
+  EXPECT_LT(elapsed, 1000u);
+  EXPECT_EQ(context->Error(), ECANCELED);
+}
+
+TEST(CancelTest, DeadlineTimesOutIO) {
+  ssize_t  n        = 0;
+  int      error    = 0;
+  uint64_t elapsed  = 0;
+  int      again    = 0;
+  int      poll_err = 0;
+  {
+    IOManager iom(1, false, "cancel");
+    iom.Schedule([&]() {
+      int fds[2];
+      MakeSocketPair(fds);
+      char        buf[16];
+      CancelScope scope(CancelContext::WithTimeout(30));
+      uint64_t    start = GetCurrentMS();
+      n                 = read(fds[0], buf, sizeof(buf));
+      error             = errno;
+      elapsed           = GetCurrentMS() - start;
+
+      // 已经到期，不再挂起
+      EXPECT_EQ(recv(fds[0], buf, sizeof(buf), 0), -1);
+      again = errno;
+
+      pollfd pfd{fds[0], POLLIN, 0};
+      EXPECT_EQ(poll(&pfd, 1, 1000), -1);
+      poll_err = errno;
+      close(fds[0]);
+      close(fds[1]);
+    });
+  }
+  EXPECT_EQ(n, -1);
+  EXPECT_EQ(error, ETIMEDOUT);
+  EXPECT_GE(elapsed, 25u);
+  EXPECT_LT(elapsed, 500u);
+  EXPECT_EQ(again, ETIMEDOUT);
+  EXPECT_EQ(poll_err, ETIMEDOUT);
+}
+
+TEST(CancelTest, ChildrenInherit) {
+  CancelContext::ptr root = std::make_shared<CancelContext>();
+  CancelContext::ptr scheduled;
+  CancelContext::ptr created;
+  CancelContext::ptr child;
+  int                child_error = 0;
+  {
+    IOManager iom(2, false, "cancel");
+    iom.Schedule([&]() {
+      CancelScope scope(root);
+      // 调度的回调和新建的协程继承当前的上下文
+      iom.Schedule([&]() { scheduled = CancelContext::GetCurrent(); });
+      Fiber::ptr fiber(new Fiber([&]() { created = CancelContext::GetCurrent(); }));
+      iom.Schedule(fiber);
+
+      child = CancelContext::WithTimeout(10 * 1000);
+      iom.Schedule([&]() {
+        CancelScope scope(child);
+        int         fds[2];
+        MakeSocketPair(fds);
+        char buf[16];
+        EXPECT_EQ(recv(fds[0], buf, sizeof(buf), 0), -1);
+        child_error = errno;
+        close(fds[0]);
+        close(fds[1]);
+      });
+      usleep(20 * 1000);
+      root->Cancel(EPIPE);
+    });
+  }
+  EXPECT_EQ(scheduled, root);
+  EXPECT_EQ(created, root);
+  ASSERT_TRUE(child);
+  EXPECT_NE(child->GetDeadlineUS(), ~0ull);
+  EXPECT_EQ(root->GetDeadlineUS(), ~0ull);
+  EXPECT_EQ(child->Error(), EPIPE);
+  EXPECT_EQ(child_error, EPIPE);
+
+  // 父上下文已经取消时，新建的子上下文直接处于取消状态
+  CancelContext late(root);
+  EXPECT_EQ(late.Error(), EPIPE);
+}
+
+TEST(CancelTest, ListenerAfterCancel) {
+  CancelContext  context;
+  int            seen = 0;
+  CancelListener listener([&](int error) { seen = error; });
+  EXPECT_TRUE(context.AddListener(listener));
+  CancelListener removed([&](int error) { seen = -1; });
+  EXPECT_TRUE(context.AddListener(removed));
+  context.RemoveListener(removed);
+
+  context.Cancel(ETIMEDOUT);
+  context.Cancel(ECANCELED);
+  EXPECT_EQ(seen, ETIMEDOUT);
+  EXPECT_EQ(context.Error(), ETIMEDOUT);
+  EXPECT_FALSE(context.AddListener(removed));
+  context.RemoveListener(listener);
+}
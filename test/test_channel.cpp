@@ -0,0 +1,231 @@
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "gudov/channel.h"
+#include "gudov/iomanager.h"
+#include "gudov/util.h"
+
+using namespace gudov;
+
+TEST(ChannelTest, BoundedBlocksFiberNotThread) {
+  Channel<int>      channel(2);
+  std::atomic<int>  ticks{0};
+  std::atomic<bool> done{false};
+  std::vector<int>  received;
+  {
+    IOManager iom(1, false, "channel");
+    // 只有一个调度线程，发送方在通道满时挂起，接收方和计数协程照常运行
+    iom.Schedule([&]() {
+      for (int i = 0; i < 10; ++i) {
+        EXPECT_TRUE(channel.Send(i));
+      }
+      channel.Close();
+    });
+    iom.Schedule([&]() {
+      int value;
+      while (channel.Recv(value)) {
+        received.push_back(value);
+        usleep(2000);
+      }
+      done = true;
+    });
+    iom.Schedule([&]() {
+      while (!done) {
+        ++ticks;
+        usleep(1000);
+      }
+    });
+  }
+  ASSERT_EQ(received.size(), 10u);
+  for (int i = 0; i < 10; ++i) {
+    EXPECT_EQ(received[i], i);
+  }
+  EXPECT_GT(ticks.load(), 5);
+}
+
+TEST(ChannelTest, MultiProducerMultiConsumer) {
+  const int            producers = 4;
+  const int            count     = 5000;
+  Channel<int>         channel(16);
+  std::atomic<int>     running{producers};
+  std::atomic<int64_t> sum{0};
+  std::atomic<int>     received{0};
+  {
+    IOManager iom(4, false, "channel");
+    for (int p = 0; p < producers; ++p) {
+      iom.Schedule([&, p]() {
+        for (int i = 1; i <= count; ++i) {
+          channel.Send(p * count + i);
+        }
+        if (--running == 0) {
+          channel.Close();
+        }
+      });
+    }
+    for (int c = 0; c < 4; ++c) {
+      iom.Schedule([&]() {
+        int value;
+        while (channel.Recv(value)) {
+          sum += value;
+          ++received;
+        }
+      });
+    }
+  }
+  int64_t n = producers * count;
+  EXPECT_EQ(received.load(), n);
+  EXPECT_EQ(sum.load(), n * (n + 1) / 2);
+}
+
+TEST(ChannelTest, UnboundedKeepsOrder) {
+  Channel<std::unique_ptr<int>> channel;
+  const int                     count = 5000;
+  // 超过环形缓冲区的元素进入溢出队列，顺序不变
+  for (int i = 0; i < count; ++i) {
+    EXPECT_TRUE(channel.TrySend(std::unique_ptr<int>(new int(i))));
+  }
+  EXPECT_EQ(channel.Size(), static_cast<size_t>(count));
+  channel.Close();
+  EXPECT_FALSE(channel.TrySend(std::unique_ptr<int>(new int(-1))));
+
+  std::unique_ptr<int> value;
+  for (int i = 0; i < count; ++i) {
+    ASSERT_TRUE(channel.TryRecv(value));
+    EXPECT_EQ(*value, i);
+  }
+  EXPECT_FALSE(channel.Recv(value));
+}
+
+TEST(ChannelTest, CloseWakesWaiters) {
+  Channel<int> channel(1);
+  int          recv_fails  = 0;
+  bool         send_failed = false;
+  {
+    IOManager iom(2, false, "channel");
+    for (int i = 0; i < 3; ++i) {
+      iom.Schedule([&]() {
+        int value;
+        if (!channel.Recv(value)) {
+          ++recv_fails;
+        }
+      });
+    }
+    iom.Schedule([&]() {
+      usleep(20 * 1000);
+      channel.Close();
+    });
+  }
+  EXPECT_EQ(recv_fails, 3);
+
+  Channel<int> full(1);
+  EXPECT_TRUE(full.TrySend(1));
+  std::thread thread([&]() { send_failed = !full.Send(2); });
+  usleep(20 * 1000);
+  full.Close();
+  thread.join();
+  EXPECT_TRUE(send_failed);
+  // 关闭前的元素仍然可以取出
+  int value = 0;
+  EXPECT_TRUE(full.Recv(value));
+  EXPECT_EQ(value, 1);
+  EXPECT_FALSE(full.Recv(value));
+}
+
+TEST(ChannelTest, TimedOperations) {
+  Channel<int> channel(1);
+  bool         recv_timed_out = false;
+  bool         send_timed_out = false;
+  {
+    IOManager iom(1, false, "channel");
+    iom.Schedule([&]() {
+      int      value;
+      uint64_t start = GetCurrentMS();
+      recv_timed_out = !channel.RecvFor(value, 20);
+      EXPECT_GE(GetCurrentMS() - start, 15u);
+      EXPECT_TRUE(channel.SendFor(1, 20));
+      send_timed_out = !channel.SendFor(2, 20);
+    });
+  }
+  EXPECT_TRUE(recv_timed_out);
+  EXPECT_TRUE(send_timed_out);
+
+  // 普通线程的超时
+  int value = 0;
+  EXPECT_TRUE(channel.RecvFor(value, 10));
+  EXPECT_EQ(value, 1);
+  EXPECT_FALSE(channel.RecvFor(value, 10));
+}
+
+TEST(ChannelTest, ThreadAndFiber) {
+  Channel<int> to_fiber(1);
+  Channel<int> to_thread(1);
+  std::thread  thread([&]() {
+    int value;
+    while (to_thread.Recv(value)) {
+      to_fiber.Send(value + 1);
+    }
+  });
+  int result = 0;
+  {
+    IOManager iom(1, false, "channel");
+    iom.Schedule([&]() {
+      int value = 0;
+      for (int i = 0; i < 1000; ++i) {
+        to_thread.Send(value);
+        to_fiber.Recv(value);
+      }
+      result = value;
+      to_thread.Close();
+    });
+  }
+  thread.join();
+  EXPECT_EQ(result, 1000);
+}
+
+TEST(ChannelTest, Select) {
+  Channel<int> a(1);
+  Channel<int> b(1);
+  Channel<int> out(1);
+  int          from_a    = 0;
+  int          from_b    = 0;
+  bool         timed_out = false;
+  bool         closed    = false;
+  {
+    IOManager iom(2, false, "channel");
+    iom.Schedule([&]() {
+      int value;
+      for (int i = 0; i < 20; ++i) {
+        int index = Select({a.RecvCase(value), b.RecvCase(value)});
+        (index == 0 ? from_a : from_b) += value;
+      }
+      timed_out = Select({a.RecvCase(value), b.RecvCase(value)}, 10) == -1;
+
+      // 发送分支立即就绪，通道满后超时
+      EXPECT_EQ(Select({out.SendCase(7)}, 0), 0);
+      EXPECT_EQ(Select({out.SendCase(8)}, 10), -1);
+
+      bool ok = true;
+      a.Close();
+      EXPECT_EQ(Select({a.RecvCase(value, &ok), b.RecvCase(value)}), 0);
+      closed = !ok;
+    });
+    iom.Schedule([&]() {
+      for (int i = 0; i < 10; ++i) {
+        a.Send(1);
+        b.Send(2);
+      }
+    });
+  }
+  EXPECT_EQ(from_a, 10);
+  EXPECT_EQ(from_b, 20);
+  EXPECT_TRUE(timed_out);
+  EXPECT_TRUE(closed);
+  int value = 0;
+  EXPECT_TRUE(out.TryRecv(value));
+  EXPECT_EQ(value, 7);
+}
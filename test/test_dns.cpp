@@ -0,0 +1,217 @@
+#include <arpa/inet.h>
+#include <gtest/gtest.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "gudov/address.h"
+#include "gudov/config.h"
+#include "gudov/dns.h"
+#include "gudov/iomanager.h"
+
+using namespace gudov;
+
+/**
+ * @brief 回环地址上的简易 DNS 服务
+ * @details 只认识 *.test 下的几个名字，其余返回 NXDOMAIN；每个请求延迟 50ms 应答，便于并发查询合并
+ *
+ */
+class FakeDnsServer {
+ public:
+  FakeDnsServer() {
+    sock_ = ::socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len        = sizeof(addr);
+    ::bind(sock_, (sockaddr*)&addr, sizeof(addr));
+    ::getsockname(sock_, (sockaddr*)&addr, &len);
+    port_ = ntohs(addr.sin_port);
+
+    timeval tv = {0, 50000};
+    ::setsockopt(sock_, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    thread_ = std::thread([this]() { Run(); });
+  }
+
+  ~FakeDnsServer() {
+    stop_ = true;
+    thread_.join();
+    ::close(sock_);
+  }
+
+  std::string GetAddress() const { return "127.0.0.1:" + std::to_string(port_); }
+
+  int GetCount(const std::string& name, uint16_t qtype) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return counts_[name + "/" + std::to_string(qtype)];
+  }
+
+ private:
+  void Run() {
+    uint8_t buf[512];
+    while (!stop_) {
+      sockaddr_in from;
+      socklen_t   len = sizeof(from);
+      int         n   = ::recvfrom(sock_, buf, sizeof(buf), 0, (sockaddr*)&from, &len);
+      if (n < 12) {
+        continue;
+      }
+      // 解析问题部分的名字和类型
+      std::string name;
+      size_t      pos = 12;
+      while (pos < (size_t)n && buf[pos]) {
+        if (!name.empty()) {
+          name += ".";
+        }
+        name.append((char*)buf + pos + 1, buf[pos]);
+        pos += buf[pos] + 1;
+      }
+      uint16_t qtype = buf[pos + 1] << 8 | buf[pos + 2];
+      size_t   qend  = pos + 5;
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++counts_[name + "/" + std::to_string(qtype)];
+      }
+      usleep(50000);
+
+      std::string reply((char*)buf, qend);
+      reply[2] = (char)0x81;  // QR RD
+      reply[3] = (char)0x80;  // RA
+      std::string rdata;
+      if (name == "coalesce.test" || name == "ttl.test") {
+        rdata = qtype == 1 ? std::string("\x0a\x00\x00\x01", 4) : std::string("\xfd\0\0\0\0\0\0\0\0\0\0\0\0\0\0\x01", 16);
+      } else {
+        reply[3] = (char)0x83;  // NXDOMAIN
+      }
+      if (!rdata.empty()) {
+        reply[7] = 1;  // ANCOUNT
+        // 指向问题中的名字，TTL 为 1s
+        reply += std::string("\xc0\x0c\x00", 3) + (char)qtype + std::string("\x00\x01\x00\x00\x00\x01\x00", 7) +
+                 (char)rdata.size() + rdata;
+      }
+      ::sendto(sock_, reply.data(), reply.size(), 0, (sockaddr*)&from, len);
+    }
+  }
+
+ private:
+  int                        sock_ = -1;
+  uint16_t                   port_ = 0;
+  std::atomic<bool>          stop_{false};
+  std::thread                thread_;
+  std::mutex                 mutex_;
+  std::map<std::string, int> counts_;
+};
+
+class DnsTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    servers_ = Config::Lookup<std::vector<std::string>>("dns.servers");
+    servers_->SetValue({server_.GetAddress()});
+    DnsMgr::GetInstance()->ClearCache();
+  }
+
+  void TearDown() override { servers_->SetValue({}); }
+
+  FakeDnsServer                            server_;
+  ConfigVar<std::vector<std::string>>::ptr servers_;
+};
+
+// 同一个名字的并发查询只发一次请求，之后命中缓存，TTL 过期后重新查询
+TEST_F(DnsTest, CoalesceAndCache) {
+  const int        kFibers = 8;
+  std::atomic<int> resolved{0};
+  uint64_t         coalesced = DnsMgr::GetInstance()->GetStats().coalesced;
+  {
+    IOManager iom(2, false, "Dns");
+    for (int i = 0; i < kFibers; ++i) {
+      iom.Schedule([&]() {
+        std::vector<IPAddress::ptr> addrs;
+        if (DnsMgr::GetInstance()->Resolve("Coalesce.Test", AF_INET, addrs) && addrs.size() == 1 &&
+            addrs[0]->ToString() == "[IPv4 10.0.0.1:0]") {
+          ++resolved;
+        }
+      });
+    }
+  }
+  EXPECT_EQ(resolved, kFibers);
+  EXPECT_EQ(server_.GetCount("coalesce.test", 1), 1);
+  EXPECT_EQ(DnsMgr::GetInstance()->GetStats().coalesced - coalesced, (uint64_t)kFibers - 1);
+
+  std::vector<IPAddress::ptr> addrs;
+  EXPECT_TRUE(DnsMgr::GetInstance()->Resolve("coalesce.test.", AF_INET, addrs));
+  EXPECT_EQ(server_.GetCount("coalesce.test", 1), 1);
+
+  usleep(1100 * 1000);
+  addrs.clear();
+  EXPECT_TRUE(DnsMgr::GetInstance()->Resolve("coalesce.test", AF_INET, addrs));
+  EXPECT_EQ(server_.GetCount("coalesce.test", 1), 2);
+}
+
+// 发起查询的是普通线程时，等待结果的协程所在的调度器要等它恢复后才能停止
+TEST_F(DnsTest, CoalesceAcrossThreads) {
+  std::atomic<bool> leader_ok{false};
+  std::atomic<bool> waiter_ok{false};
+  std::thread       leader([&]() {
+    std::vector<IPAddress::ptr> addrs;
+    leader_ok = DnsMgr::GetInstance()->Resolve("coalesce.test", AF_INET, addrs);
+  });
+  usleep(10 * 1000);
+  {
+    IOManager iom(1, false, "Dns");
+    iom.Schedule([&]() {
+      std::vector<IPAddress::ptr> addrs;
+      waiter_ok = DnsMgr::GetInstance()->Resolve("coalesce.test", AF_INET, addrs) && addrs.size() == 1;
+    });
+  }
+  EXPECT_TRUE(waiter_ok);
+  leader.join();
+  EXPECT_TRUE(leader_ok);
+  EXPECT_EQ(server_.GetCount("coalesce.test", 1), 1);
+}
+
+TEST_F(DnsTest, AAAAAndNxdomain) {
+  std::vector<IPAddress::ptr> addrs;
+  ASSERT_TRUE(DnsMgr::GetInstance()->Resolve("ttl.test", AF_INET6, addrs));
+  ASSERT_EQ(addrs.size(), 1u);
+  EXPECT_EQ(addrs[0]->GetFamily(), AF_INET6);
+
+  addrs.clear();
+  EXPECT_TRUE(DnsMgr::GetInstance()->Resolve("ttl.test", AF_UNSPEC, addrs));
+  EXPECT_EQ(addrs.size(), 2u);
+
+  addrs.clear();
+  EXPECT_FALSE(DnsMgr::GetInstance()->Resolve("missing.test", AF_UNSPEC, addrs));
+  // NXDOMAIN 后不再查询 AAAA
+  EXPECT_EQ(server_.GetCount("missing.test", 28), 0);
+
+  // 数字地址不发请求
+  addrs.clear();
+  EXPECT_TRUE(DnsMgr::GetInstance()->Resolve("127.0.0.1", AF_INET, addrs));
+  EXPECT_EQ(addrs[0]->ToString(), "[IPv4 127.0.0.1:0]");
+}
+
+// 协程中的 Address::Lookup 走 DNS 客户端，等待应答期间同一线程上的其他协程继续运行
+TEST_F(DnsTest, AddressLookupInFiber) {
+  IPAddress::ptr   addr;
+  std::atomic<int> ticks{0};
+  {
+    IOManager iom(1, false, "Dns");
+    iom.Schedule([&]() { addr = Address::LookupAnyIPAddress("coalesce.test:8080"); });
+    iom.Schedule([&]() {
+      for (int i = 0; i < 5; ++i) {
+        usleep(5000);
+        ++ticks;
+      }
+    });
+  }
+  ASSERT_TRUE(addr);
+  EXPECT_EQ(addr->ToString(), "[IPv4 10.0.0.1:8080]");
+  EXPECT_EQ(ticks, 5);
+}
@@ -0,0 +1,63 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <vector>
+
+#include "gudov/fd_table.h"
+#include "gudov/thread.h"
+
+using namespace gudov;
+
+struct Slot {
+  explicit Slot(int fd) : fd(fd) {}
+  int fd;
+};
+
+// 测试按需分配块，块内表项用下标构造
+TEST(FdTableTest, GetAndFind) {
+  FdTable<Slot, 4, 8> table;
+
+  EXPECT_EQ(table.Find(3), nullptr);
+  Slot* slot = table.Get(3);
+  ASSERT_NE(slot, nullptr);
+  EXPECT_EQ(slot->fd, 3);
+  EXPECT_EQ(table.Find(3), slot);
+  // 同一块内的其他表项一起分配
+  ASSERT_NE(table.Find(15), nullptr);
+  EXPECT_EQ(table.Find(15)->fd, 15);
+  EXPECT_EQ(table.Find(16), nullptr);
+
+  EXPECT_EQ(table.Get(-1), nullptr);
+  EXPECT_EQ(table.Get(8 * 16), nullptr);
+  EXPECT_EQ(table.Get(8 * 16 - 1)->fd, 8 * 16 - 1);
+}
+
+// 测试多个线程同时分配同一块时只有一块生效，表项地址一致
+TEST(FdTableTest, ConcurrentGet) {
+  const int                kThreads = 8;
+  const int                kFds     = 64 * 1024;
+  FdTable<Slot>            table;
+  std::vector<Slot*>       seen(kThreads * kFds);
+  std::vector<Thread::ptr> threads;
+  for (int i = 0; i < kThreads; ++i) {
+    threads.emplace_back(new Thread(
+        [&table, &seen, i]() {
+          for (int fd = 0; fd < kFds; ++fd) {
+            seen[i * kFds + fd] = table.Get(fd);
+          }
+        },
+        "fd_table_" + std::to_string(i)));
+  }
+  for (auto& thread : threads) {
+    thread->Join();
+  }
+
+  for (int fd = 0; fd < kFds; ++fd) {
+    Slot* slot = table.Find(fd);
+    ASSERT_NE(slot, nullptr);
+    EXPECT_EQ(slot->fd, fd);
+    for (int i = 0; i < kThreads; ++i) {
+      ASSERT_EQ(seen[i * kFds + fd], slot);
+    }
+  }
+}
@@ -1,6 +1,7 @@
 #include <gtest/gtest.h>
 
 #include <atomic>
+#include <cmath>
 #include <iostream>
 #include <thread>
 
@@ -139,3 +140,39 @@ TEST(FiberTest, FiberGetId) {
   auto fiber_id = gudov::Fiber::GetRunningFiberId();
   EXPECT_GT(fiber_id, 0);  // Fiber ID 应该是有效的正数
 }
+
+// 测试协程切换前后局部变量、浮点寄存器和异常处理都不受影响
+TEST(FiberTest, ContextSwitchPreservesState) {
+  gudov::Fiber::GetRunningFiber();
+
+  double in_fiber = 0;
+  auto   func     = [&in_fiber]() {
+    double acc = 1.5;
+    for (int i = 0; i < 100; ++i) {
+      acc = acc * 1.01 + i;
+      gudov::Fiber::GetRunningFiber()->Yield();
+    }
+    try {
+      throw std::runtime_error("in fiber");
+    } catch (const std::exception& e) {
+      acc += 1;
+    }
+    in_fiber = acc;
+  };
+
+  double expect = 1.5;
+  for (int i = 0; i < 100; ++i) {
+    expect = expect * 1.01 + i;
+  }
+  expect += 1;
+
+  gudov::Fiber::ptr fiber(new gudov::Fiber(func, 0, false));
+  double            outside = 3.25;
+  for (int i = 0; i < 101; ++i) {
+    fiber->Resume();
+    outside *= 2;
+  }
+  EXPECT_EQ(fiber->GetState(), gudov::Fiber::Term);
+  EXPECT_DOUBLE_EQ(in_fiber, expect);
+  EXPECT_DOUBLE_EQ(outside, 3.25 * std::pow(2.0, 101));
+}
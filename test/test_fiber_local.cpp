@@ -0,0 +1,89 @@
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <string>
+
+#include "gudov/fiber_local.h"
+#include "gudov/iomanager.h"
+
+using namespace gudov;
+
+struct Tracked {
+  static std::atomic<int> s_destroyed;
+
+  ~Tracked() { ++s_destroyed; }
+
+  int value = 0;
+};
+
+std::atomic<int> Tracked::s_destroyed{0};
+
+static FiberLocal<uint64_t>    s_trace_id;
+static FiberLocal<std::string> s_name;
+static FiberLocal<Tracked>     s_tracked;
+
+TEST(FiberLocalTest, EachFiberHasOwnValue) {
+  std::atomic<int> mismatches{0};
+  {
+    IOManager iom(2, false, "local");
+    for (uint64_t i = 1; i <= 20; ++i) {
+      iom.Schedule([&, i]() {
+        // 新协程中是值初始化的结果
+        if (s_trace_id.Get() != 0 || !s_name->empty()) {
+          ++mismatches;
+        }
+        s_trace_id.Set(i);
+        s_name.Set(std::to_string(i));
+        usleep(1000);
+        // 挂起期间其他协程的写入不影响这里
+        if (*s_trace_id != i || *s_name != std::to_string(i)) {
+          ++mismatches;
+        }
+      });
+    }
+  }
+  EXPECT_EQ(mismatches.load(), 0);
+}
+
+TEST(FiberLocalTest, DestroyedWhenFiberEnds) {
+  Tracked::s_destroyed = 0;
+  {
+    IOManager iom(1, false, "local");
+    for (int i = 0; i < 10; ++i) {
+      iom.Schedule([]() { s_tracked->value = 1; });
+    }
+    // 没有访问过的协程不创建值
+    iom.Schedule([]() {});
+  }
+  EXPECT_EQ(Tracked::s_destroyed.load(), 10);
+}
+
+TEST(FiberLocalTest, ResetBeforeReuse) {
+  Fiber::GetRunningFiber();
+  Tracked::s_destroyed = 0;
+  int seen             = -1;
+
+  Fiber::ptr fiber(new Fiber(
+      []() {
+        s_tracked->value = 7;
+        s_trace_id.Set(42);
+        Fiber::GetRunningFiber()->Yield();
+      },
+      0, false));
+  fiber->Resume();
+  EXPECT_EQ(fiber->GetState(), Fiber::Ready);
+  EXPECT_EQ(Tracked::s_destroyed.load(), 0);
+
+  // 中途挂起的协程被 Reset 复用，上一个回调的值被销毁
+  fiber->Reset([&seen]() { seen = s_tracked->value + static_cast<int>(s_trace_id.Get()); });
+  EXPECT_EQ(Tracked::s_destroyed.load(), 1);
+  fiber->Resume();
+  EXPECT_EQ(seen, 0);
+  EXPECT_EQ(Tracked::s_destroyed.load(), 2);
+
+  s_tracked->value = 3;
+  s_tracked.Reset();
+  EXPECT_EQ(Tracked::s_destroyed.load(), 3);
+  EXPECT_EQ(s_tracked->value, 0);
+}
@@ -0,0 +1,233 @@
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "gudov/fiber_sync.h"
+#include "gudov/iomanager.h"
+#include "gudov/util.h"
+
+using namespace gudov;
+
+TEST(FiberSyncTest, MutexParksFiberNotThread) {
+  FiberMutex        mutex;
+  std::atomic<int>  ticks{0};
+  std::atomic<bool> done{false};
+  int               counter = 0;
+  {
+    IOManager iom(1, false, "sync");
+    // 持有者在锁内睡眠，等待的协程只挂起，同一线程上的其他协程继续运行
+    for (int i = 0; i < 4; ++i) {
+      iom.Schedule([&]() {
+        FiberMutex::Locker lock(mutex);
+        int                value = counter;
+        usleep(20 * 1000);
+        counter = value + 1;
+      });
+    }
+    iom.Schedule([&]() {
+      while (counter < 4) {
+        ++ticks;
+        usleep(1000);
+      }
+      done = true;
+    });
+  }
+  EXPECT_TRUE(done);
+  EXPECT_EQ(counter, 4);
+  EXPECT_GT(ticks.load(), 20);
+}
+
+TEST(FiberSyncTest, MutexContention) {
+  FiberMutex mutex;
+  int64_t    counter = 0;
+  {
+    IOManager iom(4, false, "sync");
+    for (int i = 0; i < 16; ++i) {
+      iom.Schedule([&]() {
+        for (int j = 0; j < 2000; ++j) {
+          FiberMutex::Locker lock(mutex);
+          ++counter;
+          if (j % 100 == 0) {
+            // 持锁让出，制造排队
+            Scheduler::GetScheduler()->Schedule(Fiber::GetRunningFiber());
+            Fiber::GetRunningFiber()->Yield();
+          }
+        }
+      });
+    }
+  }
+  EXPECT_EQ(counter, 16 * 2000);
+}
+
+TEST(FiberSyncTest, MutexTryLockFor) {
+  FiberMutex mutex;
+  bool       timed_out = false;
+  bool       acquired  = false;
+  {
+    IOManager iom(2, false, "sync");
+    iom.Schedule([&]() {
+      FiberMutex::Locker lock(mutex);
+      usleep(100 * 1000);
+    });
+    iom.Schedule([&]() {
+      usleep(10 * 1000);
+      uint64_t start = GetCurrentMS();
+      timed_out      = !mutex.TryLockFor(20);
+      EXPECT_LT(GetCurrentMS() - start, 80u);
+      acquired = mutex.TryLockFor(1000);
+      if (acquired) {
+        mutex.Unlock();
+      }
+    });
+  }
+  EXPECT_TRUE(timed_out);
+  EXPECT_TRUE(acquired);
+}
+
+TEST(FiberSyncTest, ConditionProducerConsumer) {
+  FiberMutex       mutex;
+  FiberCondition   cond;
+  std::vector<int> queue;
+  int              sum       = 0;
+  bool             timed_out = false;
+  {
+    IOManager iom(2, false, "sync");
+    for (int c = 0; c < 3; ++c) {
+      iom.Schedule([&]() {
+        FiberMutex::Locker lock(mutex);
+        while (true) {
+          while (queue.empty()) {
+            cond.Wait(mutex);
+          }
+          int value = queue.back();
+          queue.pop_back();
+          if (value < 0) {
+            break;
+          }
+          sum += value;
+        }
+      });
+    }
+    iom.Schedule([&]() {
+      for (int i = 1; i <= 100; ++i) {
+        FiberMutex::Locker lock(mutex);
+        queue.insert(queue.begin(), i);
+        cond.Notify();
+      }
+      FiberMutex::Locker lock(mutex);
+      queue.insert(queue.begin(), {-1, -1, -1});
+      cond.NotifyAll();
+    });
+    iom.Schedule([&]() {
+      FiberMutex     m;
+      FiberCondition c;
+      m.Lock();
+      timed_out = !c.WaitFor(m, 20);
+      // 超时返回时也重新持有锁
+      EXPECT_FALSE(m.TryLock());
+      m.Unlock();
+    });
+  }
+  EXPECT_EQ(sum, 5050);
+  EXPECT_TRUE(timed_out);
+}
+
+TEST(FiberSyncTest, SemaphoreLimitsConcurrency) {
+  FiberSemaphore   sem(2);
+  std::atomic<int> running{0};
+  std::atomic<int> peak{0};
+  {
+    IOManager iom(2, false, "sync");
+    for (int i = 0; i < 8; ++i) {
+      iom.Schedule([&]() {
+        sem.Wait();
+        int now = ++running;
+        int old = peak;
+        while (now > old && !peak.compare_exchange_weak(old, now)) {
+        }
+        usleep(5 * 1000);
+        --running;
+        sem.Notify();
+      });
+    }
+  }
+  EXPECT_EQ(peak.load(), 2);
+  EXPECT_TRUE(sem.TryWait());
+  EXPECT_TRUE(sem.WaitFor(10));
+  EXPECT_FALSE(sem.TryWait());
+  EXPECT_FALSE(sem.WaitFor(10));
+}
+
+TEST(FiberSyncTest, SemaphoreWakesThreadAndFiber) {
+  FiberSemaphore to_thread;
+  FiberSemaphore to_fiber;
+  bool           fiber_timed_out = false;
+  std::thread    thread([&]() {
+    // 普通线程阻塞在信号量上，由协程唤醒
+    to_thread.Wait();
+    to_fiber.Notify();
+  });
+  {
+    IOManager iom(1, false, "sync");
+    iom.Schedule([&]() {
+      fiber_timed_out = !to_fiber.WaitFor(10);
+      to_thread.Notify();
+      to_fiber.Wait();
+    });
+  }
+  thread.join();
+  EXPECT_TRUE(fiber_timed_out);
+}
+
+TEST(FiberSyncTest, RWMutex) {
+  FiberRWMutex     rw;
+  std::atomic<int> readers{0};
+  std::atomic<int> peak_readers{0};
+  std::atomic<int> writers{0};
+  bool             overlap   = false;
+  bool             timed_out = false;
+  int              value     = 0;
+  {
+    IOManager iom(2, false, "sync");
+    for (int i = 0; i < 6; ++i) {
+      iom.Schedule([&]() {
+        FiberRWMutex::ReadLock lock(rw);
+        int                    now = ++readers;
+        if (writers != 0) {
+          overlap = true;
+        }
+        int old = peak_readers;
+        while (now > old && !peak_readers.compare_exchange_weak(old, now)) {
+        }
+        usleep(20 * 1000);
+        --readers;
+      });
+    }
+    for (int i = 0; i < 3; ++i) {
+      iom.Schedule([&]() {
+        usleep(5 * 1000);
+        FiberRWMutex::WriteLock lock(rw);
+        if (++writers != 1 || readers != 0) {
+          overlap = true;
+        }
+        ++value;
+        usleep(5 * 1000);
+        --writers;
+      });
+    }
+    iom.Schedule([&]() {
+      usleep(10 * 1000);
+      // 读者持锁 20ms，写者等不到
+      timed_out = !rw.TryWrLockFor(1);
+    });
+  }
+  EXPECT_FALSE(overlap);
+  EXPECT_GT(peak_readers.load(), 1);
+  EXPECT_EQ(value, 3);
+  EXPECT_TRUE(timed_out);
+  EXPECT_TRUE(rw.TryWrLock());
+  rw.unlock();
+}
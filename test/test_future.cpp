@@ -0,0 +1,164 @@
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gudov/future.h"
+#include "gudov/iomanager.h"
+#include "gudov/util.h"
+
+using namespace gudov;
+
+TEST(FutureTest, GetParksFiberNotThread) {
+  Promise<int>      promise;
+  std::atomic<int>  ticks{0};
+  std::atomic<bool> done{false};
+  int               value = 0;
+  {
+    IOManager iom(1, false, "future");
+    iom.Schedule([&]() {
+      value = promise.GetFuture().Get();
+      done  = true;
+    });
+    iom.Schedule([&]() {
+      while (!done) {
+        ++ticks;
+        usleep(1000);
+      }
+    });
+    iom.Schedule([&]() {
+      usleep(20 * 1000);
+      promise.SetValue(42);
+    });
+  }
+  EXPECT_EQ(value, 42);
+  EXPECT_GT(ticks.load(), 5);
+  EXPECT_THROW(promise.SetValue(1), std::logic_error);
+}
+
+TEST(FutureTest, ExceptionPropagates) {
+  bool caught     = false;
+  bool all_caught = false;
+  {
+    IOManager iom(2, false, "future");
+    iom.Schedule([&]() {
+      Future<int> future = Async([]() -> int { throw std::runtime_error("boom"); });
+      try {
+        future.Get();
+      } catch (const std::runtime_error& e) {
+        caught = std::string(e.what()) == "boom";
+      }
+
+      std::vector<Future<void>> futures;
+      futures.push_back(Async([]() { usleep(5 * 1000); }));
+      futures.push_back(Async([]() { throw std::runtime_error("second"); }));
+      try {
+        WhenAll(futures).Get();
+      } catch (const std::runtime_error& e) {
+        all_caught = std::string(e.what()) == "second";
+      }
+    });
+  }
+  EXPECT_TRUE(caught);
+  EXPECT_TRUE(all_caught);
+}
+
+TEST(FutureTest, WaitForTimeout) {
+  Promise<void> promise;
+  Future<void>  future    = promise.GetFuture();
+  bool          timed_out = false;
+  {
+    IOManager iom(1, false, "future");
+    iom.Schedule([&]() { timed_out = !future.WaitFor(20); });
+  }
+  EXPECT_TRUE(timed_out);
+  // 普通线程上等待，由其他线程设置
+  EXPECT_FALSE(future.WaitFor(10));
+  std::thread thread([&]() {
+    usleep(10 * 1000);
+    promise.SetValue();
+  });
+  future.Get();
+  EXPECT_TRUE(future.IsReady());
+  thread.join();
+}
+
+TEST(FutureTest, WhenAllScatterGather) {
+  std::vector<int> values;
+  uint64_t         elapsed = 0;
+  {
+    IOManager iom(2, false, "future");
+    iom.Schedule([&]() {
+      uint64_t                 start = GetCurrentMS();
+      std::vector<Future<int>> futures;
+      for (int i = 0; i < 8; ++i) {
+        futures.push_back(Async([i]() {
+          usleep((8 - i) * 10 * 1000);
+          return i;
+        }));
+      }
+      values  = WhenAll(futures).Get();
+      elapsed = GetCurrentMS() - start;
+    });
+  }
+  ASSERT_EQ(values.size(), 8u);
+  for (int i = 0; i < 8; ++i) {
+    EXPECT_EQ(values[i], i);
+  }
+  // 各任务共 360ms，并发时取决于最慢的 80ms
+  EXPECT_LT(elapsed, 200u);
+}
+
+TEST(FutureTest, WhenAny) {
+  size_t first = 0;
+  {
+    IOManager iom(2, false, "future");
+    iom.Schedule([&]() {
+      std::vector<Future<int>> futures;
+      for (int i = 0; i < 3; ++i) {
+        futures.push_back(Async([i]() {
+          usleep((i == 1 ? 5 : 50) * 1000);
+          return i;
+        }));
+      }
+      first = WhenAny(futures).Get();
+      EXPECT_EQ(futures[first].Get(), 1);
+    });
+  }
+  EXPECT_EQ(first, 1u);
+}
+
+TEST(FutureTest, WaitGroup) {
+  WaitGroup        wg;
+  std::atomic<int> finished{0};
+  int              seen      = 0;
+  bool             timed_out = false;
+  {
+    IOManager iom(2, false, "future");
+    wg.Add(10);
+    for (int i = 0; i < 10; ++i) {
+      iom.Schedule([&, i]() {
+        usleep(i * 1000);
+        ++finished;
+        wg.Done();
+      });
+    }
+    iom.Schedule([&]() {
+      wg.Wait();
+      seen = finished;
+
+      WaitGroup never(1);
+      timed_out = !never.WaitFor(10);
+    });
+    // 普通线程也可以等待
+    wg.Wait();
+    EXPECT_EQ(finished.load(), 10);
+  }
+  EXPECT_EQ(seen, 10);
+  EXPECT_TRUE(timed_out);
+  EXPECT_THROW(wg.Done(), std::logic_error);
+}
@@ -1,16 +1,25 @@
 #include <arpa/inet.h>
+#include <dirent.h>
 #include <fcntl.h>
 #include <gtest/gtest.h>
+#include <poll.h>
+#include <string.h>
 #include <sys/epoll.h>
 #include <sys/eventfd.h>
+#include <sys/select.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <atomic>
 #include <iostream>
+#include <thread>
 
+#include "gudov/fdmanager.h"
 #include "gudov/gudov.h"
 #include "gudov/iomanager.h"
+#include "gudov/socket.h"
 
 using namespace gudov;
 
@@ -132,3 +141,546 @@ TEST_F(IOManagerTest, CancelAllTest) {
 
   close(efd);  // 关闭 eventfd
 }
+
+static void BusyWaitMS(uint64_t ms) {
+  uint64_t start = GetCurrentMS();
+  while (GetCurrentMS() - start < ms) {
+  }
+}
+
+/**
+ * @brief 等待所有工作线程进入休眠，不依赖固定的等待时间
+ *
+ */
+static void WaitAllSleeping(IOManager& iom, size_t workers) {
+  while (iom.GetSleepingCount() < workers) {
+    std::this_thread::yield();
+  }
+}
+
+// 测试每个任务只唤醒一个空闲线程，指定线程的任务只唤醒目标线程
+TEST(IOManagerWakeupTest, TargetedWakeup) {
+  const int        kWorkers = 4;
+  const int        kTasks   = 50;
+  IOManager        iom(kWorkers, false, "Wakeup");
+  std::atomic<int> done{0};
+  std::atomic<int> target{0};
+  std::atomic<int> misplaced{0};
+
+  iom.Schedule([&]() { target = GetThreadId(); });
+  while (target == 0) {
+    std::this_thread::yield();
+  }
+  WaitAllSleeping(iom, kWorkers);
+
+  auto before = iom.GetWakeupStats();
+  for (int i = 0; i < kTasks; ++i) {
+    iom.Schedule([&]() { ++done; });
+    while (done < 2 * i + 1) {
+      std::this_thread::yield();
+    }
+    WaitAllSleeping(iom, kWorkers);
+
+    iom.Schedule(
+        [&]() {
+          if (GetThreadId() != target) {
+            ++misplaced;
+          }
+          ++done;
+        },
+        target);
+    while (done < 2 * i + 2) {
+      std::this_thread::yield();
+    }
+    WaitAllSleeping(iom, kWorkers);
+  }
+  auto after = iom.GetWakeupStats();
+
+  EXPECT_EQ(misplaced, 0);
+  uint64_t wakeups  = after.wakeups - before.wakeups;
+  uint64_t spurious = after.spurious - before.spurious;
+  std::cout << "tasks=" << 2 * kTasks << " wakeups=" << wakeups << " spurious=" << spurious << std::endl;
+  EXPECT_LE(wakeups, 2u * kTasks + 2);
+  EXPECT_LE(spurious, 2u);
+}
+
+// 在 TearDown 中恢复后端配置，断言提前返回时之后的测试也不会继续使用 io_uring
+class IOManagerUringTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    backend_ = Config::Lookup<std::string>("iomanager.backend");
+    backend_->SetValue("io_uring");
+  }
+
+  void TearDown() override { backend_->SetValue("epoll"); }
+
+  ConfigVar<std::string>::ptr backend_;
+};
+
+// 测试 io_uring 后端下 hook 的 accept/connect/send/recv 以及接收超时
+TEST_F(IOManagerUringTest, EchoAndTimeout) {
+  std::atomic<int>  echoed{0};
+  std::atomic<bool> timed_out{false};
+  std::string       used;
+  {
+    IOManager iom(2, false, "Uring");
+    used = iom.GetBackend();
+    if (iom.IsUring()) {
+      auto server = Socket::CreateTCPSocket();
+      ASSERT_TRUE(server->Bind(IPv4Address::Create("127.0.0.1", 0)));
+      ASSERT_TRUE(server->Listen());
+      auto addr = server->GetLocalAddress();
+
+      iom.Schedule([server]() {
+        auto client = server->Accept();
+        if (!client) {
+          return;
+        }
+        char buf[64];
+        int  n;
+        while ((n = client->Recv(buf, sizeof(buf))) > 0) {
+          client->Send(buf, n);
+        }
+      });
+      iom.Schedule([addr, &echoed, &timed_out]() {
+        auto sock = Socket::CreateTCPSocket();
+        if (!sock->Connect(addr)) {
+          return;
+        }
+        char buf[64];
+        for (int i = 0; i < 100; ++i) {
+          std::string msg = "ping " + std::to_string(i);
+          if (sock->Send(msg.c_str(), msg.size()) != (int)msg.size()) {
+            return;
+          }
+          int n = sock->Recv(buf, sizeof(buf));
+          if (n == (int)msg.size() && std::string(buf, n) == msg) {
+            ++echoed;
+          }
+        }
+        sock->SetRecvTimeout(50);
+        uint64_t start = GetCurrentMS();
+        int      n     = sock->Recv(buf, sizeof(buf));
+        timed_out      = n < 0 && errno == ETIMEDOUT && GetCurrentMS() - start >= 40;
+        sock->Close();
+      });
+    }
+  }
+
+  if (used != "io_uring") {
+    GTEST_SKIP() << "io_uring is not available, fell back to " << used;
+  }
+  EXPECT_EQ(echoed, 100);
+  EXPECT_TRUE(timed_out);
+}
+
+// 测试 per_thread_reactor 模式下等待 IO 的协程总是回到注册事件的线程继续执行
+TEST(IOManagerReactorTest, ResumeOnSameThread) {
+  auto reactor = Config::Lookup<bool>("iomanager.per_thread_reactor");
+  reactor->SetValue(true);
+
+  const int        kFibers = 16;
+  const int        kRounds = 50;
+  std::atomic<int> resumed{0};
+  std::atomic<int> migrated{0};
+  {
+    IOManager iom(4, false, "Reactor");
+    EXPECT_TRUE(iom.IsPerThreadReactor());
+    for (int i = 0; i < kFibers; ++i) {
+      iom.Schedule([&]() {
+        int fds[2];
+        if (pipe2(fds, O_NONBLOCK) != 0) {
+          return;
+        }
+        IOManager* self = IOManager::GetThis();
+        for (int j = 0; j < kRounds; ++j) {
+          int wfd = fds[1];
+          self->Schedule([wfd]() {
+            char c = 'x';
+            EXPECT_EQ(write(wfd, &c, 1), 1);
+          });
+          int thread = GetThreadId();
+          self->AddEvent(fds[0], IOManager::READ);
+          Fiber::GetRunningFiber()->Yield();
+          if (GetThreadId() != thread) {
+            ++migrated;
+          }
+          char c;
+          EXPECT_EQ(read(fds[0], &c, 1), 1);
+          ++resumed;
+        }
+        close(fds[0]);
+        close(fds[1]);
+      });
+    }
+  }
+  reactor->SetValue(false);
+
+  EXPECT_EQ(resumed, kFibers * kRounds);
+  EXPECT_EQ(migrated, 0);
+}
+
+// 测试 per_thread_reactor 模式下工作线程有任务时被 tickle，不阻塞的取事件不会把 eventfd 和 timerfd 当作 fd 事件处理
+TEST(IOManagerReactorTest, TickleWhileTasksPending) {
+  auto reactor    = Config::Lookup<bool>("iomanager.per_thread_reactor");
+  auto timerfd    = Config::Lookup<bool>("iomanager.timerfd");
+  auto time_slice = Config::Lookup<uint64_t>("scheduler.time_slice_us");
+  reactor->SetValue(true);
+  timerfd->SetValue(true);
+  time_slice->SetValue(200);
+
+  std::atomic<bool> stop{false};
+  std::atomic<int>  spins{0};
+  int               sleeps = 0;
+  {
+    IOManager iom(1, false, "Reactor");
+    EXPECT_TRUE(iom.IsPerThreadReactor());
+    // 工作线程阻塞时设置了 timerfd，被 tickle 提前叫醒后计算协程用完时间片，
+    // 让出后 idle 协程在队列非空时运行，此时 timerfd 到期或又被 tickle
+    iom.Schedule([&]() {
+      while (!stop) {
+        usleep(500);
+        ++sleeps;
+      }
+    });
+    std::thread tickler([&]() {
+      uint64_t start = GetMonotonicUS();
+      while (GetMonotonicUS() - start < 200 * 1000) {
+        iom.Schedule([&]() {
+          uint64_t begin = GetMonotonicUS();
+          while (GetMonotonicUS() - begin < 1000) {
+            Fiber::MaybeYield();
+          }
+          ++spins;
+        });
+        usleep(300);
+      }
+      stop = true;
+    });
+    tickler.join();
+  }
+  time_slice->SetValue(0);
+  timerfd->SetValue(false);
+  reactor->SetValue(false);
+
+  EXPECT_GT(spins, 0);
+  EXPECT_GT(sleeps, 0);
+}
+
+/**
+ * @brief 多个协程各自在一个 pipe 上反复等待可读，返回这期间 epoll_ctl 的调用次数
+ *
+ */
+static uint64_t PipeWaitRounds(int fibers, int rounds, std::atomic<int>& resumed) {
+  IOManager iom(2, false, "PipeWait");
+  for (int i = 0; i < fibers; ++i) {
+    iom.Schedule([&iom, rounds, &resumed]() {
+      int fds[2];
+      if (pipe2(fds, O_NONBLOCK) != 0) {
+        return;
+      }
+      for (int j = 0; j < rounds; ++j) {
+        int wfd = fds[1];
+        iom.Schedule([wfd]() {
+          char c = 'x';
+          EXPECT_EQ(write(wfd, &c, 1), 1);
+        });
+        iom.AddEvent(fds[0], IOManager::READ);
+        Fiber::GetRunningFiber()->Yield();
+        char c;
+        EXPECT_EQ(read(fds[0], &c, 1), 1);
+        ++resumed;
+      }
+      // pipe 不经过 FdManager，hook 的 close 不会撤销注册，手动撤销
+      iom.CancelAll(fds[0]);
+      close(fds[0]);
+      close(fds[1]);
+    });
+  }
+  iom.Stop();
+  return iom.GetEpollCtlCount();
+}
+
+// 测试 persistent_epoll 模式下每个 fd 只注册和撤销各一次
+TEST(IOManagerPersistentTest, EpollCtlOncePerFd) {
+  const int        kFibers = 8;
+  const int        kRounds = 100;
+  std::atomic<int> resumed{0};
+
+  uint64_t oneshot = PipeWaitRounds(kFibers, kRounds, resumed);
+  EXPECT_EQ(resumed, kFibers * kRounds);
+
+  auto persistent = Config::Lookup<bool>("iomanager.persistent_epoll");
+  persistent->SetValue(true);
+  resumed            = 0;
+  uint64_t latched   = PipeWaitRounds(kFibers, kRounds, resumed);
+  persistent->SetValue(false);
+  EXPECT_EQ(resumed, kFibers * kRounds);
+
+  std::cout << "epoll_ctl oneshot=" << oneshot << " persistent=" << latched << std::endl;
+  EXPECT_GE(oneshot, (uint64_t)kFibers * kRounds);
+  EXPECT_EQ(latched, 2u * kFibers);
+}
+
+// 工作线程创建的定时器由该线程管理，其他线程的 Cancel/Reset 通过请求队列生效
+TEST(IOManagerTimerShardTest, CrossThreadCancelAndReset) {
+  auto shards = Config::Lookup<bool>("iomanager.per_thread_timers");
+  shards->SetValue(true);
+
+  std::atomic<int>  fired{0};
+  std::atomic<int>  cancelled{0};
+  std::atomic<int>  reset{0};
+  std::atomic<int>  shared{0};
+  std::atomic<bool> ready{false};
+  Timer::ptr        cancel_timer;
+  Timer::ptr        reset_timer;
+  uint64_t          start = GetCurrentMS();
+  {
+    IOManager iom(2, false, "TimerShard");
+    EXPECT_TRUE(iom.IsPerThreadTimers());
+    iom.Schedule([&]() {
+      IOManager* self = IOManager::GetThis();
+      self->AddTimer(20, [&]() { ++fired; });
+      cancel_timer = self->AddTimer(50, [&]() { ++cancelled; });
+      reset_timer  = self->AddTimer(5000, [&]() { ++reset; });
+      ready        = true;
+    });
+    while (!ready) {
+      std::this_thread::yield();
+    }
+    // 主线程不是工作线程，只能投递请求
+    EXPECT_TRUE(cancel_timer->Cancel());
+    EXPECT_FALSE(cancel_timer->Cancel());
+    EXPECT_TRUE(reset_timer->Reset(30, true));
+    // 主线程创建的定时器放在共享分片
+    iom.AddTimer(10, [&]() { ++shared; });
+    BusyWaitMS(200);
+  }
+  shards->SetValue(false);
+
+  EXPECT_EQ(fired, 1);
+  EXPECT_EQ(cancelled, 0);
+  EXPECT_EQ(reset, 1);
+  EXPECT_EQ(shared, 1);
+  EXPECT_LT(GetCurrentMS() - start, 2000u);
+}
+
+// 开启 timerfd 后 hook 的 usleep 按微秒等待，不再取整到 epoll_wait 的毫秒超时
+TEST(IOManagerTimerFdTest, MicrosecondSleep) {
+  auto timerfd = Config::Lookup<bool>("iomanager.timerfd");
+  timerfd->SetValue(true);
+
+  const int             kRounds = 20;
+  std::atomic<uint64_t> cost{0};
+  {
+    IOManager iom(1, false, "TimerFd");
+    EXPECT_TRUE(iom.IsTimerFd());
+    iom.Schedule([&]() {
+      uint64_t start = GetMonotonicUS();
+      for (int i = 0; i < kRounds; ++i) {
+        usleep(300);
+      }
+      cost = GetMonotonicUS() - start;
+    });
+  }
+  timerfd->SetValue(false);
+
+  EXPECT_GE(cost, kRounds * 300u);
+  // 取整到毫秒时至少需要 kRounds 毫秒
+  EXPECT_LT(cost, kRounds * 1000u);
+}
+
+// hook 后的 recv：超时返回 ETIMEDOUT，等待中数据到达时被唤醒；close 后同一个 fd 复用时重新初始化
+TEST(IOManagerHookTest, RecvTimeoutAndWakeup) {
+  int fds[2];
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+  FdCtx* ctx = FdMgr::GetInstance()->Get(fds[0], true);
+  ASSERT_NE(ctx, nullptr);
+  EXPECT_TRUE(ctx->IsSocket());
+
+  int  timeout_errno = 0;
+  int  received      = 0;
+  char c             = 0;
+  {
+    IOManager iom(2, false, "Hook");
+    iom.Schedule([&]() {
+      timeval tv{0, 20000};
+      setsockopt(fds[0], SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+      if (recv(fds[0], &c, 1, 0) == -1) {
+        timeout_errno = errno;
+      }
+      // 另一个协程 5ms 后写入，应在超时前被唤醒
+      IOManager::GetThis()->Schedule([&]() {
+        usleep(5000);
+        send(fds[1], "x", 1, 0);
+      });
+      received = recv(fds[0], &c, 1, 0);
+    });
+  }
+  EXPECT_EQ(timeout_errno, ETIMEDOUT);
+  EXPECT_EQ(received, 1);
+  EXPECT_EQ(c, 'x');
+
+  FdMgr::GetInstance()->Del(fds[0]);
+  EXPECT_EQ(FdMgr::GetInstance()->Get(fds[0]), nullptr);
+  // 表项原地复用，重新登记时按新的 fd 初始化
+  EXPECT_EQ(FdMgr::GetInstance()->Get(fds[0], true), ctx);
+  EXPECT_EQ(ctx->GetTimeout(SO_RCVTIMEO), (uint64_t)-1);
+  FdMgr::GetInstance()->Del(fds[0]);
+  close(fds[0]);
+  close(fds[1]);
+}
+
+// 单线程 IOManager 上用 poll 写的非阻塞客户端访问同进程的回显服务，poll 阻塞线程时服务端协程无法运行，只能等到超时
+TEST(IOManagerHookTest, PollParksFiber) {
+  int         poll_connect = -1;
+  int         poll_recv    = -1;
+  int         select_rt    = -1;
+  int         epoll_rt     = -1;
+  char        reply[5]     = {0};
+  uint64_t    cost         = 0;
+  sockaddr_in addr;
+  {
+    IOManager iom(1, false, "Poll");
+    iom.Schedule([&]() {
+      int server = socket(AF_INET, SOCK_STREAM, 0);
+      memset(&addr, 0, sizeof(addr));
+      addr.sin_family      = AF_INET;
+      addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+      socklen_t len        = sizeof(addr);
+      bind(server, (sockaddr*)&addr, sizeof(addr));
+      listen(server, 1);
+      getsockname(server, (sockaddr*)&addr, &len);
+
+      IOManager::GetThis()->Schedule([&]() {
+        uint64_t start  = GetCurrentMS();
+        int      client = socket(AF_INET, SOCK_STREAM, 0);
+        fcntl(client, F_SETFL, fcntl(client, F_GETFL) | O_NONBLOCK);
+        connect(client, (sockaddr*)&addr, sizeof(addr));
+
+        pollfd pfd   = {client, POLLOUT, 0};
+        poll_connect = poll(&pfd, 1, 2000);
+        send(client, "ping", 4, 0);
+        pfd.events = POLLIN;
+        poll_recv  = poll(&pfd, 1, 2000);
+        recv(client, reply, 4, 0);
+
+        // 没有数据时按超时返回 0
+        fd_set rset;
+        FD_ZERO(&rset);
+        FD_SET(client, &rset);
+        timeval tv = {0, 20000};
+        select_rt  = select(client + 1, &rset, nullptr, nullptr, &tv);
+
+        int         epfd  = epoll_create1(0);
+        epoll_event event = {EPOLLIN, {0}};
+        epoll_ctl(epfd, EPOLL_CTL_ADD, client, &event);
+        epoll_rt = epoll_wait(epfd, &event, 1, 20);
+        close(epfd);
+        close(client);
+        cost = GetCurrentMS() - start;
+      });
+
+      int  conn = accept(server, nullptr, nullptr);
+      char buf[4];
+      if (recv(conn, buf, sizeof(buf), 0) == 4) {
+        send(conn, buf, 4, 0);
+      }
+      // 等客户端关闭后再关闭，避免 select/epoll_wait 看到 EOF
+      recv(conn, buf, sizeof(buf), 0);
+      close(conn);
+      close(server);
+    });
+  }
+
+  EXPECT_EQ(poll_connect, 1);
+  EXPECT_EQ(poll_recv, 1);
+  EXPECT_STREQ(reply, "ping");
+  EXPECT_EQ(select_rt, 0);
+  EXPECT_EQ(epoll_rt, 0);
+  EXPECT_GE(cost, 40u);
+  EXPECT_LT(cost, 2000u);
+}
+
+/**
+ * @brief 当前进程打开的 fd 数量
+ *
+ */
+static int CountOpenFds() {
+  int  count = 0;
+  DIR* dir   = opendir("/proc/self/fd");
+  if (!dir) {
+    return -1;
+  }
+  while (dirent* entry = readdir(dir)) {
+    if (entry->d_name[0] != '.') {
+      ++count;
+    }
+  }
+  closedir(dir);
+  return count;
+}
+
+// 测试单个 fd 的 poll 直接在该 fd 上注册事件，同一个 fd 已有协程在等待时退回到临时 epoll
+TEST(IOManagerHookTest, PollSameFdTwice) {
+  int fds[2];
+  int ready[2] = {-1, -1};
+  int opened   = -1;
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+  {
+    IOManager iom(1, false, "Poll");
+    int       base = CountOpenFds();
+    for (int i = 0; i < 2; ++i) {
+      iom.Schedule([&, i]() {
+        pollfd pfd = {fds[0], POLLIN, 0};
+        ready[i]   = poll(&pfd, 1, 2000);
+      });
+    }
+    iom.Schedule([&]() {
+      usleep(20 * 1000);
+      // 只有第二个协程创建了临时 epoll
+      opened = CountOpenFds() - base;
+      EXPECT_EQ(write(fds[1], "x", 1), 1);
+    });
+  }
+  close(fds[0]);
+  close(fds[1]);
+
+  EXPECT_EQ(ready[0], 1);
+  EXPECT_EQ(ready[1], 1);
+  EXPECT_EQ(opened, 1);
+}
+
+// 测试开启时间片后，一直有计算协程排队时定时器仍能按时唤醒睡眠的协程
+TEST(IOManagerTimeSliceTest, TimersFireWhileFibersSpin) {
+  auto time_slice = Config::Lookup<uint64_t>("scheduler.time_slice_us");
+  ASSERT_TRUE(time_slice);
+  time_slice->SetValue(2000);
+
+  std::atomic<bool> stop{false};
+  int               wakeups = 0;
+  uint64_t          worst   = 0;
+  {
+    IOManager iom(1, false, "TimeSlice");
+    iom.Schedule([&]() {
+      for (int i = 0; i < 10; ++i) {
+        uint64_t start = GetMonotonicUS();
+        usleep(1000);
+        worst = std::max(worst, GetMonotonicUS() - start);
+        ++wakeups;
+      }
+      stop = true;
+    });
+    for (int i = 0; i < 2; ++i) {
+      iom.Schedule([&]() {
+        while (!stop) {
+          Fiber::MaybeYield();
+        }
+      });
+    }
+  }
+  time_slice->SetValue(0);
+
+  EXPECT_EQ(wakeups, 10);
+  EXPECT_LT(worst, 100 * 1000u);
+}
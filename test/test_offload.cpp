@@ -0,0 +1,147 @@
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "gudov/bytearray.h"
+#include "gudov/iomanager.h"
+#include "gudov/offload.h"
+#include "gudov/util.h"
+
+using namespace gudov;
+
+TEST(OffloadTest, AwaitDoesNotBlockWorker) {
+  OffloadPool       pool(2, 16, "offload_test");
+  std::atomic<int>  ticks{0};
+  std::atomic<bool> done{false};
+  int               value = 0;
+  {
+    IOManager iom(1, false, "offload");
+    iom.Schedule([&]() {
+      value = pool.Await([]() {
+        usleep(100 * 1000);
+        return 42;
+      });
+      done = true;
+    });
+    // 只有一个调度线程，阻塞调用期间其他协程仍然能运行
+    iom.Schedule([&]() {
+      while (!done) {
+        ++ticks;
+        usleep(1000);
+      }
+    });
+  }
+  EXPECT_EQ(value, 42);
+  EXPECT_GT(ticks.load(), 10);
+
+  OffloadPool::Stats stats = pool.GetStats();
+  EXPECT_EQ(stats.completed, 1u);
+  EXPECT_EQ(stats.inline_runs, 0u);
+  EXPECT_EQ(stats.queue_depth, 0u);
+  EXPECT_GE(stats.total_run_us, 100 * 1000u);
+}
+
+TEST(OffloadTest, RethrowException) {
+  OffloadPool pool(1, 16, "offload_test");
+  bool        caught = false;
+  {
+    IOManager iom(1, false, "offload");
+    iom.Schedule([&]() {
+      try {
+        pool.Await([]() -> int { throw std::runtime_error("boom"); });
+      } catch (const std::runtime_error& e) {
+        caught = std::string(e.what()) == "boom";
+      }
+    });
+  }
+  EXPECT_TRUE(caught);
+  EXPECT_EQ(pool.GetStats().completed, 1u);
+}
+
+TEST(OffloadTest, InlineOutsideScheduler) {
+  OffloadPool pool(1, 16, "offload_test");
+  pthread_t   self    = pthread_self();
+  bool        inline_ = pool.Await([self]() { return pthread_equal(self, pthread_self()) != 0; });
+  EXPECT_TRUE(inline_);
+  EXPECT_EQ(pool.GetStats().inline_runs, 1u);
+  EXPECT_EQ(pool.GetStats().completed, 0u);
+}
+
+TEST(OffloadTest, QueueFullRunsInline) {
+  OffloadPool       pool(1, 1, "offload_test");
+  std::atomic<int>  finished{0};
+  std::atomic<bool> started{false};
+  std::atomic<bool> release{false};
+  {
+    IOManager iom(2, false, "offload");
+    // 第一个任务占住唯一的线程，第二个占满队列，第三个只能在调用方执行
+    iom.Schedule([&]() {
+      pool.Await([&]() {
+        started = true;
+        while (!release) {
+          usleep(1000);
+        }
+      });
+      ++finished;
+    });
+    iom.Schedule([&]() {
+      while (!started) {
+        usleep(1000);
+      }
+      pool.Await([]() {});
+      ++finished;
+    });
+    iom.Schedule([&]() {
+      while (pool.GetStats().queue_depth == 0) {
+        usleep(1000);
+      }
+      pool.Await([]() {});
+      ++finished;
+      release = true;
+    });
+  }
+  EXPECT_EQ(finished.load(), 3);
+
+  OffloadPool::Stats stats = pool.GetStats();
+  EXPECT_EQ(stats.completed, 2u);
+  EXPECT_EQ(stats.inline_runs, 1u);
+  EXPECT_EQ(stats.max_queue_depth, 1u);
+}
+
+TEST(OffloadTest, FileRoundTrip) {
+  std::string dir  = "/tmp/gudov_offload_test_" + std::to_string(getpid());
+  std::string file = dir + "/data.bin";
+  bool        ok   = false;
+  std::string content;
+  {
+    IOManager iom(1, false, "offload");
+    iom.Schedule([&]() {
+      ByteArray::ptr ba(new ByteArray(16));
+      for (int i = 0; i < 100; ++i) {
+        ba->WriteFint32(i);
+      }
+      ba->SetPosition(0);
+      ok = FSUtil::MkdirAsync(dir) && ba->WriteToFileAsync(file);
+
+      ByteArray::ptr rb(new ByteArray(16));
+      ok = ok && rb->ReadFromFileAsync(file);
+      rb->SetPosition(0);
+      for (int i = 0; ok && i < 100; ++i) {
+        ok = rb->ReadFint32() == i;
+      }
+
+      std::vector<std::string> files;
+      FSUtil::ListAllFileAsync(files, dir, ".bin");
+      ok      = ok && files.size() == 1 && files[0] == file;
+      content = FSUtil::ReadFileAsync(file);
+      ok      = ok && FSUtil::RmAsync(dir);
+    });
+  }
+  EXPECT_TRUE(ok);
+  EXPECT_EQ(content.size(), 400u);
+  EXPECT_NE(access(dir.c_str(), F_OK), 0);
+}
@@ -2,6 +2,7 @@
 
 #include <atomic>
 #include <iostream>
+#include <set>
 #include <thread>
 
 #include "gudov/gudov.h"
@@ -70,3 +71,162 @@ TEST(SchedulerTest, DynamicTaskAddition) {
 
   EXPECT_EQ(counter, 20);
 }
+
+// 测试指定线程的任务只在目标线程上执行
+TEST(SchedulerTest, PinnedTaskRunsOnTargetThread) {
+  gudov::Scheduler scheduler(4, false, "Pinned");
+  scheduler.Start();
+
+  std::atomic<int>  target{0};
+  std::atomic<int>  mismatch{0};
+  std::atomic<int>  done{0};
+  scheduler.Schedule([&]() { target = gudov::GetThreadId(); });
+  while (target == 0) {
+    std::this_thread::yield();
+  }
+
+  for (int i = 0; i < 100; ++i) {
+    scheduler.Schedule(
+        [&]() {
+          if (gudov::GetThreadId() != target) {
+            ++mismatch;
+          }
+          ++done;
+        },
+        target);
+  }
+
+  scheduler.Stop();
+  EXPECT_EQ(done, 100);
+  EXPECT_EQ(mismatch, 0);
+}
+
+// 测试一个线程产生的任务会被其他空闲线程窃取
+TEST(SchedulerTest, WorkStealing) {
+  gudov::Scheduler scheduler(4, false, "Stealing");
+  scheduler.Start();
+
+  gudov::Mutex     mutex;
+  std::set<int>    threads;
+  std::atomic<int> done{0};
+  scheduler.Schedule([&]() {
+    // 任务全部进入当前线程的本地队列
+    for (int i = 0; i < 16; ++i) {
+      gudov::Scheduler::GetScheduler()->Schedule([&]() {
+        uint64_t start = gudov::GetCurrentMS();
+        while (gudov::GetCurrentMS() - start < 20) {
+        }
+        gudov::Mutex::Locker lock(mutex);
+        threads.insert(gudov::GetThreadId());
+        ++done;
+      });
+    }
+  });
+
+  while (done < 16) {
+    std::this_thread::yield();
+  }
+  scheduler.Stop();
+  EXPECT_GT(threads.size(), 1u);
+}
+
+// 测试回调任务复用已结束的协程，中途 Yield 的协程不会被复用
+TEST(SchedulerTest, CallbackFiberReuse) {
+  gudov::Scheduler scheduler(1, false, "Reuse");
+  scheduler.Start();
+
+  std::atomic<int> done{0};
+  scheduler.Schedule([&]() {
+    for (int i = 0; i < 100; ++i) {
+      gudov::Scheduler::GetScheduler()->Schedule([&]() { ++done; });
+    }
+  });
+  scheduler.Schedule([&]() {
+    // 把自己重新加入队列后让出，协程被队列持有期间不能被其他回调复用
+    auto self = gudov::Fiber::GetRunningFiber();
+    gudov::Scheduler::GetScheduler()->Schedule(self);
+    self.reset();
+    gudov::Fiber::GetRunningFiber()->Yield();
+    ++done;
+  });
+
+  while (done < 101) {
+    std::this_thread::yield();
+  }
+  scheduler.Stop();
+
+  auto stats = scheduler.GetStats();
+  EXPECT_EQ(stats.callback_tasks, 102u);
+  EXPECT_EQ(stats.fibers_created + stats.fibers_reused, stats.callback_tasks);
+  EXPECT_LE(stats.fibers_created, 3u);
+}
+
+// 测试 inline 任务直接在调度协程上执行，不创建回调协程
+TEST(SchedulerTest, InlineTask) {
+  gudov::Scheduler scheduler(2, false, "Inline");
+  scheduler.Start();
+
+  std::atomic<int> done{0};
+  std::atomic<int> inline_count{0};
+  for (int i = 0; i < 100; ++i) {
+    scheduler.ScheduleInline([&]() {
+      if (gudov::Scheduler::IsRunningInline()) {
+        ++inline_count;
+      }
+      ++done;
+    });
+  }
+
+  while (done < 100) {
+    std::this_thread::yield();
+  }
+  scheduler.Stop();
+
+  EXPECT_EQ(inline_count, 100);
+  EXPECT_FALSE(gudov::Scheduler::IsRunningInline());
+  EXPECT_EQ(scheduler.GetStats().callback_tasks, 0u);
+}
+
+// 测试开启时间片后占用 CPU 的协程在 MaybeYield 处让出，并被记录为超时任务
+TEST(SchedulerTest, TimeSlicePreemption) {
+  auto time_slice = gudov::Config::Lookup<uint64_t>("scheduler.time_slice_us");
+  ASSERT_TRUE(time_slice);
+  time_slice->SetValue(2000);
+
+  gudov::Scheduler scheduler(1, false, "TimeSlice");
+  scheduler.Start();
+
+  std::atomic<bool>     hog_done{false};
+  std::atomic<uint64_t> light_at{0};
+  uint64_t              start = gudov::GetMonotonicUS();
+  scheduler.Schedule([&]() {
+    while (gudov::GetMonotonicUS() - start < 100 * 1000) {
+      gudov::Fiber::MaybeYield();
+    }
+    hog_done = true;
+  });
+  scheduler.Schedule([&]() { light_at = gudov::GetMonotonicUS() - start; });
+  // 不调用 MaybeYield 的任务无法让出，只会被记录下来
+  scheduler.Schedule([]() {
+    uint64_t begin = gudov::GetMonotonicUS();
+    while (gudov::GetMonotonicUS() - begin < 20 * 1000) {
+    }
+  });
+
+  while (!hog_done || !light_at) {
+    std::this_thread::yield();
+  }
+  scheduler.Stop();
+  time_slice->SetValue(0);
+
+  EXPECT_LT(light_at.load(), 50 * 1000u);
+  EXPECT_GT(scheduler.GetStats().preemptions, 0u);
+
+  auto offenders = scheduler.GetSliceOffenders();
+  ASSERT_FALSE(offenders.empty());
+  EXPECT_GE(offenders.front().max_us, 20 * 1000u);
+  EXPECT_NE(offenders.front().task.find("TimeSlicePreemption"), std::string::npos);
+  for (size_t i = 1; i < offenders.size(); ++i) {
+    EXPECT_LE(offenders[i].max_us, offenders[i - 1].max_us);
+  }
+}
@@ -0,0 +1,171 @@
+#include <gtest/gtest.h>
+#include <sys/mman.h>
+
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "gudov/config.h"
+
+#include "gudov/fiber.h"
+#include "gudov/stack_allocator.h"
+#include "gudov/thread.h"
+
+using namespace gudov;
+
+// 测试栈大小按 2 的幂分级
+TEST(StackAllocatorTest, RoundUp) {
+  EXPECT_EQ(PooledStackAllocator::RoundUp(1), 1u);
+  EXPECT_EQ(PooledStackAllocator::RoundUp(4096), 4096u);
+  EXPECT_EQ(PooledStackAllocator::RoundUp(4097), 8192u);
+  EXPECT_EQ(PooledStackAllocator::RoundUp(1024 * 1024), 1024u * 1024);
+}
+
+// 测试释放后的栈被同一线程复用
+TEST(StackAllocatorTest, ThreadCacheHit) {
+  MallocStackAllocator backing;
+  PooledStackAllocator pool(&backing);
+
+  void* first = pool.Alloc(64 * 1024);
+  pool.Dealloc(first, 64 * 1024);
+  void* second = pool.Alloc(64 * 1024);
+  EXPECT_EQ(first, second);
+
+  auto stats = pool.GetStats();
+  EXPECT_EQ(stats.misses, 1u);
+  EXPECT_EQ(stats.hits, 1u);
+  pool.Dealloc(second, 64 * 1024);
+}
+
+// 测试不同大小级别互不复用
+TEST(StackAllocatorTest, SizeClassesAreSeparate) {
+  MallocStackAllocator backing;
+  PooledStackAllocator pool(&backing);
+
+  void* small = pool.Alloc(16 * 1024);
+  pool.Dealloc(small, 16 * 1024);
+  void* large = pool.Alloc(128 * 1024);
+  EXPECT_EQ(pool.GetStats().misses, 2u);
+  pool.Dealloc(large, 128 * 1024);
+}
+
+// 测试线程退出时本地缓存归还全局池，供其他线程复用
+TEST(StackAllocatorTest, GlobalPoolAcrossThreads) {
+  MallocStackAllocator backing;
+  PooledStackAllocator pool(&backing);
+
+  void*  stack = nullptr;
+  Thread thread(
+      [&]() {
+        stack = pool.Alloc(32 * 1024);
+        pool.Dealloc(stack, 32 * 1024);
+      },
+      "stack_pool");
+  thread.Join();
+
+  void* reused = pool.Alloc(32 * 1024);
+  EXPECT_EQ(reused, stack);
+  EXPECT_EQ(pool.GetStats().hits, 1u);
+  pool.Dealloc(reused, 32 * 1024);
+}
+
+// 测试缓存池析构后，其他线程缓存中的栈不会交给复用同一编号的新实例
+TEST(StackAllocatorTest, StaleThreadCacheDropped) {
+  MallocStackAllocator                  backing;
+  std::unique_ptr<PooledStackAllocator> pool(new PooledStackAllocator(&backing));
+  Semaphore                             cached;
+  Semaphore                             replaced;
+  void*                                 stale = nullptr;
+
+  Thread thread(
+      [&]() {
+        stale = pool->Alloc(32 * 1024);
+        pool->Dealloc(stale, 32 * 1024);
+        cached.Notify();
+        replaced.Wait();
+        // 本线程缓存中的栈属于已析构的实例，新实例向底层分配器申请
+        void* fresh = pool->Alloc(32 * 1024);
+        pool->Dealloc(fresh, 32 * 1024);
+      },
+      "stack_pool");
+  cached.Wait();
+  pool.reset();
+  pool.reset(new PooledStackAllocator(&backing));
+  replaced.Notify();
+  thread.Join();
+
+  auto stats = pool->GetStats();
+  EXPECT_EQ(stats.hits, 0u);
+  EXPECT_EQ(stats.misses, 1u);
+  // 被丢弃的栈没有归还，由测试释放
+  backing.Dealloc(stale, 32 * 1024);
+}
+
+// 测试协程默认通过缓存池分配栈
+TEST(StackAllocatorTest, FiberUsesPool) {
+  Fiber::GetRunningFiber();
+  {
+    Fiber::ptr fiber(new Fiber([]() {}, 0, false));
+    fiber->Resume();
+  }
+  auto before = Fiber::GetStackPoolStats();
+  {
+    Fiber::ptr fiber(new Fiber([]() {}, 0, false));
+    fiber->Resume();
+  }
+  auto after = Fiber::GetStackPoolStats();
+  EXPECT_EQ(after.hits, before.hits + 1);
+  EXPECT_EQ(after.misses, before.misses);
+}
+
+// 测试 mmap 栈底的保护页，越界访问直接触发 SIGSEGV
+TEST(StackAllocatorTest, MmapGuardPage) {
+  MmapStackAllocator allocator;
+  size_t             size  = 64 * 1024;
+  char*              stack = (char*)allocator.Alloc(size);
+  ASSERT_NE(stack, nullptr);
+  memset(stack, 0x5a, size);
+  EXPECT_DEATH({ *(volatile char*)(stack - 1) = 0; }, "");
+  allocator.Dealloc(stack, size);
+}
+
+// 测试回收后栈顶热页保留，其余页可以被重新写入
+TEST(StackAllocatorTest, MmapRecycle) {
+  MmapStackAllocator allocator;
+  size_t             page  = MmapStackAllocator::PageSize();
+  size_t             size  = 256 * 1024;
+  char*              stack = (char*)allocator.Alloc(size);
+  ASSERT_NE(stack, nullptr);
+  memset(stack, 0x5a, size);
+  allocator.Recycle(stack, size);
+  EXPECT_EQ(stack[size - 1], 0x5a);
+
+  // 被 madvise 的页要么保持原样要么被清零，重新写入后必须可用
+  memset(stack, 0x33, page);
+  EXPECT_EQ(stack[0], 0x33);
+  allocator.Dealloc(stack, size);
+}
+
+// 测试通过 fiber.stack_allocator 配置切换为 mmap 栈
+TEST(StackAllocatorTest, FiberUsesMmapAllocator) {
+  auto stack_allocator = Config::Lookup<std::string>("fiber.stack_allocator", "malloc");
+  stack_allocator->SetValue("mmap");
+  Fiber::GetRunningFiber();
+  {
+    Fiber::ptr fiber(new Fiber(
+        []() {
+          char buf[64 * 1024];
+          memset(buf, 0, sizeof(buf));
+        },
+        0, false));
+    fiber->Resume();
+  }
+  auto before = Fiber::GetStackPoolStats();
+  {
+    Fiber::ptr fiber(new Fiber([]() {}, 0, false));
+    fiber->Resume();
+  }
+  auto after = Fiber::GetStackPoolStats();
+  EXPECT_EQ(after.hits, before.hits + 1);
+  stack_allocator->SetValue("malloc");
+}
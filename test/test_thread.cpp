@@ -88,6 +88,26 @@ TEST(ThreadTest, SemaphoreSync) {
   thread->Join();
 }
 
+// 测试信号量的限时等待：超时返回 false，等待期间被通知返回 true
+TEST(ThreadTest, SemaphoreWaitFor) {
+  gudov::Semaphore semaphore(0);
+
+  uint64_t start = gudov::GetMonotonicUS();
+  EXPECT_FALSE(semaphore.WaitFor(30));
+  uint64_t cost = gudov::GetMonotonicUS() - start;
+  EXPECT_GE(cost, 30 * 1000u);
+  EXPECT_LT(cost, 1000 * 1000u);
+
+  gudov::Thread::ptr thread = std::make_shared<gudov::Thread>(
+      [&]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        semaphore.Notify();
+      },
+      "WaitForThread");
+  EXPECT_TRUE(semaphore.WaitFor(2000));
+  thread->Join();
+}
+
 // 测试线程 ID
 TEST(ThreadTest, ThreadId) {
   auto func = []() { std::this_thread::sleep_for(std::chrono::milliseconds(50)); };
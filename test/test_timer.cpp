@@ -174,3 +174,104 @@ TEST(TimerManagerTest, ReSetTimerTest) {
   }
   EXPECT_EQ(counter.load(), 1);
 }
+
+// 测试时间轮后端：跨层的定时器、取消、刷新和循环定时器
+TEST(TimerManagerTest, WheelBackendTest) {
+  auto backend = Config::Lookup<std::string>("timer.backend");
+  backend->SetValue("wheel");
+  TimerManagerTest timerManager;
+  backend->SetValue("set");
+  ASSERT_TRUE(timerManager.IsWheel());
+
+  uint64_t start     = GetCurrentMS();
+  uint64_t near_at   = 0, far_at = 0, refreshed_at = 0;
+  int      cancelled = 0, recurring = 0;
+
+  timerManager.AddTimer(20, [&]() { near_at = GetCurrentMS() - start; });
+  // 超过第 0 层的 256ms，需要从第 1 层 cascade 下来
+  timerManager.AddTimer(300, [&]() { far_at = GetCurrentMS() - start; });
+  auto cancel  = timerManager.AddTimer(40, [&]() { ++cancelled; });
+  auto refresh = timerManager.AddTimer(60, [&]() { refreshed_at = GetCurrentMS() - start; });
+  auto repeat  = timerManager.AddTimer(25, [&]() { ++recurring; }, true);
+  // 微秒的到期时间在时间轮中向上取整到 1ms 的刻度
+  EXPECT_LE(timerManager.GetNextTimeout(), 21u);
+
+  cancel->Cancel();
+  bool refreshed = false;
+  while (GetCurrentMS() - start < 400) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    if (!refreshed && GetCurrentMS() - start >= 30) {
+      EXPECT_TRUE(refresh->Refresh());
+      refreshed = true;
+    }
+    std::vector<std::function<void()>> expiredCallbacks;
+    timerManager.ListExpiredCallbacks(expiredCallbacks);
+    for (auto &cb : expiredCallbacks) {
+      cb();
+    }
+  }
+  repeat->Cancel();
+
+  EXPECT_GE(near_at, 20u);
+  EXPECT_GE(far_at, 300u);
+  EXPECT_EQ(cancelled, 0);
+  EXPECT_GE(refreshed_at, 90u);
+  EXPECT_GE(recurring, 10);
+  EXPECT_FALSE(timerManager.HasTimer());
+}
+
+// 测试微秒定时器：到期时间按单调时钟的微秒计算
+TEST(TimerManagerTest, MicrosecondTimerTest) {
+  TimerManagerTest timerManager;
+
+  std::atomic<int> counter{0};
+  timerManager.AddTimerUS(300, [&]() { ++counter; });
+  timerManager.AddTimerUS(5000, [&]() { ++counter; });
+
+  uint64_t timeout = timerManager.GetNextTimeoutUS();
+  EXPECT_GT(timeout, 0u);
+  EXPECT_LE(timeout, 300u);
+  // 毫秒超时向上取整，不会提前醒来
+  EXPECT_EQ(timerManager.GetNextTimeout(), 1u);
+
+  uint64_t start = GetMonotonicUS();
+  while (GetMonotonicUS() - start < 400) {
+  }
+  std::vector<std::function<void()>> expiredCallbacks;
+  timerManager.ListExpiredCallbacks(expiredCallbacks);
+  EXPECT_EQ(expiredCallbacks.size(), 1);
+  for (auto &cb : expiredCallbacks) {
+    cb();
+  }
+  EXPECT_EQ(counter.load(), 1);
+  EXPECT_TRUE(timerManager.HasTimer());
+}
+
+// 测试 slack：到期时间取整后相同的定时器合并为一个批处理回调
+TEST(TimerManagerTest, SlackBatchTest) {
+  TimerManagerTest timerManager;
+
+  std::atomic<int> batched{0};
+  std::atomic<int> exact{0};
+  // 从 50ms 周期的前段开始，保证 10~19ms 后取整到同一个时间点
+  while (GetMonotonicUS() % 50000 >= 20000) {
+  }
+  for (int i = 0; i < 100; ++i) {
+    // 10~19ms 的超时取整到 50ms 的整数倍
+    timerManager.AddTimer(10 + i % 10, [&]() { ++batched; }, false, 50);
+  }
+  timerManager.AddTimer(10, [&]() { ++exact; });
+  timerManager.AddTimer(10, [&]() { ++exact; });
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(80));
+  std::vector<std::function<void()>> expiredCallbacks;
+  timerManager.ListExpiredCallbacks(expiredCallbacks);
+  // 两个没有 slack 的定时器各自一个回调，其余合并为一个
+  EXPECT_EQ(expiredCallbacks.size(), 3);
+  for (auto &cb : expiredCallbacks) {
+    cb();
+  }
+  EXPECT_EQ(batched.load(), 100);
+  EXPECT_EQ(exact.load(), 2);
+  EXPECT_FALSE(timerManager.HasTimer());
+}